@@ -0,0 +1,1125 @@
+/*
+   (c)2023 Forward Computing and Control Pty. Ltd.
+   NSW Australia, www.forward.com.au
+   This code is not warranted to be fit for any purpose. You may only use it at your own risk.
+   This code may be freely used for both private and commercial use
+   provided this copyright is maintained.
+*/
+// HS_AsyncTCP_host.cpp
+// Linux epoll replacement for HS_AsyncTCP_base.cpp, see HS_AsyncTCP_host.h
+// The HS_AsyncClient / HS_AsyncServer methods HS_AsyncTCP.cpp uses are implemented on non-blocking sockets,
+// the callbacks are the same as HS_AsyncTCP_base.cpp's, just called straight from the loop instead of from an event queue.
+
+#include "Arduino.h"
+#include "HS_AsyncTCP_base.h"
+#include "HS_AsyncTCP.h"
+#include "HandleTable.h"
+#include "HS_AsyncTrace.h"
+#include "HS_AsyncTCP_host.h"
+
+#include <atomic>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <linux/sockios.h>
+
+// the ESP32 Arduino lwIP defaults, so the send queue and span handler see the same limits as on the ESP32
+#ifndef HOST_TCP_MSS
+#define HOST_TCP_MSS 1436 // CONFIG_LWIP_TCP_MSS
+#endif
+#ifndef HOST_TCP_SND_BUF
+#define HOST_TCP_SND_BUF 5744 // CONFIG_LWIP_TCP_SND_BUF_DEFAULT, bytes written and not yet acked
+#endif
+#ifndef HOST_TCP_WND
+#define HOST_TCP_WND 5744 // CONFIG_LWIP_TCP_WND_DEFAULT, bytes received and not yet acked by ackPacket()
+#endif
+
+// lwIP values returned by the client methods
+static const int8_t ERR_OK = 0;
+static const int8_t ERR_ABRT = -13;
+static const int8_t ERR_RST = -14;
+static const uint8_t LISTEN = 1;
+static const uint8_t ESTABLISHED = 4;
+
+// trace event numbers, the same as lwip_event_t in HS_AsyncTCP_base.cpp so asyncTraceDump() output reads the same
+enum {
+  LWIP_TCP_SENT, LWIP_TCP_RECV, LWIP_TCP_FIN, LWIP_TCP_ERROR, LWIP_TCP_POLL, LWIP_TCP_CLEAR, LWIP_TCP_ACCEPT, LWIP_TCP_CONNECTED, LWIP_TCP_DNS, LWIP_UDP_RECV
+};
+
+// a socket in place of the lwIP pcb, the rest of HS_AsyncTCP only sees the forward declaration
+struct tcp_pcb {
+  int fd;
+  uint8_t state; // lwIP numbering, LISTEN or ESTABLISHED
+  uint64_t tag; // epoll data, the client's handle
+  size_t inFlight; // written to the socket and not yet acked by the other end
+  size_t rxUnacked; // passed to the client and not yet acked, reading stops at HOST_TCP_WND
+  bool reading; // EPOLLIN is set
+  bool noDelay;
+  struct sockaddr_in local;
+  struct sockaddr_in remote;
+};
+
+HS_AsyncClient* HS_AsyncServer::clientPtrs[ASYNC_MAX_CLIENTS];
+HS_AsyncServer* HS_AsyncServer::_loopServerPtr = NULL;
+extern void asyncSetup();
+
+/*
+ * Host Event Loop
+ * */
+
+// epoll data of the fds that are not clients, client fds carry their handle which is always < 2^32
+static const uint64_t _LISTEN_TAG = 1ULL << 32;
+static const uint64_t _NOTIFY_TAG = 2ULL << 32;
+static const uint64_t _TIMER_TAG = 3ULL << 32;
+static const uint64_t _UDP_TAG = 4ULL << 32;
+static const int _MAX_EVENTS = 16; // per epoll_wait()
+static const int _MAX_READS = 16; // per socket per wake, so one busy sender can not hold up the others
+
+static int _epoll_fd = -1;
+static int _timer_fd = -1;
+static std::atomic<int> _notify_fd(-1); // eventfd, asyncNotify() can be called from any thread
+static bool _setup_done = false;
+static HS_AsyncServer* _listen_server = NULL; // only one on the host
+static int _listen_fd = -1;
+
+// client sockets carry a handle from here instead of the HS_AsyncClient*
+// + 4 for clients refused when the server is full
+static HandleTable<HS_AsyncClient, ASYNC_MAX_CLIENTS + 4> _client_handles;
+static uint32_t _stale_event_count = 0;
+static bool _hold_acks = false; // see asyncHostHoldAcks()
+
+static std::atomic<bool> _notify_pending(false); // asyncNotify() only writes the eventfd once per wake
+static uint32_t _loop_interval_us = 1000;
+static volatile uint32_t _wake_count[ASYNC_WAKE_REASONS];
+static volatile uint32_t _wake_busy_us[ASYNC_WAKE_REASONS];
+
+// the UDP listener, see initAsyncUdp()
+static int _udp_fd = -1;
+static AsyncUdpHandler _udp_handler = NULL;
+static uint32_t _udp_dropped_count = 0;
+static const size_t _UDP_MAX_LEN = 512; // longer datagrams are truncated, as on the ESP32
+
+struct pbuf *pbuf_alloc_host(size_t len) {
+  pbuf *p = (pbuf *)malloc(sizeof(pbuf) + len);
+  if (p) {
+    p->next = NULL;
+    p->payload = p + 1;
+    p->len = len;
+    p->tot_len = len;
+  }
+  return p;
+}
+
+uint8_t pbuf_free(struct pbuf *p) {
+  uint8_t count = 0;
+  while (p) {
+    pbuf *next = p->next;
+    free(p);
+    p = next;
+    count++;
+  }
+  return count;
+}
+
+uint16_t asyncEventPoolHighWater() {
+  return 0; // no event queue on the host
+}
+
+uint32_t asyncEventPoolFailCount() {
+  return 0;
+}
+
+uint32_t asyncStaleEventCount() {
+  return _stale_event_count;
+}
+
+uint32_t asyncUdpDroppedCount() {
+  return _udp_dropped_count;
+}
+
+uint32_t asyncWakeCount(AsyncWakeReason reason) {
+  return (reason < ASYNC_WAKE_REASONS) ? _wake_count[reason] : 0;
+}
+
+uint32_t asyncWakeBusyMicros(AsyncWakeReason reason) {
+  return (reason < ASYNC_WAKE_REASONS) ? _wake_busy_us[reason] : 0;
+}
+
+void asyncNotify() {
+  int fd = _notify_fd.load(std::memory_order_acquire);
+  if (fd < 0) {
+    return; // not started yet, it will run asyncLoop() when it does
+  }
+  if (!_notify_pending.exchange(true, std::memory_order_acq_rel)) {
+    uint64_t one = 1;
+    ssize_t n = write(fd, &one, sizeof(one));
+    (void)n; // only fails if the count is about to overflow, then it is already readable
+  }
+}
+
+static void _start_loop_timer() {
+  struct itimerspec its = {};
+  its.it_interval.tv_sec = _loop_interval_us / 1000000;
+  its.it_interval.tv_nsec = (_loop_interval_us % 1000000) * 1000;
+  its.it_value = its.it_interval; // all 0 stops the timer
+  timerfd_settime(_timer_fd, 0, &its, NULL);
+}
+
+void asyncLoopInterval(uint32_t us) {
+  _loop_interval_us = us;
+  if (_timer_fd >= 0) {
+    _start_loop_timer();
+  }
+}
+
+static bool _epoll_ctl(int op, int fd, uint32_t events, uint64_t tag) {
+  struct epoll_event ev = {};
+  ev.events = events;
+  ev.data.u64 = tag;
+  if (epoll_ctl(_epoll_fd, op, fd, &ev) < 0) {
+    ASYNC_LOG_ERROR("epoll_ctl %d fd %d: %s\n", op, fd, strerror(errno));
+    return false;
+  }
+  return true;
+}
+
+// the host version of the HS_Async task, just the fds, the loop itself is run by asyncHostRun()
+static bool _start_async_task() {
+  if (_epoll_fd >= 0) {
+    return true;
+  }
+  _epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  _timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  int notify_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if ((_epoll_fd < 0) || (_timer_fd < 0) || (notify_fd < 0)
+      || !_epoll_ctl(EPOLL_CTL_ADD, _timer_fd, EPOLLIN, _TIMER_TAG)
+      || !_epoll_ctl(EPOLL_CTL_ADD, notify_fd, EPOLLIN, _NOTIFY_TAG)) {
+    ASYNC_LOG_ERROR("host loop start failed: %s\n", strerror(errno));
+    return false;
+  }
+  _notify_fd.store(notify_fd, std::memory_order_release);
+  _start_loop_timer();
+  return true;
+}
+
+/*
+ * Socket helpers, in place of the lwIP tcpip_api_call wrappers
+ * */
+
+// stop reading while the receive window is full, so the sender is slowed down by TCP as with lwIP
+static void _tcp_reading(tcp_pcb * pcb, bool reading) {
+  if (pcb->reading != reading) {
+    pcb->reading = reading;
+    _epoll_ctl(EPOLL_CTL_MOD, pcb->fd, reading ? EPOLLIN : 0, pcb->tag);
+  }
+}
+
+static void _tcp_recved(tcp_pcb * pcb, int8_t closed_slot, size_t len) {
+  pcb->rxUnacked = (len < pcb->rxUnacked) ? (pcb->rxUnacked - len) : 0;
+  if (pcb->rxUnacked < HOST_TCP_WND) {
+    _tcp_reading(pcb, true);
+  }
+}
+
+// returns the bytes the socket took
+static size_t _tcp_write(tcp_pcb * pcb, int8_t closed_slot, const char* data, size_t size, uint8_t apiflags) {
+  ssize_t n = send(pcb->fd, data, size, MSG_NOSIGNAL | MSG_DONTWAIT);
+  if (n <= 0) {
+    return 0; // a reset connection is seen by the next read
+  }
+  pcb->inFlight += n;
+  return n;
+}
+
+// close() sends a FIN once the data already written has gone, and takes the fd out of the epoll set
+static int8_t _tcp_close(tcp_pcb * pcb, int8_t closed_slot) {
+  close(pcb->fd);
+  delete pcb;
+  return ERR_OK;
+}
+
+static int8_t _tcp_abort(tcp_pcb * pcb, int8_t closed_slot) {
+  struct linger lin = { 1, 0 }; // RST instead of FIN
+  setsockopt(pcb->fd, SOL_SOCKET, SO_LINGER, &lin, sizeof(lin));
+  return _tcp_close(pcb, closed_slot);
+}
+
+static void _handle_accept() {
+  for (int i = 0; i < _MAX_READS; i++) {
+    struct sockaddr_in remote;
+    socklen_t len = sizeof(remote);
+    int fd = accept4(_listen_fd, (struct sockaddr *)&remote, &len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+      return;
+    }
+    tcp_pcb * pcb = new tcp_pcb();
+    pcb->fd = fd;
+    pcb->state = ESTABLISHED;
+    pcb->remote = remote;
+    len = sizeof(pcb->local);
+    getsockname(fd, (struct sockaddr *)&pcb->local, &len);
+    ASYNC_TRACE(LWIP_TCP_ACCEPT, pcb, 0);
+    HS_AsyncServer::_s_accept(_listen_server, pcb, ERR_OK);
+  }
+}
+
+static void _handle_client(void * handle, uint32_t events) {
+  HS_AsyncClient * client = _client_handles.get(handle);
+  if (client == NULL) {
+    // closed by an earlier callback in this wake
+    _stale_event_count++;
+    return;
+  }
+  if ((events & (EPOLLERR | EPOLLHUP)) && !client->pcb()->reading) {
+    // reset while the window is full, would be reported again on every wake until it reopens
+    ASYNC_TRACE(LWIP_TCP_ERROR, client->pcb(), ERR_RST);
+    HS_AsyncClient::_s_error(client, ERR_RST);
+    return;
+  }
+  for (int i = 0; i < _MAX_READS; i++) {
+    tcp_pcb * pcb = client->pcb();
+    if (!pcb->reading) {
+      return; // window full, read again when ackPacket() reopens it
+    }
+    size_t room = HOST_TCP_WND - pcb->rxUnacked;
+    pbuf * pb = pbuf_alloc_host((room < HOST_TCP_MSS) ? room : HOST_TCP_MSS);
+    if (pb == NULL) {
+      return;
+    }
+    ssize_t n = recv(pcb->fd, pb->payload, pb->len, MSG_DONTWAIT);
+    if ((n < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK))) {
+      pbuf_free(pb);
+      return;
+    }
+    if (n <= 0) {
+      pbuf_free(pb);
+      if (n == 0) {
+        ASYNC_TRACE(LWIP_TCP_FIN, pcb, 0);
+        HS_AsyncClient::_s_fin(client, pcb, ERR_OK);
+      } else {
+        ASYNC_TRACE(LWIP_TCP_ERROR, pcb, ERR_RST);
+        HS_AsyncClient::_s_error(client, ERR_RST);
+      }
+      return;
+    }
+    pb->len = n;
+    pb->tot_len = n;
+    pcb->rxUnacked += n;
+    if (pcb->rxUnacked >= HOST_TCP_WND) {
+      _tcp_reading(pcb, false);
+    }
+    ASYNC_TRACE(LWIP_TCP_RECV, pcb, n);
+    HS_AsyncClient::_s_recv(client, pcb, pb, ERR_OK);
+    if (_client_handles.get(handle) != client) {
+      return; // closed by the callback
+    }
+  }
+}
+
+// lwIP tells the HS_Async task when sent data is acked, a socket does not, so check each client's send queue
+// returns true if there were any acks
+static bool _poll_acks() {
+  bool acked = false;
+  if (_hold_acks) {
+    return false;
+  }
+  for (int i = 0; i < ASYNC_MAX_CLIENTS; i++) {
+    HS_AsyncClient * client = HS_AsyncServer::clientPtrs[i];
+    tcp_pcb * pcb = client ? client->pcb() : NULL;
+    if ((pcb == NULL) || (pcb->inFlight == 0)) {
+      continue;
+    }
+    int outq = 0;
+    if ((ioctl(pcb->fd, SIOCOUTQ, &outq) < 0) || ((size_t)outq >= pcb->inFlight)) {
+      continue;
+    }
+    uint16_t len = pcb->inFlight - outq;
+    pcb->inFlight = outq;
+    acked = true;
+    ASYNC_TRACE(LWIP_TCP_SENT, pcb, len);
+    HS_AsyncClient::_s_sent(client, pcb, len);
+  }
+  return acked;
+}
+
+static bool _any_in_flight() {
+  for (int i = 0; i < ASYNC_MAX_CLIENTS; i++) {
+    HS_AsyncClient * client = HS_AsyncServer::clientPtrs[i];
+    if (client && client->pcb() && client->pcb()->inFlight) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// each datagram goes straight to the handler, rx_us is when it was read rather than when the kernel got it
+static void _handle_udp() {
+  static uint8_t data[_UDP_MAX_LEN];
+  for (int i = 0; i < _MAX_READS; i++) {
+    char control[CMSG_SPACE(sizeof(uint32_t))];
+    struct iovec iov = { data, sizeof(data) };
+    struct msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    ssize_t len = recvmsg(_udp_fd, &msg, MSG_DONTWAIT);
+    if (len < 0) {
+      return;
+    }
+    uint32_t rx_us = micros();
+    // the kernel's count of datagrams dropped because the receive buffer was full
+    for (struct cmsghdr * c = CMSG_FIRSTHDR(&msg); c != NULL; c = CMSG_NXTHDR(&msg, c)) {
+      if ((c->cmsg_level == SOL_SOCKET) && (c->cmsg_type == SO_RXQ_OVFL)) {
+        memcpy(&_udp_dropped_count, CMSG_DATA(c), sizeof(_udp_dropped_count));
+      }
+    }
+    ASYNC_TRACE(LWIP_UDP_RECV, &_udp_fd, len);
+    if (_udp_handler) {
+      _udp_handler(data, len, rx_us);
+    }
+  }
+}
+
+// one wake of the HS_Async task, timeout_ms -1 waits for ever
+static void _async_wake(int timeout_ms) {
+  struct epoll_event events[_MAX_EVENTS];
+  int n = epoll_wait(_epoll_fd, events, _MAX_EVENTS, timeout_ms);
+  unsigned long start_us = micros();
+  uint32_t bits = 0;
+  for (int i = 0; i < n; i++) {
+    uint64_t tag = events[i].data.u64;
+    if (tag == _NOTIFY_TAG) {
+      uint64_t count;
+      ssize_t len = read(_notify_fd.load(std::memory_order_relaxed), &count, sizeof(count));
+      (void)len;
+      _notify_pending.store(false, std::memory_order_release);
+      bits |= 1 << ASYNC_WAKE_NOTIFY;
+    } else if (tag == _TIMER_TAG) {
+      uint64_t expirations;
+      ssize_t len = read(_timer_fd, &expirations, sizeof(expirations));
+      (void)len;
+      bits |= 1 << ASYNC_WAKE_TIMER;
+    } else if (tag == _LISTEN_TAG) {
+      _handle_accept();
+      bits |= 1 << ASYNC_WAKE_LWIP;
+    } else if (tag == _UDP_TAG) {
+      _handle_udp();
+      bits |= 1 << ASYNC_WAKE_LWIP;
+    } else {
+      _handle_client((void *)(uintptr_t)tag, events[i].events);
+      bits |= 1 << ASYNC_WAKE_LWIP;
+    }
+  }
+  if (_poll_acks()) {
+    bits |= 1 << ASYNC_WAKE_LWIP;
+  }
+  if (bits == 0) {
+    return; // timed out, nothing to do
+  }
+  HS_AsyncServer::_s_loop();
+  // the busy time goes to the first reason in lwIP, notify, timer order
+  uint32_t busy_us = micros() - start_us;
+  bool first = true;
+  for (int i = 0; i < ASYNC_WAKE_REASONS; i++) {
+    if (bits & (1 << i)) {
+      _wake_count[i]++;
+      if (first) {
+        _wake_busy_us[i] += busy_us;
+        first = false;
+      }
+    }
+  }
+}
+
+void asyncHostHoldAcks(bool hold) {
+  _hold_acks = hold;
+}
+
+bool asyncHostRun(unsigned long ms) {
+  if (!_start_async_task()) {
+    return false;
+  }
+  if (!_setup_done) {
+    _setup_done = true;
+    asyncSetup();
+  }
+  unsigned long start_ms = millis();
+  for (;;) {
+    // while data is unacked look for acks every 1ms, as lwIP would report them
+    int timeout_ms = _any_in_flight() ? 1 : -1;
+    if (ms) {
+      unsigned long elapsed_ms = millis() - start_ms;
+      if (elapsed_ms >= ms) {
+        return true;
+      }
+      unsigned long left_ms = ms - elapsed_ms;
+      if ((timeout_ms < 0) || (left_ms < (unsigned long)timeout_ms)) {
+        timeout_ms = (left_ms < INT_MAX) ? left_ms : INT_MAX;
+      }
+    }
+    _async_wake(timeout_ms);
+  }
+}
+
+bool initAsyncUdp(uint16_t port, AsyncUdpHandler handler) {
+  if (_udp_fd >= 0) {
+    return false; // only one listener
+  }
+  if (!_start_async_task()) {
+    ASYNC_LOG_ERROR("failed to start task\n");
+    return false;
+  }
+  int fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    ASYNC_LOG_ERROR("udp socket failed: %s\n", strerror(errno));
+    return false;
+  }
+  int one = 1;
+  setsockopt(fd, SOL_SOCKET, SO_RXQ_OVFL, &one, sizeof(one));
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(port);
+  if ((bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) || !_epoll_ctl(EPOLL_CTL_ADD, fd, EPOLLIN, _UDP_TAG)) {
+    ASYNC_LOG_ERROR("udp bind to port %d failed: %s\n", port, strerror(errno));
+    close(fd);
+    return false;
+  }
+  _udp_handler = handler;
+  _udp_fd = fd;
+  return true;
+}
+
+/*
+  Async TCP Client
+ */
+
+HS_AsyncClient::HS_AsyncClient(tcp_pcb* pcb)
+  : _async_loop_cb(0) // called when not processing wifi msg
+  , _async_loop_cb_arg(0)
+  , _connect_cb(0)
+  , _connect_cb_arg(0)
+  , _discard_cb(0)
+  , _discard_cb_arg(0)
+  , _sent_cb(0)
+  , _sent_cb_arg(0)
+  , _error_cb(0)
+  , _error_cb_arg(0)
+  , _recv_cb(0)
+  , _recv_cb_arg(0)
+  , _pb_cb(0)
+  , _pb_cb_arg(0)
+  , _timeout_cb(0)
+  , _timeout_cb_arg(0)
+  , _pcb_busy(false)
+  , _pcb_sent_at(0)
+  , _ack_pcb(true)
+  , _rx_ack_len(0)
+  , _rx_last_packet(0)
+  , _rx_since_timeout(0)
+  , _ack_timeout(ASYNC_MAX_ACK_TIME)
+  , _connect_port(0)
+  , _handle(NULL)
+  , prev(NULL)
+  , next(NULL) {
+  _pcb = pcb;
+  _closed_slot = -1;
+  if(_pcb) {
+    _rx_last_packet = millis();
+    _pcb->tag = (uintptr_t)_alloc_handle();
+    _pcb->reading = true;
+    _epoll_ctl(EPOLL_CTL_ADD, _pcb->fd, EPOLLIN, _pcb->tag);
+  }
+}
+
+HS_AsyncClient::~HS_AsyncClient() {
+  if(_pcb) {
+    _close();
+  }
+  _free_handle();
+}
+
+/*
+ * Callback Setters
+ * */
+
+void HS_AsyncClient::onConnect(AcConnectHandler cb, void* arg) {
+  _connect_cb = cb;
+  _connect_cb_arg = arg;
+}
+
+void HS_AsyncClient::onDisconnect(AcConnectHandler cb, void* arg) {
+  _discard_cb = cb;
+  _discard_cb_arg = arg;
+}
+
+void HS_AsyncClient::onAck(AcAckHandler cb, void* arg) {
+  _sent_cb = cb;
+  _sent_cb_arg = arg;
+}
+
+void HS_AsyncClient::onError(AcErrorHandler cb, void* arg) {
+  _error_cb = cb;
+  _error_cb_arg = arg;
+}
+
+void HS_AsyncClient::onData(AcDataHandler cb, void* arg) {
+  _recv_cb = cb;
+  _recv_cb_arg = arg;
+}
+
+void HS_AsyncClient::onPacket(AcPacketHandler cb, void* arg) {
+  _pb_cb = cb;
+  _pb_cb_arg = arg;
+}
+
+void HS_AsyncClient::onTimeout(AcTimeoutHandler cb, void* arg) {
+  _timeout_cb = cb;
+  _timeout_cb_arg = arg;
+}
+
+void HS_AsyncClient::onLoop(AcLoopHandler cb, void* arg) {
+   // call each loop of async task
+  _async_loop_cb = cb;
+  _async_loop_cb_arg = arg;
+}
+
+void HS_AsyncClient::onPoll(AcConnectHandler cb, void* arg) {
+  _poll_cb = cb;
+  _poll_cb_arg = arg;
+}
+
+/*
+ * Main Public Methods
+ * */
+
+void HS_AsyncClient::close(bool now) {
+  if(_pcb) {
+    _tcp_recved(_pcb, _closed_slot, _rx_ack_len);
+  }
+  _close();
+}
+
+int8_t HS_AsyncClient::abort() {
+  if(_pcb) {
+    _free_handle();
+    _tcp_abort(_pcb, _closed_slot);
+    _pcb = NULL;
+  }
+  return ERR_ABRT;
+}
+
+size_t HS_AsyncClient::space() {
+  if((_pcb != NULL) && (_pcb->state == ESTABLISHED)) {
+    return (_pcb->inFlight < HOST_TCP_SND_BUF) ? (HOST_TCP_SND_BUF - _pcb->inFlight) : 0;
+  }
+  return 0;
+}
+
+size_t HS_AsyncClient::add(const char* data, size_t size, uint8_t apiflags) {
+  if(!_pcb || size == 0 || data == NULL) {
+    return 0;
+  }
+  size_t room = space();
+  if(!room) {
+    return 0;
+  }
+  size_t will_send = (room < size) ? room : size;
+  return _tcp_write(_pcb, _closed_slot, data, will_send, apiflags);
+}
+
+// add() has already given the data to the socket
+bool HS_AsyncClient::send() {
+  if(!_pcb) {
+    return false;
+  }
+  _pcb_busy = true;
+  _pcb_sent_at = millis();
+  return true;
+}
+
+size_t HS_AsyncClient::ack(size_t len) {
+  if(len > _rx_ack_len) {
+    len = _rx_ack_len;
+  }
+  if(len) {
+    _tcp_recved(_pcb, _closed_slot, len);
+  }
+  _rx_ack_len -= len;
+  return len;
+}
+
+void HS_AsyncClient::ackPacket(struct pbuf * pb) {
+  if(!pb) {
+    return;
+  }
+  if(_pcb) {
+    _tcp_recved(_pcb, _closed_slot, pb->len);
+  }
+  pbuf_free(pb);
+}
+
+size_t HS_AsyncClient::write(const char* data) {
+  if(data == NULL) {
+    return 0;
+  }
+  return write(data, strlen(data));
+}
+
+size_t HS_AsyncClient::write(const char* data, size_t size, uint8_t apiflags) {
+  size_t will_send = add(data, size, apiflags);
+  if(!will_send || !send()) {
+    return 0;
+  }
+  return will_send;
+}
+
+/*
+ * Main Private Methods
+ * */
+
+int8_t HS_AsyncClient::_close() {
+  int8_t err = ERR_OK;
+  if(_pcb) {
+    _free_handle(); // any socket events still to be handled for this client are now stale
+    err = _tcp_close(_pcb, _closed_slot);
+    _pcb = NULL;
+    HS_AsyncServer::_s_removeClient(this);
+    if(_discard_cb) {
+      _discard_cb(_discard_cb_arg, this);
+    }
+  }
+  return err;
+}
+
+// returns this client's epoll data, NULL if there are no handles left
+void* HS_AsyncClient::_alloc_handle() {
+  if(!_handle) {
+    _handle = _client_handles.add(this);
+    if(!_handle) {
+      ASYNC_LOG_ERROR("no free client handles\n");
+    }
+  }
+  return _handle;
+}
+
+void HS_AsyncClient::_free_handle() {
+  if(_handle) {
+    _client_handles.remove(_handle);
+    _handle = NULL;
+  }
+}
+
+/*
+ * Private Callbacks
+ * */
+
+// the connection was reset, there is no lwIP to free the pcb so close the socket here
+void HS_AsyncClient::_error(int8_t err) {
+  _free_handle();
+  if(_pcb) {
+    _tcp_close(_pcb, _closed_slot);
+    _pcb = NULL;
+  }
+  if(_error_cb) {
+    _error_cb(_error_cb_arg, this, err);
+  }
+  HS_AsyncServer::_s_removeClient(this);
+  if(_discard_cb) {
+    _discard_cb(_discard_cb_arg, this);
+  }
+}
+
+// the other end closed, close our end too, as _lwip_fin() does on the ESP32
+int8_t HS_AsyncClient::_fin(tcp_pcb* pcb, int8_t err) {
+  _close();
+  return ERR_OK;
+}
+
+int8_t HS_AsyncClient::_sent(tcp_pcb* pcb, uint16_t len) {
+  _rx_last_packet = millis();
+  _pcb_busy = false;
+  if(_sent_cb) {
+    _sent_cb(_sent_cb_arg, this, len, (millis() - _pcb_sent_at));
+  }
+  return ERR_OK;
+}
+
+int8_t HS_AsyncClient::_recv(tcp_pcb* pcb, pbuf* pb, int8_t err) {
+  while(pb != NULL) {
+    _rx_last_packet = millis();
+    //we should not ack before we assimilate the data
+    _ack_pcb = true;
+    pbuf *b = pb;
+    pb = b->next;
+    b->next = NULL;
+    if(_pb_cb) {
+      _pb_cb(_pb_cb_arg, this, b);
+    } else {
+      if(_recv_cb) {
+        _recv_cb(_recv_cb_arg, this, b->payload, b->len);
+      }
+      if(!_ack_pcb) {
+        _rx_ack_len += b->len;
+      } else if(_pcb) {
+        _tcp_recved(_pcb, _closed_slot, b->len);
+      }
+      pbuf_free(b);
+    }
+  }
+  return ERR_OK;
+}
+
+int8_t HS_AsyncClient::_loop() {
+  if(_async_loop_cb) {
+    _async_loop_cb(_async_loop_cb_arg, this);
+  }
+  return ERR_OK;
+}
+
+/*
+ * Public Helper Methods
+ * */
+
+void HS_AsyncClient::stop() {
+  close(false);
+}
+
+bool HS_AsyncClient::free() {
+  if(!_pcb) {
+    return true;
+  }
+  if(_pcb->state == 0 || _pcb->state > 4) {
+    return true;
+  }
+  return false;
+}
+
+void HS_AsyncClient::setRxTimeout(uint32_t timeout) {
+  _rx_since_timeout = timeout;
+}
+
+uint32_t HS_AsyncClient::getRxTimeout() {
+  return _rx_since_timeout;
+}
+
+uint32_t HS_AsyncClient::getAckTimeout() {
+  return _ack_timeout;
+}
+
+void HS_AsyncClient::setAckTimeout(uint32_t timeout) {
+  _ack_timeout = timeout;
+}
+
+void HS_AsyncClient::setNoDelay(bool nodelay) {
+  if(!_pcb) {
+    return;
+  }
+  int flag = nodelay ? 1 : 0;
+  setsockopt(_pcb->fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+  _pcb->noDelay = nodelay;
+}
+
+bool HS_AsyncClient::getNoDelay() {
+  if(!_pcb) {
+    return false;
+  }
+  return _pcb->noDelay;
+}
+
+uint16_t HS_AsyncClient::getMss() {
+  if(!_pcb) {
+    return 0;
+  }
+  return HOST_TCP_MSS;
+}
+
+uint32_t HS_AsyncClient::getRemoteAddress() {
+  if(!_pcb) {
+    return 0;
+  }
+  return _pcb->remote.sin_addr.s_addr;
+}
+
+uint16_t HS_AsyncClient::getRemotePort() {
+  if(!_pcb) {
+    return 0;
+  }
+  return ntohs(_pcb->remote.sin_port);
+}
+
+uint32_t HS_AsyncClient::getLocalAddress() {
+  if(!_pcb) {
+    return 0;
+  }
+  return _pcb->local.sin_addr.s_addr;
+}
+
+uint16_t HS_AsyncClient::getLocalPort() {
+  if(!_pcb) {
+    return 0;
+  }
+  return ntohs(_pcb->local.sin_port);
+}
+
+IPAddress HS_AsyncClient::remoteIP() {
+  return IPAddress(getRemoteAddress());
+}
+
+uint16_t HS_AsyncClient::remotePort() {
+  return getRemotePort();
+}
+
+IPAddress HS_AsyncClient::localIP() {
+  return IPAddress(getLocalAddress());
+}
+
+uint16_t HS_AsyncClient::localPort() {
+  return getLocalPort();
+}
+
+uint8_t HS_AsyncClient::state() {
+  if(!_pcb) {
+    return 0;
+  }
+  return _pcb->state;
+}
+
+bool HS_AsyncClient::connected() {
+  if (!_pcb) {
+    return false;
+  }
+  return _pcb->state == ESTABLISHED;
+}
+
+bool HS_AsyncClient::connecting() {
+  return false; // no outgoing connections on the host
+}
+
+bool HS_AsyncClient::disconnecting() {
+  return false; // the socket is closed straight away
+}
+
+bool HS_AsyncClient::disconnected() {
+  return !_pcb;
+}
+
+bool HS_AsyncClient::freeable() {
+  return !_pcb;
+}
+
+bool HS_AsyncClient::canSend() {
+  return space() > 0;
+}
+
+/*
+ * Static Callbacks, called from the host loop with the client the handle refers to
+ * */
+
+int8_t HS_AsyncClient::_s_recv(void * arg, struct tcp_pcb * pcb, struct pbuf *pb, int8_t err) {
+  return reinterpret_cast<HS_AsyncClient*>(arg)->_recv(pcb, pb, err);
+}
+
+int8_t HS_AsyncClient::_s_fin(void * arg, struct tcp_pcb * pcb, int8_t err) {
+  return reinterpret_cast<HS_AsyncClient*>(arg)->_fin(pcb, err);
+}
+
+int8_t HS_AsyncClient::_s_sent(void * arg, struct tcp_pcb * pcb, uint16_t len) {
+  return reinterpret_cast<HS_AsyncClient*>(arg)->_sent(pcb, len);
+}
+
+void HS_AsyncClient::_s_error(void * arg, int8_t err) {
+  reinterpret_cast<HS_AsyncClient*>(arg)->_error(err);
+}
+
+/*
+  Async TCP Server
+ */
+
+HS_AsyncServer::HS_AsyncServer(IPAddress addr, uint16_t port)
+  : _port(port)
+  , _addr(addr)
+  , _noDelay(false)
+  , _pcb(0)
+  , _connect_cb(0)
+  , _connect_cb_arg(0)
+  , _loop_cb(0)
+  , _loop_cb_arg(0)
+{}
+
+HS_AsyncServer::HS_AsyncServer(uint16_t port)
+  : _port(port)
+  , _addr((uint32_t) INADDR_ANY)
+  , _noDelay(false)
+  , _pcb(0)
+  , _connect_cb(0)
+  , _connect_cb_arg(0)
+  , _loop_cb(0)
+  , _loop_cb_arg(0)
+{}
+
+HS_AsyncServer::~HS_AsyncServer() {
+  for (int i = 0; i < ASYNC_MAX_CLIENTS; i++) {
+    clientPtrs[i] = NULL;
+  }
+  if (_loopServerPtr == this) {
+    _loopServerPtr = NULL;
+  }
+  end();
+}
+
+void HS_AsyncServer::onClient(AcConnectHandler cb, void* arg) {
+  _connect_cb = cb;
+  _connect_cb_arg = arg;
+}
+
+void HS_AsyncServer::onLoop(AsLoopHandler cb, void* arg) {
+  _loop_cb = cb;
+  _loop_cb_arg = arg;
+  _loopServerPtr = this;
+}
+
+size_t HS_AsyncServer::getNumClients() {
+  size_t count = 0;
+  for (int i = 0; i < ASYNC_MAX_CLIENTS; i++) {
+    if (clientPtrs[i]) {
+      count++;
+    }
+  }
+  return count;
+}
+
+// In the host loop, each client's loop handler then the server's
+// a handler may close a client, so the slots are re-read each time
+int8_t HS_AsyncServer::_s_loop() {
+  for (int i = 0; i < ASYNC_MAX_CLIENTS; i++) {
+    if (clientPtrs[i]) {
+      clientPtrs[i]->_loop();
+    }
+  }
+  if (_loopServerPtr && _loopServerPtr->_loop_cb) {
+    _loopServerPtr->_loop_cb(_loopServerPtr->_loop_cb_arg);
+  }
+  return ERR_OK;
+}
+
+void HS_AsyncServer::_s_removeClient(HS_AsyncClient* client) {
+  for (int i = 0; i < ASYNC_MAX_CLIENTS; i++) {
+    if (clientPtrs[i] == client) {
+      clientPtrs[i] = NULL;
+    }
+  }
+}
+
+bool HS_AsyncServer::begin() {
+  if(_pcb) {
+    return true;
+  }
+  if(_listen_server) {
+    ASYNC_LOG_ERROR("only one listening HS_AsyncServer on the host\n");
+    return false;
+  }
+  if(!_start_async_task()) {
+    ASYNC_LOG_ERROR("failed to start task\n");
+    return false;
+  }
+  int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    ASYNC_LOG_ERROR("socket failed: %s\n", strerror(errno));
+    return false;
+  }
+  int one = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)); // restart straight away in CI
+  struct sockaddr_in local = {};
+  local.sin_family = AF_INET;
+  local.sin_addr.s_addr = (uint32_t) _addr;
+  local.sin_port = htons(_port);
+  static uint8_t backlog = 5;
+  if ((bind(fd, (struct sockaddr *)&local, sizeof(local)) < 0) || (listen(fd, backlog) < 0)
+      || !_epoll_ctl(EPOLL_CTL_ADD, fd, EPOLLIN, _LISTEN_TAG)) {
+    ASYNC_LOG_ERROR("bind / listen on port %d failed: %s\n", _port, strerror(errno));
+    close(fd);
+    return false;
+  }
+  _pcb = new tcp_pcb();
+  _pcb->fd = fd;
+  _pcb->state = LISTEN;
+  _pcb->local = local;
+  _listen_server = this;
+  _listen_fd = fd;
+  return true;
+}
+
+void HS_AsyncServer::end() {
+  if(_pcb) {
+    _tcp_close(_pcb, -1);
+    _pcb = NULL;
+    _listen_server = NULL;
+    _listen_fd = -1;
+  }
+}
+
+int8_t HS_AsyncServer::_accept(tcp_pcb* pcb, int8_t err) {
+  if(_connect_cb) {
+    HS_AsyncClient *c = new HS_AsyncClient(pcb);
+    if(c) {
+      c->setNoDelay(_noDelay);
+      return _accepted(c); // no lwIP thread, so straight on to the accepted step
+    }
+  }
+  _tcp_close(pcb, -1);
+  ASYNC_LOG_ERROR("accept FAIL\n");
+  return ERR_OK;
+}
+
+int8_t HS_AsyncServer::_accepted(HS_AsyncClient* client) {
+  int slot = -1;
+  for (int i = 0; i < ASYNC_MAX_CLIENTS; i++) {
+    if (clientPtrs[i] == NULL) {
+      slot = i;
+      break;
+    }
+  }
+  if (slot < 0) {
+    // full, refuse the new connection, the existing clients keep going
+    client->stop();
+    delete client;
+    return ERR_OK;
+  }
+  clientPtrs[slot] = client;
+  if(_connect_cb) {
+    _connect_cb(_connect_cb_arg, client);
+  }
+  return ERR_OK;
+}
+
+void HS_AsyncServer::setNoDelay(bool nodelay) {
+  _noDelay = nodelay;
+}
+
+bool HS_AsyncServer::getNoDelay() {
+  return _noDelay;
+}
+
+uint8_t HS_AsyncServer::status() {
+  if (!_pcb) {
+    return 0;
+  }
+  return _pcb->state;
+}
+
+int8_t HS_AsyncServer::_s_accept(void * arg, tcp_pcb * pcb, int8_t err) {
+  return reinterpret_cast<HS_AsyncServer*>(arg)->_accept(pcb, err);
+}
+
+int8_t HS_AsyncServer::_s_accepted(void *arg, HS_AsyncClient* client) {
+  return reinterpret_cast<HS_AsyncServer*>(arg)->_accepted(client);
+}
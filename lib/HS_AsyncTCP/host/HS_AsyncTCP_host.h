@@ -0,0 +1,44 @@
+#ifndef HS_ASYNCTCP_HOST_H_
+#define HS_ASYNCTCP_HOST_H_
+/*
+   (c)2023 Forward Computing and Control Pty. Ltd.
+   NSW Australia, www.forward.com.au
+   This code is not warranted to be fit for any purpose. You may only use it at your own risk.
+   This code may be freely used for both private and commercial use
+   provided this copyright is maintained.
+*/
+
+/**
+   Linux host port of HS_AsyncTCP
+   HS_AsyncTCP_host.cpp replaces HS_AsyncTCP_base.cpp, the lwIP / FreeRTOS half, with one epoll loop on real sockets.
+   HS_AsyncTCP.cpp, BufferStream, StreamBuffers, HS_AsyncTrace and your WiFiDataHandling.cpp compile unchanged
+   against the small Arduino shim in arduino/, so command parsing, telemetry output and connect / disconnect
+   can be run, load tested and profiled on a PC or in CI, see the Makefile.
+
+   The thread that calls asyncHostRun() is the HS_Async task, all the async...() callbacks run on it.
+   It wakes, as on the ESP32, for
+     ASYNC_WAKE_LWIP   - socket events, accept, data, EOF, UDP datagrams and sent data acked
+     ASYNC_WAKE_NOTIFY - asyncNotify(), which can be called from any thread, e.g. the one running your loop()
+     ASYNC_WAKE_TIMER  - a timerfd every asyncLoopInterval() us
+   Each connection is limited to the ESP32's default MSS and send / receive windows (HOST_TCP_MSS, HOST_TCP_SND_BUF,
+   HOST_TCP_WND) so the send queue, coalescing and span handler back pressure behave as they do on the ESP32.
+   ACKs are found by polling SIOCOUTQ each wake, every 1ms at least while any data is unacked.
+   Not emulated: outgoing connect(), the 500ms lwIP poll and the rx / ack timeouts.
+   asyncEventPoolHighWater() and asyncEventPoolFailCount() are always 0, there is no event queue.
+*/
+
+/**
+   asyncHostRun(unsigned long ms)
+   runs the HS_Async task loop for ms, 0 for ever, returns false if the loop could not be started
+   Call initAsyncServer() (and initAsyncUdp()) first. asyncSetup() is called at the start of the first run.
+*/
+bool asyncHostRun(unsigned long ms);
+
+/**
+   asyncHostHoldAcks(bool hold)
+   true stops reporting acks, as if the peer's ACKs were delayed, so sent data stays unacked and the send window
+   does not reopen. false reports everything acked since on the next wake. For testing the send queue.
+*/
+void asyncHostHoldAcks(bool hold);
+
+#endif
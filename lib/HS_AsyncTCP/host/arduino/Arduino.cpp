@@ -0,0 +1,309 @@
+/*
+   (c)2023 Forward Computing and Control Pty. Ltd.
+   NSW Australia, www.forward.com.au
+   This code is not warranted to be fit for any purpose. You may only use it at your own risk.
+   This code may be freely used for both private and commercial use
+   provided this copyright is maintained.
+*/
+// host build only, see ../Makefile
+#include <Arduino.h>
+#include <stdarg.h>
+#include <time.h>
+#include <sched.h>
+
+static uint64_t monotonic_us() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ((uint64_t)ts.tv_sec * 1000000) + (ts.tv_nsec / 1000);
+}
+
+static const uint64_t start_us = monotonic_us();
+
+unsigned long micros() {
+  return monotonic_us() - start_us;
+}
+
+unsigned long millis() {
+  return micros() / 1000;
+}
+
+void delay(unsigned long ms) {
+  struct timespec ts = { (time_t)(ms / 1000), (long)((ms % 1000) * 1000000) };
+  nanosleep(&ts, NULL);
+}
+
+void delayMicroseconds(unsigned int us) {
+  unsigned long start = micros();
+  while ((micros() - start) < us) {
+  }
+}
+
+void yield() {
+  sched_yield();
+}
+
+extern "C" char *dtostrf(double val, signed char width, unsigned char prec, char *sout) {
+  sprintf(sout, "%*.*f", width, prec, val);
+  return sout;
+}
+
+/*
+  Print
+ */
+
+size_t Print::write(const uint8_t *buffer, size_t size) {
+  size_t n = 0;
+  while (size--) {
+    if (!write(*buffer++)) {
+      break;
+    }
+    n++;
+  }
+  return n;
+}
+
+size_t Print::printf(const char *format, ...) {
+  char buf[128];
+  va_list args;
+  va_start(args, format);
+  int len = vsnprintf(buf, sizeof(buf), format, args);
+  va_end(args);
+  if (len < 0) {
+    return 0;
+  }
+  if ((size_t)len < sizeof(buf)) {
+    return write((const uint8_t *)buf, len);
+  }
+  char *big = (char *)malloc(len + 1);
+  if (!big) {
+    return 0;
+  }
+  va_start(args, format);
+  vsnprintf(big, len + 1, format, args);
+  va_end(args);
+  size_t n = write((const uint8_t *)big, len);
+  free(big);
+  return n;
+}
+
+size_t Print::print(const __FlashStringHelper *ifsh) {
+  return print((const char *)ifsh);
+}
+
+size_t Print::print(const char str[]) {
+  return write(str);
+}
+
+size_t Print::print(char c) {
+  return write((uint8_t)c);
+}
+
+size_t Print::print(unsigned char b, int base) {
+  return print((unsigned long long)b, base);
+}
+
+size_t Print::print(int n, int base) {
+  return print((long long)n, base);
+}
+
+size_t Print::print(unsigned int n, int base) {
+  return print((unsigned long long)n, base);
+}
+
+size_t Print::print(long n, int base) {
+  return print((long long)n, base);
+}
+
+size_t Print::print(unsigned long n, int base) {
+  return print((unsigned long long)n, base);
+}
+
+size_t Print::print(long long n, int base) {
+  if (base == 0) {
+    return write((uint8_t)n);
+  }
+  if ((base == DEC) && (n < 0)) {
+    return print('-') + printNumber(-(unsigned long long)n, DEC);
+  }
+  return printNumber((unsigned long long)n, base);
+}
+
+size_t Print::print(unsigned long long n, int base) {
+  if (base == 0) {
+    return write((uint8_t)n);
+  }
+  return printNumber(n, base);
+}
+
+size_t Print::print(double n, int digits) {
+  return printFloat(n, digits);
+}
+
+size_t Print::print(const Printable &x) {
+  return x.printTo(*this);
+}
+
+size_t Print::println(void) {
+  return print("\r\n");
+}
+
+size_t Print::println(const __FlashStringHelper *ifsh) {
+  size_t n = print(ifsh);
+  return n + println();
+}
+
+size_t Print::println(const char str[]) {
+  size_t n = print(str);
+  return n + println();
+}
+
+size_t Print::println(char c) {
+  size_t n = print(c);
+  return n + println();
+}
+
+size_t Print::println(unsigned char b, int base) {
+  size_t n = print(b, base);
+  return n + println();
+}
+
+size_t Print::println(int num, int base) {
+  size_t n = print(num, base);
+  return n + println();
+}
+
+size_t Print::println(unsigned int num, int base) {
+  size_t n = print(num, base);
+  return n + println();
+}
+
+size_t Print::println(long num, int base) {
+  size_t n = print(num, base);
+  return n + println();
+}
+
+size_t Print::println(unsigned long num, int base) {
+  size_t n = print(num, base);
+  return n + println();
+}
+
+size_t Print::println(long long num, int base) {
+  size_t n = print(num, base);
+  return n + println();
+}
+
+size_t Print::println(unsigned long long num, int base) {
+  size_t n = print(num, base);
+  return n + println();
+}
+
+size_t Print::println(double num, int digits) {
+  size_t n = print(num, digits);
+  return n + println();
+}
+
+size_t Print::println(const Printable &x) {
+  size_t n = print(x);
+  return n + println();
+}
+
+size_t Print::printNumber(unsigned long long n, uint8_t base) {
+  char buf[8 * sizeof(n) + 1];
+  char *str = &buf[sizeof(buf) - 1];
+  *str = '\0';
+  if (base < 2) {
+    base = 10;
+  }
+  do {
+    char c = n % base;
+    n /= base;
+    *--str = (c < 10) ? (c + '0') : (c + 'A' - 10);
+  } while (n);
+  return write(str);
+}
+
+// same output as the ESP32 core, including nan, inf and ovf
+size_t Print::printFloat(double number, uint8_t digits) {
+  if (isnan(number)) {
+    return print("nan");
+  }
+  if (isinf(number)) {
+    return print("inf");
+  }
+  if (number > 4294967040.0) {
+    return print("ovf");
+  }
+  if (number < -4294967040.0) {
+    return print("ovf");
+  }
+  size_t n = 0;
+  if (number < 0.0) {
+    n += print('-');
+    number = -number;
+  }
+  double rounding = 0.5;
+  for (uint8_t i = 0; i < digits; ++i) {
+    rounding /= 10.0;
+  }
+  number += rounding;
+  unsigned long int_part = (unsigned long)number;
+  double remainder = number - (double)int_part;
+  n += print(int_part);
+  if (digits > 0) {
+    n += print('.');
+  }
+  while (digits-- > 0) {
+    remainder *= 10.0;
+    unsigned int toPrint = (unsigned int)remainder;
+    n += print(toPrint);
+    remainder -= toPrint;
+  }
+  return n;
+}
+
+/*
+  Stream
+ */
+
+int Stream::timedRead() {
+  unsigned long start = millis();
+  do {
+    int c = read();
+    if (c >= 0) {
+      return c;
+    }
+    yield();
+  } while ((millis() - start) < _timeout);
+  return -1;
+}
+
+size_t Stream::readBytes(char *buffer, size_t length) {
+  size_t count = 0;
+  while (count < length) {
+    int c = timedRead();
+    if (c < 0) {
+      break;
+    }
+    *buffer++ = (char)c;
+    count++;
+  }
+  return count;
+}
+
+/*
+  Serial
+ */
+
+HostSerial Serial;
+
+size_t HostSerial::write(uint8_t c) {
+  return (fputc(c, stdout) == EOF) ? 0 : 1;
+}
+
+size_t HostSerial::write(const uint8_t *buffer, size_t size) {
+  return fwrite(buffer, 1, size, stdout);
+}
+
+void HostSerial::flush() {
+  fflush(stdout);
+}
@@ -0,0 +1,81 @@
+#ifndef HOST_ARDUINO_H_
+#define HOST_ARDUINO_H_
+/*
+   (c)2023 Forward Computing and Control Pty. Ltd.
+   NSW Australia, www.forward.com.au
+   This code is not warranted to be fit for any purpose. You may only use it at your own risk.
+   This code may be freely used for both private and commercial use
+   provided this copyright is maintained.
+*/
+
+/**
+   Just enough of the Arduino core for HS_AsyncTCP, SafeString and WiFiDataHandling to compile and run on Linux
+   host build only, see ../Makefile and ../HS_AsyncTCP_host.h
+   ESP32 is not defined, so code that needs the real hardware is left out or fails to compile.
+*/
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include "avr/pgmspace.h"
+#include "Print.h"
+#include "Stream.h"
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+unsigned long millis(); // CLOCK_MONOTONIC since the program started
+unsigned long micros(); // unsigned long is 64 bits on Linux, so unlike the ESP32 this does not wrap
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield();
+
+inline int xPortGetCoreID() {
+  return 0;
+}
+
+inline bool isDigit(int c) {
+  return isdigit(c) != 0;
+}
+inline bool isSpace(int c) {
+  return isspace(c) != 0;
+}
+inline bool isAlpha(int c) {
+  return isalpha(c) != 0;
+}
+
+extern "C" char *dtostrf(double val, signed char width, unsigned char prec, char *sout);
+
+/**
+   Serial
+   writes to stdout, never has anything to read
+*/
+class HostSerial : public Stream {
+public:
+  void begin(unsigned long baud) {}
+  size_t write(uint8_t c) override;
+  size_t write(const uint8_t *buffer, size_t size) override;
+  using Print::write;
+  int available() override {
+    return 0;
+  }
+  int read() override {
+    return -1;
+  }
+  int peek() override {
+    return -1;
+  }
+  int availableForWrite() override {
+    return 256;
+  }
+  void flush() override;
+  operator bool() const {
+    return true;
+  }
+};
+extern HostSerial Serial;
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef HOST_IPADDRESS_H_
+#define HOST_IPADDRESS_H_
+/*
+   (c)2023 Forward Computing and Control Pty. Ltd.
+   NSW Australia, www.forward.com.au
+   This code is not warranted to be fit for any purpose. You may only use it at your own risk.
+   This code may be freely used for both private and commercial use
+   provided this copyright is maintained.
+*/
+
+#include <stdint.h>
+
+// host build only, see ../Makefile. IPv4 only, held in network byte order like lwIP
+class IPAddress {
+public:
+  IPAddress() : _addr(0) {}
+  IPAddress(uint32_t addr) : _addr(addr) {}
+  IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d)
+    : _addr((uint32_t)a | ((uint32_t)b << 8) | ((uint32_t)c << 16) | ((uint32_t)d << 24)) {}
+  operator uint32_t() const {
+    return _addr;
+  }
+  uint8_t operator[](int index) const {
+    return (_addr >> (8 * index)) & 0xff;
+  }
+
+private:
+  uint32_t _addr;
+};
+
+#endif
@@ -0,0 +1,78 @@
+#ifndef HOST_PRINT_H_
+#define HOST_PRINT_H_
+/*
+   (c)2023 Forward Computing and Control Pty. Ltd.
+   NSW Australia, www.forward.com.au
+   This code is not warranted to be fit for any purpose. You may only use it at your own risk.
+   This code may be freely used for both private and commercial use
+   provided this copyright is maintained.
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "Printable.h"
+#include "avr/pgmspace.h"
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+/**
+   Print
+   host build only, see ../Makefile
+   The Arduino Print methods HS_AsyncTCP, SafeString and WiFiDataHandling use, numbers are formatted as the ESP32 core does
+*/
+class Print {
+public:
+  virtual ~Print() {}
+
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t *buffer, size_t size);
+  size_t write(const char *str) {
+    return str ? write((const uint8_t *)str, strlen(str)) : 0;
+  }
+  size_t write(const char *buffer, size_t size) {
+    return write((const uint8_t *)buffer, size);
+  }
+  virtual int availableForWrite() {
+    return 0;
+  }
+  virtual void flush() {}
+
+  size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+  size_t print(const __FlashStringHelper *ifsh);
+  size_t print(const char str[]);
+  size_t print(char c);
+  size_t print(unsigned char b, int base = DEC);
+  size_t print(int n, int base = DEC);
+  size_t print(unsigned int n, int base = DEC);
+  size_t print(long n, int base = DEC);
+  size_t print(unsigned long n, int base = DEC);
+  size_t print(long long n, int base = DEC);
+  size_t print(unsigned long long n, int base = DEC);
+  size_t print(double n, int digits = 2);
+  size_t print(const Printable &x);
+
+  size_t println(const __FlashStringHelper *ifsh);
+  size_t println(const char str[]);
+  size_t println(char c);
+  size_t println(unsigned char b, int base = DEC);
+  size_t println(int n, int base = DEC);
+  size_t println(unsigned int n, int base = DEC);
+  size_t println(long n, int base = DEC);
+  size_t println(unsigned long n, int base = DEC);
+  size_t println(long long n, int base = DEC);
+  size_t println(unsigned long long n, int base = DEC);
+  size_t println(double n, int digits = 2);
+  size_t println(const Printable &x);
+  size_t println(void);
+
+private:
+  size_t printNumber(unsigned long long n, uint8_t base);
+  size_t printFloat(double number, uint8_t digits);
+};
+
+#endif
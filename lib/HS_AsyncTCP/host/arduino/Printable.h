@@ -0,0 +1,22 @@
+#ifndef HOST_PRINTABLE_H_
+#define HOST_PRINTABLE_H_
+/*
+   (c)2023 Forward Computing and Control Pty. Ltd.
+   NSW Australia, www.forward.com.au
+   This code is not warranted to be fit for any purpose. You may only use it at your own risk.
+   This code may be freely used for both private and commercial use
+   provided this copyright is maintained.
+*/
+
+#include <stddef.h>
+
+class Print;
+
+// host build only, see ../Makefile
+class Printable {
+public:
+  virtual ~Printable() {}
+  virtual size_t printTo(Print &p) const = 0;
+};
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef HOST_STREAM_H_
+#define HOST_STREAM_H_
+/*
+   (c)2023 Forward Computing and Control Pty. Ltd.
+   NSW Australia, www.forward.com.au
+   This code is not warranted to be fit for any purpose. You may only use it at your own risk.
+   This code may be freely used for both private and commercial use
+   provided this copyright is maintained.
+*/
+
+#include "Print.h"
+
+/**
+   Stream
+   host build only, see ../Makefile
+   readBytes() waits up to setTimeout() ms like the Arduino one, the HS_AsyncTCP streams override it so they never wait
+*/
+class Stream : public Print {
+public:
+  Stream() : _timeout(1000) {}
+
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() = 0;
+
+  void setTimeout(unsigned long timeout) {
+    _timeout = timeout;
+  }
+  unsigned long getTimeout() const {
+    return _timeout;
+  }
+  virtual size_t readBytes(char *buffer, size_t length);
+  size_t readBytes(uint8_t *buffer, size_t length) {
+    return readBytes((char *)buffer, length);
+  }
+
+protected:
+  unsigned long _timeout; // ms
+
+  int timedRead(); // -1 on timeout
+};
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef HOST_PGMSPACE_H_
+#define HOST_PGMSPACE_H_
+/*
+   (c)2023 Forward Computing and Control Pty. Ltd.
+   NSW Australia, www.forward.com.au
+   This code is not warranted to be fit for any purpose. You may only use it at your own risk.
+   This code may be freely used for both private and commercial use
+   provided this copyright is maintained.
+*/
+
+#include <string.h>
+
+// host build only, see ../../Makefile. Flash and RAM are the same thing on Linux
+#define PROGMEM
+#define PGM_P const char *
+#define PSTR(s) (s)
+#define strlen_P strlen
+#define strcpy_P strcpy
+#define strncpy_P strncpy
+#define strcmp_P strcmp
+#define memcpy_P memcpy
+#define pgm_read_byte(addr) (*(const unsigned char *)(addr))
+
+class __FlashStringHelper;
+#define F(s) ((const __FlashStringHelper *)(s))
+
+#endif
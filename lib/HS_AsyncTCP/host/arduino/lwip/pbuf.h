@@ -0,0 +1,27 @@
+#ifndef HOST_LWIP_PBUF_H_
+#define HOST_LWIP_PBUF_H_
+/*
+   (c)2023 Forward Computing and Control Pty. Ltd.
+   NSW Australia, www.forward.com.au
+   This code is not warranted to be fit for any purpose. You may only use it at your own risk.
+   This code may be freely used for both private and commercial use
+   provided this copyright is maintained.
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+
+// host build only, see ../../Makefile
+// just the pbuf fields HS_AsyncTCP uses, each host pbuf is one malloc() of the struct followed by its payload
+
+struct pbuf {
+  struct pbuf *next;
+  void *payload;
+  uint16_t tot_len;
+  uint16_t len;
+};
+
+struct pbuf *pbuf_alloc_host(size_t len); // NULL if out of memory
+uint8_t pbuf_free(struct pbuf *p); // frees the chain, returns the number freed
+
+#endif
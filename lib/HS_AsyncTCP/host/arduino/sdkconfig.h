@@ -0,0 +1,13 @@
+#ifndef HOST_SDKCONFIG_H_
+#define HOST_SDKCONFIG_H_
+/*
+   (c)2023 Forward Computing and Control Pty. Ltd.
+   NSW Australia, www.forward.com.au
+   This code is not warranted to be fit for any purpose. You may only use it at your own risk.
+   This code may be freely used for both private and commercial use
+   provided this copyright is maintained.
+*/
+
+// host build only, see ../Makefile. HS_AsyncTCP_base.h includes this, no ESP-IDF settings are needed on Linux
+
+#endif
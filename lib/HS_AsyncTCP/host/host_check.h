@@ -0,0 +1,34 @@
+#ifndef HOST_CHECK_H_
+#define HOST_CHECK_H_
+/*
+   (c)2023 Forward Computing and Control Pty. Ltd.
+   NSW Australia, www.forward.com.au
+   This code is not warranted to be fit for any purpose. You may only use it at your own risk.
+   This code may be freely used for both private and commercial use
+   provided this copyright is maintained.
+*/
+
+/**
+   host_check.h
+   CHECK() for the test_*.cpp programs run by  make check
+   A failed CHECK() prints the file, line and condition and carries on, checkExitCode() is main()'s return value.
+*/
+
+#include <stdio.h>
+#include <atomic>
+
+static std::atomic<int> checkFailures(0); // CHECK() may be called from several threads
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+      checkFailures++; \
+      printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+    } \
+  } while (0)
+
+static inline int checkExitCode(const char *name) {
+  printf("%s: %s\n", name, (checkFailures == 0) ? "PASS" : "FAIL");
+  return (checkFailures == 0) ? 0 : 1;
+}
+
+#endif
@@ -0,0 +1,168 @@
+/*
+   (c)2023 Forward Computing and Control Pty. Ltd.
+   NSW Australia, www.forward.com.au
+   This code is not warranted to be fit for any purpose. You may only use it at your own risk.
+   This code may be freely used for both private and commercial use
+   provided this copyright is maintained.
+*/
+// host_main.cpp
+// Runs src/WiFiDataHandling.cpp on Linux against real sockets, see HS_AsyncTCP_host.h and the Makefile
+//   ./hs_async_host [tcpPort [udpPort [run_ms]]]   defaults 4989 4989 0 (run for ever)
+// e.g. connect with  nc localhost 4989  or  telnet_from_esp32.py with HOST = 'localhost'
+// The loop() below runs in its own thread, like loop() on core 1, and moves a simulated stepper instead of driving pins,
+// so the telemetry and the cmd / setpoint paths through the volatile vars are the same as on the ESP32.
+
+#include <Arduino.h>
+#include <thread>
+#include <atomic>
+#include "HS_AsyncTCP.h"
+#include "HS_AsyncTCP_host.h"
+#include "VolatileVars.h"
+#include "WiFiDataHandling.h"
+
+static const unsigned long LOOP_SLEEP_US = 100; // the host loop() sleeps each time round, rather than use up a whole core
+
+static std::atomic<bool> running(true);
+
+/**
+   SimStepper
+   just enough of SpeedStepper for the cmds, speed ramps to the target at accel, position follows speed
+   Profiles are not simulated, p<n> runs at the first profile speed.
+*/
+struct SimStepper {
+  float speed = 0; // steps/sec
+  float targetSpeed = 0;
+  float accel = 1000; // steps/sec/sec
+  double position = 0;
+  bool moving = false; // moving to target
+  int32_t target = 0;
+
+  void run(float dt) {
+    if (moving) {
+      float dist = target - position;
+      float stopDist = (speed * speed) / (2 * accel);
+      targetSpeed = (fabsf(dist) <= stopDist) ? 0 : ((dist > 0) ? 5000 : -5000);
+      if (fabsf(dist) < 1) {
+        position = target;
+        speed = targetSpeed = 0;
+        moving = false;
+        return;
+      }
+    }
+    float dv = accel * dt;
+    if (speed < targetSpeed) {
+      speed = (speed + dv > targetSpeed) ? targetSpeed : speed + dv;
+    } else if (speed > targetSpeed) {
+      speed = (speed - dv < targetSpeed) ? targetSpeed : speed - dv;
+    }
+    position += speed * dt;
+  }
+};
+
+// the host version of loop() in HighSpeedESP32_ex2.cpp
+static void motionLoop() {
+  SimStepper stepper;
+  float runSpeed = 5000;
+  MotionSnapshot snapshot = {};
+  uint32_t maxLoopTimeClearAck = 0;
+  unsigned long last_us = micros();
+  while (running.load(std::memory_order_relaxed)) {
+    snapshot.loopCount++;
+    unsigned long us = micros();
+    unsigned long deltaT = us - last_us;
+    last_us = us;
+    uint32_t clearReq = netVars_v.maxLoopTimeClearReq.load(std::memory_order_relaxed);
+    if (clearReq != maxLoopTimeClearAck) {
+      maxLoopTimeClearAck = clearReq;
+      snapshot.maxLoopTime = 0;
+      snapshot.maxSetpointLatency = 0;
+    }
+    if (deltaT > snapshot.maxLoopTime) {
+      snapshot.maxLoopTime = deltaT;
+    }
+    StepperCmd cmd;
+    bool gotCmd = false;
+    while (stepperCmds_v.pop(cmd)) {
+      gotCmd = true;
+      switch (cmd.cmd) {
+        case STOP:
+          stepper.moving = false;
+          stepper.targetSpeed = 0;
+          break;
+        case RUN:
+          stepper.moving = false;
+          stepper.targetSpeed = runSpeed;
+          break;
+        case HOME:
+          stepper.moving = true;
+          stepper.target = 0;
+          break;
+        case SET_SPEED:
+          runSpeed = cmd.value;
+          stepper.moving = false;
+          stepper.targetSpeed = runSpeed;
+          break;
+        case MOVE_TO:
+          stepper.moving = true;
+          stepper.target = cmd.position;
+          break;
+        case SET_ACCEL:
+          if (cmd.value > 0.0) {
+            stepper.accel = cmd.value;
+          }
+          break;
+        case PROFILE:
+          stepper.moving = false;
+          stepper.targetSpeed = (cmd.value < 1.0) ? 4000 : 5000;
+          break;
+      }
+    }
+    SetpointFrame frame;
+    if (setpointFrames_v.read(frame)) {
+      stepper.moving = false;
+      stepper.targetSpeed = stepper.speed = 0;
+      stepper.position = frame.position[0];
+      uint32_t latency = (uint32_t)micros() - frame.time_us;
+      if (latency > snapshot.maxSetpointLatency) {
+        snapshot.maxSetpointLatency = latency;
+      }
+    }
+    stepper.run(deltaT / 1000000.0f);
+    snapshot.speed = stepper.speed;
+    snapshot.position = lround(stepper.position);
+    motionSnapshot_v.write(snapshot); // never blocks
+    if (gotCmd) {
+      asyncNotify(); // let asyncLoop() see the result of the cmds now instead of at the next timer wake
+    }
+    std::this_thread::sleep_for(std::chrono::microseconds(LOOP_SLEEP_US));
+  }
+}
+
+int main(int argc, char *argv[]) {
+  uint16_t portNo = (argc > 1) ? atoi(argv[1]) : 4989;
+  uint16_t udpPortNo = (argc > 2) ? atoi(argv[2]) : 4989;
+  unsigned long run_ms = (argc > 3) ? strtoul(argv[3], NULL, 10) : 0;
+  setvbuf(stdout, NULL, _IOLBF, 0);
+
+  asyncSetOverflowPolicy(ASYNC_DROP_OLDEST); // a client that falls behind gets the latest results
+  if (!initAsyncServer(portNo)) {
+    Serial.println("HS_AsyncTCP failed to started");
+    return 1;
+  }
+  if (!initAsyncUdp(udpPortNo, udpSetpointReceived)) {
+    Serial.println("UDP setpoint listener failed to start");
+    return 1;
+  }
+  Serial.printf("HS_AsyncTCP host listening on tcp %u, udp %u\n", portNo, udpPortNo);
+  std::thread motion(motionLoop); // after initAsyncServer(), so asyncNotify() works
+
+  bool ok = asyncHostRun(run_ms);
+
+  running = false;
+  motion.join();
+  Serial.printf("wakes lwIP,notify,timer: %lu,%lu,%lu  outputs sent %lu dropped %lu coalesced %lu  stale events %lu\n",
+                (unsigned long)asyncWakeCount(ASYNC_WAKE_LWIP), (unsigned long)asyncWakeCount(ASYNC_WAKE_NOTIFY),
+                (unsigned long)asyncWakeCount(ASYNC_WAKE_TIMER), (unsigned long)asyncSentCount(),
+                (unsigned long)asyncDroppedCount(), (unsigned long)asyncCoalescedCount(), (unsigned long)asyncStaleEventCount());
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,136 @@
+/*
+   (c)2023 Forward Computing and Control Pty. Ltd.
+   NSW Australia, www.forward.com.au
+   This code is not warranted to be fit for any purpose. You may only use it at your own risk.
+   This code may be freely used for both private and commercial use
+   provided this copyright is maintained.
+*/
+// test_buffer_stream.cpp
+// BufferStream, reads, writes and removes keep the unread bytes in order, and the time to drain a full MTU buffer
+//   make check   or   make build/test_buffer_stream && build/test_buffer_stream
+
+#include <Arduino.h>
+#include <chrono>
+#include "BufferStream.h"
+#include "host_check.h"
+
+static const size_t MTU = 1400; // BufferStream's BUFFER_SIZE
+static const int RUNS = 20000;
+
+static uint8_t pattern(size_t i) {
+  return (uint8_t)(i * 7 + 1); // includes '\0' bytes
+}
+
+static void fill(BufferStream &bs) {
+  bs.clear();
+  for (size_t i = 0; i < MTU; i++) {
+    uint8_t b = pattern(i);
+    bs.write(&b, 1);
+  }
+}
+
+// read(), readBytes(), remove() and a write that has to move the unread bytes to the front
+static void checkOrder() {
+  BufferStream bs;
+  fill(bs);
+  CHECK(bs.available() == (int)MTU);
+  CHECK(bs.availableForWrite() == 0);
+  uint8_t extra = 0x55;
+  CHECK(bs.write(&extra, 1) == 0); // full
+  for (size_t i = 0; i < 100; i++) {
+    CHECK(bs.read() == pattern(i));
+  }
+  uint8_t got[200];
+  CHECK(bs.readBytes(got, 200) == 200);
+  for (size_t i = 0; i < 200; i++) {
+    CHECK(got[i] == pattern(100 + i));
+  }
+  bs.remove(100); // 400 read or removed
+  CHECK(bs.peek() == pattern(400));
+  uint8_t more[500];
+  for (size_t i = 0; i < sizeof(more); i++) {
+    more[i] = pattern(MTU + i);
+  }
+  CHECK(bs.write(more, sizeof(more)) == 400); // room for 400 after moving the unread 1000 to the front
+  CHECK(bs.available() == (int)MTU);
+  const char *p = bs.getBuffer(); // contiguous, from the next unread byte
+  for (size_t i = 0; i < MTU; i++) {
+    CHECK((uint8_t)p[i] == pattern(400 + i));
+  }
+  CHECK(p[MTU] == '\0');
+  bs.remove(1, 2); // from the middle
+  CHECK(bs.read() == pattern(400));
+  CHECK(bs.read() == pattern(403));
+  while (bs.available()) {
+    bs.read();
+  }
+  CHECK(bs.read() == -1);
+  CHECK(bs.availableForWrite() == (int)MTU); // back at the front once all read
+}
+
+// the drain before the read cursor, read() took charAt(0) then remove(0,1), moving the rest down each byte
+static uint32_t oldDrain(char *buf, size_t len) {
+  uint32_t sum = 0;
+  while (len) {
+    sum += (uint8_t)buf[0];
+    memmove(buf, buf + 1, len); // the rest and the '\0'
+    len--;
+  }
+  return sum;
+}
+
+static double usPerDrain(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / RUNS;
+}
+
+// drain a full buffer a byte at a time through Stream::read(), as asyncDataReceived() does, and with readBytes()
+static void benchDrain() {
+  BufferStream bs;
+  uint32_t expected = 0;
+  for (size_t i = 0; i < MTU; i++) {
+    expected += pattern(i);
+  }
+
+  char old[MTU + 1];
+  double oldUs = 0;
+  for (int r = 0; r < RUNS; r++) {
+    for (size_t i = 0; i < MTU; i++) {
+      old[i] = pattern(i);
+    }
+    old[MTU] = '\0';
+    auto start = std::chrono::steady_clock::now();
+    CHECK(oldDrain(old, MTU) == expected);
+    oldUs += usPerDrain(start);
+  }
+
+  double readUs = 0;
+  Stream &stream = bs;
+  for (int r = 0; r < RUNS; r++) {
+    fill(bs);
+    auto start = std::chrono::steady_clock::now();
+    uint32_t sum = 0;
+    while (stream.available()) {
+      sum += stream.read();
+    }
+    readUs += usPerDrain(start);
+    CHECK(sum == expected);
+  }
+
+  double readBytesUs = 0;
+  uint8_t out[MTU];
+  for (int r = 0; r < RUNS; r++) {
+    fill(bs);
+    auto start = std::chrono::steady_clock::now();
+    CHECK(bs.readBytes(out, MTU) == MTU);
+    readBytesUs += usPerDrain(start);
+    CHECK(out[MTU - 1] == pattern(MTU - 1));
+  }
+  printf("%u byte drain, old charAt/remove %.2fus, read() %.2fus, readBytes() %.3fus\n",
+         (unsigned)MTU, oldUs, readUs, readBytesUs);
+}
+
+int main() {
+  checkOrder();
+  benchDrain();
+  return checkExitCode("test_buffer_stream");
+}
@@ -0,0 +1,119 @@
+/*
+   (c)2023 Forward Computing and Control Pty. Ltd.
+   NSW Australia, www.forward.com.au
+   This code is not warranted to be fit for any purpose. You may only use it at your own risk.
+   This code may be freely used for both private and commercial use
+   provided this copyright is maintained.
+*/
+// test_fixed_pool.cpp
+// FixedPool, the event packet pool vs malloc() through a 32 deep queue, and a 4 thread alloc/release hammer
+//   make check   or   make build/test_fixed_pool && build/test_fixed_pool
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <thread>
+#include <vector>
+#include <chrono>
+#include "FixedPool.h"
+#include "host_check.h"
+
+static const uint32_t EVENTS = 2000000;
+static const int QUEUE_LENGTH = 32; // _async_queue_length
+static const int POOL_SIZE = QUEUE_LENGTH + 4; // as _event_pool
+
+// about the size of lwip_event_packet_t
+struct EventPacket {
+  int event;
+  void *arg;
+  uint32_t data[6];
+};
+
+static FixedPool<EventPacket, POOL_SIZE> pool;
+
+// the lwIP callbacks fill the queue, then the async task empties it, as when it wakes to a burst of events
+template <class ALLOC, class RELEASE>
+static double runEvents(ALLOC alloc, RELEASE release) {
+  EventPacket *queue[QUEUE_LENGTH];
+  uint32_t sum = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t n = 0; n < EVENTS; n += QUEUE_LENGTH) {
+    for (int i = 0; i < QUEUE_LENGTH; i++) {
+      EventPacket *e = alloc();
+      e->event = i;
+      e->data[0] = n;
+      queue[i] = e;
+    }
+    for (int i = 0; i < QUEUE_LENGTH; i++) {
+      sum += queue[i]->event + queue[i]->data[0];
+      release(queue[i]);
+    }
+  }
+  double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  CHECK(sum != 0);
+  return secs;
+}
+
+// pool vs malloc, one thread
+static void checkPoolVsMalloc() {
+  double poolSecs = runEvents([]() { return pool.alloc(); }, [](EventPacket * e) { pool.release(e); });
+  double mallocSecs = runEvents([]() { return (EventPacket*)malloc(sizeof(EventPacket)); }, [](EventPacket * e) { free(e); });
+  CHECK(pool.getHighWater() == QUEUE_LENGTH);
+  CHECK(pool.getFailCount() == 0);
+  CHECK(pool.getInUse() == 0);
+  printf("%u events, pool %.3fs, malloc %.3fs, high water %u\n", (unsigned)EVENTS, poolSecs, mallocSecs, (unsigned)pool.getHighWater());
+}
+
+// several threads alloc and release at once, the free list must still hold every item, once
+static void checkHammer() {
+  const int THREADS = 4;
+  const int ROUNDS = 200000;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < THREADS; t++) {
+    threads.push_back(std::thread([t]() {
+      EventPacket *held[4];
+      for (int r = 0; r < ROUNDS; r++) {
+        int got = 0;
+        for (int i = 0; i < 4; i++) {
+          held[got] = pool.alloc();
+          if (held[got] != NULL) {
+            held[got]->event = t; // no other thread has this item
+            got++;
+          }
+        }
+        for (int i = 0; i < got; i++) {
+          CHECK(held[i]->event == t);
+          pool.release(held[i]);
+        }
+        if ((r & 0xff) == 0) {
+          std::this_thread::yield();
+        }
+      }
+    }));
+  }
+  for (std::thread &t : threads) {
+    t.join();
+  }
+  CHECK(pool.getInUse() == 0);
+  EventPacket *all[POOL_SIZE];
+  for (int i = 0; i < POOL_SIZE; i++) {
+    all[i] = pool.alloc();
+    CHECK(all[i] != NULL);
+    CHECK(pool.owns(all[i]));
+    for (int j = 0; j < i; j++) {
+      CHECK(all[i] != all[j]);
+    }
+  }
+  uint32_t failCount = pool.getFailCount();
+  CHECK(pool.alloc() == NULL);
+  CHECK(pool.getFailCount() == failCount + 1);
+  for (int i = 0; i < POOL_SIZE; i++) {
+    pool.release(all[i]);
+  }
+  printf("%d threads x %d rounds, %u empty pool allocs\n", THREADS, ROUNDS, (unsigned)failCount);
+}
+
+int main() {
+  checkPoolVsMalloc();
+  checkHammer();
+  return checkExitCode("test_fixed_pool");
+}
@@ -0,0 +1,197 @@
+/*
+   (c)2023 Forward Computing and Control Pty. Ltd.
+   NSW Australia, www.forward.com.au
+   This code is not warranted to be fit for any purpose. You may only use it at your own risk.
+   This code may be freely used for both private and commercial use
+   provided this copyright is maintained.
+*/
+// test_handle_table.cpp
+// HandleTable, stale handles after remove(), the 24 bit generation wrapping, and a storm of recv events from an 'lwIP' thread
+// while the dispatch thread closes and reopens the connections they are for
+//   make check   or   make build/test_handle_table && build/test_handle_table
+// Build with  make BUILD=build-asan CXXFLAGS="-O1 -g -fsanitize=address,undefined" LDFLAGS="-fsanitize=address,undefined" check
+// to also check the discarded events' data is freed.
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <thread>
+#include <atomic>
+#include "HandleTable.h"
+#include "SpscQueue.h"
+#include "host_check.h"
+
+static const int CONNECTIONS = 4;
+static const uint32_t EVENTS = 1000000;
+
+struct Connection {
+  void *handle; // current handle, NULL while closed, only used by the dispatch thread
+  uint32_t received;
+};
+
+// a queued recv event, data stands for the pbuf the dispatcher must free
+struct RecvEvent {
+  void *handle;
+  uint32_t *data;
+};
+
+static HandleTable<Connection, CONNECTIONS + 4> table; // as _client_handles
+static Connection connections[CONNECTIONS];
+static std::atomic<void *> lwipArgs[CONNECTIONS]; // the handle lwIP has as each pcb's callback arg
+static std::atomic<uint32_t> dataAllocs(0);
+static std::atomic<uint32_t> dataFrees(0);
+
+// add, get, remove, a removed handle stays stale even when its slot is reused
+static void checkStaleHandles() {
+  HandleTable<Connection, 2> small;
+  Connection a, b, c;
+  void *ha = small.add(&a);
+  void *hb = small.add(&b);
+  CHECK((ha != NULL) && (hb != NULL) && (ha != hb));
+  CHECK(small.add(&c) == NULL); // full
+  CHECK(small.get(ha) == &a);
+  small.remove(ha);
+  CHECK(small.get(ha) == NULL);
+  void *hc = small.add(&c); // reuses a's slot
+  CHECK(hc != NULL);
+  CHECK(hc != ha);
+  CHECK(small.get(ha) == NULL);
+  CHECK(small.get(hc) == &c);
+  small.remove(ha); // already stale, must not free c's slot
+  CHECK(small.get(hc) == &c);
+  CHECK(small.get(hb) == &b);
+  CHECK(small.get(NULL) == NULL);
+  CHECK(small.get((void *)(uintptr_t)0x103) == NULL); // index past SIZE
+}
+
+// one slot added and removed past 2^24 times, remove() must keep freeing it and
+// get() must keep returning NULL for the removed handle as the generation wraps to 0
+static void checkGenerationWrap() {
+  HandleTable<Connection, 1> one;
+  Connection a;
+  uint32_t notAdded = 0;
+  uint32_t notFreed = 0;
+  uint32_t staleFound = 0;
+  for (uint32_t i = 0; i < (1UL << 24) + 3; i++) {
+    void *h = one.add(&a);
+    if (h == NULL) {
+      notAdded++; // the last remove() did not free the slot
+      continue;
+    }
+    one.remove(h);
+    if (one.get(h) != NULL) {
+      staleFound++;
+    }
+    void *next = one.add(&a);
+    if (next == NULL) {
+      notFreed++;
+      continue;
+    }
+    one.remove(next);
+  }
+  CHECK(notAdded == 0);
+  CHECK(notFreed == 0);
+  CHECK(staleFound == 0);
+  void *h = one.add(&a);
+  CHECK(one.get(h) == &a);
+  one.remove(h);
+  CHECK(one.get(h) == NULL);
+}
+
+static void openConnection(int i) {
+  connections[i].handle = table.add(&connections[i]);
+  CHECK(connections[i].handle != NULL);
+  lwipArgs[i].store(connections[i].handle, std::memory_order_release);
+}
+
+static void closeConnection(int i) {
+  table.remove(connections[i].handle);
+  connections[i].handle = NULL;
+}
+
+// the 'lwIP' thread posts recv events with whatever handle each pcb has, and looks a client up for FIN as _tcp_recv() does,
+// while the dispatch thread, as the HS_Async task, closes and reopens connections under it
+static void checkStorm() {
+  SpscQueue<RecvEvent, 32> queue; // _async_queue_length
+  for (int i = 0; i < CONNECTIONS; i++) {
+    openConnection(i);
+  }
+  std::atomic<bool> done(false);
+  std::atomic<uint32_t> badLookups(0);
+  std::thread lwip([&]() {
+    uint32_t rnd = 12345;
+    for (uint32_t n = 0; n < EVENTS; n++) {
+      rnd = rnd * 1103515245 + 12345;
+      int i = (rnd >> 16) % CONNECTIONS;
+      void *handle = lwipArgs[i].load(std::memory_order_acquire);
+      if ((n & 0x3f) == 0) {
+        Connection *c = table.get(handle); // FIN, the client may be gone but never some other T
+        if ((c != NULL) && (c != &connections[i])) {
+          badLookups++;
+        }
+      }
+      RecvEvent e = { handle, (uint32_t *)malloc(sizeof(uint32_t)) };
+      *e.data = n;
+      dataAllocs++;
+      while (!queue.push(e)) {
+        std::this_thread::yield(); // xQueueSend() waits for room
+      }
+    }
+    done.store(true);
+  });
+
+  uint32_t dispatched = 0;
+  uint32_t stale = 0;
+  uint32_t closes = 0;
+  uint32_t wrongClient = 0;
+  uint32_t rnd = 54321;
+  RecvEvent e;
+  while (true) {
+    if (!queue.pop(e)) {
+      if (done.load()) {
+        if (!queue.pop(e)) {
+          break;
+        }
+      } else {
+        std::this_thread::yield();
+        continue;
+      }
+    }
+    Connection *c = table.get(e.handle);
+    if (c == NULL) {
+      stale++; // discarded, as _handle_async_event() does
+    } else {
+      if (c->handle != e.handle) {
+        wrongClient++; // delivered to a connection opened after the event was posted
+      }
+      c->received++;
+      dispatched++;
+    }
+    free(e.data);
+    dataFrees++;
+    rnd = rnd * 1103515245 + 12345;
+    if (((rnd >> 16) & 0x7) == 0) { // close and reopen one connection every 8 events or so
+      int i = (rnd >> 20) % CONNECTIONS;
+      closeConnection(i);
+      closes++;
+      openConnection(i);
+    }
+  }
+  lwip.join();
+  CHECK(dispatched + stale == EVENTS);
+  CHECK(wrongClient == 0);
+  CHECK(badLookups.load() == 0);
+  CHECK(dataAllocs.load() == dataFrees.load());
+  CHECK(stale > 0); // the storm did race the closes
+  CHECK(dispatched > 0);
+  for (int i = 0; i < CONNECTIONS; i++) {
+    closeConnection(i);
+  }
+  printf("%u events, %u dispatched, %u stale over %u closes\n", (unsigned)EVENTS, (unsigned)dispatched, (unsigned)stale, (unsigned)closes);
+}
+
+int main() {
+  checkStaleHandles();
+  checkGenerationWrap();
+  checkStorm();
+  return checkExitCode("test_handle_table");
+}
@@ -0,0 +1,204 @@
+/*
+   (c)2023 Forward Computing and Control Pty. Ltd.
+   NSW Australia, www.forward.com.au
+   This code is not warranted to be fit for any purpose. You may only use it at your own risk.
+   This code may be freely used for both private and commercial use
+   provided this copyright is maintained.
+*/
+// test_send_queue.cpp
+// The per connection send queue while the ACKs are held back, records are coalesced
+// and each overflow policy drops what it should, nothing is lost uncounted
+//   make check   or   make build/test_send_queue && build/test_send_queue
+
+#include <Arduino.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <string>
+#include <vector>
+#include "HS_AsyncTCP.h"
+#include "HS_AsyncTCP_host.h"
+#include "host_check.h"
+
+static const uint16_t PORT = 49893;
+static const int RECORDS = 200; // while the ACKs are held, then one more after
+static const int RECORD_LEN = 60;
+
+static int recordsToSend = 0;
+static int nextRecord = 0;
+
+// the user methods HS_AsyncTCP.cpp calls, asyncLoop() outputs one numbered record each wake until recordsToSend are done
+void asyncSetup() {
+}
+
+void asyncConnected(Stream &stream, uint8_t connection) {
+}
+
+void asyncDisconnected(uint8_t connection) {
+}
+
+void asyncDataReceived(Stream &stream, uint8_t connection) {
+  while (stream.available()) {
+    stream.read();
+  }
+}
+
+void asyncLoop(Stream &stream) {
+  if (recordsToSend <= 0) {
+    return;
+  }
+  recordsToSend--;
+  char rec[RECORD_LEN + 1];
+  int len = snprintf(rec, sizeof(rec), "rec,%d,", nextRecord++);
+  memset(rec + len, 'x', RECORD_LEN - 2 - len);
+  memcpy(rec + RECORD_LEN - 2, "\r\n", 3);
+  stream.write((const uint8_t*)rec, RECORD_LEN);
+  asyncNotify(); // wake again straight away, so the records come much faster than COALESCE_MAX_MS
+}
+
+static int connectClient() {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(PORT);
+  CHECK(connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+  fcntl(fd, F_SETFL, O_NONBLOCK);
+  asyncHostRun(20); // accept it
+  CHECK(asyncClientCount() == 1);
+  return fd;
+}
+
+// reads everything the server sends until it has been quiet for 100ms, returns the lines
+static std::vector<std::string> drain(int fd) {
+  std::string data;
+  unsigned long quiet_ms = millis();
+  while ((millis() - quiet_ms) < 100) {
+    asyncHostRun(5);
+    char buf[4096];
+    ssize_t n;
+    while ((n = recv(fd, buf, sizeof(buf), 0)) > 0) {
+      data.append(buf, n);
+      quiet_ms = millis();
+    }
+  }
+  std::vector<std::string> lines;
+  size_t start = 0;
+  size_t end;
+  while ((end = data.find("\r\n", start)) != std::string::npos) {
+    lines.push_back(data.substr(start, end - start));
+    start = end + 2;
+  }
+  CHECK(start == data.size()); // no part records
+  return lines;
+}
+
+struct QueueResult {
+  std::vector<int> records; // record numbers received, in order
+  uint32_t summarized; // total of the  dropped,<count>  lines
+  uint32_t sent;
+  uint32_t coalesced;
+  uint32_t dropped;
+};
+
+// RECORDS records while the ACKs are held, then one more after they are released, and read them all
+static QueueResult runHeldAcks(AsyncOverflowPolicy policy) {
+  asyncSetOverflowPolicy(policy);
+  int fd = connectClient();
+  uint32_t sent = asyncSentCount();
+  uint32_t coalesced = asyncCoalescedCount();
+  uint32_t dropped = asyncDroppedCount();
+  asyncHostHoldAcks(true);
+  nextRecord = 0;
+  recordsToSend = RECORDS;
+  while (recordsToSend > 0) {
+    asyncHostRun(1);
+  }
+  asyncHostRun(50); // part segments still go after COALESCE_MAX_MS, while there is send window
+  asyncHostHoldAcks(false);
+  recordsToSend = 1; // so ASYNC_SUMMARIZE queues its  dropped,<count>  line
+  std::vector<std::string> lines = drain(fd);
+  QueueResult result;
+  result.summarized = 0;
+  for (const std::string &line : lines) {
+    int n;
+    unsigned long count;
+    if (sscanf(line.c_str(), "rec,%d,", &n) == 1) {
+      result.records.push_back(n);
+    } else if (sscanf(line.c_str(), "dropped,%lu", &count) == 1) {
+      result.summarized += count;
+    } else {
+      CHECK(false); // unexpected line
+    }
+  }
+  result.sent = asyncSentCount() - sent;
+  result.coalesced = asyncCoalescedCount() - coalesced;
+  result.dropped = asyncDroppedCount() - dropped;
+  close(fd);
+  asyncHostRun(20); // disconnect
+  CHECK(asyncClientCount() == 0);
+  printf("  %d records, %u received, %u TCP writes, %u dropped, %u summarized\n", RECORDS + 1, (unsigned)result.records.size(),
+         (unsigned)(result.sent - result.coalesced), (unsigned)result.dropped, (unsigned)result.summarized);
+  return result;
+}
+
+// every record is received or counted as dropped, those received are in order, and they were coalesced
+static void checkCommon(const QueueResult &r) {
+  CHECK(r.records.size() + r.dropped == RECORDS + 1);
+  CHECK(r.dropped > 0); // the held ACKs did fill the queue
+  for (size_t i = 1; i < r.records.size(); i++) {
+    CHECK(r.records[i] > r.records[i - 1]);
+  }
+  CHECK(r.records.back() == RECORDS);
+  CHECK((r.sent - r.coalesced) * 4 < r.sent); // far fewer TCP writes than records
+}
+
+// the first record goes straight away, the queue behind it fills and is never dropped from
+static void checkFirstKept(const QueueResult &r) {
+  CHECK(r.records.size() > ASYNC_SEND_QUEUE_RECORDS);
+  for (int i = 0; i <= ASYNC_SEND_QUEUE_RECORDS; i++) {
+    CHECK(r.records[i] == i);
+  }
+}
+
+// the new record is dropped when the queue is full
+static void checkDropNewest() {
+  printf("ASYNC_DROP_NEWEST\n");
+  QueueResult r = runHeldAcks(ASYNC_DROP_NEWEST);
+  checkCommon(r);
+  checkFirstKept(r);
+  CHECK(r.summarized == 0);
+}
+
+// the oldest records not yet started are dropped, so the latest one before the ACKs were released gets through
+static void checkDropOldest() {
+  printf("ASYNC_DROP_OLDEST\n");
+  QueueResult r = runHeldAcks(ASYNC_DROP_OLDEST);
+  checkCommon(r);
+  CHECK(r.summarized == 0);
+  CHECK(r.records[0] == 0); // sent before the queue filled
+  CHECK(r.records[1] != 1); // dropped for a newer one
+  CHECK(r.records.size() >= 2);
+  CHECK(r.records[r.records.size() - 2] == RECORDS - 1);
+}
+
+// as ASYNC_DROP_NEWEST, and the  dropped,<count>  lines account for each dropped record
+static void checkSummarize() {
+  printf("ASYNC_SUMMARIZE\n");
+  QueueResult r = runHeldAcks(ASYNC_SUMMARIZE);
+  checkCommon(r);
+  checkFirstKept(r);
+  CHECK(r.summarized == r.dropped);
+}
+
+int main() {
+  if (!initAsyncServer(PORT)) {
+    printf("test_send_queue: could not listen on %u\n", PORT);
+    return 1;
+  }
+  checkDropNewest();
+  checkDropOldest();
+  checkSummarize();
+  return checkExitCode("test_send_queue");
+}
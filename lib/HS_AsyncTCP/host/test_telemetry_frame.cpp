@@ -0,0 +1,69 @@
+/*
+   (c)2023 Forward Computing and Control Pty. Ltd.
+   NSW Australia, www.forward.com.au
+   This code is not warranted to be fit for any purpose. You may only use it at your own risk.
+   This code may be freely used for both private and commercial use
+   provided this copyright is maintained.
+*/
+// test_telemetry_frame.cpp
+// src/TelemetryFrame.h, the CRC-16/CCITT-FALSE check value and the frame's header, field and crc bytes
+//   make check   or   make build/test_telemetry_frame && build/test_telemetry_frame
+
+#include <stdint.h>
+#include <string.h>
+#include "TelemetryFrame.h"
+#include "host_check.h"
+
+// the catalogue check value for CRC-16/CCITT-FALSE
+static void checkCrc() {
+  const char *check = "123456789";
+  CHECK(TelemetryFrame::crc16((const uint8_t *)check, strlen(check)) == 0x29B1);
+  CHECK(TelemetryFrame::crc16(NULL, 0) == 0xFFFF); // just the init value
+}
+
+// sync, schema, little endian length, the fields as added, then the crc of everything after the sync
+static void checkLayout() {
+  TelemetryFrame frame(7);
+  frame.add((uint32_t)0x11223344);
+  frame.add(1.5f);
+  frame.add((int16_t)-2);
+  const uint8_t *buf = frame.finish();
+  const size_t fieldsLen = 4 + 4 + 2;
+  CHECK(frame.length() == TelemetryFrame::HEADER_LEN + fieldsLen + 2);
+  CHECK(buf[0] == TelemetryFrame::SYNC);
+  CHECK(buf[1] == 7);
+  CHECK(buf[2] == fieldsLen);
+  CHECK(buf[3] == 0);
+  const uint8_t u32[] = {0x44, 0x33, 0x22, 0x11};
+  CHECK(memcmp(buf + 4, u32, 4) == 0);
+  const uint8_t f32[] = {0x00, 0x00, 0xc0, 0x3f}; // 1.5f
+  CHECK(memcmp(buf + 8, f32, 4) == 0);
+  CHECK((buf[12] == 0xfe) && (buf[13] == 0xff));
+  uint16_t crc = TelemetryFrame::crc16(buf + 1, 3 + fieldsLen);
+  CHECK(buf[14] == (crc & 0xff));
+  CHECK(buf[15] == (crc >> 8));
+}
+
+// adds past MAX_FIELDS_LEN are ignored, the frame stays consistent
+static void checkFull() {
+  TelemetryFrame frame(1);
+  for (size_t i = 0; i < (TelemetryFrame::MAX_FIELDS_LEN / 4) + 3; i++) {
+    frame.add((uint32_t)i);
+  }
+  frame.add((uint8_t)0xff); // no room either
+  const uint8_t *buf = frame.finish();
+  CHECK(frame.length() == TelemetryFrame::HEADER_LEN + TelemetryFrame::MAX_FIELDS_LEN + 2);
+  CHECK((buf[2] | (buf[3] << 8)) == TelemetryFrame::MAX_FIELDS_LEN);
+  uint32_t last = 0;
+  memcpy(&last, buf + TelemetryFrame::HEADER_LEN + TelemetryFrame::MAX_FIELDS_LEN - 4, 4);
+  CHECK(last == (TelemetryFrame::MAX_FIELDS_LEN / 4) - 1);
+  uint16_t crc = TelemetryFrame::crc16(buf + 1, TelemetryFrame::HEADER_LEN - 1 + TelemetryFrame::MAX_FIELDS_LEN);
+  CHECK((buf[frame.length() - 2] | (buf[frame.length() - 1] << 8)) == crc);
+}
+
+int main() {
+  checkCrc();
+  checkLayout();
+  checkFull();
+  return checkExitCode("test_telemetry_frame");
+}
@@ -0,0 +1,173 @@
+/*
+   (c)2023 Forward Computing and Control Pty. Ltd.
+   NSW Australia, www.forward.com.au
+   This code is not warranted to be fit for any purpose. You may only use it at your own risk.
+   This code may be freely used for both private and commercial use
+   provided this copyright is maintained.
+*/
+// test_udp_setpoints.cpp
+// src/WiFiDataHandling.cpp's udpSetpointReceived(), the seq filter and the udp counters in the telemetry,
+// and each connection getting the telemetry in its own format at its own interval
+//   make check   or   make build/test_udp_setpoints && build/test_udp_setpoints
+
+#include <Arduino.h>
+#include <string>
+#include "BufferStream.h"
+#include "TelemetryFrame.h"
+#include "VolatileVars.h"
+#include "WiFiDataHandling.h"
+#include "host_check.h"
+
+static const size_t FRAME_LEN = 8 + 4 * SETPOINT_AXES;
+
+static void sendFrame(uint32_t seq, int32_t position, uint32_t rx_us, size_t len = FRAME_LEN) {
+  uint8_t data[FRAME_LEN + 4] = {};
+  memcpy(data, &seq, 4); // the host is little endian too
+  for (uint8_t i = 0; i < SETPOINT_AXES; i++) {
+    int32_t p = position + i;
+    memcpy(data + 8 + 4 * i, &p, 4);
+  }
+  udpSetpointReceived(data, len, rx_us);
+}
+
+// true if loop() would get a new frame, and it has this seq, position and rx_us
+static bool gotFrame(uint32_t seq, int32_t position, uint32_t rx_us) {
+  SetpointFrame frame;
+  if (!setpointFrames_v.read(frame)) {
+    return false;
+  }
+  return (frame.seq == seq) && (frame.position[0] == position) && (frame.time_us == rx_us);
+}
+
+struct UdpCounters {
+  unsigned long frames, lost, late, bad;
+};
+
+// asyncLoop() and then asyncConnectionLoop() for each connection, as HS_AsyncTCP's loop does
+// out[i] gets connection i's output
+static void runLoop(BufferStream out[], uint8_t connections) {
+  BufferStream all;
+  asyncLoop(all);
+  CHECK(all.available() == 0); // the telemetry is only sent per connection
+  for (uint8_t i = 0; i < connections; i++) {
+    out[i].clear();
+    asyncConnectionLoop(out[i], i);
+  }
+}
+
+// the last 4 columns of the next CSV telemetry line
+static UdpCounters readCounters() {
+  BufferStream out[1];
+  delay(2); // the i1 cmd set a 1ms telemetry interval
+  runLoop(out, 1);
+  std::string line(out[0].getBuffer());
+  UdpCounters c = {};
+  size_t comma = line.size();
+  for (int i = 0; i < 4; i++) {
+    comma = line.rfind(',', comma - 1);
+  }
+  CHECK(sscanf(line.c_str() + comma, ",%lu,%lu,%lu,%lu", &c.frames, &c.lost, &c.late, &c.bad) == 4);
+  return c;
+}
+
+static void checkCounters(unsigned long frames, unsigned long lost, unsigned long late, unsigned long bad) {
+  UdpCounters c = readCounters();
+  CHECK(c.frames == frames);
+  CHECK(c.lost == lost);
+  CHECK(c.late == late);
+  CHECK(c.bad == bad);
+}
+
+static void connect(uint8_t connection, const char *cmds) {
+  BufferStream greeting;
+  asyncConnected(greeting, connection);
+  CHECK(greeting.available() > 0);
+  BufferStream cmd;
+  cmd.print(cmds);
+  asyncDataReceived(cmd, connection);
+}
+
+// connection 1 asks for binary frames every 5ms, connection 0 keeps CSV every 1ms
+static void checkPerConnectionTelemetry() {
+  connect(1, "x i5\n");
+  unsigned long lastFrame_ms = millis();
+  BufferStream out[2];
+  uint32_t csvLines = 0;
+  uint32_t frames = 0;
+  for (int i = 0; i < 12; i++) {
+    delay(1);
+    runLoop(out, 2);
+    if (out[0].available()) {
+      CHECK(out[0].getBuffer()[out[0].available() - 1] == '\n');
+      csvLines++;
+    }
+    if (out[1].available()) {
+      const uint8_t *frame = (const uint8_t *)out[1].getBuffer();
+      CHECK(frame[0] == TelemetryFrame::SYNC);
+      uint16_t fieldsLen = frame[2] | (frame[3] << 8);
+      CHECK(out[1].available() == (int)(TelemetryFrame::HEADER_LEN + fieldsLen + 2));
+      CHECK((millis() - lastFrame_ms) >= 5);
+      lastFrame_ms = millis();
+      frames++;
+    }
+  }
+  CHECK(csvLines == 12); // each delay(1) is at least the 1ms interval
+  CHECK(frames >= 1);
+  asyncDisconnected(1);
+  delay(5);
+  runLoop(out, 2);
+  CHECK(out[1].available() == 0); // no telemetry once disconnected
+}
+
+int main() {
+  asyncSetup();
+  connect(0, "c i1\n"); // CSV telemetry every 1ms
+  checkCounters(0, 0, 0, 0);
+
+  sendFrame(10, 100, 1000); // the first frame is always used
+  CHECK(gotFrame(10, 100, 1000));
+  sendFrame(11, 110, 1100);
+  CHECK(gotFrame(11, 110, 1100));
+  checkCounters(2, 0, 0, 0);
+
+  sendFrame(14, 140, 1400); // 12 and 13 lost
+  CHECK(gotFrame(14, 140, 1400));
+  checkCounters(3, 2, 0, 0);
+
+  sendFrame(13, 130, 1500); // late, after 14
+  sendFrame(14, 140, 1600); // repeated
+  CHECK(!gotFrame(14, 140, 1600)); // neither reaches loop()
+  checkCounters(3, 2, 2, 0);
+
+  sendFrame(15, 150, 1700, FRAME_LEN - 1); // wrong length
+  sendFrame(15, 150, 1700, FRAME_LEN + 4);
+  CHECK(!gotFrame(15, 150, 1700));
+  checkCounters(3, 2, 2, 2);
+
+  sendFrame(15, 150, 1800); // the bad ones did not use up seq 15
+  CHECK(gotFrame(15, 150, 1800));
+  sendFrame(15 - 1000, 0, 1900); // a jump back of 1000 is still late
+  CHECK(!gotFrame(15 - 1000, 0, 1900));
+  checkCounters(4, 2, 3, 2);
+
+  sendFrame(15 - 1001, 50, 2000); // more than 1000 back, the sender restarted
+  CHECK(gotFrame(15 - 1001, 50, 2000));
+  sendFrame(15 - 1000, 60, 2100);
+  CHECK(gotFrame(15 - 1000, 60, 2100));
+  checkCounters(6, 2, 3, 2);
+
+  // the restart was to 0xfffffc1c, carry on through the seq wrap at 0
+  unsigned long frames = 6;
+  for (uint32_t seq = 15 - 999; seq != 3; seq++) {
+    sendFrame(seq, 70, 2200);
+    frames++;
+  }
+  CHECK(gotFrame(2, 70, 2200));
+  checkCounters(frames, 2, 3, 2);
+  sendFrame(0xffffffff, 80, 2300); // late across the wrap
+  CHECK(!gotFrame(0xffffffff, 80, 2300));
+  checkCounters(frames, 2, 4, 2);
+
+  checkPerConnectionTelemetry();
+  return checkExitCode("test_udp_setpoints");
+}
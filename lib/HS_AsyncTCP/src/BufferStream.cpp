@@ -7,58 +7,108 @@
 #include "BufferStream.h"
 
 BufferStream::BufferStream() {
-  sfPtr = new SafeString(sizeof(buffer), buffer, NULL);
+  clear();
 }
 
 BufferStream::~BufferStream() {
-  delete sfPtr;
 }
 
 void BufferStream::clear() {
-  sfPtr->clear();
+  readIdx = 0;
+  writeIdx = 0;
+  buffer[0] = '\0';
+}
+
+void BufferStream::remove(size_t count) {
+  size_t len = writeIdx - readIdx;
+  if (count >= len) {
+    clear();
+  } else {
+    readIdx += count;
+  }
+}
+
+void BufferStream::remove(size_t index, size_t count) {
+  size_t len = writeIdx - readIdx;
+  if (index >= len) {
+    return;
+  }
+  if (index == 0) {
+    remove(count);
+    return;
+  }
+  if (count > (len - index)) {
+    count = len - index;
+  }
+  char *start = buffer + readIdx + index;
+  memmove(start, start + count, len - index - count + 1); // + 1 for the '\0'
+  writeIdx -= count;
 }
 
 const char* BufferStream::getBuffer() {
-  return sfPtr->c_str(); // null terminated
+  return buffer + readIdx; // null terminated
 }
 
 int BufferStream::availableForWrite() {
-  return (sfPtr->availableForWrite());
+  return BUFFER_SIZE - (writeIdx - readIdx);
 }
 
 size_t BufferStream::write(const uint8_t *data, size_t size) {
-  if (data && size) {
-    sfPtr->readFrom((char*)data, size);
-    return size;
+  if ((!data) || (!size)) {
+    return 0;
+  }
+  if ((BUFFER_SIZE - writeIdx) < size) {
+    // move the unread chars to the front to make room
+    size_t len = writeIdx - readIdx;
+    if (readIdx) {
+      memmove(buffer, buffer + readIdx, len);
+      readIdx = 0;
+      writeIdx = len;
+    }
+    if ((BUFFER_SIZE - writeIdx) < size) {
+      size = BUFFER_SIZE - writeIdx; // full, keep what fits
+    }
   }
-  return 0;
+  memcpy(buffer + writeIdx, data, size);
+  writeIdx += size;
+  buffer[writeIdx] = '\0';
+  return size;
 }
 
 size_t BufferStream::write(uint8_t data) {
-  sfPtr->concat((char)data);
-  return 1;
+  return write(&data, 1);
 }
 
 int BufferStream::available() {
-  return sfPtr->length();
+  return writeIdx - readIdx;
 }
 
 int BufferStream::read() {
-  if (sfPtr->length()) {
-    char c = sfPtr->charAt(0);
-    sfPtr->remove(0, 1);
-    return c;
+  if (readIdx == writeIdx) {
+    return -1;
+  }
+  char c = buffer[readIdx++];
+  if (readIdx == writeIdx) {
+    clear(); // all read, start again at the front
+  }
+  return (uint8_t)c;
+}
 
+size_t BufferStream::readBytes(char *data, size_t length) {
+  size_t len = writeIdx - readIdx;
+  if (length > len) {
+    length = len;
   }
-  return -1;
+  memcpy(data, buffer + readIdx, length);
+  remove(length);
+  return length;
 }
 
 int BufferStream::peek() {
-  if (sfPtr->length()) {
-    char c = sfPtr->charAt(0);
-    return c;
+  if (readIdx == writeIdx) {
+    return -1;
   }
-  return -1;
+  return (uint8_t)buffer[readIdx];
 }
 
 void BufferStream::flush() {
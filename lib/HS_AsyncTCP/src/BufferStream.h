@@ -1,19 +1,24 @@
 /**
  BufferStream.h
- Can read/write at most 1600 chars
+ Can read/write at most 1400 chars
  which is sufficient for pfodParser and max MTU
+
+ The chars are kept in one linear buffer with a read cursor, so read() is O(1)
+ and getBuffer() always returns the unread chars as one null terminated string.
+ When the buffer is all read the cursor goes back to the start,
+ a write that does not fit after the unread chars first moves them to the start.
 */
 
 #ifndef BufferStream_H_
 #define BufferStream_H_
 
-#include "SafeString.h"
+#include <Arduino.h>
 
 class BufferStream: public Stream  {
 public:
     BufferStream();
     ~BufferStream();
-    size_t write(const uint8_t *buffer, size_t size) override;
+    size_t write(const uint8_t *buffer, size_t size) override; // returns number written, less than size if full
     size_t write(uint8_t data) override;
 
     int available() override;
@@ -21,12 +26,19 @@ public:
     int read() override;
     int peek() override;
     void flush() override;
+    size_t readBytes(char *buffer, size_t length); // bulk read, does not wait
+    size_t readBytes(uint8_t *buffer, size_t length) {
+      return readBytes((char *)buffer, length);
+    }
     void clear();
+    void remove(size_t count); // removes count chars from the front
+    void remove(size_t index, size_t count); // removes count chars starting index chars after the front
     const char* getBuffer(); // null terminated
 protected:
-    char buffer[1400+1]; // add 1 for trailing '\0'
-    SafeString* sfPtr; // = SafeString(maxBufferSize, writeBuffer, NULL);
-
+    const static size_t BUFFER_SIZE = 1400;
+    char buffer[BUFFER_SIZE+1]; // add 1 for trailing '\0'
+    size_t readIdx;  // next char to read
+    size_t writeIdx; // next char to write, buffer[writeIdx] is always '\0'
 };
 
 
@@ -0,0 +1,116 @@
+#ifndef FIXED_POOL_H_
+#define FIXED_POOL_H_
+/*
+   (c)2023 Forward Computing and Control Pty. Ltd.
+   NSW Australia, www.forward.com.au
+   This code is not warranted to be fit for any purpose. You may only use it at your own risk.
+   This code may be freely used for both private and commercial use
+   provided this copyright is maintained.
+*/
+
+#include <atomic>
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+   FixedPool<T, SIZE>
+   SIZE preallocated T's handed out by alloc() and returned by release(), no heap use.
+   alloc() and release() are lock free and can be called from any task on either core.
+   The free list is a stack whose head holds a tag that changes on every push/pop,
+   so a compare-exchange cannot succeed on a head that was popped and pushed back in between (ABA).
+
+   alloc() returns NULL when the pool is empty and counts a failure.
+   SIZE must be < 65535
+*/
+template <class T, uint16_t SIZE>
+class FixedPool {
+  static_assert((SIZE > 0) && (SIZE < 0xffff), "FixedPool SIZE must be 1..65534");
+public:
+  FixedPool() : head(0), inUse(0), highWater(0), failCount(0) {
+    // chain all the items into the free list, index + 1 so 0 is end of list
+    for (uint16_t i = 0; i < SIZE; i++) {
+      next[i].store((i + 1 < SIZE) ? (i + 2) : 0, std::memory_order_relaxed);
+    }
+    head.store(1, std::memory_order_release);
+  }
+
+  /**
+     alloc()
+     returns an unused T or NULL if there are none left
+     The T is not cleared.
+  */
+  T *alloc() {
+    uint32_t h = head.load(std::memory_order_acquire);
+    while (true) {
+      uint16_t idx = h & 0xffff;
+      if (idx == 0) {
+        failCount.fetch_add(1, std::memory_order_relaxed);
+        return NULL;
+      }
+      uint32_t newHead = ((h & 0xffff0000) + 0x10000) | next[idx - 1].load(std::memory_order_relaxed);
+      if (head.compare_exchange_weak(h, newHead, std::memory_order_acquire, std::memory_order_acquire)) {
+        uint16_t used = inUse.fetch_add(1, std::memory_order_relaxed) + 1;
+        if (used > highWater.load(std::memory_order_relaxed)) {
+          highWater.store(used, std::memory_order_relaxed); // only approximate if two cores race here
+        }
+        return &items[idx - 1];
+      }
+      // else h now has the current head, try again
+    }
+  }
+
+  /**
+     release(T *item)
+     returns an item from alloc() to the pool
+  */
+  void release(T *item) {
+    uint16_t idx = (item - items) + 1;
+    uint32_t h = head.load(std::memory_order_relaxed);
+    do {
+      next[idx - 1].store(h & 0xffff, std::memory_order_relaxed);
+    } while (!head.compare_exchange_weak(h, ((h & 0xffff0000) + 0x10000) | idx, std::memory_order_release, std::memory_order_relaxed));
+    inUse.fetch_sub(1, std::memory_order_relaxed);
+  }
+
+  /**
+     owns(const void *ptr)
+     returns true if ptr is one of this pool's items
+  */
+  bool owns(const void *ptr) const {
+    return (ptr >= (const void*)items) && (ptr < (const void*)(items + SIZE));
+  }
+
+  /**
+     getInUse()
+     number of items currently allocated
+  */
+  uint16_t getInUse() const {
+    return inUse.load(std::memory_order_relaxed);
+  }
+
+  /**
+     getHighWater()
+     max items allocated at any one time
+  */
+  uint16_t getHighWater() const {
+    return highWater.load(std::memory_order_relaxed);
+  }
+
+  /**
+     getFailCount()
+     number of alloc() calls that returned NULL
+  */
+  uint32_t getFailCount() const {
+    return failCount.load(std::memory_order_relaxed);
+  }
+
+private:
+  T items[SIZE];
+  std::atomic<uint16_t> next[SIZE]; // free list links, index + 1, 0 => end
+  std::atomic<uint32_t> head; // tag << 16 | (index + 1) of first free item
+  std::atomic<uint16_t> inUse;
+  std::atomic<uint16_t> highWater;
+  std::atomic<uint32_t> failCount;
+};
+
+#endif
@@ -3,28 +3,59 @@
 #include "BufferStream.h"
 #include "StreamBuffers.h"
 #include "millisDelay.h"  // from SafeString library
+#include "HS_AsyncTCP.h"
 
 // user code must implement these methods
 extern void asyncSetup();
-extern void asyncConnected(Stream &stream);
-extern void asyncDisconnected();
-extern void asyncDataReceived(Stream &stream);
+extern void asyncConnected(Stream &stream, uint8_t connection);
+extern void asyncDisconnected(uint8_t connection);
+extern void asyncDataReceived(Stream &stream, uint8_t connection);
 extern void asyncLoop(Stream &stream);
 
-static millisDelay connectionTimeout;
 static unsigned long connection_timeout_ms = 0;
 static void connect_cb(void* arg, HS_AsyncClient* newClientPtr);
 static Stream *wifiDebugPtr;
 
 static HS_AsyncServer *serverPtr;
-static HS_AsyncClient* clientPtr; // set to NULL on disconnect
 static volatile bool disconnectNow = false;
 
+// asyncLoop() output is written once to outBuffer and then copied to each client's backlog
+// so a client whose TCP window is full just falls behind, it does not hold up the others
+struct ClientSlot {
+  HS_AsyncClient* clientPtr; // NULL if slot not in use
+  millisDelay connectionTimeout;
+  BufferStream backlog; // records waiting to be sent to this client
+  uint16_t recordLen[ASYNC_SEND_QUEUE_RECORDS]; // length of each record in backlog, oldest at recordHead
+  uint8_t recordHead;
+  uint8_t recordCount;
+  size_t frontSent; // bytes of the oldest record already written, the rest are still in backlog
+  size_t unacked; // bytes written and not yet acked
+  bool holding; // waiting to coalesce a part segment with later records
+  unsigned long holdStart_ms;
+  uint32_t summaryCount; // records dropped since the last  dropped,<count>  line, for ASYNC_SUMMARIZE
+  bool dropping; // last output dropped records
+  unsigned long dropStart_ms;
+  bool slow; // close from loopHandler, not from inside this client's callbacks
+  pbuf *pending; // received but not all used by spanHandler, linked by next, not yet acked
+  size_t pendingOffset; // bytes of the first pending pbuf already used
+};
+static ClientSlot clientSlots[ASYNC_MAX_CLIENTS];
+static const unsigned long SLOW_CLIENT_TIMEOUT_MS = 5000; // close a client that has not kept up for this long
+static const unsigned long COALESCE_MAX_MS = 10; // send a part segment after this long even if still waiting for an ACK
+static uint32_t sentCount = 0;
+static uint32_t droppedCount = 0;
+static uint32_t coalescedCount = 0;
+static uint32_t slowClientCloseCount = 0;
+static AsyncOverflowPolicy overflowPolicy = ASYNC_DROP_NEWEST;
+
 static BufferStream inBuffer;
 static BufferStream outBuffer;
 
 static StreamBuffers streamBuffers(inBuffer, outBuffer);
 
+static AsyncSpanHandler spanHandler = NULL;
+static AsyncConnectionLoopHandler connectionLoopHandler = NULL;
+
 // call this to set connection timeout if sending keepalives
 // else leave as 0 i.e. not connection timeout
 void asyncConnectionTimeout(unsigned long ms_timeout) {
@@ -35,6 +66,40 @@ void setAsyncDebugPtr(Stream *debugPtr) {
   wifiDebugPtr = debugPtr;
 }
 
+void asyncSetOverflowPolicy(AsyncOverflowPolicy policy) {
+  overflowPolicy = policy;
+}
+
+uint32_t asyncSentCount() {
+  return sentCount;
+}
+
+uint32_t asyncDroppedCount() {
+  return droppedCount;
+}
+
+uint32_t asyncCoalescedCount() {
+  return coalescedCount;
+}
+
+uint32_t asyncSlowClientCloseCount() {
+  return slowClientCloseCount;
+}
+
+void asyncSetSpanHandler(AsyncSpanHandler handler) {
+  spanHandler = handler;
+}
+
+void asyncSetConnectionLoopHandler(AsyncConnectionLoopHandler handler) {
+  connectionLoopHandler = handler;
+}
+
+size_t asyncClientCount() {
+  return HS_AsyncServer::getNumClients();
+}
+
+static void loopHandler(void* arg);
+
 bool initAsyncServer(uint16_t port) {
   if (serverPtr) {
     return true; // already done
@@ -45,6 +110,7 @@ bool initAsyncServer(uint16_t port) {
   }
   serverPtr->setNoDelay(true);
   serverPtr->onClient(connect_cb, 0);
+  serverPtr->onLoop(loopHandler, 0);
   return serverPtr->begin();
 }
 
@@ -52,37 +118,264 @@ void asyncCloseConnection() {
   disconnectNow = true;
 }
 
-static void stopClient() {
-  streamBuffers.clear(); // clean up
-  if (clientPtr) {
-    clientPtr->stop();
-    clientPtr = NULL;
+static ClientSlot* findSlot(HS_AsyncClient* client) {
+  for (int i = 0; i < ASYNC_MAX_CLIENTS; i++) {
+    if (clientSlots[i].clientPtr == client) {
+      return &clientSlots[i];
+    }
   }
-  disconnectNow = false;
+  return NULL;
+}
+
+// the connection number passed to the user callbacks
+static uint8_t slotIndex(const ClientSlot &slot) {
+  return &slot - clientSlots;
+}
+
+// the client's disconnect_cb frees the slot
+static void stopClient(ClientSlot &slot) {
+  if (slot.clientPtr) {
+    slot.clientPtr->stop();
+  }
+}
+
+static void clearSendQueue(ClientSlot &slot) {
+  slot.backlog.clear();
+  slot.recordHead = 0;
+  slot.recordCount = 0;
+  slot.frontSent = 0;
+  slot.unacked = 0;
+  slot.holding = false;
+  slot.summaryCount = 0;
+  slot.dropping = false;
 }
 
-static void loopHandler(void* arg, HS_AsyncClient* newClientPtr) {
-  if (connectionTimeout.justFinished() || disconnectNow) {
-    stopClient();
+// send as much of the backlog as the client's TCP window will take, never waits
+// while earlier data is unacked only whole MSS segments are sent, the rest waits upto COALESCE_MAX_MS to be coalesced with later records
+static void sendBacklog(ClientSlot &slot) {
+  HS_AsyncClient* client = slot.clientPtr;
+  if ((!client) || (!slot.backlog.available()) || (!client->connected())) {
+    return;
+  }
+  size_t len = slot.backlog.available();
+  size_t space = client->space();
+  if (space < len) {
+    len = space;
+  }
+  size_t mss = client->getMss();
+  if (slot.unacked && mss) {
+    if (!slot.holding) {
+      slot.holding = true;
+      slot.holdStart_ms = millis();
+    }
+    if ((millis() - slot.holdStart_ms) < COALESCE_MAX_MS) {
+      len -= len % mss;
+    }
+  }
+  if (len == 0) {
+    if (wifiDebugPtr) {
+      wifiDebugPtr->println("skip write as waiting for Ack");
+    }
     return;
   }
+  size_t sent = client->write(slot.backlog.getBuffer(), len);
+  slot.backlog.remove(sent);
+  slot.unacked += sent;
+  if (!slot.backlog.available()) {
+    slot.holding = false;
+  }
+  // count the records completed by this write
+  uint32_t records = 0;
+  while (slot.recordCount && (sent >= (slot.recordLen[slot.recordHead] - slot.frontSent))) {
+    sent -= slot.recordLen[slot.recordHead] - slot.frontSent;
+    slot.frontSent = 0;
+    slot.recordHead = (slot.recordHead + 1) % ASYNC_SEND_QUEUE_RECORDS;
+    slot.recordCount--;
+    records++;
+  }
+  slot.frontSent += sent;
+  sentCount += records;
+  if (records > 1) {
+    coalescedCount += records - 1;
+  }
+}
 
+// add a record to the end of the backlog, returns false if it does not fit
+static bool pushRecord(ClientSlot &slot, const char* data, size_t len) {
+  if ((slot.recordCount >= ASYNC_SEND_QUEUE_RECORDS) || ((size_t)slot.backlog.availableForWrite() < len)) {
+    return false;
+  }
+  slot.backlog.write((const uint8_t*)data, len);
+  slot.recordLen[(slot.recordHead + slot.recordCount) % ASYNC_SEND_QUEUE_RECORDS] = len;
+  slot.recordCount++;
+  return true;
+}
+
+// for ASYNC_DROP_OLDEST, drop the oldest records not yet started until len fits, returns number dropped
+static uint32_t dropOldest(ClientSlot &slot, size_t len) {
+  uint32_t dropped = 0;
+  while ((slot.recordCount >= ASYNC_SEND_QUEUE_RECORDS) || ((size_t)slot.backlog.availableForWrite() < len)) {
+    if (slot.frontSent == 0) {
+      if (slot.recordCount == 0) {
+        break;
+      }
+      slot.backlog.remove(slot.recordLen[slot.recordHead]);
+    } else {
+      // the oldest record is partly sent so must be finished, drop the one after it
+      if (slot.recordCount < 2) {
+        break;
+      }
+      uint8_t second = (slot.recordHead + 1) % ASYNC_SEND_QUEUE_RECORDS;
+      slot.backlog.remove(slot.recordLen[slot.recordHead] - slot.frontSent, slot.recordLen[second]);
+      slot.recordLen[second] = slot.recordLen[slot.recordHead];
+    }
+    slot.recordHead = (slot.recordHead + 1) % ASYNC_SEND_QUEUE_RECORDS;
+    slot.recordCount--;
+    dropped++;
+  }
+  return dropped;
+}
+
+// add data to the client's backlog as one record and send what can be sent now
+// if the backlog is full records are dropped as set by asyncSetOverflowPolicy(), if that goes on the client is closed
+static void queueOutput(ClientSlot &slot, const char* data, size_t len) {
+  if (len) {
+    uint32_t dropped = 0;
+    if ((overflowPolicy == ASYNC_SUMMARIZE) && slot.summaryCount) {
+      char summary[24];
+      int summaryLen = snprintf(summary, sizeof(summary), "dropped,%lu\r\n", (unsigned long)slot.summaryCount);
+      if (pushRecord(slot, summary, summaryLen)) {
+        slot.summaryCount = 0;
+      }
+    }
+    if (overflowPolicy == ASYNC_DROP_OLDEST) {
+      dropped = dropOldest(slot, len);
+    }
+    if (!pushRecord(slot, data, len)) {
+      dropped++;
+      if (overflowPolicy == ASYNC_SUMMARIZE) {
+        slot.summaryCount++;
+      }
+    }
+    droppedCount += dropped;
+    if (!dropped) {
+      slot.dropping = false;
+    } else if (!slot.dropping) {
+      slot.dropping = true;
+      slot.dropStart_ms = millis();
+    } else if ((millis() - slot.dropStart_ms) > SLOW_CLIENT_TIMEOUT_MS) {
+      if (!slot.slow) {
+        slowClientCloseCount++;
+        slot.slow = true;
+      }
+      return;
+    }
+  }
+  sendBacklog(slot);
+}
+
+// offer the pending pbufs to spanHandler, in order, ack each one when it is all used
+static void processPending(ClientSlot &slot) {
+  while (slot.pending && slot.clientPtr && spanHandler) {
+    pbuf *b = slot.pending;
+    size_t len = b->len - slot.pendingOffset;
+    outBuffer.clear();
+    size_t used = spanHandler(((const uint8_t*)b->payload) + slot.pendingOffset, len, streamBuffers, slotIndex(slot));
+    queueOutput(slot, outBuffer.getBuffer(), outBuffer.available());
+    outBuffer.clear();
+    if (used < len) {
+      slot.pendingOffset += used;
+      return; // try the rest next loop
+    }
+    slot.pending = b->next;
+    slot.pendingOffset = 0;
+    b->next = NULL;
+    slot.clientPtr->ackPacket(b); // reopens the TCP window and frees b
+  }
+}
+
+static void freePending(ClientSlot &slot) {
+  while (slot.pending) {
+    pbuf *b = slot.pending;
+    slot.pending = b->next;
+    b->next = NULL;
+    pbuf_free(b);
+  }
+  slot.pendingOffset = 0;
+}
+
+// onPacket handler when there is a spanHandler, called for each pbuf, no copy
+static void packetReceived_cb(void* arg, HS_AsyncClient* client, pbuf *pb) {
+  ClientSlot *slot = findSlot(client);
+  if (!slot) {
+    pbuf_free(pb);
+    return;
+  }
+  if (connection_timeout_ms) {
+    slot->connectionTimeout.restart();
+  }
+  // add to the end of the pending list to keep the order
+  pb->next = NULL;
+  if (!slot->pending) {
+    slot->pending = pb;
+  } else {
+    pbuf *last = slot->pending;
+    while (last->next) {
+      last = last->next;
+    }
+    last->next = pb;
+  }
+  processPending(*slot);
+}
+
+// called once each async task loop, whether or not there is new data
+static void loopHandler(void* arg) {
+  bool anyClient = false;
+  for (int i = 0; i < ASYNC_MAX_CLIENTS; i++) {
+    ClientSlot &slot = clientSlots[i];
+    if (!slot.clientPtr) {
+      continue;
+    }
+    if (slot.slow && wifiDebugPtr) {
+      wifiDebugPtr->println("closing slow client");
+    }
+    if (slot.connectionTimeout.justFinished() || disconnectNow || slot.slow) {
+      stopClient(slot);
+    } else {
+      anyClient = true;
+      processPending(slot); // retry spans the handler could not take last time
+    }
+  }
+  disconnectNow = false;
+  if (!anyClient) {
+    return;
+  }
+
+  // format the output once for all the clients
+  outBuffer.clear();
   asyncLoop(streamBuffers);
   if (wifiDebugPtr) {
     if (outBuffer.available()) {
       wifiDebugPtr->println(outBuffer.getBuffer());
     }
   }
-  if (clientPtr && (clientPtr->connected()) && (clientPtr->canSend())) {
-    if (outBuffer.available()) {
-      clientPtr->write(outBuffer.getBuffer(), outBuffer.available());
-    }
-  } else {
-    if (wifiDebugPtr) {
-      wifiDebugPtr->println("skip write as not connected or waiting for Ack");
+  for (int i = 0; i < ASYNC_MAX_CLIENTS; i++) {
+    if (clientSlots[i].clientPtr) {
+      queueOutput(clientSlots[i], outBuffer.getBuffer(), outBuffer.available());
     }
   }
   outBuffer.clear();
+  if (!connectionLoopHandler) {
+    return;
+  }
+  // then each client's own output
+  for (int i = 0; i < ASYNC_MAX_CLIENTS; i++) {
+    if (clientSlots[i].clientPtr) {
+      connectionLoopHandler(streamBuffers, i);
+      queueOutput(clientSlots[i], outBuffer.getBuffer(), outBuffer.available());
+      outBuffer.clear();
+    }
+  }
 }
 
 // not used
@@ -96,38 +389,41 @@ static void ackHandler(void* arg, HS_AsyncClient* clientPtr, size_t len, uint32_
   if (wifiDebugPtr) {
     wifiDebugPtr->print("got ack len:"); wifiDebugPtr->print(len); wifiDebugPtr->print(" time:"); wifiDebugPtr->println(time);
   }
+  ClientSlot *slot = findSlot(clientPtr);
+  if (!slot) {
+    return;
+  }
   if (connection_timeout_ms) {
-    connectionTimeout.restart();
+    slot->connectionTimeout.restart();
   }
+  slot->unacked = (len < slot->unacked) ? (slot->unacked - len) : 0;
+  sendBacklog(*slot); // window has opened
 }
 
 static void dataRecieved_cb(void*arg, HS_AsyncClient*client, void *data, size_t len) {
   if (wifiDebugPtr) {
     wifiDebugPtr->print("dataRecieved_cb core:"); wifiDebugPtr->println(xPortGetCoreID());
   }
+  ClientSlot *slot = findSlot(client);
+  if (!slot) {
+    return;
+  }
   if (connection_timeout_ms) {
-    connectionTimeout.restart();
+    slot->connectionTimeout.restart();
   }
   inBuffer.clear();
+  outBuffer.clear();
   inBuffer.write((uint8_t*)data, len);
   if (wifiDebugPtr) {
     wifiDebugPtr->println("got data");
     wifiDebugPtr->println(inBuffer.getBuffer());
   }
-  asyncDataReceived(streamBuffers); // may write response msg
+  asyncDataReceived(streamBuffers, slotIndex(*slot)); // may write response msg
   if (wifiDebugPtr) {
     wifiDebugPtr->println(outBuffer.getBuffer());
   }
-  // write response if any
-  if (clientPtr && (clientPtr->connected())) {
-    if (outBuffer.available()) {
-      clientPtr->write(outBuffer.getBuffer(), outBuffer.available());
-    }
-  } else {
-    if (wifiDebugPtr) {
-      wifiDebugPtr->println("skip write as not connected");
-    }
-  }
+  // response, if any, only to the client that sent the cmd
+  queueOutput(*slot, outBuffer.getBuffer(), outBuffer.available());
   outBuffer.clear();
 }
 
@@ -136,25 +432,48 @@ static void disconnect_cb(void* arg, HS_AsyncClient* existingClientPtr) {
   if (wifiDebugPtr) {
     wifiDebugPtr->println("disconnected");
   }
-  connectionTimeout.stop();
-  stopClient(); // cleans up
+  ClientSlot *slot = findSlot(existingClientPtr);
+  if (slot) {
+    slot->clientPtr = NULL;
+    slot->connectionTimeout.stop();
+    clearSendQueue(*slot);
+    slot->slow = false;
+    freePending(*slot);
+  }
   delete existingClientPtr;
-  asyncDisconnected(); // inform user
+  if (slot) {
+    asyncDisconnected(slotIndex(*slot)); // inform user
+  }
 }
 
 static void connect_cb(void* arg, HS_AsyncClient* newClientPtr) {
   if (wifiDebugPtr) {
     wifiDebugPtr->println("got server connect");
   }
+  ClientSlot *slot = findSlot(NULL); // HS_AsyncServer accepts at most ASYNC_MAX_CLIENTS
+  if (!slot) {
+    newClientPtr->stop();
+    delete newClientPtr;
+    return;
+  }
+  slot->clientPtr = newClientPtr;
+  clearSendQueue(*slot);
+  slot->slow = false;
   if (connection_timeout_ms) {
-    connectionTimeout.start(connection_timeout_ms);
-  }
-  clientPtr = newClientPtr;
-  clientPtr->onData(dataRecieved_cb);
-  clientPtr->onDisconnect(disconnect_cb);
-  clientPtr->onAck(ackHandler);
-  //  clientPtr->onPoll(pollHandler); // not used
-  clientPtr->onLoop(loopHandler);
+    slot->connectionTimeout.start(connection_timeout_ms);
+  }
+  slot->pending = NULL;
+  slot->pendingOffset = 0;
+  if (spanHandler) {
+    newClientPtr->onPacket(packetReceived_cb); // zero copy
+  } else {
+    newClientPtr->onData(dataRecieved_cb);
+  }
+  newClientPtr->onDisconnect(disconnect_cb);
+  newClientPtr->onAck(ackHandler);
+  //  newClientPtr->onPoll(pollHandler); // not used
   streamBuffers.clear();
-  asyncConnected(streamBuffers);
+  asyncConnected(streamBuffers, slotIndex(*slot)); // greeting only to this client
+  queueOutput(*slot, outBuffer.getBuffer(), outBuffer.available());
+  outBuffer.clear();
 }
@@ -5,50 +5,153 @@
 
 bool initAsyncServer(uint16_t port);
 
-void asyncCloseConnection();
+void asyncCloseConnection(); // closes all the connections
 void asyncConnectionTimeout(unsigned long msTimeout); // default on startup is 0, never timeout
 
+#ifndef ASYNC_MAX_CLIENTS
+#define ASYNC_MAX_CLIENTS 4 // max connections HS_AsyncServer accepts at one time
+#endif
+
+// up to ASYNC_MAX_CLIENTS (default 4) connections at once, asyncLoop() output goes to all of them
+// The callbacks for a connection are passed its number, 0 .. ASYNC_MAX_CLIENTS-1, to index any per connection state
+size_t asyncClientCount(); // connections open now
+uint32_t asyncSlowClientCloseCount(); // connections closed for dropping output for 5sec
+
+#ifndef ASYNC_SEND_QUEUE_RECORDS
+#define ASYNC_SEND_QUEUE_RECORDS 16 // outputs waiting per connection, also limited to 1400 bytes
+#endif
+
+/**
+ * Each asyncLoop(), asyncConnected() and asyncDataReceived() output is one record in its connection's send queue.
+ * While the connection has data waiting for an ACK, records are held and sent together as full MSS segments,
+ * otherwise they are sent straight away.
+ * When the queue is full the overflow policy decides what is lost
+ *   ASYNC_DROP_NEWEST - the new record (the default)
+ *   ASYNC_DROP_OLDEST - the oldest records not yet started, so the client gets the latest
+ *   ASYNC_SUMMARIZE   - the new record, and a  dropped,<count>  line is queued in their place once there is room
+ */
+enum AsyncOverflowPolicy {
+  ASYNC_DROP_NEWEST,
+  ASYNC_DROP_OLDEST,
+  ASYNC_SUMMARIZE
+};
+void asyncSetOverflowPolicy(AsyncOverflowPolicy policy);
+uint32_t asyncSentCount(); // records handed to TCP
+uint32_t asyncDroppedCount(); // records dropped because the connection's send queue was full
+uint32_t asyncCoalescedCount(); // records sent in the same TCP write as the record before them
+
+/**
+ * asyncSetSpanHandler(AsyncSpanHandler handler)
+ * Optional zero copy receive, call before initAsyncServer(), NULL to go back to asyncDataReceived()
+ * Instead of copying the received data into the asyncDataReceived() Stream,
+ * handler is called with each received lwIP pbuf's payload in place, a contiguous span of bytes.
+ * The handler returns how many bytes it used. The pbuf is only acknowledged (freed and the TCP window reopened)
+ * when all of it has been used. If the handler uses less, the rest is offered again on the next async loop,
+ * so a handler whose downstream queue is full can just return 0 and the sender is slowed down by TCP.
+ * A frame may be split across spans, so the handler keeps its own decode state between calls, one for each connection.
+ * Text written to out is sent to just the connection the data came from.
+ * Runs on WiFi core 0, in HS_Async thread (task), like asyncDataReceived()
+ * e.g.
+ * size_t spanHandler(const uint8_t *data, size_t len, Stream &out, uint8_t connection) {
+ *   size_t used = 0;
+ *   while ((used < len) && decoders[connection].add(data[used])) { used++; }
+ *   return used;
+ * }
+ */
+typedef size_t (*AsyncSpanHandler)(const uint8_t *data, size_t len, Stream &out, uint8_t connection);
+void asyncSetSpanHandler(AsyncSpanHandler handler);
+
+/**
+ * asyncSetConnectionLoopHandler(AsyncConnectionLoopHandler handler)
+ * Optional, NULL (the default) for none
+ * handler is called after each asyncLoop(), once for each open connection.
+ * Text written to out is sent to just that connection, e.g. results in the format, or at the rate, that client asked for.
+ * Runs on WiFi core 0, in HS_Async thread (task), like asyncLoop()
+ */
+typedef void (*AsyncConnectionLoopHandler)(Stream &out, uint8_t connection);
+void asyncSetConnectionLoopHandler(AsyncConnectionLoopHandler handler);
+
+/**
+ * The HS_Async task sleeps until it has something to do, then handles any lwIP events and calls asyncLoop()
+ * It is woken by
+ *   ASYNC_WAKE_LWIP   - lwIP queued an event (data received, sent data acked, connect/disconnect ..)
+ *   ASYNC_WAKE_NOTIFY - asyncNotify() was called, e.g. from loop() when it has a new result to send
+ *   ASYNC_WAKE_TIMER  - the periodic timer, every asyncLoopInterval() us
+ * One wake can have more than one reason.
+ */
+enum AsyncWakeReason {
+  ASYNC_WAKE_LWIP,
+  ASYNC_WAKE_NOTIFY,
+  ASYNC_WAKE_TIMER,
+  ASYNC_WAKE_REASONS // number of reasons
+};
+void asyncLoopInterval(uint32_t us); // periodic asyncLoop() call, default 1000us, 0 for none
+void asyncNotify(); // wake the HS_Async task, can be called from any task (not an ISR), calls before it wakes only count once
+uint32_t asyncWakeCount(AsyncWakeReason reason); // times woken for this reason
+uint32_t asyncWakeBusyMicros(AsyncWakeReason reason); // us spent handling wakes, each wake counted under its first reason
+
+/**
+ * initAsyncUdp(uint16_t port, AsyncUdpHandler handler)
+ * Also listen for UDP datagrams on port, e.g. setpoints streamed by motion sim software
+ * handler is called with each datagram, in the HS_Async task like asyncDataReceived(),
+ * rx_us is micros() when lwIP received it. The data is freed on return.
+ * UDP has no ACKs or resends, so datagrams may be lost, repeated or out of order, the handler must check.
+ * Datagrams are dropped instead of waiting when the event queue is full, see asyncUdpDroppedCount()
+ * Only one UDP port, returns false if already called or the bind fails.
+ */
+typedef void (*AsyncUdpHandler)(const uint8_t *data, size_t len, uint32_t rx_us);
+bool initAsyncUdp(uint16_t port, AsyncUdpHandler handler);
+uint32_t asyncUdpDroppedCount(); // datagrams dropped because the event queue or pool was full
+
+// lwIP event packets come from a fixed pool, these show if it is big enough
+uint16_t asyncEventPoolHighWater(); // max packets in use at one time
+uint32_t asyncEventPoolFailCount(); // times the pool was empty and the heap was used instead
+uint32_t asyncStaleEventCount(); // lwIP events discarded because their connection had closed
+
 // ============= Start of methods that need to be implemented by user =====================
 
 void setAsyncDebugPtr(Stream *debugPtr);
 /**
  * Your code MUST implement these 3 methods
-  void asyncConnected(Stream &stream); 
-  void asyncDisconnected(); 
-  void asyncDataReceived(Stream &stream); 
+  void asyncConnected(Stream &stream, uint8_t connection); 
+  void asyncDisconnected(uint8_t connection); 
+  void asyncDataReceived(Stream &stream, uint8_t connection); 
   void asyncLoop(Stream &stream); 
  */
 
 /**
  * asyncConnected
  * runs on WiFi core 0, in HS_Async thread (task). Use volatiles to interact with your Arduino loop() code
- * Called on new connection
- * Text written to stream sent on return from this method.
+ * Called on each new connection, connection is its number, 0 .. ASYNC_MAX_CLIENTS-1, reset any state kept for it here
+ * Text written to stream sent to just the new connection on return from this method.
  */
-void asyncConnected(Stream &stream);  
+void asyncConnected(Stream &stream, uint8_t connection);  
 
 /**
  * asyncDisconnected
  * runs on WiFi core 0, in HS_Async thread (task). Use volatiles to interact with your Arduino loop() code
  * Called when connection closed, either by other side or by your code calling asyncCloseConnection();
- * Text written to stream sent on return from this method.
+ * connection is the number that was passed to asyncConnected(), it can be reused by the next new connection
  */
-void asyncDisconnected(); 
+void asyncDisconnected(uint8_t connection); 
 
 /**
  * asyncDataReceived
  * runs on WiFi core 0, in HS_Async thread (task). Use volatiles to interact with your Arduino loop() code
  * Called on when data received from WiFi connection.
  * All incoming data should be processed in this method. Any unprocessed data will be discared on return from this method
- * Text written to stream sent on return from this method.
+ * Text written to stream sent to just the connection the data came from on return from this method.
+ * connection is the number of the connection the data came from, data from other connections may arrive in between
+ * so keep any partly parsed state for each connection.
  */
-void asyncDataReceived(Stream &stream); 
+void asyncDataReceived(Stream &stream, uint8_t connection); 
 
 /**
  * asyncLoop
  * runs on WiFi core 0, in HS_Async thread (task). Use volatiles to interact with your Arduino loop() code
- * Called on average every 1.5ms but can be upto 20ms between calls if the WiFi is busy
- * Text written to stream sent on return from this method.
+ * Called every time the task wakes, i.e. after lwIP events, on asyncNotify() and every asyncLoopInterval() us
+ * Text written to stream sent to every connection on return from this method.
+ * Use asyncSetConnectionLoopHandler() for output that differs between connections.
  */
 void asyncLoop(Stream &stream); 
 
@@ -22,23 +22,24 @@
 #include "Arduino.h"
 
 #include "HS_AsyncTCP_base.h"
+#include "HS_AsyncTCP.h"
+#include "FixedPool.h"
+#include "HandleTable.h"
 extern "C" {
 #include "lwip/opt.h"
 #include "lwip/tcp.h"
 #include "lwip/inet.h"
 #include "lwip/dns.h"
+#include "lwip/udp.h"
 #include "lwip/err.h"
 }
 #include "esp_task_wdt.h"
+#include "esp_timer.h"
 
-//#define DEBUG
-#ifdef DEBUG
-#define ets_printf Serial.printf
-#else
-#define ets_printf (void)
-#endif
+#include "HS_AsyncTrace.h" // set ASYNC_LOG_LEVEL build flag for event tracing
 
-HS_AsyncClient* HS_AsyncServer::clientPtr = NULL;
+HS_AsyncClient* HS_AsyncServer::clientPtrs[ASYNC_MAX_CLIENTS];
+HS_AsyncServer* HS_AsyncServer::_loopServerPtr = NULL;
 extern void asyncSetup();
 
 /*
@@ -46,7 +47,7 @@ extern void asyncSetup();
  * */
 
 typedef enum {
-  LWIP_TCP_SENT, LWIP_TCP_RECV, LWIP_TCP_FIN, LWIP_TCP_ERROR, LWIP_TCP_POLL, LWIP_TCP_CLEAR, LWIP_TCP_ACCEPT, LWIP_TCP_CONNECTED, LWIP_TCP_DNS
+  LWIP_TCP_SENT, LWIP_TCP_RECV, LWIP_TCP_FIN, LWIP_TCP_ERROR, LWIP_TCP_POLL, LWIP_TCP_CLEAR /* no longer sent, kept so trace event numbers do not change */, LWIP_TCP_ACCEPT, LWIP_TCP_CONNECTED, LWIP_TCP_DNS, LWIP_UDP_RECV
 } lwip_event_t;
 
 typedef struct {
@@ -83,15 +84,37 @@ typedef struct {
       const char * name;
       ip_addr_t addr;
     } dns;
+    struct {
+      pbuf * pb;
+      uint32_t time_us; // micros() when lwIP received it
+    } udp;
   };
 } lwip_event_packet_t;
 
+static const int _async_queue_length = 32;
 static xQueueHandle _async_queue;
+// event packets are taken from this pool instead of malloc()
+// queue length + the one being handled + ones held by lwIP callbacks waiting on a full queue
+static FixedPool<lwip_event_packet_t, _async_queue_length + 4> _event_pool;
 static TaskHandle_t _async_service_task_handle = NULL;
+// client events carry a handle from here instead of the HS_AsyncClient*
+// + 4 for clients refused when the server is full and outgoing clients
+static HandleTable<HS_AsyncClient, ASYNC_MAX_CLIENTS + 4> _client_handles;
+static uint32_t _stale_event_count = 0;
+
+// the async task blocks on its task notification, these bits say why it woke
+static const uint32_t _WAKE_LWIP_BIT = 1 << ASYNC_WAKE_LWIP;
+static const uint32_t _WAKE_NOTIFY_BIT = 1 << ASYNC_WAKE_NOTIFY;
+static const uint32_t _WAKE_TIMER_BIT = 1 << ASYNC_WAKE_TIMER;
+static std::atomic<bool> _notify_pending(false); // asyncNotify() only notifies once per wake
+static esp_timer_handle_t _loop_timer = NULL;
+static uint32_t _loop_interval_us = 1000;
+static volatile uint32_t _wake_count[ASYNC_WAKE_REASONS];
+static volatile uint32_t _wake_busy_us[ASYNC_WAKE_REASONS];
 
 
 SemaphoreHandle_t _slots_lock;
-const int _number_of_closed_slots = 1;//CONFIG_LWIP_MAX_ACTIVE_TCP;
+const int _number_of_closed_slots = ASYNC_MAX_CLIENTS;//CONFIG_LWIP_MAX_ACTIVE_TCP;
 static uint32_t _closed_slots[_number_of_closed_slots];
 static uint32_t _closed_index = []() {
   _slots_lock = xSemaphoreCreateBinary();
@@ -106,7 +129,7 @@ static uint32_t _closed_index = []() {
 
 static inline bool _init_async_event_queue() {
   if(!_async_queue) {
-    _async_queue = xQueueCreate(32, sizeof(lwip_event_packet_t *));
+    _async_queue = xQueueCreate(_async_queue_length, sizeof(lwip_event_packet_t *));
     if(!_async_queue) {
       return false;
     }
@@ -114,102 +137,202 @@ static inline bool _init_async_event_queue() {
   return true;
 }
 
+/*
+ * returns a packet from _event_pool, or from the heap if the pool is empty (counted in asyncEventPoolFailCount())
+ * */
+static inline lwip_event_packet_t * _alloc_async_event() {
+  lwip_event_packet_t * e = _event_pool.alloc();
+  if (e == NULL) {
+    e = (lwip_event_packet_t *)malloc(sizeof(lwip_event_packet_t));
+  }
+  return e;
+}
+
+static inline void _free_async_event(lwip_event_packet_t * e) {
+  if (_event_pool.owns(e)) {
+    _event_pool.release(e);
+  } else {
+    free((void*)(e));
+  }
+}
+
+uint16_t asyncEventPoolHighWater() {
+  return _event_pool.getHighWater();
+}
+
+uint32_t asyncEventPoolFailCount() {
+  return _event_pool.getFailCount();
+}
+
+uint32_t asyncStaleEventCount() {
+  return _stale_event_count;
+}
+
+// notify after queuing so an event queued while the task is handling the previous ones still wakes it
+static inline void _wake_async_task(uint32_t bit) {
+  if (_async_service_task_handle) {
+    xTaskNotify(_async_service_task_handle, bit, eSetBits);
+  }
+}
+
 static inline bool _send_async_event(lwip_event_packet_t ** e) {
-  return _async_queue && xQueueSend(_async_queue, e, portMAX_DELAY) == pdPASS;
+  if (_async_queue && xQueueSend(_async_queue, e, portMAX_DELAY) == pdPASS) {
+    _wake_async_task(_WAKE_LWIP_BIT);
+    return true;
+  }
+  return false;
 }
 
 static inline bool _prepend_async_event(lwip_event_packet_t ** e) {
-  return _async_queue && xQueueSendToFront(_async_queue, e, portMAX_DELAY) == pdPASS;
+  if (_async_queue && xQueueSendToFront(_async_queue, e, portMAX_DELAY) == pdPASS) {
+    _wake_async_task(_WAKE_LWIP_BIT);
+    return true;
+  }
+  return false;
 }
 
-static inline bool _get_async_event(lwip_event_packet_t ** e) {
-  return _async_queue && xQueueReceive(_async_queue, e, 1) == pdPASS; // wait one tick lets wdt run 
+// for events that can be lost, never blocks the lwIP thread
+static inline bool _try_send_async_event(lwip_event_packet_t ** e) {
+  if (_async_queue && xQueueSend(_async_queue, e, 0) == pdPASS) {
+    _wake_async_task(_WAKE_LWIP_BIT);
+    return true;
+  }
+  return false;
 }
 
-static bool _remove_events_with_arg(void * arg) {
-  lwip_event_packet_t * first_packet = NULL;
-  lwip_event_packet_t * packet = NULL;
+static inline bool _get_async_event(lwip_event_packet_t ** e) {
+  return _async_queue && xQueueReceive(_async_queue, e, 0) == pdPASS; // never waits, the task waits on its notification
+}
 
-  if(!_async_queue) {
-    return false;
+void asyncNotify() {
+  if (!_async_service_task_handle) {
+    return; // not started yet, it will run asyncLoop() when it does
   }
-  //figure out which is the first packet so we can keep the order
-  while(!first_packet) {
-    if(xQueueReceive(_async_queue, &first_packet, 0) != pdPASS) {
-      return false;
-    }
-    //discard packet if matching
-    if((int)first_packet->arg == (int)arg) {
-      free(first_packet);
-      first_packet = NULL;
-      //return first packet to the back of the queue
-    } else if(xQueueSend(_async_queue, &first_packet, portMAX_DELAY) != pdPASS) {
-      return false;
-    }
+  if (!_notify_pending.exchange(true, std::memory_order_acq_rel)) {
+    _wake_async_task(_WAKE_NOTIFY_BIT);
   }
+}
 
-  while(xQueuePeek(_async_queue, &packet, 0) == pdPASS && packet != first_packet) {
-    if(xQueueReceive(_async_queue, &packet, 0) != pdPASS) {
-      return false;
-    }
-    if((int)packet->arg == (int)arg) {
-      free(packet);
-      packet = NULL;
-    } else if(xQueueSend(_async_queue, &packet, portMAX_DELAY) != pdPASS) {
-      return false;
+static void _loop_timer_cb(void *arg) {
+  _wake_async_task(_WAKE_TIMER_BIT);
+}
+
+static void _start_loop_timer() {
+  if (!_loop_timer) {
+    esp_timer_create_args_t args = {};
+    args.callback = _loop_timer_cb;
+    args.name = "async_loop";
+    if (esp_timer_create(&args, &_loop_timer) != ESP_OK) {
+      ASYNC_LOG_ERROR("async loop timer create failed\n");
+      _loop_timer = NULL;
+      return;
     }
   }
-  return true;
+  esp_timer_stop(_loop_timer); // returns an error if not running, ignore
+  if (_loop_interval_us) {
+    esp_timer_start_periodic(_loop_timer, _loop_interval_us);
+  }
+}
+
+void asyncLoopInterval(uint32_t us) {
+  _loop_interval_us = us;
+  if (_loop_timer) {
+    _start_loop_timer();
+  }
 }
 
+uint32_t asyncWakeCount(AsyncWakeReason reason) {
+  return (reason < ASYNC_WAKE_REASONS) ? _wake_count[reason] : 0;
+}
+
+uint32_t asyncWakeBusyMicros(AsyncWakeReason reason) {
+  return (reason < ASYNC_WAKE_REASONS) ? _wake_busy_us[reason] : 0;
+}
 
 static void _handle_async_loop() {
-    HS_AsyncClient::_s_loop();
+    HS_AsyncServer::_s_loop();
 }
 
+static void _handle_async_udp(lwip_event_packet_t * e);
+
 static void _handle_async_event(lwip_event_packet_t * e) {
+  // only accept and udp events are not for a client, all the rest carry a client handle
+  void * arg = ((e->event == LWIP_TCP_ACCEPT) || (e->event == LWIP_UDP_RECV) || (e->arg == NULL)) ? e->arg : _client_handles.get(e->arg);
   if(e->arg == NULL) {
     // do nothing when arg is NULL
-    ets_printf("event arg == NULL: 0x%08x\n", e->recv.pcb);
-  } else if(e->event == LWIP_TCP_CLEAR) {
-    _remove_events_with_arg(e->arg);
+    ASYNC_LOG_ERROR("event arg == NULL: 0x%08x\n", e->recv.pcb);
+  } else if(arg == NULL) {
+    // the client was closed after this event was queued
+    _stale_event_count++;
+    ASYNC_LOG_DEBUG("stale event %d handle 0x%08x\n", e->event, e->arg);
+    if((e->event == LWIP_TCP_RECV) && e->recv.pb) {
+      pbuf_free(e->recv.pb);
+    }
   } else if(e->event == LWIP_TCP_RECV) {
-    ets_printf("-R: 0x%08x\n", e->recv.pcb);
-    HS_AsyncClient::_s_recv(e->arg, e->recv.pcb, e->recv.pb, e->recv.err);
+    ASYNC_TRACE(e->event, e->recv.pcb, e->recv.pb->tot_len);
+    ASYNC_LOG_DEBUG("-R: 0x%08x\n", e->recv.pcb);
+    HS_AsyncClient::_s_recv(arg, e->recv.pcb, e->recv.pb, e->recv.err);
   } else if(e->event == LWIP_TCP_FIN) {
-    ets_printf("-F: 0x%08x\n", e->fin.pcb);
-    HS_AsyncClient::_s_fin(e->arg, e->fin.pcb, e->fin.err);
+    ASYNC_TRACE(e->event, e->fin.pcb, e->fin.err);
+    ASYNC_LOG_DEBUG("-F: 0x%08x\n", e->fin.pcb);
+    HS_AsyncClient::_s_fin(arg, e->fin.pcb, e->fin.err);
   } else if(e->event == LWIP_TCP_SENT) {
-    ets_printf("-S: 0x%08x\n", e->sent.pcb);
-    HS_AsyncClient::_s_sent(e->arg, e->sent.pcb, e->sent.len);
+    ASYNC_TRACE(e->event, e->sent.pcb, e->sent.len);
+    ASYNC_LOG_DEBUG("-S: 0x%08x\n", e->sent.pcb);
+    HS_AsyncClient::_s_sent(arg, e->sent.pcb, e->sent.len);
   } else if(e->event == LWIP_TCP_POLL) {
-    ets_printf("-P: 0x%08x\n", e->poll.pcb);
-    HS_AsyncClient::_s_poll(e->arg, e->poll.pcb);
+    ASYNC_TRACE(e->event, e->poll.pcb, 0);
+    ASYNC_LOG_DEBUG("-P: 0x%08x\n", e->poll.pcb);
+    HS_AsyncClient::_s_poll(arg, e->poll.pcb);
   } else if(e->event == LWIP_TCP_ERROR) {
-    ets_printf("-E: 0x%08x %d\n", e->arg, e->error.err);
-    HS_AsyncClient::_s_error(e->arg, e->error.err);
+    ASYNC_TRACE(e->event, e->arg, e->error.err);
+    ASYNC_LOG_DEBUG("-E: 0x%08x %d\n", e->arg, e->error.err);
+    HS_AsyncClient::_s_error(arg, e->error.err);
   } else if(e->event == LWIP_TCP_CONNECTED) {
-    ets_printf("C: 0x%08x 0x%08x %d\n", e->arg, e->connected.pcb, e->connected.err);
-    HS_AsyncClient::_s_connected(e->arg, e->connected.pcb, e->connected.err);
+    ASYNC_TRACE(e->event, e->connected.pcb, e->connected.err);
+    ASYNC_LOG_DEBUG("C: 0x%08x 0x%08x %d\n", e->arg, e->connected.pcb, e->connected.err);
+    HS_AsyncClient::_s_connected(arg, e->connected.pcb, e->connected.err);
   } else if(e->event == LWIP_TCP_ACCEPT) {
-    ets_printf("A: 0x%08x 0x%08x\n", e->arg, e->accept.client);
-    HS_AsyncServer::_s_accepted(e->arg, e->accept.client);
+    ASYNC_TRACE(e->event, e->accept.client, 0);
+    ASYNC_LOG_DEBUG("A: 0x%08x 0x%08x\n", e->arg, e->accept.client);
+    HS_AsyncServer::_s_accepted(arg, e->accept.client);
   } else if(e->event == LWIP_TCP_DNS) {
-    ets_printf("D: 0x%08x %s = %s\n", e->arg, e->dns.name, ipaddr_ntoa(&e->dns.addr));
-    HS_AsyncClient::_s_dns_found(e->dns.name, &e->dns.addr, e->arg);
+    ASYNC_TRACE(e->event, e->arg, 0);
+    ASYNC_LOG_DEBUG("D: 0x%08x %s = %s\n", e->arg, e->dns.name, ipaddr_ntoa(&e->dns.addr));
+    HS_AsyncClient::_s_dns_found(e->dns.name, &e->dns.addr, arg);
+  } else if(e->event == LWIP_UDP_RECV) {
+    ASYNC_TRACE(e->event, e->arg, e->udp.pb->tot_len);
+    _handle_async_udp(e);
   }
-  free((void*)(e));
+  _free_async_event(e);
 }
 
 static void _async_service_task(void *pvParameters) {
   lwip_event_packet_t * packet = NULL;
-  static unsigned long lastMillis = millis();
   asyncSetup();
   for (;;) {
-     _handle_async_loop();
-    if(_get_async_event(&packet)) {
+    uint32_t bits = 0;
+    xTaskNotifyWait(0, 0xffffffff, &bits, portMAX_DELAY); // blocked here lets wdt run
+    unsigned long start_us = micros();
+    if (bits & _WAKE_NOTIFY_BIT) {
+      _notify_pending.store(false, std::memory_order_release);
+    }
+    while(_get_async_event(&packet)) {
       _handle_async_event(packet);
     }
+    _handle_async_loop();
+    // the busy time goes to the first reason in lwIP, notify, timer order
+    uint32_t busy_us = micros() - start_us;
+    bool first = true;
+    for (int i = 0; i < ASYNC_WAKE_REASONS; i++) {
+      if (bits & (1 << i)) {
+        _wake_count[i]++;
+        if (first) {
+          _wake_busy_us[i] += busy_us;
+          first = false;
+        }
+      }
+    }
   }
   vTaskDelete(NULL);
   _async_service_task_handle = NULL;
@@ -233,6 +356,7 @@ static bool _start_async_task() {
     if(!_async_service_task_handle) {
       return false;
     }
+    _start_loop_timer();
   }
   return true;
 }
@@ -241,43 +365,42 @@ static bool _start_async_task() {
  * LwIP Callbacks
  * */
 
-static int8_t _tcp_clear_events(void * arg) {
-  lwip_event_packet_t * e = (lwip_event_packet_t *)malloc(sizeof(lwip_event_packet_t));
-  e->event = LWIP_TCP_CLEAR;
-  e->arg = arg;
-  if (!_prepend_async_event(&e)) {
-    free((void*)(e));
-  }
-  return ERR_OK;
-}
-
 static int8_t _tcp_connected(void * arg, tcp_pcb * pcb, int8_t err) {
   //ets_printf("+C: 0x%08x\n", pcb);
-  lwip_event_packet_t * e = (lwip_event_packet_t *)malloc(sizeof(lwip_event_packet_t));
+  lwip_event_packet_t * e = _alloc_async_event();
+  if (e == NULL) {
+    return ERR_MEM;
+  }
   e->event = LWIP_TCP_CONNECTED;
   e->arg = arg;
   e->connected.pcb = pcb;
   e->connected.err = err;
   if (!_prepend_async_event(&e)) {
-    free((void*)(e));
+    _free_async_event(e);
   }
   return ERR_OK;
 }
 
 static int8_t _tcp_poll(void * arg, struct tcp_pcb * pcb) {
   //ets_printf("+P: 0x%08x\n", pcb);
-  lwip_event_packet_t * e = (lwip_event_packet_t *)malloc(sizeof(lwip_event_packet_t));
+  lwip_event_packet_t * e = _alloc_async_event();
+  if (e == NULL) {
+    return ERR_MEM;
+  }
   e->event = LWIP_TCP_POLL;
   e->arg = arg;
   e->poll.pcb = pcb;
   if (!_send_async_event(&e)) {
-    free((void*)(e));
+    _free_async_event(e);
   }
   return ERR_OK;
 }
 
 static int8_t _tcp_recv(void * arg, struct tcp_pcb * pcb, struct pbuf *pb, int8_t err) {
-  lwip_event_packet_t * e = (lwip_event_packet_t *)malloc(sizeof(lwip_event_packet_t));
+  lwip_event_packet_t * e = _alloc_async_event();
+  if (e == NULL) {
+    return ERR_MEM;
+  }
   e->arg = arg;
   if(pb) {
     //ets_printf("+R: 0x%08x\n", pcb);
@@ -291,40 +414,52 @@ static int8_t _tcp_recv(void * arg, struct tcp_pcb * pcb, struct pbuf *pb, int8_
     e->fin.pcb = pcb;
     e->fin.err = err;
     //close the PCB in LwIP thread
-    HS_AsyncClient::_s_lwip_fin(e->arg, e->fin.pcb, e->fin.err);
+    HS_AsyncClient * client = _client_handles.get(arg);
+    if (client) {
+      HS_AsyncClient::_s_lwip_fin(client, e->fin.pcb, e->fin.err);
+    }
   }
   if (!_send_async_event(&e)) {
-    free((void*)(e));
+    _free_async_event(e);
   }
   return ERR_OK;
 }
 
 static int8_t _tcp_sent(void * arg, struct tcp_pcb * pcb, uint16_t len) {
   //ets_printf("+S: 0x%08x\n", pcb);
-  lwip_event_packet_t * e = (lwip_event_packet_t *)malloc(sizeof(lwip_event_packet_t));
+  lwip_event_packet_t * e = _alloc_async_event();
+  if (e == NULL) {
+    return ERR_MEM;
+  }
   e->event = LWIP_TCP_SENT;
   e->arg = arg;
   e->sent.pcb = pcb;
   e->sent.len = len;
   if (!_send_async_event(&e)) {
-    free((void*)(e));
+    _free_async_event(e);
   }
   return ERR_OK;
 }
 
 static void _tcp_error(void * arg, int8_t err) {
   //ets_printf("+E: 0x%08x\n", arg);
-  lwip_event_packet_t * e = (lwip_event_packet_t *)malloc(sizeof(lwip_event_packet_t));
+  lwip_event_packet_t * e = _alloc_async_event();
+  if (e == NULL) {
+    return;
+  }
   e->event = LWIP_TCP_ERROR;
   e->arg = arg;
   e->error.err = err;
   if (!_send_async_event(&e)) {
-    free((void*)(e));
+    _free_async_event(e);
   }
 }
 
 static void _tcp_dns_found(const char * name, struct ip_addr * ipaddr, void * arg) {
-  lwip_event_packet_t * e = (lwip_event_packet_t *)malloc(sizeof(lwip_event_packet_t));
+  lwip_event_packet_t * e = _alloc_async_event();
+  if (e == NULL) {
+    return;
+  }
   //ets_printf("+DNS: name=%s ipaddr=0x%08x arg=%x\n", name, ipaddr, arg);
   e->event = LWIP_TCP_DNS;
   e->arg = arg;
@@ -335,13 +470,13 @@ static void _tcp_dns_found(const char * name, struct ip_addr * ipaddr, void * ar
     memset(&e->dns.addr, 0, sizeof(e->dns.addr));
   }
   if (!_send_async_event(&e)) {
-    free((void*)(e));
+    _free_async_event(e);
   }
 }
 
 //Used to switch out from LwIP thread
 static int8_t _tcp_accept(void * arg, HS_AsyncClient * client) {
-  lwip_event_packet_t * e = (lwip_event_packet_t *)malloc(sizeof(lwip_event_packet_t));
+  lwip_event_packet_t * e = _alloc_async_event();
   if (e == NULL) {
   	return ERR_MEM;
   }
@@ -349,7 +484,7 @@ static int8_t _tcp_accept(void * arg, HS_AsyncClient * client) {
   e->arg = arg;
   e->accept.client = client;
   if (!_prepend_async_event(&e)) {
-    free((void*)(e));
+    _free_async_event(e);
   }
   return ERR_OK;
 }
@@ -578,6 +713,7 @@ HS_AsyncClient::HS_AsyncClient(tcp_pcb* pcb)
   , _rx_since_timeout(0)
   , _ack_timeout(ASYNC_MAX_ACK_TIME)
   , _connect_port(0)
+  , _handle(NULL)
   , prev(NULL)
   , next(NULL) {
   _pcb = pcb;
@@ -585,7 +721,7 @@ HS_AsyncClient::HS_AsyncClient(tcp_pcb* pcb)
   if(_pcb) {
     _allocate_closed_slot();
     _rx_last_packet = millis();
-    tcp_arg(_pcb, this);
+    tcp_arg(_pcb, _alloc_handle());
     tcp_recv(_pcb, &_tcp_recv);
     tcp_sent(_pcb, &_tcp_sent);
     tcp_err(_pcb, &_tcp_error);
@@ -597,6 +733,7 @@ HS_AsyncClient::~HS_AsyncClient() {
   if(_pcb) {
     _close();
   }
+  _free_handle();
   _free_closed_slot();
 }
 
@@ -613,7 +750,7 @@ HS_AsyncClient& HS_AsyncClient::operator=(const HS_AsyncClient& other) {
   _closed_slot = other._closed_slot;
   if (_pcb) {
     _rx_last_packet = millis();
-    tcp_arg(_pcb, this);
+    tcp_arg(_pcb, _alloc_handle());
     tcp_recv(_pcb, &_tcp_recv);
     tcp_sent(_pcb, &_tcp_sent);
     tcp_err(_pcb, &_tcp_error);
@@ -715,7 +852,7 @@ bool HS_AsyncClient::connect(IPAddress ip, uint16_t port) {
     return false;
   }
 
-  tcp_arg(pcb, this);
+  tcp_arg(pcb, _alloc_handle());
   tcp_err(pcb, &_tcp_error);
   tcp_recv(pcb, &_tcp_recv);
   tcp_sent(pcb, &_tcp_sent);
@@ -733,7 +870,7 @@ bool HS_AsyncClient::connect(const char* host, uint16_t port) {
     return false;
   }
 
-  err_t err = dns_gethostbyname(host, &addr, (dns_found_callback)&_tcp_dns_found, this);
+  err_t err = dns_gethostbyname(host, &addr, (dns_found_callback)&_tcp_dns_found, _alloc_handle());
   if(err == ERR_OK) {
     return connect(IPAddress(addr.u_addr.ip4.addr), port);
   } else if(err == ERR_INPROGRESS) {
@@ -827,15 +964,13 @@ int8_t HS_AsyncClient::_close() {
     tcp_recv(_pcb, NULL);
     tcp_err(_pcb, NULL);
     tcp_poll(_pcb, NULL, 0);
-    _tcp_clear_events(this);
+    _free_handle(); // any events still queued for this client are now stale
     err = _tcp_close(_pcb, _closed_slot);
     if(err != ERR_OK) {
       err = abort();
     }
     _pcb = NULL;
-    if(HS_AsyncServer::clientPtr == this) {
-      HS_AsyncServer::clientPtr = NULL;
-    }
+    HS_AsyncServer::_s_removeClient(this);
     if(_discard_cb) {
       _discard_cb(_discard_cb_arg, this);
     }
@@ -843,6 +978,24 @@ int8_t HS_AsyncClient::_close() {
   return err;
 }
 
+// returns this client's lwIP callback arg, NULL if there are no handles left
+void* HS_AsyncClient::_alloc_handle() {
+  if(!_handle) {
+    _handle = _client_handles.add(this);
+    if(!_handle) {
+      ASYNC_LOG_ERROR("no free client handles\n");
+    }
+  }
+  return _handle;
+}
+
+void HS_AsyncClient::_free_handle() {
+  if(_handle) {
+    _client_handles.remove(_handle);
+    _handle = NULL;
+  }
+}
+
 void HS_AsyncClient::_allocate_closed_slot() {
   xSemaphoreTake(_slots_lock, portMAX_DELAY);
   uint32_t closed_slot_min_index = 0;
@@ -899,9 +1052,7 @@ void HS_AsyncClient::_error(int8_t err) {
   if(_error_cb) {
     _error_cb(_error_cb_arg, this, err);
   }
-    if(HS_AsyncServer::clientPtr == this) {
-      HS_AsyncServer::clientPtr = NULL;
-    }
+  HS_AsyncServer::_s_removeClient(this);
   if(_discard_cb) {
     _discard_cb(_discard_cb_arg, this);
   }
@@ -930,10 +1081,8 @@ int8_t HS_AsyncClient::_lwip_fin(tcp_pcb* pcb, int8_t err) {
 
 //In Async Thread
 int8_t HS_AsyncClient::_fin(tcp_pcb* pcb, int8_t err) {
-  _tcp_clear_events(this);
-    if(HS_AsyncServer::clientPtr == this) {
-      HS_AsyncServer::clientPtr = NULL;
-    }
+  _free_handle(); // any events still queued for this client are now stale
+  HS_AsyncServer::_s_removeClient(this);
   if(_discard_cb) {
     _discard_cb(_discard_cb_arg, this);
   }
@@ -1023,9 +1172,7 @@ void HS_AsyncClient::_dns_found(struct ip_addr *ipaddr) {
     if(_error_cb) {
       _error_cb(_error_cb_arg, this, -55);
     }
-    if(HS_AsyncServer::clientPtr == this) {
-      HS_AsyncServer::clientPtr = NULL;
-    }
+    HS_AsyncServer::_s_removeClient(this);
     if(_discard_cb) {
       _discard_cb(_discard_cb_arg, this);
     }
@@ -1274,14 +1421,6 @@ const char * HS_AsyncClient::stateToString() {
   reinterpret_cast<HS_AsyncClient*>(arg)->_dns_found(ipaddr);
 }
 
-int8_t HS_AsyncClient::_s_loop() {
-  if (HS_AsyncServer::clientPtr) {
-      return HS_AsyncServer::clientPtr->_loop();
-  } else {
-      return ERR_OK;
-  }
-}
-
 int8_t HS_AsyncClient::_s_poll(void * arg, struct tcp_pcb * pcb) {
   return reinterpret_cast<HS_AsyncClient*>(arg)->_poll(pcb);
 }
@@ -1321,6 +1460,8 @@ HS_AsyncServer::HS_AsyncServer(IPAddress addr, uint16_t port)
   , _pcb(0)
   , _connect_cb(0)
   , _connect_cb_arg(0)
+  , _loop_cb(0)
+  , _loop_cb_arg(0)
 {}
 
 HS_AsyncServer::HS_AsyncServer(uint16_t port)
@@ -1330,10 +1471,17 @@ HS_AsyncServer::HS_AsyncServer(uint16_t port)
   , _pcb(0)
   , _connect_cb(0)
   , _connect_cb_arg(0)
+  , _loop_cb(0)
+  , _loop_cb_arg(0)
 {}
 
 HS_AsyncServer::~HS_AsyncServer() {
-  clientPtr = NULL;
+  for (int i = 0; i < ASYNC_MAX_CLIENTS; i++) {
+    clientPtrs[i] = NULL;
+  }
+  if (_loopServerPtr == this) {
+    _loopServerPtr = NULL;
+  }
   end();
 }
 
@@ -1342,6 +1490,44 @@ void HS_AsyncServer::onClient(AcConnectHandler cb, void* arg) {
   _connect_cb_arg = arg;
 }
 
+void HS_AsyncServer::onLoop(AsLoopHandler cb, void* arg) {
+  _loop_cb = cb;
+  _loop_cb_arg = arg;
+  _loopServerPtr = this;
+}
+
+size_t HS_AsyncServer::getNumClients() {
+  size_t count = 0;
+  for (int i = 0; i < ASYNC_MAX_CLIENTS; i++) {
+    if (clientPtrs[i]) {
+      count++;
+    }
+  }
+  return count;
+}
+
+// In Async Thread, each client's loop handler then the server's
+// a handler may close a client, so the slots are re-read each time
+int8_t HS_AsyncServer::_s_loop() {
+  for (int i = 0; i < ASYNC_MAX_CLIENTS; i++) {
+    if (clientPtrs[i]) {
+      clientPtrs[i]->_loop();
+    }
+  }
+  if (_loopServerPtr && _loopServerPtr->_loop_cb) {
+    _loopServerPtr->_loop_cb(_loopServerPtr->_loop_cb_arg);
+  }
+  return ERR_OK;
+}
+
+void HS_AsyncServer::_s_removeClient(HS_AsyncClient* client) {
+  for (int i = 0; i < ASYNC_MAX_CLIENTS; i++) {
+    if (clientPtrs[i] == client) {
+      clientPtrs[i] = NULL;
+    }
+  }
+}
+
 bool HS_AsyncServer::begin() {
   if(_pcb) {
     return true;
@@ -1409,12 +1595,20 @@ int8_t HS_AsyncServer::_accept(tcp_pcb* pcb, int8_t err) {
 }
 
 int8_t HS_AsyncServer::_accepted(HS_AsyncClient* client) {
-  if (clientPtr) {
-      client->stop();
-     return ERR_OK;
+  int slot = -1;
+  for (int i = 0; i < ASYNC_MAX_CLIENTS; i++) {
+    if (clientPtrs[i] == NULL) {
+      slot = i;
+      break;
+    }
+  }
+  if (slot < 0) {
+    // full, refuse the new connection, the existing clients keep going
+    client->stop();
+    delete client;
+    return ERR_OK;
   }
-  // else
-  clientPtr = client;
+  clientPtrs[slot] = client;
   if(_connect_cb) {
     _connect_cb(_connect_cb_arg, client);
   }
@@ -1443,3 +1637,97 @@ int8_t HS_AsyncServer::_s_accept(void * arg, tcp_pcb * pcb, int8_t err) {
 int8_t HS_AsyncServer::_s_accepted(void *arg, HS_AsyncClient* client) {
   return reinterpret_cast<HS_AsyncServer*>(arg)->_accepted(client);
 }
+
+/*
+  Async UDP listener
+ */
+
+static udp_pcb * _udp_pcb = NULL;
+static AsyncUdpHandler _udp_handler = NULL;
+static uint32_t _udp_dropped_count = 0;
+static const size_t _UDP_MAX_LEN = 512; // longer datagrams are truncated if lwIP split them into a pbuf chain
+
+//In LwIP Thread
+static void _udp_recv(void * arg, udp_pcb * pcb, pbuf * pb, const ip_addr_t * addr, u16_t port) {
+  lwip_event_packet_t * e = _alloc_async_event();
+  if (e == NULL) {
+    _udp_dropped_count++;
+    pbuf_free(pb);
+    return;
+  }
+  e->event = LWIP_UDP_RECV;
+  e->arg = pcb;
+  e->udp.pb = pb;
+  e->udp.time_us = micros();
+  if (!_try_send_async_event(&e)) {
+    // the queue is full, drop it rather than hold up lwIP, a later datagram will replace it
+    _udp_dropped_count++;
+    pbuf_free(pb);
+    _free_async_event(e);
+  }
+}
+
+//In Async Thread
+static void _handle_async_udp(lwip_event_packet_t * e) {
+  pbuf * pb = e->udp.pb;
+  if (_udp_handler) {
+    if (pb->len == pb->tot_len) {
+      _udp_handler((const uint8_t *)pb->payload, pb->len, e->udp.time_us);
+    } else {
+      static uint8_t data[_UDP_MAX_LEN];
+      size_t len = pbuf_copy_partial(pb, data, sizeof(data), 0);
+      _udp_handler(data, len, e->udp.time_us);
+    }
+  }
+  pbuf_free(pb);
+}
+
+typedef struct {
+  struct tcpip_api_call_data call;
+  udp_pcb * pcb;
+  uint16_t port;
+  int8_t err;
+} udp_api_call_t;
+
+static err_t _udp_listen_api(struct tcpip_api_call_data *api_call_msg) {
+  udp_api_call_t * msg = (udp_api_call_t *)api_call_msg;
+  msg->pcb = udp_new();
+  if (!msg->pcb) {
+    msg->err = ERR_MEM;
+    return msg->err;
+  }
+  msg->err = udp_bind(msg->pcb, IP_ADDR_ANY, msg->port);
+  if (msg->err != ERR_OK) {
+    udp_remove(msg->pcb);
+    msg->pcb = NULL;
+    return msg->err;
+  }
+  udp_recv(msg->pcb, &_udp_recv, NULL);
+  return msg->err;
+}
+
+bool initAsyncUdp(uint16_t port, AsyncUdpHandler handler) {
+  if (_udp_pcb) {
+    return false; // only one listener
+  }
+  if (!_start_async_task()) {
+    log_e("failed to start task");
+    return false;
+  }
+  _udp_handler = handler;
+  udp_api_call_t msg;
+  msg.pcb = NULL;
+  msg.port = port;
+  msg.err = ERR_OK;
+  tcpip_api_call(_udp_listen_api, (struct tcpip_api_call_data*)&msg);
+  if (!msg.pcb) {
+    log_e("udp bind to port %d failed: %d", port, msg.err);
+    return false;
+  }
+  _udp_pcb = msg.pcb;
+  return true;
+}
+
+uint32_t asyncUdpDroppedCount() {
+  return _udp_dropped_count;
+}
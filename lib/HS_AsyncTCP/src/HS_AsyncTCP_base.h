@@ -25,6 +25,7 @@
 #include "IPAddress.h"
 #include "sdkconfig.h"
 #include <functional>
+#include "HS_AsyncTCP.h" // for ASYNC_MAX_CLIENTS
 extern "C" {
 #include "freertos/semphr.h"
 #include "lwip/pbuf.h"
@@ -37,6 +38,7 @@ extern "C" {
 //#define CONFIG_ASYNC_TCP_USE_WDT 1 //if enabled, adds between 33us and 200us per event
 //#endif
 
+
 class HS_AsyncClient;
 
 #define ASYNC_MAX_ACK_TIME 5000
@@ -50,6 +52,7 @@ typedef std::function<void(void*, HS_AsyncClient*, int8_t error)> AcErrorHandler
 typedef std::function<void(void*, HS_AsyncClient*, void *data, size_t len)> AcDataHandler;
 typedef std::function<void(void*, HS_AsyncClient*, struct pbuf *pb)> AcPacketHandler;
 typedef std::function<void(void*, HS_AsyncClient*, uint32_t time)> AcTimeoutHandler;
+typedef std::function<void(void*)> AsLoopHandler;
 
 struct tcp_pcb;
 struct ip_addr;
@@ -132,7 +135,6 @@ public:
   const char * stateToString();
 
   //Do not use any of the functions below!
-  static int8_t _s_loop();
   static int8_t _s_poll(void *arg, struct tcp_pcb *tpcb);
   static int8_t _s_recv(void *arg, struct tcp_pcb *tpcb, struct pbuf *pb, int8_t err);
   static int8_t _s_fin(void *arg, struct tcp_pcb *tpcb, int8_t err);
@@ -143,6 +145,7 @@ public:
   static void _s_dns_found(const char *name, struct ip_addr *ipaddr, void *arg);
 
   int8_t _recv(tcp_pcb* pcb, pbuf* pb, int8_t err);
+  int8_t _loop(); // called by HS_AsyncServer::_s_loop()
   tcp_pcb * pcb() {
     return _pcb;
   }
@@ -178,12 +181,14 @@ protected:
   uint32_t _ack_timeout;
   uint16_t _connect_port;
 
+  void* _handle; // given to lwIP as the callback arg instead of this, so events queued after _close() can be seen to be stale
+  void* _alloc_handle();
+  void _free_handle();
   int8_t _close();
   void _free_closed_slot();
   void _allocate_closed_slot();
   int8_t _connected(void* pcb, int8_t err);
   void _error(int8_t err);
-  int8_t _loop();
   int8_t _poll(tcp_pcb* pcb);
   int8_t _sent(tcp_pcb* pcb, uint16_t len);
   int8_t _fin(tcp_pcb* pcb, int8_t err);
@@ -207,11 +212,17 @@ public:
   void setNoDelay(bool nodelay);
   bool getNoDelay();
   uint8_t status();
-  static HS_AsyncClient* clientPtr;
+  // called once each time round the async task loop, after each client's onLoop handler
+  void onLoop(AsLoopHandler cb, void* arg);
+  // the connected clients, NULL for unused slots
+  static HS_AsyncClient* clientPtrs[ASYNC_MAX_CLIENTS];
+  static size_t getNumClients();
 
   //Do not use any of the functions below!
   static int8_t _s_accept(void *arg, tcp_pcb* newpcb, int8_t err);
   static int8_t _s_accepted(void *arg, HS_AsyncClient* client);
+  static int8_t _s_loop();
+  static void _s_removeClient(HS_AsyncClient* client);
 
 protected:
   uint16_t _port;
@@ -220,6 +231,9 @@ protected:
   tcp_pcb* _pcb;
   AcConnectHandler _connect_cb;
   void* _connect_cb_arg;
+  AsLoopHandler _loop_cb;
+  void* _loop_cb_arg;
+  static HS_AsyncServer* _loopServerPtr; // the server with an onLoop handler
 
   int8_t _accept(tcp_pcb* newpcb, int8_t err);
   int8_t _accepted(HS_AsyncClient* client);
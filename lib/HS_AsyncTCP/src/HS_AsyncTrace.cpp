@@ -0,0 +1,71 @@
+/*
+   (c)2023 Forward Computing and Control Pty. Ltd.
+   NSW Australia, www.forward.com.au
+   This code is not warranted to be fit for any purpose. You may only use it at your own risk.
+   This code may be freely used for both private and commercial use
+   provided this copyright is maintained.
+*/
+// HS_AsyncTrace.cpp
+#include "HS_AsyncTrace.h"
+
+#if ASYNC_LOG_LEVEL >= ASYNC_LOG_LEVEL_TRACE
+// the records are only written and read in the HS_AsyncTCP task, so no locking
+static AsyncTraceRecord traceRing[ASYNC_TRACE_SIZE];
+static uint32_t traceHead = 0; // next record to write
+static uint32_t traceTail = 0; // oldest record not yet dumped
+static uint32_t traceOverwriteCount = 0;
+
+void asyncTraceRecord(uint8_t event, const void *pcb, uint16_t len) {
+  if ((traceHead - traceTail) >= ASYNC_TRACE_SIZE) {
+    traceTail++; // drop the oldest
+    traceOverwriteCount++;
+  }
+  AsyncTraceRecord &r = traceRing[traceHead & (ASYNC_TRACE_SIZE - 1)];
+  r.time_us = micros();
+  r.pcb = (uint32_t)(uintptr_t)pcb;
+  r.len = len;
+  r.event = event;
+  r.spare = 0;
+  traceHead++;
+}
+
+size_t asyncTraceDump(Print &out, size_t maxRecords) {
+  size_t count = 0;
+  while ((traceTail != traceHead) && (count < maxRecords)) {
+    const AsyncTraceRecord &r = traceRing[traceTail & (ASYNC_TRACE_SIZE - 1)];
+    out.print(r.time_us);
+    out.print(',');
+    out.print(r.event);
+    out.print(",0x");
+    out.print(r.pcb, HEX);
+    out.print(',');
+    out.println(r.len);
+    traceTail++;
+    count++;
+  }
+  return count;
+}
+
+uint32_t asyncTraceOverwriteCount() {
+  return traceOverwriteCount;
+}
+
+#else
+// tracing not enabled
+
+void asyncTraceRecord(uint8_t event, const void *pcb, uint16_t len) {
+  (void)event;
+  (void)pcb;
+  (void)len;
+}
+
+size_t asyncTraceDump(Print &out, size_t maxRecords) {
+  (void)out;
+  (void)maxRecords;
+  return 0;
+}
+
+uint32_t asyncTraceOverwriteCount() {
+  return 0;
+}
+#endif
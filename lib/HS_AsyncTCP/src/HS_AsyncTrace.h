@@ -0,0 +1,88 @@
+#ifndef HS_ASYNC_TRACE_H_
+#define HS_ASYNC_TRACE_H_
+/*
+   (c)2023 Forward Computing and Control Pty. Ltd.
+   NSW Australia, www.forward.com.au
+   This code is not warranted to be fit for any purpose. You may only use it at your own risk.
+   This code may be freely used for both private and commercial use
+   provided this copyright is maintained.
+*/
+
+#include <Arduino.h>
+
+/**
+   Logging and tracing for HS_AsyncTCP
+   Set ASYNC_LOG_LEVEL as a build flag, e.g. in platformio.ini
+     build_flags = -DASYNC_LOG_LEVEL=ASYNC_LOG_LEVEL_TRACE
+   Calls below the level compile to nothing.
+
+   ASYNC_LOG_ERROR(..) / ASYNC_LOG_DEBUG(..) are printf style and print to Serial, so they block on the UART.
+   Some errors are logged from the lwIP thread, e.g. when no client handle is free, so the default is NONE,
+   set ASYNC_LOG_LEVEL_ERROR or above only when debugging.
+   ASYNC_TRACE(event, pcb, len) just writes a 12 byte record to a RAM ring and never blocks,
+   use asyncTraceDump() from asyncLoop() or asyncDataReceived() to send the records over the connection later.
+   When the ring is full the oldest records are overwritten and counted.
+*/
+
+#define ASYNC_LOG_LEVEL_NONE  0
+#define ASYNC_LOG_LEVEL_ERROR 1
+#define ASYNC_LOG_LEVEL_TRACE 2  // binary event records into the trace ring
+#define ASYNC_LOG_LEVEL_DEBUG 3  // printf every event, slows down asyncLoop()
+
+#ifndef ASYNC_LOG_LEVEL
+#define ASYNC_LOG_LEVEL ASYNC_LOG_LEVEL_NONE
+#endif
+
+#ifndef ASYNC_TRACE_SIZE
+#define ASYNC_TRACE_SIZE 256 // records, must be a power of 2
+#endif
+
+#if ASYNC_LOG_LEVEL >= ASYNC_LOG_LEVEL_ERROR
+#define ASYNC_LOG_ERROR(...) Serial.printf(__VA_ARGS__)
+#else
+#define ASYNC_LOG_ERROR(...) ((void)0)
+#endif
+
+#if ASYNC_LOG_LEVEL >= ASYNC_LOG_LEVEL_DEBUG
+#define ASYNC_LOG_DEBUG(...) Serial.printf(__VA_ARGS__)
+#else
+#define ASYNC_LOG_DEBUG(...) ((void)0)
+#endif
+
+#if ASYNC_LOG_LEVEL >= ASYNC_LOG_LEVEL_TRACE
+#define ASYNC_TRACE(event, pcb, len) asyncTraceRecord((event), (pcb), (len))
+#else
+#define ASYNC_TRACE(event, pcb, len) ((void)0)
+#endif
+
+struct AsyncTraceRecord {
+  uint32_t time_us;
+  uint32_t pcb;
+  uint16_t len;   // bytes for sent/recv, else err
+  uint8_t event;  // lwip_event_t
+  uint8_t spare;
+};
+
+/**
+   asyncTraceRecord(uint8_t event, const void *pcb, uint16_t len)
+   adds a record to the ring, use the ASYNC_TRACE() macro instead
+   Only call from the HS_AsyncTCP task.
+*/
+void asyncTraceRecord(uint8_t event, const void *pcb, uint16_t len);
+
+/**
+   asyncTraceDump(Print &out, size_t maxRecords)
+   prints and removes up to maxRecords of the oldest records, one per line
+     time_us,event,pcb,len
+   returns the number printed, 0 if none left or tracing is not enabled
+   Only call from the HS_AsyncTCP task, e.g. asyncLoop()
+*/
+size_t asyncTraceDump(Print &out, size_t maxRecords);
+
+/**
+   asyncTraceOverwriteCount()
+   number of records overwritten before they were dumped
+*/
+uint32_t asyncTraceOverwriteCount();
+
+#endif
@@ -0,0 +1,100 @@
+#ifndef HANDLE_TABLE_H_
+#define HANDLE_TABLE_H_
+/*
+   (c)2023 Forward Computing and Control Pty. Ltd.
+   NSW Australia, www.forward.com.au
+   This code is not warranted to be fit for any purpose. You may only use it at your own risk.
+   This code may be freely used for both private and commercial use
+   provided this copyright is maintained.
+*/
+
+#include <atomic>
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+   HandleTable<T, SIZE>
+   Gives out generation tagged handles for up to SIZE T*'s, to pass to code that may call back after the T is gone.
+   A handle is  generation << 8 | (index + 1)  so it is never 0 (NULL).
+   remove() bumps the slot's generation, so get() on any earlier handle for that slot returns NULL in O(1),
+   no matter how many copies of the handle are still waiting in queues.
+
+   add() and remove() are lock free and can be called from any task on either core.
+   get() is safe against a concurrent add()/remove() of the same slot, it returns either the T or NULL,
+   but the caller must still make sure the T is not deleted while it is using it.
+   The generation is 24 bits and wraps, so a stale handle would only match its slot again
+   if it were still held after exactly a multiple of 16M reuses of that slot.
+   SIZE must be < 255
+*/
+template <class T, uint8_t SIZE>
+class HandleTable {
+  static_assert((SIZE > 0) && (SIZE < 0xff), "HandleTable SIZE must be 1..254");
+public:
+  HandleTable() {
+    for (uint8_t i = 0; i < SIZE; i++) {
+      items[i].store(NULL, std::memory_order_relaxed);
+      generations[i].store(0, std::memory_order_relaxed);
+    }
+  }
+
+  /**
+     add(T *item)
+     returns a new handle for item, or NULL if the table is full
+  */
+  void *add(T *item) {
+    for (uint8_t i = 0; i < SIZE; i++) {
+      T *expected = NULL;
+      if (items[i].compare_exchange_strong(expected, item, std::memory_order_acq_rel, std::memory_order_relaxed)) {
+        uint32_t gen = generations[i].load(std::memory_order_relaxed);
+        return (void *)(uintptr_t)((gen << 8) | (i + 1));
+      }
+    }
+    return NULL;
+  }
+
+  /**
+     get(const void *handle)
+     returns the T for this handle, or NULL if it has been removed (or was never valid)
+  */
+  T *get(const void *handle) const {
+    uint32_t h = (uint32_t)(uintptr_t)handle;
+    uint8_t idx = h & 0xff;
+    if ((idx == 0) || (idx > SIZE)) {
+      return NULL;
+    }
+    idx--;
+    T *item = items[idx].load(std::memory_order_acquire);
+    // remove() changes the generation before clearing the item, so a reused slot always has a new generation
+    if (generations[idx].load(std::memory_order_acquire) != (h >> 8)) {
+      return NULL;
+    }
+    return item;
+  }
+
+  /**
+     remove(const void *handle)
+     invalidates the handle and frees its slot, does nothing if the handle is already stale
+  */
+  void remove(const void *handle) {
+    uint32_t h = (uint32_t)(uintptr_t)handle;
+    uint8_t idx = h & 0xff;
+    if ((idx == 0) || (idx > SIZE)) {
+      return;
+    }
+    idx--;
+    uint32_t gen = h >> 8;
+    // only the first remove() of this handle moves the generation on
+    // kept masked to the 24 bits a handle holds, so the compare still matches after the generation wraps
+    if (generations[idx].compare_exchange_strong(gen, (gen + 1) & GENERATION_MASK, std::memory_order_acq_rel, std::memory_order_relaxed)) {
+      items[idx].store(NULL, std::memory_order_release);
+    }
+  }
+
+private:
+  const static uint32_t GENERATION_MASK = 0xffffff;
+
+  std::atomic<T *> items[SIZE]; // NULL if free
+  std::atomic<uint32_t> generations[SIZE]; // 0..GENERATION_MASK
+};
+
+#endif
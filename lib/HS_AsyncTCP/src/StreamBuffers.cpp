@@ -35,6 +35,10 @@ int StreamBuffers::read() {
   return inPtr->read();
 }
 
+size_t StreamBuffers::readBytes(char *data, size_t length) {
+  return inPtr->readBytes(data, length);
+}
+
 int StreamBuffers::peek() {
   return inPtr->peek();
 }
@@ -15,6 +15,10 @@ public:
     int read() override;
     int peek() override;
     void flush() override;
+    size_t readBytes(char *buffer, size_t length); // bulk read from in, does not wait
+    size_t readBytes(uint8_t *buffer, size_t length) {
+      return readBytes((char *)buffer, length);
+    }
     void clear();
 protected:
     BufferStream *inPtr;
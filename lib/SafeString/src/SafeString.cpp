@@ -169,7 +169,7 @@ bool SafeString::classErrorFlag = false; // set true if any SafeString object ha
     if maxLen == -1 then capacity == strlen(char*)  i.e. cSFP( )
     else capacity == maxLen-1;   i.e. cSFPS( )
 */
-SafeString::SafeString(size_t maxLen, char *buf, const char* cstr, const char* _name, bool _fromBuffer, bool _fromPtr) {
+SafeString::SafeString(unsigned int maxLen, char *buf, const char* cstr, const char* _name, bool _fromBuffer, bool _fromPtr) {
    errorFlag = false; // set to true if error detected, cleared on each call to hasError()
   timeoutStart_ms = 0;
   noCharsRead = 0; // number of char read on last call to readUntilToken
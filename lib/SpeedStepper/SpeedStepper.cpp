@@ -1,5 +1,6 @@
 // SpeedStepper.cpp
 #include "SpeedStepper.h"
+#include <new>
 
 /*
    Modification (c)2019 Forward Computing and Control Pty. Ltd.
@@ -43,16 +44,63 @@
    Default for dir pin is HIGH for forward
    Use InvertDirectionPin() to change this if needed
 */
-SpeedStepper::SpeedStepper(int stepPin, int dirPin) :  maxMaxSpeed(1000.0), minMaxSpeed(0.0003), minPulseWidth(2) {
+SpeedStepper::SpeedStepper(int stepPin, int dirPin) :  maxMaxSpeed(50000.0), minMaxSpeed(0.1), minPulseWidth(2) {
   DIR_PIN = dirPin;
   STEP_PIN = stepPin;
   totalComputeTime = 0;
   maxComputeTime = 0;
+  acceleration = 0.0;
+  jerk = 0.0;
+  scSpeed = 0.0;
+  scAccel = 0.0;
+  scMinSpeed = 0.0;
+  scInvJerk = 0.0;
+  scInvAccel = 0.0;
+  scDt = 0.0;
+  scLandJerk = 0.0;
+  scLimitDistance = -1;
+  scStopX = 0.0;
+  scStopInvH = 0.0;
+  scStopJerk = 0.0;
+  scStopAccel = 0.0;
+  scStopFitted = false;
   currentPosition = 0;
   maxPositionLimit = MAX_INT32_T;
   minPositionLimit = -MAX_INT32_T;
+  goingHome = false;
+  movingToTarget = false;
+  targetPosition = 0;
+  moveDecelSteps = -1;
   profileArray = NULL;
+  following = false;
+  followerDelay = 0;
+  followerKp = 0.0;
+  followerMaxExtrapolation = 0;
+  followerLastUpdate = 0;
+  followerHead = 0;
+  followerCount = 0;
+  followerPushed = 0;
+  clearFollowerStats();
   runningProfile = false;
+  useRampTables = false;
+  absoluteSchedule = false;
+  scheduleFrac = 0;
+  dirPinInverted = false;
+  deferDirOutput = false;
+  nonBlockingPulse = false;
+  stepPulseHigh = false;
+  stepPulsePending = false;
+  stepPulseEdgeTime = 0;
+  stepQueuePtr = NULL;
+  queueLookAhead = 0;
+  lastStepTime = 0;
+  clearScheduleCounts();
+  rampTablePtr = NULL;
+  rampTableNext = 0;
+  rampTableBuildCount = 0;
+  for (size_t i = 0; i < RAMP_TABLE_CACHE_SIZE; i++) {
+    rampTables[i].deltas = NULL;
+  }
   hardStop();
   setMaxSpeed(maxMaxSpeed); // sets cmax,cmin
   setMinSpeed(minMaxSpeed);
@@ -60,29 +108,44 @@ SpeedStepper::SpeedStepper(int stepPin, int dirPin) :  maxMaxSpeed(1000.0), minM
   hardStop(); // picks up c0;
   pinMode(DIR_PIN, OUTPUT);
   digitalWrite(DIR_PIN, LOW);
+  dirPinLevel = false; // the first step writes DIR_PIN if dir needs it HIGH
   pinMode(STEP_PIN, OUTPUT);
   digitalWrite(STEP_PIN, LOW);
 }
 
+SpeedStepper::~SpeedStepper() {
+  for (size_t i = 0; i < RAMP_TABLE_CACHE_SIZE; i++) {
+    delete[] rampTables[i].deltas;
+  }
+}
+
 /**
    setAcceleration(float)
    Set the acceleration rate in steps/sec^2 used to change speeds
    Rates < 0.0001 are set to 0.0001
 */
 void SpeedStepper::setAcceleration(float newAcceleration) {
-  if (newAcceleration < 0.0) {
-    newAcceleration = -newAcceleration;
-  }
-  if (newAcceleration <= 1e-4) {
-    newAcceleration = 1e-4;
-  }
+  internalSetAcceleration(newAcceleration, true);
+}
+
+/**
+   internalSetAcceleration(float newAcceleration, bool buildTable)
+   setAcceleration(), buildTable false when called from run() so a ramp table
+   missing from the cache is not built there, the ramp is calculated each step instead
+*/
+void SpeedStepper::internalSetAcceleration(float newAcceleration, boolean buildTable) {
+  newAcceleration = limitAcceleration(newAcceleration);
   if (acceleration != newAcceleration)  {
     // Recompute _n per Equation 17
     n = n * (acceleration / newAcceleration); //
     // New c0 per Equation 7, with correction per Equation 15
     //min accel of 1e-4 => initial speed of 0.01 c0 = 95e6
-    c0 = 0.676 * sqrt(2.0 / newAcceleration) * 1000000.0; // Equation 15
+    c0 = accelerationToC0(newAcceleration);
+    scMinSpeed = (1000000.0 * CN_ONE_US) / c0;
     acceleration = newAcceleration;
+    scInvAccel = 1.0 / acceleration;
+    scStopFitted = false;
+    selectRampTable(buildTable);
     // recalculate n using this new accel
     internalSetSpeed(targetSpeed);
 #ifdef DEBUG
@@ -97,10 +160,83 @@ void SpeedStepper::setAcceleration(float newAcceleration) {
       debugPtr->println();
     }
 #endif
-    computeNewSpeed();
+    if (!((jerk > 0.0) && isRunning())) {
+      computeNewSpeed();
+    }
   }
 }
 
+/**
+   limitAcceleration(float)
+   returns abs(newAcceleration), at least 0.0001
+   and, when using ramp tables, rounded to 1/RAMP_TABLE_ACCEL_STEPS of a doubling
+   so profile segments with nearly the same acceleration share a table
+   Only called when the acceleration changes, not per step
+*/
+float SpeedStepper::limitAcceleration(float newAcceleration) {
+  if (newAcceleration < 0.0) {
+    newAcceleration = -newAcceleration;
+  }
+  if (newAcceleration <= 1e-4) {
+    newAcceleration = 1e-4;
+  }
+  if (useRampTables) {
+    newAcceleration = exp2f(roundf(log2f(newAcceleration) * RAMP_TABLE_ACCEL_STEPS) / RAMP_TABLE_ACCEL_STEPS);
+  }
+  return newAcceleration;
+}
+
+/**
+   accelerationToC0(float)
+   returns the first step interval, Equation 15, as a fixed point cn
+*/
+uint32_t SpeedStepper::accelerationToC0(float a) {
+  float c0f = 0.676 * sqrt(2.0 / a) * (1000000.0 * CN_ONE_US); // Equation 15
+  return (c0f >= (float)CN_MAX) ? CN_MAX : (uint32_t)c0f;
+}
+
+/**
+   setJerk(float)
+   0.0 (the default) uses the constant acceleration ramp
+   > 0.0 uses a jerk limited (S-curve) ramp up to the setAcceleration() rate
+*/
+void SpeedStepper::setJerk(float newJerk) {
+  if (newJerk < 0.0) {
+    newJerk = -newJerk;
+  }
+  if ((jerk == 0.0) && (newJerk > 0.0)) {
+    // start the S-curve from the current speed
+    scSpeed = isRunning() ? (1000000.0 * CN_ONE_US) / cn : 0.0;
+    scAccel = 0.0;
+    scDt = cn * (1.0 / (1000000.0 * CN_ONE_US));
+    scLandJerk = 0.0;
+    scLimitDistance = -1;
+  }
+  jerk = newJerk;
+  scInvJerk = (jerk > 0.0) ? (1.0 / jerk) : 0.0;
+  scStopFitted = false;
+  if (jerk == 0.0) {
+    internalSetSpeed(targetSpeed); // back to the constant acceleration ramp from this speed
+  }
+}
+
+/**
+   getJerk()
+   returns the jerk set, 0.0 if using the constant acceleration ramp
+*/
+float SpeedStepper::getJerk() {
+  return jerk;
+}
+
+/**
+   getSCurveAcceleration()
+   returns the S-curve ramp's current rate of change of abs(getSpeed()), steps/sec^2
+   0.0 if using the constant acceleration ramp
+*/
+float SpeedStepper::getSCurveAcceleration() {
+  return (jerk > 0.0) ? scAccel : 0.0;
+}
+
 /**
    hardStop()
    Just stops the motor without any deceleration
@@ -122,16 +258,21 @@ void SpeedStepper::hardStop() {
   }
 #endif
   stepInterval = 0; // stop;
-  goingHome = false;
-  speed = 0.0;
-  a_speed = 0.0;
+  restoreLimits(); // clears goingHome
   targetSpeed = 0.0;
   a_targetSpeed = 0.0;
-  final_cn = 1000000000.0; // very bigf
+  final_cn = CN_MAX; // very big
   targetDir = true;
   setDir(true); // sets forward
   n = 0;
   cn = c0;
+  cnRest = 0;
+  cruiseStepsToStop = 0;
+  scSpeed = 0.0;
+  scAccel = 0.0;
+  scLandJerk = 0.0;
+  scLimitDistance = -1;
+  scStopFitted = false;
 }
 
 /**
@@ -154,11 +295,7 @@ void SpeedStepper::hardStart(float sp) {
     debugPtr->print(F(" total ComputeNewStep time:")); debugPtr->print(totalComputeTime); debugPtr->println(F("us"));
   }
 #endif
-  if (goingHome) {
-      maxPositionLimit = tempMaxPosLimit;
-      minPositionLimit = tempMinPosLimit;
-  }
-  goingHome = false; // always
+  restoreLimits(); // clears goingHome, always
   bool isTargetSpDirForward = (sp >= 0);
   setDir(isTargetSpDirForward);
   float a_sp = isTargetSpDirForward ? sp : -sp;
@@ -175,30 +312,35 @@ void SpeedStepper::hardStart(float sp) {
   }
 
   // assume newSpeed will be ok
-  final_cn = 1000000.0 / a_sp;
+  final_cn = speedToCn(a_sp);
   cn = final_cn;
+  cnRest = 0;
+  scSpeed = a_sp;
+  scAccel = 0.0;
+  scDt = cn * (1.0 / (1000000.0 * CN_ONE_US));
+  scLandJerk = 0.0;
+  scLimitDistance = -1;
+  scStopFitted = false;
   n = LARGE_N; // this suppresses further changes
+  cruiseStepsToStop = (int32_t)((a_sp * a_sp) / (2.0 * acceleration)); // Equation 16
   targetSpeed = sp;
   a_targetSpeed = a_sp;
-  speed = sp;
-  a_speed = a_sp;
 
 #ifdef DEBUG
   if (debugPtr != NULL) {
     debugPtr->print(F(" targetSpeed : "));
     debugPtr->print(targetSpeed);
     debugPtr->print(F(" speed : "));
-    debugPtr->print(speed);
+    debugPtr->print(getSpeed());
     debugPtr->println();
   }
 #endif
 
-  uint32_t laststepInterval = stepInterval;
-  stepInterval = cn;
+  stepInterval = cnToInterval(cn);
   bool stepTaken = computeNewSpeed(); // apply limits here
   // here stepInterval may have been limited and updated
-  if ( (starting) ||
-       ( (!stepTaken) && ((micros() - lastStepTime) >= stepInterval))
+  if (isRunning() && ( (starting) ||
+       ( (!stepTaken) && ((micros() - lastStepTime) >= stepInterval)) )
      ) {
     // was stopped so do one step NOW
     // OR new stepInterval passed and step not taken
@@ -207,7 +349,10 @@ void SpeedStepper::hardStart(float sp) {
       debugPtr->print(F(" hardStart takes oneStep "));
     }
 #endif
-    oneStep();
+    startStep();
+    if (distanceToGo() == 0) {
+      hardStop(); // that one step reached the limit
+    }
   }
 }
 
@@ -237,6 +382,7 @@ void SpeedStepper::goHome() {
     debugPtr->print(F(" >> goHome "));
   }
 #endif
+  following = false;
   if (currentPosition == 0) {
     hardStop();
     return;
@@ -244,6 +390,7 @@ void SpeedStepper::goHome() {
   if (goingHome) {
       return;
   }
+  restoreLimits(); // cancel any startMove()
   goingHome = true;
   tempMaxPosLimit = maxPositionLimit;
   tempMinPosLimit = minPositionLimit;
@@ -266,6 +413,152 @@ void SpeedStepper::goHome() {
   internalSetSpeed(homeSpeed); // skips setting goingHome false
 }
 
+/**
+   restoreLimits()
+   puts back the position limits saved by goHome() or startMove()
+   clears goingHome and movingToTarget
+*/
+void SpeedStepper::restoreLimits() {
+  if (goingHome || movingToTarget) {
+    maxPositionLimit = tempMaxPosLimit;
+    minPositionLimit = tempMinPosLimit;
+  }
+  goingHome = false;
+  movingToTarget = false;
+  moveDecelSteps = -1;
+}
+
+/**
+  moveTo(int32_t)
+  run to this absolute position, in steps, and stop there
+  accelerates to maxSpeed, or less for short moves, and decelerates to stop at the target
+  calling setSpeed(), stop() or goHome() cancels the move
+*/
+void SpeedStepper::moveTo(int32_t absolute) {
+  if (absolute > MAX_INT32_T) {
+    absolute = MAX_INT32_T;
+  } else if (absolute < -MAX_INT32_T) {
+    absolute = -MAX_INT32_T;
+  }
+  following = false;
+  startMove(absolute, maxSpeed);
+}
+
+/**
+  move(int32_t)
+  moveTo() relative to the current position
+*/
+void SpeedStepper::move(int32_t relative) {
+  // both within +/-MAX_INT32_T so the sum fits in int32_t
+  if (relative > MAX_INT32_T) {
+    relative = MAX_INT32_T;
+  } else if (relative < -MAX_INT32_T) {
+    relative = -MAX_INT32_T;
+  }
+  moveTo(currentPosition + relative);
+}
+
+/**
+  getTargetPosition()
+  returns the target of the last moveTo()/move()
+*/
+int32_t SpeedStepper::getTargetPosition() {
+  return targetPosition;
+}
+
+/**
+  isMovingToTarget()
+  returns true if running a moveTo()/move()
+*/
+boolean SpeedStepper::isMovingToTarget() {
+  return movingToTarget;
+}
+
+/**
+   planMove()
+   sets moveDecelSteps, the closed form distance from the target to start decelerating
+   From the current speed v0, with max speed vmax, acceleration a and d steps to go
+   the speed peaks at vpeak^2 = (2*a*d + v0^2)/2 (triangle) or vmax^2 if that is less (trapezoid)
+   and the deceleration takes vpeak^2/(2*a) steps (Equation 16)
+   Not planned (-1) if still running away from the target, computeNewSpeed() re-plans when it reverses
+*/
+void SpeedStepper::planMove() {
+  moveDecelSteps = -1;
+  if (!movingToTarget) {
+    return;
+  }
+  bool towardsTarget = (targetPosition > currentPosition);
+  if (isRunning() && (isDirForward() != towardsTarget)) {
+    return; // have to stop and reverse first
+  }
+  int32_t d = towardsTarget ? (maxPositionLimit - currentPosition) : (currentPosition - minPositionLimit);
+  if (d <= 0) {
+    moveDecelSteps = 0;
+    return;
+  }
+  float v0 = isRunning() ? getSpeed() : 0.0;
+  float v02 = v0 * v0;
+  float vmax2 = a_targetSpeed * a_targetSpeed;
+  float peak2 = (2.0 * acceleration * d + v02) / 2.0;
+  if (v02 > vmax2) {
+    // slowing down to vmax, if too short just decelerate now
+    peak2 = (peak2 < vmax2) ? v02 : vmax2;
+  } else if (peak2 > vmax2) {
+    peak2 = vmax2; // trapezoid, cruise at vmax
+  }
+  float decelSteps = peak2 / (2.0 * acceleration);
+  moveDecelSteps = (decelSteps >= (float)d) ? d : (int32_t)decelSteps;
+}
+
+/**
+   startMove(int32_t target, float speed)
+   run at abs(speed) towards target and stop there
+   uses temporary position limits at the target, as goHome() does
+   so computeNewSpeed() decelerates to stop at the target
+*/
+void SpeedStepper::startMove(int32_t target, float speed) {
+  restoreLimits(); // back to the user's limits
+  tempMaxPosLimit = maxPositionLimit;
+  tempMinPosLimit = minPositionLimit;
+  movingToTarget = true;
+  targetPosition = target;
+  float a_sp = (speed >= 0.0) ? speed : -speed;
+  if (target > currentPosition) {
+    if (target < maxPositionLimit) {
+      maxPositionLimit = target; // set to stop at target
+    }
+    internalSetSpeed(a_sp);
+  } else {
+    if (target > minPositionLimit) {
+      minPositionLimit = target; // set to stop at target
+    }
+    internalSetSpeed(-a_sp); // hardStops if already at target
+  }
+}
+
+/**
+   groupStep(bool forward)
+   one step in the given direction, within the position limits
+   used by SpeedStepperGroup for the slave axes
+*/
+void SpeedStepper::groupStep(boolean forward) {
+  if (forward) {
+    if (currentPosition >= maxPositionLimit) {
+      return;
+    }
+    currentPosition += 1;
+  } else {
+    if (currentPosition <= minPositionLimit) {
+      return;
+    }
+    currentPosition -= 1;
+  }
+  if (forward != dir) {
+    setDir(forward);
+  }
+  stepPulse();
+}
+
 /**
    isGoingHome()
    returns true if currently returning to position 0
@@ -381,9 +674,7 @@ boolean SpeedStepper::isDirForward() {
     set direction FORWARD
 */
 void SpeedStepper::setDirForward() {
-  dir = true;
-  digitalWrite(DIR_PIN, HIGH);
-  delayMicroseconds(minPulseWidth);
+  setDir(true);
 }
 
 /**
@@ -391,9 +682,7 @@ void SpeedStepper::setDirForward() {
     set direction REVERSE
 */
 void SpeedStepper::setDirReverse() {
-  dir = false;
-  digitalWrite(DIR_PIN, LOW);
-  delayMicroseconds(minPulseWidth);
+  setDir(false);
 }
 
 
@@ -408,15 +697,131 @@ void SpeedStepper::stop() {
 /**
    oneStep()
    Takes a single step in the current direction
+   Does not change the current position or check the position limits
 */
 void SpeedStepper::oneStep() {
-  lastStepTime = micros(); // set lastStep
-  digitalWrite(STEP_PIN, HIGH);
-  // Delay the minimum allowed pulse width
-  delayMicroseconds(minPulseWidth);
-  digitalWrite(STEP_PIN, LOW);
+  lastStepTime = micros(); // set lastStep, also restarts the absolute schedule
+  scheduleFrac = 0;
+  stepPulse();
 }
 
+/**
+   startStep()
+   oneStep() for the first step of a run from stopped, hardStart(), computeNewSpeed() and computeSCurveSpeed()
+   counted in the current position like the steps run() takes, so positioned moves end with
+   the same number of pulses as position changes
+*/
+void SpeedStepper::startStep() {
+  if (isDirForward()) {
+    if (currentPosition < MAX_INT32_T) {
+      currentPosition += 1;
+    }
+  }  else  {
+    if (currentPosition > -MAX_INT32_T) {
+      currentPosition -= 1;
+    }
+  }
+  oneStep();
+}
+
+/**
+   stepPulse()
+   Outputs one step pulse on the STEP_PIN
+*/
+void SpeedStepper::stepPulse() {
+#ifdef SPEED_STEPPER_STEP_QUEUE
+  if (stepQueuePtr != NULL) {
+    // steps from oneStep() go as soon as the previous queued step is done
+    stepQueuePtr->push(0, dir);
+    stepQueuePtr->kick();
+    return;
+  }
+#endif
+  outputStepPulse<DigitalPins>();
+}
+
+/**
+   endStepPulse()
+   For non-blocking step pulses, sets STEP_PIN LOW once minPulseWidth has passed
+   and then writes DIR_PIN if setDir() changed it and outputs any step pulse left pending
+   returns true if STEP_PIN is LOW and has been for minPulseWidth, i.e. ready for the next step
+*/
+boolean SpeedStepper::endStepPulse() {
+  return finishStepPulse<DigitalPins>();
+}
+
+/**
+   waitStepPulseEnd()
+   Busy waits for any non-blocking step pulse to finish
+   Only used when changing direction or stepping without run()
+*/
+void SpeedStepper::waitStepPulseEnd() {
+  if (!nonBlockingPulse) {
+    return;
+  }
+  while (!endStepPulse()) {
+  }
+}
+
+/**
+   setNonBlockingStepPulse(bool)
+   false (the default), each step busy waits minPulseWidth between STEP_PIN HIGH and LOW
+   true, STEP_PIN is set HIGH by one run() and set LOW by a later run() once minPulseWidth has passed
+*/
+void SpeedStepper::setNonBlockingStepPulse(boolean enable) {
+  waitStepPulseEnd();
+  nonBlockingPulse = enable;
+}
+
+#ifdef SPEED_STEPPER_STEP_QUEUE
+/**
+   setStepQueue(StepQueue *queuePtr, uint32_t lookAhead_us)
+   NULL (the default), run() outputs the steps itself when they are due
+   otherwise run() plans the steps up to lookAhead_us ahead into the queue
+   and the queue's timer interrupt outputs them
+   Call while stopped.
+*/
+void SpeedStepper::setStepQueue(StepQueue *queuePtr, uint32_t lookAhead_us) {
+  waitStepPulseEnd();
+  if (stepQueuePtr != NULL) {
+    stepQueuePtr->setProducerRunning(false);
+  }
+  stepQueuePtr = queuePtr;
+  queueLookAhead = lookAhead_us;
+  if (stepQueuePtr == NULL) {
+    dirPinLevel = (dir == dirPinInverted); // DIR_PIN may have been left by the queue, force setDir() to rewrite it
+    setDir(dir);
+  }
+}
+
+/**
+   planSteps()
+   fills the step queue up to queueLookAhead us ahead
+   Same as runSpeed() + computeNewSpeed() but each step is queued with its interval instead of waiting for it
+   Keeps one queue entry spare for the oneStep() computeNewSpeed() takes when reversing
+   returns true if stepper still running
+*/
+boolean SpeedStepper::planSteps() {
+  while (isRunning() && (stepQueuePtr->availableForWrite() > 1)
+         && (stepQueuePtr->queuedTime() < queueLookAhead)) {
+    if (isDirForward()) {
+      if (currentPosition < MAX_INT32_T) {
+        currentPosition += 1;
+      }
+    }  else  {
+      if (currentPosition > -MAX_INT32_T) {
+        currentPosition -= 1;
+      }
+    }
+    stepQueuePtr->push(stepInterval, dir);
+    computeNewSpeed();
+  }
+  stepQueuePtr->setProducerRunning(isRunning());
+  stepQueuePtr->kick();
+  return isRunning();
+}
+#endif // SPEED_STEPPER_STEP_QUEUE
+
 /**
    stepForward()
    Take one step in the FORWARD direction
@@ -459,6 +864,34 @@ void SpeedStepper::stopAndSetHome() {
    returns true if stepper still running
 */
 boolean SpeedStepper::run() {
+  runUpdate();
+#ifdef SPEED_STEPPER_STEP_QUEUE
+  if (stepQueuePtr != NULL) {
+    return planSteps();
+  }
+#endif
+  if (nonBlockingPulse && (!endStepPulse())) {
+    return (stepInterval != 0); // the last step pulse is not finished yet
+  }
+  if (runSpeed()) {
+    computeNewSpeed(); // does ramping if runningProfile
+  }
+  return (stepInterval != 0.0); // can also use isRunning() to check that
+}
+
+/**
+   runUpdate()
+   the start of run(), follower updates and moving on to the next profile segment
+   SpeedStepperT's run() calls this too
+*/
+void SpeedStepper::runUpdate() {
+  if (following) {
+    unsigned long now = micros();
+    if ((now - followerLastUpdate) >= FOLLOWER_UPDATE_US) {
+      followerLastUpdate = now;
+      updateFollower(now);
+    }
+  }
   if (runningProfile) {
     // check end time
     unsigned long ms = millis();
@@ -481,17 +914,13 @@ boolean SpeedStepper::run() {
           hardStart(profileTargetSpeed);
         } else {
           float deltaSp = (profileTargetSpeed - getSpeed());
-          setAcceleration( (deltaSp / ((float)(profileStepLenMs) )) * 1000.0); // setAcceleration handles -ve arg
+          // ramp tables for the segments were built by setProfile(), do not build any here
+          internalSetAcceleration( (deltaSp / ((float)(profileStepLenMs) )) * 1000.0, false); // handles -ve arg
           setSpeed(profileTargetSpeed);
         }
       }
     }
   }
-
-  if (runSpeed()) {
-    computeNewSpeed(); // does ramping if runningProfile
-  }
-  return (stepInterval != 0.0); // can also use isRunning() to check that
 }
 
 
@@ -505,9 +934,38 @@ boolean SpeedStepper::runSpeed() {
   if (stepInterval == 0) {
     return false;
   }
+  return runSpeed(micros());
+}
 
-  unsigned long time = micros();
-  if (time - lastStepTime >= stepInterval) {
+/**
+   runSpeed(uint32_t now)
+   as runSpeed() but uses now instead of reading micros()
+   so SpeedStepperGroup can run all its axes from one micros() call
+*/
+boolean SpeedStepper::runSpeed(uint32_t time) {
+  if (!stepDue(time)) {
+    return false;
+  }
+  stepPulse();
+  return true;
+}
+
+/**
+   stepDue(uint32_t now)
+   returns true if it is time for the next step and updates the position and the step schedule for it
+   the caller outputs the step pulse
+*/
+boolean SpeedStepper::stepDue(uint32_t time) {
+  if (stepInterval == 0) {
+    return false;
+  }
+  uint32_t interval = stepInterval;
+  if (absoluteSchedule) {
+    // include the fractions of a us left over from previous steps
+    interval = (cn + scheduleFrac) >> CN_FRAC_BITS;
+  }
+  uint32_t sinceLastStep = time - lastStepTime;
+  if (sinceLastStep >= interval) {
     if (isDirForward()) {
       // Clockwise
       if (currentPosition < MAX_INT32_T) {
@@ -519,14 +977,76 @@ boolean SpeedStepper::runSpeed() {
         currentPosition -= 1;
       }
     }
-    oneStep();
-    lastStepTime = time;
+    uint32_t lateness = sinceLastStep - interval;
+    if (lateness > maxStepLateness) {
+      maxStepLateness = lateness;
+    }
+    if (lateness >= interval) {
+      lateStepCount++; // next step would have been due already
+    }
+    if (!absoluteSchedule) {
+      lastStepTime = time; // any lateness delays all the following steps
+    } else if (lateness > (MAX_CATCH_UP_STEPS * interval)) {
+      // too far behind, drop the backlog and restart the schedule from now
+      missedStepCount += (lateness / interval);
+      lastStepTime = time;
+      scheduleFrac = 0;
+    } else {
+      // next deadline is from this step's deadline, not from now
+      // so late steps are caught up by the following steps
+      lastStepTime += interval;
+      scheduleFrac = (cn + scheduleFrac) & (CN_ONE_US - 1);
+    }
     return true;
   }  else    {
     return false;
   }
 }
 
+/**
+   setAbsoluteSchedule(bool)
+   false (the default), each step is timed from when the previous step was actually taken
+   true, each step is timed from the previous step's deadline
+*/
+void SpeedStepper::setAbsoluteSchedule(boolean enable) {
+  absoluteSchedule = enable;
+  scheduleFrac = 0;
+}
+
+/**
+   getLateStepCount()
+   returns number of steps taken a whole step interval or more after their deadline
+*/
+uint32_t SpeedStepper::getLateStepCount() {
+  return lateStepCount;
+}
+
+/**
+   getMissedStepCount()
+   returns number of steps dropped when the absolute schedule fell more than MAX_CATCH_UP_STEPS behind
+*/
+uint32_t SpeedStepper::getMissedStepCount() {
+  return missedStepCount;
+}
+
+/**
+   getMaxStepLateness()
+   returns the max us a step was taken after its deadline
+*/
+uint32_t SpeedStepper::getMaxStepLateness() {
+  return maxStepLateness;
+}
+
+/**
+   clearScheduleCounts()
+   zeros the late/missed step counts and the max step lateness
+*/
+void SpeedStepper::clearScheduleCounts() {
+  lateStepCount = 0;
+  missedStepCount = 0;
+  maxStepLateness = 0;
+}
+
 /**
    distanceToGo()
   calculate distance to go to limit based on direction of current speed
@@ -558,7 +1078,7 @@ void SpeedStepper::printComputeNewStepDebug() {
   if (debugPtr != NULL) {
     debugPtr->println();
     debugPtr->print(F(" speed "));
-    debugPtr->print(speed);
+    debugPtr->print(getSpeed());
     debugPtr->print(F(" target "));
     debugPtr->println(targetSpeed);
     debugPtr->print(F(" p "));
@@ -570,7 +1090,7 @@ void SpeedStepper::printComputeNewStepDebug() {
     debugPtr->print(F(" c0 "));
     debugPtr->print(c0);
     debugPtr->print(F(" c0 Speed: "));
-    debugPtr->println(1000000.0 / c0);
+    debugPtr->println((1000000.0 * CN_ONE_US) / c0);
     debugPtr->print(F(" n "));
     debugPtr->println(n);
     debugPtr->print(F(" sInt "));
@@ -621,8 +1141,23 @@ bool SpeedStepper::computeNewSpeed() {
     hardStop();
     return rtn;
   }
+  if (jerk > 0.0) {
+    rtn = computeSCurveSpeed(distanceTo);
+#ifdef COMPUTE_NEW_STEP_TIMING
+    updateComputeTimes();
+#endif
+    return rtn;
+  }
 
-  int32_t stepsToStop = (int32_t)((speed * speed) / (2.0 * acceleration)); // Equation 16
+  // Equation 16 stepsToStop = speed^2/(2*acceleration)
+  // but while ramping |n| is already the number of steps to stop from the current speed
+  // and at a constant speed it was saved when the ramp finished, so no float maths needed here
+  int32_t stepsToStop = cruiseStepsToStop;
+  if (moveDecelSteps >= 0) {
+    stepsToStop = moveDecelSteps; // planned by planMove() for moveTo()
+  } else if (n != LARGE_N) {
+    stepsToStop = (n >= 0) ? n : -n;
+  }
 
 #ifdef DEBUG
   if (debugPtr != NULL) {
@@ -666,7 +1201,11 @@ bool SpeedStepper::computeNewSpeed() {
 
     // else do first step
     cn = c0;
+    cnRest = 0;
     setDir(targetDir); // was at n==0 so change dir now
+    if (movingToTarget && (moveDecelSteps < 0)) {
+      planMove(); // now heading towards the target
+    }
     if (cn > final_cn) { // i.e. first step slower then final
       // first step of acceleration
       n++; // increment for next call n goes from 0 to 1
@@ -681,17 +1220,12 @@ bool SpeedStepper::computeNewSpeed() {
       // go straight to target speed as less the first acceleration step
       cn = final_cn;
       n = LARGE_N; // this suppresses further changes
+      cruiseStepsToStop = 0; // slower than the first step
     }
 
-    // set stepInterval and speed
+    // set stepInterval
     uint32_t laststepInterval = stepInterval;
-    stepInterval = cn;
-    a_speed = 1000000.0 / cn;
-    if (isDirForward()) {
-      speed = a_speed;
-    } else {
-      speed = -a_speed;
-    }
+    stepInterval = cnToInterval(cn);
     if (laststepInterval == 0) {
       // was stopped so do one step NOW
 #ifdef DEBUG
@@ -699,8 +1233,11 @@ bool SpeedStepper::computeNewSpeed() {
         debugPtr->print(F(" computeNewSpeed takes oneStep "));
       }
 #endif
-      oneStep();
+      startStep();
       rtn = true;
+      if (distanceToGo() == 0) {
+        hardStop(); // that one step reached the limit
+      }
     }
 #ifdef DEBUG
     printComputeNewStepDebug();
@@ -728,10 +1265,21 @@ bool SpeedStepper::computeNewSpeed() {
   }
 
   // else need to adjust speed
-  float deltaCn = - ((2.0 * cn) / ((4.0 * n) + 1));
-  float final_deltaCn = final_cn - cn;
-  float a_deltaCn = (deltaCn >= 0) ? deltaCn : -deltaCn;
-  float a_final_deltaCn = (final_deltaCn >= 0) ? final_deltaCn : -final_deltaCn;
+  // Equation 13, deltaCn = -(2*cn)/(4*n+1)
+  // +ve n is speeding up so cn decreases, -ve n is slowing down so cn increases
+  // speeding up at n uses table delta[n], slowing down at -n reverses that step using delta[-n]
+  uint32_t a_deltaCn;
+  int32_t rampIdx = ((n > 0) ? n : -n);
+  if ((rampTablePtr != NULL) && (rampIdx >= rampTablePtr->startN) && ((rampIdx - rampTablePtr->startN) < rampTablePtr->len)) {
+    a_deltaCn = rampTablePtr->deltas[rampIdx - rampTablePtr->startN];
+    if ((n > 0) && ((rampIdx - rampTablePtr->startN) == (rampTablePtr->len - 1))) {
+      cnRest = rampTablePtr->endRest; // speeding up past the end of the table
+    }
+  } else {
+    uint32_t denom = (n > 0) ? ((((uint32_t)n) << 2) + 1) : ((((uint32_t)(-n)) << 2) - 1);
+    a_deltaCn = rampDelta(cn, denom, cnRest);
+  }
+  uint32_t a_final_deltaCn = (final_cn >= cn) ? (final_cn - cn) : (cn - final_cn);
 #ifdef DEBUG
   if (debugPtr != NULL) {
     debugPtr->println();
@@ -749,22 +1297,21 @@ bool SpeedStepper::computeNewSpeed() {
       debugPtr->println();
     }
 #endif
+    cruiseStepsToStop = (n >= 0) ? n : -n; // steps to stop from here
     cn = final_cn;  // limited in setSpeed to be > cmin
+    cnRest = 0;
     n = LARGE_N;
   } else {
-    cn = cn + deltaCn; // Equation 13
+    if (n < 0) { // slowing down
+      cn = (a_deltaCn > (CN_MAX - cn)) ? CN_MAX : (cn + a_deltaCn); // Equation 13
+    } else {
+      cn = cn - a_deltaCn; // Equation 13, a_deltaCn <= 2*cn/5
+    }
     if (n < MAX_INT32_T) {
       n++; // for next loop
     }
   }
-  stepInterval = cn;
-  a_speed = 1000000.0 / cn;
-
-  if (isDirForward()) {
-    speed = a_speed;
-  } else {
-    speed = -a_speed;
-  }
+  stepInterval = cnToInterval(cn);
 #ifdef DEBUG
   printComputeNewStepDebug();
 #endif
@@ -775,6 +1322,446 @@ bool SpeedStepper::computeNewSpeed() {
 }
 
 
+/**
+   sCurveStopDistance(float speed, float accel, boolean &reachesAccel)
+   steps to stop from abs(speed) speed, rate of change of abs(speed) accel, with the S-curve ramp, times STOP_DISTANCE_MARGIN
+   While decelerating with a = -accel, the ramp to stop is jerk up to -acceleration (t1 = (acceleration-a)/jerk),
+   hold, then jerk back to 0 (t3 = acceleration/jerk) so, in closed form
+     d1 = v*t1 - a*t1^2/2 - jerk*t1^3/6
+     d2 = (v1^2 - v3^2)/(2*acceleration),  v1 = v - (acceleration^2-a^2)/(2*jerk), v3 = acceleration^2/(2*jerk)
+     d3 = acceleration^3/(6*jerk^2)
+   with v the speed above the c0 speed the ramp ends at, plus the c0 speed times the time taken.
+   If still accelerating, the distance and speed gained while bringing the acceleration to 0 are added first.
+   If too slow to reach -acceleration, reachesAccel is set false and the larger
+   v^2/(2*acceleration) + v*acceleration/(2*jerk) is used.
+   Only called by fitSCurveStopDistance(), not per step
+*/
+float SpeedStepper::sCurveStopDistance(float speed, float accel, boolean &reachesAccel) {
+  float A = acceleration;
+  float v = speed - scMinSpeed; // the ramp stops at the c0 speed
+  float a = 0.0; // deceleration
+  float d0 = 0.0;
+  if (accel > 0.0) {
+    // first bring the acceleration back to 0, taking accel/jerk sec at no more than the final speed
+    v += accel * accel * 0.5 * scInvJerk;
+    d0 = (v + scMinSpeed) * accel * scInvJerk;
+  } else {
+    a = -accel;
+  }
+  if (v < 0.0) {
+    v = 0.0;
+  }
+  float v3 = A * A * 0.5 * scInvJerk; // speed lost while jerking from -acceleration to 0
+  float v1 = v - (A * A - a * a) * 0.5 * scInvJerk;
+  reachesAccel = (v1 >= v3);
+  if (!reachesAccel) {
+    // does not reach -acceleration, use the larger constant acceleration + jerk distance
+    // over time v/acceleration + acceleration/jerk
+    return STOP_DISTANCE_MARGIN * (d0 + v * v * 0.5 * scInvAccel + v * A * 0.5 * scInvJerk
+                                   + scMinSpeed * (v * scInvAccel + A * scInvJerk));
+  }
+  float t1 = (A - a) * scInvJerk;
+  float d1 = t1 * (v - t1 * (a * 0.5 + jerk * t1 * (1.0 / 6.0)));
+  float d2 = (v1 * v1 - v3 * v3) * 0.5 * scInvAccel;
+  float d3 = v3 * A * scInvJerk * (1.0 / 3.0);
+  // plus the c0 speed for the time taken, t1 + (v1 - v3)/acceleration + acceleration/jerk
+  float dMin = scMinSpeed * (t1 + (v1 - v3) * scInvAccel + A * scInvJerk);
+  return STOP_DISTANCE_MARGIN * (d0 + d1 + d2 + d3 + dMin);
+}
+
+/**
+   fitSCurveStopDistance(float j, float T)
+   While the ramp's jerk j is constant, speed and acceleration are polynomials in the time t since this call,
+   v = scSpeed + scAccel*t + j*t^2/2 and a = scAccel + j*t, so each branch of sCurveStopDistance() is a
+   polynomial in t of degree 4. It is sampled at t = 0, T/4, T/2, 3T/4, T, T the expected length of this phase
+   of the ramp, and the forward differences converted to coefficients of x = 4*t/T in scStopPoly.
+   computeSCurveSpeed() then advances x by dt*scStopInvH and evaluates the polynomial each step, 4 multiplies.
+   Which branch applies only changes once along a phase, so T is halved until it ends in the branch it starts in.
+   Called only when the jerk changes, the acceleration changes sign or x passes 4, a few times a speed change.
+   T <= 0 fits the constant sCurveStopDistance(scSpeed, scAccel), for cruising.
+*/
+void SpeedStepper::fitSCurveStopDistance(float j, float T) {
+  scStopJerk = j;
+  scStopAccel = scAccel;
+  scStopX = 0.0;
+  scStopFitted = true;
+  boolean reachesAccel;
+  float d[5];
+  d[0] = sCurveStopDistance(scSpeed, scAccel, reachesAccel);
+  if (T <= 0.0) {
+    scStopPoly[0] = d[0];
+    scStopPoly[1] = scStopPoly[2] = scStopPoly[3] = scStopPoly[4] = 0.0;
+    scStopInvH = 0.0;
+    return;
+  }
+  boolean endReachesAccel = reachesAccel;
+  for (int i = 0; i < 8; i++) {
+    d[4] = sCurveStopDistance(scSpeed + T * (scAccel + j * T * 0.5), scAccel + j * T, endReachesAccel);
+    if (endReachesAccel == reachesAccel) {
+      break;
+    }
+    T *= 0.5;
+  }
+  float h = T * 0.25;
+  for (int i = 1; i < 4; i++) {
+    float t = h * i;
+    d[i] = sCurveStopDistance(scSpeed + t * (scAccel + j * t * 0.5), scAccel + j * t, endReachesAccel);
+  }
+  // forward differences, d[i] becomes the i'th difference of d[0]
+  for (int k = 1; k < 5; k++) {
+    for (int i = 4; i >= k; i--) {
+      d[i] -= d[i - 1];
+    }
+  }
+  // Newton's forward difference form, sum of d[k]*x*(x-1)*..*(x-k+1)/k!, as powers of x
+  scStopPoly[0] = d[0];
+  scStopPoly[1] = d[1] - d[2] * 0.5 + d[3] * (1.0 / 3.0) - d[4] * 0.25;
+  scStopPoly[2] = d[2] * 0.5 - d[3] * 0.5 + d[4] * (11.0 / 24.0);
+  scStopPoly[3] = d[3] * (1.0 / 6.0) - d[4] * 0.25;
+  scStopPoly[4] = d[4] * (1.0 / 24.0);
+  scStopInvH = 1.0 / h;
+}
+
+/**
+   setSCurveInterval()
+   sets scDt = 1/scSpeed, cn and stepInterval for the new S-curve speed
+   1/scSpeed is refined from the last step's scDt by Newton's iteration x += x*(1 - scSpeed*x), two multiplies,
+   which squares the relative error each time. The speed changes little per step so two iterations are usual.
+   Only a change of more than 1/4 of the speed in one step, just after the first step, divides instead.
+*/
+void SpeedStepper::setSCurveInterval() {
+  float x = scDt;
+  float e = 1.0 - scSpeed * x;
+  if ((e > 0.25) || (e < -0.25)) {
+    x = 1.0 / scSpeed;
+  } else {
+    for (int i = 0; (i < 4) && ((e > 1e-6) || (e < -1e-6)); i++) {
+      x += x * e;
+      e = 1.0 - scSpeed * x;
+    }
+  }
+  scDt = x;
+  float c = x * (1000000.0 * CN_ONE_US);
+  cn = (c >= (float)CN_MAX) ? CN_MAX : (uint32_t)c;
+  stepInterval = cnToInterval(cn);
+}
+
+/**
+   computeSCurveSpeed(int32_t distanceTo)
+   computeNewSpeed() for setJerk() > 0
+   Each step moves the acceleration towards +/-acceleration by jerk*dt and the speed by the average
+   acceleration times dt, where dt is the step interval just taken.
+   The step before the speed gained while bringing the acceleration back to 0 would pass the speed still
+   to change, the jerk that lands on the target speed with zero acceleration is calculated, limited to jerk,
+   and used until the acceleration reaches 0.
+   The stopping distance is the polynomial from fitSCurveStopDistance() so per step it is a few float
+   multiplies, no roots and no divides, see setSCurveInterval().
+   It is checked every step and once it reaches the distance to the limit the stop is followed down to the
+   c0 speed, then the last few steps creep to the limit.
+   returns true if oneStep taken
+*/
+bool SpeedStepper::computeSCurveSpeed(int32_t distanceTo) {
+  if (stepInterval == 0) {
+    // stopped, start at the speed of the first step
+    if (a_targetSpeed < minSpeed) {
+      hardStop();
+      return false;
+    }
+    setDir(targetDir);
+    scSpeed = scMinSpeed;
+    scAccel = 0.0;
+    scLandJerk = 0.0;
+    scLimitDistance = -1;
+    scStopFitted = false;
+    cn = speedToCn(scSpeed);
+    scDt = cn * (1.0 / (1000000.0 * CN_ONE_US));
+    stepInterval = cnToInterval(cn);
+    startStep();
+    if (distanceToGo() == 0) {
+      hardStop(); // that one step reached the limit
+    }
+    return true;
+  }
+
+  float dt = scDt; // last step interval in sec
+  // stopping and reversing ramp down to the c0 speed
+  bool stopping = (targetDir != isDirForward()) || (a_targetSpeed < minSpeed);
+  float stopDistance;
+  if (scStopFitted) {
+    float x = scStopX;
+    stopDistance = scStopPoly[0] + x * (scStopPoly[1] + x * (scStopPoly[2] + x * (scStopPoly[3] + x * scStopPoly[4])));
+  } else {
+    boolean reachesAccel;
+    stopDistance = sCurveStopDistance(scSpeed, scAccel, reachesAccel);
+  }
+  if (distanceTo > scLimitDistance) {
+    scLimitDistance = -1; // the limit moved away
+  }
+  // once started, the stop to the limit is followed to the c0 speed, rechecking could end it and restart it each step
+  bool approachingLimit = (scLimitDistance >= 0) || (stopDistance >= (float)distanceTo);
+  if (approachingLimit) {
+    stopping = true;
+    scLimitDistance = distanceTo;
+  }
+  float vTarget = stopping ? scMinSpeed : a_targetSpeed;
+
+  float deltaV = vTarget - scSpeed;
+  float jerkDt = jerk * dt;
+  float absDeltaV = (deltaV >= 0.0) ? deltaV : -deltaV;
+  float lastAccel = scAccel;
+  float absAccel = (scAccel >= 0.0) ? scAccel : -scAccel;
+  // speed change while bringing scAccel back to 0 at jerk, plus this step's accel*dt
+  float accelStopDeltaV = absAccel * absAccel * 0.5 * scInvJerk + absAccel * dt;
+  float j; // the jerk from here on, for fitSCurveStopDistance()
+  if ((absDeltaV <= (jerkDt * dt)) && (absAccel <= jerkDt)) {
+    // close enough, at target speed
+    scSpeed = vTarget;
+    scAccel = 0.0;
+    scLandJerk = 0.0;
+    j = 0.0;
+  } else if ((scAccel != 0.0) && ((deltaV > 0.0) == (scAccel > 0.0)) && (absDeltaV <= accelStopDeltaV)) {
+    // bring scAccel to 0 just as the speed reaches vTarget
+    if (scLandJerk == 0.0) {
+      // once per landing, absDeltaV = accel^2/(2*landJerk)
+      // switching a step early keeps it <= jerk, the limit covers a late switch after a target speed change
+      scLandJerk = (absAccel * absAccel * 0.5) / absDeltaV;
+      if (scLandJerk > jerk) {
+        scLandJerk = jerk;
+      }
+    }
+    if ((scLandJerk * dt) >= absAccel) {
+      // the acceleration reaches 0 during this step, adding the last accel^2/(2*landJerk)
+      // which is the rest of deltaV unless landJerk was limited to jerk
+      scAccel = 0.0;
+      scSpeed += (scLandJerk < jerk) ? deltaV : (lastAccel * absAccel * 0.5 * scInvJerk);
+      scLandJerk = 0.0;
+      j = 0.0;
+    } else {
+      j = (scAccel > 0.0) ? -scLandJerk : scLandJerk;
+      scAccel += j * dt;
+      scSpeed += (lastAccel + scAccel) * 0.5 * dt;
+    }
+  } else {
+    // jerk towards +/-acceleration
+    scLandJerk = 0.0;
+    if (deltaV > 0.0) {
+      j = jerk;
+      scAccel += jerkDt;
+      if (scAccel >= acceleration) {
+        scAccel = acceleration;
+        j = 0.0;
+      }
+    } else {
+      j = -jerk;
+      scAccel -= jerkDt;
+      if (scAccel <= -acceleration) {
+        scAccel = -acceleration;
+        j = 0.0;
+      }
+    }
+    scSpeed += (lastAccel + scAccel) * 0.5 * dt; // exact for constant jerk
+  }
+
+  if (scSpeed <= scMinSpeed) {
+    scSpeed = scMinSpeed;
+    if (scAccel < 0.0) {
+      // can not slow any more, bring the deceleration to 0 at no more than jerk
+      scAccel = lastAccel + jerkDt;
+      if (scAccel > 0.0) {
+        scAccel = 0.0;
+      }
+      scLandJerk = 0.0;
+      j = 0.0;
+      scStopFitted = false;
+    }
+    if (stopping && (scAccel == 0.0)) {
+      if (approachingLimit) {
+        // creep to the limit, hardStop() when distanceTo == 0
+      } else if (a_targetSpeed < minSpeed) {
+        hardStop();
+        return false;
+      } else {
+        setDir(targetDir); // reverse
+      }
+    }
+  }
+  if (scSpeed > maxSpeed) {
+    scSpeed = maxSpeed;
+  }
+
+  scStopX += dt * scStopInvH;
+  if (!scStopFitted || (j != scStopJerk) || ((scAccel * scStopAccel) < 0.0) || (scStopX > 4.0)) {
+    // a new phase of the ramp, refit the stop distance over the time to its end
+    float T = 0.0;
+    if (j > 0.0) {
+      T = ((scAccel < 0.0) ? -scAccel : (acceleration - scAccel)) / j;
+    } else if (j < 0.0) {
+      T = ((scAccel > 0.0) ? scAccel : (acceleration + scAccel)) / -j;
+    } else if (scAccel != 0.0) {
+      // holding +/-acceleration until the landing takes the last acceleration^2/(2*jerk)
+      float absDeltaV = (vTarget > scSpeed) ? (vTarget - scSpeed) : (scSpeed - vTarget);
+      T = (absDeltaV - acceleration * acceleration * 0.5 * scInvJerk) * scInvAccel;
+    }
+    if ((T < dt) && ((j != 0.0) || (scAccel != 0.0))) {
+      T = dt;
+    }
+    fitSCurveStopDistance(j, T);
+  }
+  setSCurveInterval();
+  return false;
+}
+
+/**
+   rampDelta(uint32_t c, uint32_t denom, uint32_t &rest)
+   returns abs(deltaCn) = (2*c)/denom for Equation 13, in integer maths
+   The remainder of the division is carried forward in rest (as in Atmel AVR446)
+   otherwise at high step rates deltaCn is less then one unit and the ramp stalls
+   rest < denom and denom is only large when c is small so (2*c)+rest does not overflow
+*/
+uint32_t SpeedStepper::rampDelta(uint32_t c, uint32_t denom, uint32_t &rest) {
+  uint32_t delta;
+  if (c < 0x80000000UL) {
+    uint32_t num = (c << 1) + rest;
+    delta = num / denom;
+    rest = num - (delta * denom);
+  } else { // very slow step, > 8sec, split the division so 2*c does not overflow
+    uint32_t q = c / denom;
+    uint32_t num = ((c - (q * denom)) << 1) + rest;
+    delta = (q << 1) + (num / denom);
+    rest = num % denom;
+  }
+  return delta;
+}
+
+/**
+   setRampTables(bool)
+   true to use precomputed ramp tables for speeding up and slowing down
+   false (the default) to calculate each step
+*/
+void SpeedStepper::setRampTables(boolean enable) {
+  useRampTables = enable;
+  internalSetAcceleration(acceleration, true); // rounds it for the tables
+  selectRampTable(true);
+  buildProfileRampTables();
+}
+
+/**
+   selectRampTable(bool build)
+   picks the cached ramp table for the current acceleration and cmin
+   if it is not in the cache, builds it if build is true, else the ramp is calculated each step
+   Called when acceleration or maxSpeed changes, not per step
+*/
+void SpeedStepper::selectRampTable(boolean build) {
+  rampTablePtr = NULL;
+  if (!useRampTables) {
+    return;
+  }
+  rampTablePtr = findRampTable(acceleration, build);
+}
+
+/**
+   findRampTable(float accel, bool build)
+   returns the cached ramp table for accel and the current cmin
+   if it is not in the cache and build is true, builds it over the oldest table
+   returns NULL if not found and not built
+*/
+SpeedRampTable *SpeedStepper::findRampTable(float accel, boolean build) {
+  for (size_t i = 0; i < RAMP_TABLE_CACHE_SIZE; i++) {
+    if ((rampTables[i].deltas != NULL) && (rampTables[i].acceleration == accel) && (rampTables[i].cmin == cmin)) {
+      return &rampTables[i];
+    }
+  }
+  if (!build) {
+    return NULL;
+  }
+  SpeedRampTable *tablePtr = &rampTables[rampTableNext];
+  if (tablePtr->deltas == NULL) {
+    tablePtr->deltas = new (std::nothrow) uint16_t[RAMP_TABLE_MAX_LEN];
+    if (tablePtr->deltas == NULL) {
+      return NULL; // out of memory, just calculate each step
+    }
+  }
+  rampTableNext = (rampTableNext + 1) % RAMP_TABLE_CACHE_SIZE;
+  buildRampTable(tablePtr, accel);
+  rampTableBuildCount++;
+  return tablePtr;
+}
+
+/**
+   getRampTableBuildCount()
+   returns the number of ramp tables built
+*/
+uint32_t SpeedStepper::getRampTableBuildCount() {
+  return rampTableBuildCount;
+}
+
+/**
+   buildProfileRampTables()
+   builds the ramp tables for the set profile's segments, so run() never builds one
+   Segments after the first ramp from the previous segment's speed (run() hardStart()s each segment's end speed)
+   The first segment ramps from the speed when startProfile() is called, startProfile() builds that table.
+   Stops when the tables built here fill the cache, later segments calculate each step.
+*/
+void SpeedStepper::buildProfileRampTables() {
+  if ((!useRampTables) || (profileArray == NULL)) {
+    return;
+  }
+  size_t built = 0;
+  for (size_t i = 1; (i < profileArraySize) && (built < RAMP_TABLE_CACHE_SIZE); i++) {
+    if (profileArray[i].deltaTms == 0) {
+      continue; // hardStart()
+    }
+    float deltaSp = profileArray[i].speed - profileArray[i - 1].speed;
+    float accel = limitAcceleration((deltaSp / ((float)(profileArray[i].deltaTms))) * 1000.0);
+    if (findRampTable(accel, false) == NULL) {
+      if (findRampTable(accel, true) == NULL) {
+        break; // out of memory
+      }
+      built++;
+    }
+  }
+  selectRampTable(false); // the current table may have been replaced
+}
+
+/**
+   buildRampTable(SpeedRampTable*, float accel)
+   runs Equation 13 from the c0 for accel up to cmin and saves the deltaCn's
+   The first few deltas, at low speeds, are too large for uint16_t,
+   those steps are slow enough to be calculated each step, so the table starts at the first delta that fits
+*/
+void SpeedStepper::buildRampTable(SpeedRampTable *tablePtr, float accel) {
+  tablePtr->acceleration = accel;
+  tablePtr->cmin = cmin;
+  tablePtr->startN = 0;
+  tablePtr->len = 0;
+  uint32_t c = accelerationToC0(accel);
+  uint32_t rest = 0;
+  for (int32_t k = 1; (c > cmin) && (tablePtr->len < RAMP_TABLE_MAX_LEN); k++) {
+    uint32_t delta = rampDelta(c, (((uint32_t)k) << 2) + 1, rest);
+    if (tablePtr->len == 0) {
+      if (delta > 0xffff) {
+        c -= delta;
+        continue;
+      }
+      tablePtr->startN = k;
+    }
+    tablePtr->deltas[tablePtr->len++] = delta;
+    c -= delta;
+  }
+  tablePtr->endRest = rest;
+#ifdef DEBUG
+  if (debugPtr != NULL) {
+    debugPtr->print(F(" buildRampTable acc:"));
+    debugPtr->print(accel);
+    debugPtr->print(F(" startN:"));
+    debugPtr->print(tablePtr->startN);
+    debugPtr->print(F(" len:"));
+    debugPtr->print(tablePtr->len);
+    debugPtr->println();
+  }
+#endif
+}
+
 /**
    invertDirectionLogic()
    Changes logic of DIR_PIN output.
@@ -795,15 +1782,21 @@ void SpeedStepper::invertDirectionLogic() {
    Set the direction output to the stepper driver on the DIR_PIN
    Default is HIGH for forward
    Use InvertDirectionPin() to change to opposite polarity (e.g. LOW for forward)
+   DIR_PIN is only written, and minPulseWidth waited for the driver's dir setup time, when its level changes
+   With non-blocking step pulses, run() writes DIR_PIN once the current step pulse is finished
 */
 void SpeedStepper::setDir(boolean flag) {
   dir = flag;
-  if (dir) {
-    digitalWrite(DIR_PIN, dirPinInverted ? LOW : HIGH);
-  } else {
-    digitalWrite(DIR_PIN, dirPinInverted ? HIGH : LOW);
+  if (stepQueuePtr != NULL) {
+    return; // the queue sets DIR_PIN for each step
+  }
+  if (deferDirOutput) {
+    return; // SpeedStepperT writes DIR_PIN just before the next step pulse
   }
-  delayMicroseconds(minPulseWidth);
+  if (nonBlockingPulse) {
+    return; // endStepPulse() writes DIR_PIN, never during a step pulse
+  }
+  outputDir<DigitalPins>();
 }
 
 /**
@@ -818,9 +1811,39 @@ boolean SpeedStepper::isRunning() {
 /**
    getSpeed()
    return current speed
+   calculated here from the current step interval so that there are no float divides per step
 */
 float SpeedStepper::getSpeed() {
-  return speed;
+  if (stepInterval == 0) {
+    return 0.0;
+  }
+  float a_sp = (1000000.0 * CN_ONE_US) / cn;
+  return isDirForward() ? a_sp : -a_sp;
+}
+
+/**
+   speedToCn(float)
+   convert abs(speed) steps/sec to a fixed point step interval
+   clamped to CN_MAX
+*/
+uint32_t SpeedStepper::speedToCn(float a_sp) {
+  if (a_sp <= 0.0) {
+    return CN_MAX;
+  }
+  float c = (1000000.0 * CN_ONE_US) / a_sp;
+  if (c >= (float)CN_MAX) {
+    return CN_MAX;
+  }
+  return (uint32_t)c;
+}
+
+/**
+   cnToInterval(uint32_t)
+   round a fixed point step interval to the nearest us for stepInterval
+*/
+uint32_t SpeedStepper::cnToInterval(uint32_t c) {
+  uint32_t interval = (c >> CN_FRAC_BITS) + ((c >> (CN_FRAC_BITS - 1)) & 1);
+  return (interval == 0) ? 1 : interval;
 }
 
 /**
@@ -834,11 +1857,8 @@ float SpeedStepper::getSpeed() {
      Speeds > maxSpeed are set as maxSpeed
 */
 void SpeedStepper::setSpeed(float sp) {
-  if (goingHome) {
-      maxPositionLimit = tempMaxPosLimit;
-      minPositionLimit = tempMinPosLimit;
-  }
-  goingHome = false; // calls to setSpeed disable goingHome
+  restoreLimits(); // calls to setSpeed disable goingHome
+  following = false;
   if (sp == targetSpeed) { // already at this speed nothing to do
     return; // nothing to do
   }
@@ -875,9 +1895,9 @@ void SpeedStepper::internalSetSpeed(float sp) {
   a_targetSpeed = a_sp;
   if (a_targetSpeed < minSpeed) {
     a_targetSpeed = 0.0;
-    final_cn = 1000000000.0; // very big
+    final_cn = CN_MAX; // very big
   } else {
-    final_cn = 1000000.0 / a_targetSpeed;
+    final_cn = speedToCn(a_targetSpeed);
   }
 #ifdef DEBUG
   if (debugPtr != NULL) {
@@ -888,9 +1908,12 @@ void SpeedStepper::internalSetSpeed(float sp) {
 
   targetDir = targetSpeed >= 0;  // the final direction we want to go in
 
+  float speed = getSpeed();
+  float a_speed = (speed >= 0.0) ? speed : -speed;
   long stepsToStop = ((long)((speed * speed) / (2.0 * acceleration))); // Equation 16
   // can be zero, will be zero if stopped
   n = stepsToStop; // new n for acceleration
+  cnRest = 0;
 
   // find the step sign to change speed
   if (stepInterval == 0) {
@@ -931,13 +1954,17 @@ void SpeedStepper::internalSetSpeed(float sp) {
   }
 #endif
 
+  planMove(); // for moveTo(), before computeNewSpeed() uses moveDecelSteps
+  if ((jerk > 0.0) && isRunning()) {
+    return; // the S-curve moves towards the new target speed from the next step
+  }
   computeNewSpeed();
 }
 
 /**
    setMaxSpeed(float)
    Sets the maximum abs(speed) that setSpeed can set
-   Is limited to < 1000
+   Is limited to <= 50000
    Must be called by this class' construction
    to initialize cmin,cmax
 */
@@ -958,8 +1985,9 @@ void SpeedStepper::setMaxSpeed(float maxSp) {
     minSpeed = maxSpeed;
     maxSpeed = temp;
   }
-  cmin = (1000000.0 / maxSpeed); // to compare to cn float
-  cmax = (1000000.0 / minSpeed); // to compare to cn float
+  cmin = speedToCn(maxSpeed); // to compare to cn
+  cmax = speedToCn(minSpeed); // to compare to cn
+  selectRampTable(true); // table ends at cmin
 #ifdef DEBUG
   if (debugPtr != NULL) {
     debugPtr->print(F("  maxSpeed:"));
@@ -974,7 +2002,7 @@ void SpeedStepper::setMaxSpeed(float maxSp) {
 /**
    setMinSpeed(float)
    Sets the minimum abs(speed) that setSpeed can set
-   minSpeed is limited to > 0.0003
+   minSpeed is limited to >= 0.1
    Must be called by this class' construction
    to initialize cmin,cmax
 */
@@ -982,8 +2010,8 @@ void SpeedStepper::setMinSpeed(float minSp) {
   if (minSp < 0) {
     minSp = -minSp;
   }
-  if (minSpeed < minMaxSpeed) {
-    minSpeed = minMaxSpeed;
+  if (minSp < minMaxSpeed) {
+    minSp = minMaxSpeed;
   }
   if (minSp > maxMaxSpeed) {
     minSp = maxMaxSpeed;
@@ -995,8 +2023,8 @@ void SpeedStepper::setMinSpeed(float minSp) {
     minSpeed = maxSpeed;
     maxSpeed = temp;
   }
-  cmin = (1000000.0 / maxSpeed); // to compare to cn float
-  cmax = (1000000.0 / minSpeed); // to compare to cn float
+  cmin = speedToCn(maxSpeed); // to compare to cn
+  cmax = speedToCn(minSpeed); // to compare to cn
 #ifdef DEBUG
   if (debugPtr != NULL) {
     debugPtr->print(F("  minSpeed:"));
@@ -1015,6 +2043,7 @@ void SpeedStepper::setMinSpeed(float minSp) {
 void SpeedStepper::setProfile(SpeedProfileStruct* _profileArray, size_t _arrayLen) {
   profileArray = _profileArray;
   profileArraySize = _arrayLen;
+  buildProfileRampTables();
 }
 
 /**
@@ -1087,3 +2116,195 @@ bool SpeedStepper::isProfileRunning() {
   return runningProfile;
 }
 
+/**
+   startFollowing(uint32_t delay_us, float kp, uint32_t maxExtrapolation_us)
+   Follows a stream of positions added by pushSetpoint()
+   played back delay_us behind the sample times
+   speed = interpolated sample velocity + kp * position error
+*/
+void SpeedStepper::startFollowing(uint32_t delay_us, float kp, uint32_t maxExtrapolation_us) {
+  restoreLimits(); // cancel any moveTo() or goHome()
+  if (runningProfile) {
+    runningProfile = false;
+  }
+  followerDelay = delay_us;
+  followerKp = kp;
+  followerMaxExtrapolation = maxExtrapolation_us;
+  followerHead = 0;
+  followerCount = 0;
+  followerPushed = 0;
+  followerLastUpdate = micros();
+  following = true;
+}
+
+/**
+   stopFollowing()
+   stop following and decelerate to a stop
+*/
+void SpeedStepper::stopFollowing() {
+  following = false;
+  stop();
+}
+
+/**
+   isFollowing()
+   returns true if following pushSetpoint() positions
+*/
+boolean SpeedStepper::isFollowing() {
+  return following;
+}
+
+/**
+   pushSetpoint(int32_t position)
+   add a position sample for the follower at micros()
+*/
+boolean SpeedStepper::pushSetpoint(int32_t position) {
+  return pushSetpoint(position, micros());
+}
+
+/**
+   pushSetpoint(int32_t position, uint32_t time_us)
+   add a position sample for the follower, time_us is the micros() the sample applies at
+   The sample velocity is the secant back FOLLOWER_VELOCITY_SAMPLES samples, or as many as have been pushed
+   returns false if not following or the sample is not later than the last one
+*/
+boolean SpeedStepper::pushSetpoint(int32_t position, uint32_t time_us) {
+  if (!following) {
+    return false;
+  }
+  size_t tail = (followerHead + followerCount) % FOLLOWER_QUEUE_SIZE;
+  float velocity = 0.0;
+  if (followerPushed > 0) {
+    FollowerSetpoint &newest = followerQueue[(tail + FOLLOWER_QUEUE_SIZE - 1) % FOLLOWER_QUEUE_SIZE];
+    if ((int32_t)(time_us - newest.time_us) <= 0) {
+      return false; // out of order or repeated
+    }
+    size_t back = (followerPushed < FOLLOWER_VELOCITY_SAMPLES) ? followerPushed : FOLLOWER_VELOCITY_SAMPLES;
+    FollowerSetpoint &old = followerQueue[(tail + FOLLOWER_QUEUE_SIZE - back) % FOLLOWER_QUEUE_SIZE];
+    int32_t dt = (int32_t)(time_us - old.time_us);
+    velocity = ((float)(position - old.position)) * 1000000.0 / dt;
+  }
+  if (followerCount >= FOLLOWER_QUEUE_SIZE) {
+    // drop the oldest
+    followerHead = (followerHead + 1) % FOLLOWER_QUEUE_SIZE;
+    followerCount--;
+    followerDroppedCount++;
+    tail = (followerHead + followerCount) % FOLLOWER_QUEUE_SIZE;
+  }
+  followerQueue[tail].position = position;
+  followerQueue[tail].time_us = time_us;
+  followerQueue[tail].velocity = velocity;
+  followerPushTime[tail] = micros();
+  followerCount++;
+  followerPushed++;
+  return true;
+}
+
+/**
+   followerSetpoint(size_t i)
+   returns the i'th oldest queued setpoint
+*/
+FollowerSetpoint &SpeedStepper::followerSetpoint(size_t i) {
+  return followerQueue[(followerHead + i) % FOLLOWER_QUEUE_SIZE];
+}
+
+/**
+   updateFollower(uint32_t now)
+   sets the speed from the setpoint queue, called from run() every FOLLOWER_UPDATE_US while following
+   O(1) except for popping the samples passed since the last update
+*/
+void SpeedStepper::updateFollower(uint32_t now) {
+  if (followerCount == 0) {
+    return;
+  }
+  uint32_t tPlay = now - followerDelay;
+  // drop samples once playback has passed the next one
+  while ((followerCount >= 2) && ((int32_t)(tPlay - followerSetpoint(1).time_us) >= 0)) {
+    followerHead = (followerHead + 1) % FOLLOWER_QUEUE_SIZE;
+    followerCount--;
+    uint32_t latency = now - followerPushTime[followerHead];
+    if (latency > followerMaxLatency) {
+      followerMaxLatency = latency;
+    }
+  }
+  FollowerSetpoint &a = followerSetpoint(0);
+  int32_t sinceA = (int32_t)(tPlay - a.time_us);
+  float setpoint = a.position;
+  float velocity = 0.0;
+  if (sinceA <= 0) {
+    // playback has not reached the first sample yet, hold there
+  } else if (followerCount >= 2) {
+    // interpolate position and velocity between a and b
+    FollowerSetpoint &b = followerSetpoint(1);
+    float f = ((float)sinceA) / ((int32_t)(b.time_us - a.time_us));
+    setpoint += f * (b.position - a.position);
+    velocity = a.velocity + f * (b.velocity - a.velocity);
+  } else if ((uint32_t)sinceA <= followerMaxExtrapolation) {
+    // past the last sample, keep going at its velocity for a while
+    velocity = a.velocity;
+    setpoint += velocity * sinceA * 1e-6;
+  } else {
+    // no new samples, hold the extrapolated position
+    setpoint += a.velocity * followerMaxExtrapolation * 1e-6;
+    followerStarvedCount++;
+  }
+  float error = setpoint - currentPosition;
+  followerError = (int32_t)error;
+  int32_t absError = (followerError >= 0) ? followerError : -followerError;
+  if (absError > followerMaxError) {
+    followerMaxError = absError;
+  }
+  float speed = velocity + followerKp * error;
+  if (speed != targetSpeed) {
+    internalSetSpeed(speed);
+  }
+}
+
+/**
+   getFollowerError()
+   returns the last follower position error, steps, setpoint - currentPosition
+*/
+int32_t SpeedStepper::getFollowerError() {
+  return followerError;
+}
+
+/**
+   getFollowerMaxError()
+   returns the max abs(follower position error) since clearFollowerStats()
+*/
+int32_t SpeedStepper::getFollowerMaxError() {
+  return followerMaxError;
+}
+
+/**
+   getFollowerMaxLatency()
+   returns the max us from a sample being pushed to it being played back
+*/
+uint32_t SpeedStepper::getFollowerMaxLatency() {
+  return followerMaxLatency;
+}
+
+/**
+   getFollowerDroppedCount()
+   returns number of samples dropped because the queue was full
+*/
+uint32_t SpeedStepper::getFollowerDroppedCount() {
+  return followerDroppedCount;
+}
+
+/**
+   getFollowerStarvedCount()
+   returns number of updates that ran past maxExtrapolation_us with no new sample
+*/
+uint32_t SpeedStepper::getFollowerStarvedCount() {
+  return followerStarvedCount;
+}
+
+void SpeedStepper::clearFollowerStats() {
+  followerError = 0;
+  followerMaxError = 0;
+  followerMaxLatency = 0;
+  followerDroppedCount = 0;
+  followerStarvedCount = 0;
+}
+
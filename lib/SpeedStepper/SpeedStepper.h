@@ -33,13 +33,33 @@
  */
 
 #include <Arduino.h>
+#include "StepQueue.h"
 
 struct SpeedProfileStruct {
   float speed;   // the target speed at the end of this step
   unsigned long deltaTms;  // the time to accelerate from current speed (at start of this step) to the target speed
 };
 
+// precomputed Equation 13 deltaCn's for one acceleration, see setRampTables()
+struct SpeedRampTable {
+  float acceleration; // the acceleration this table was built for
+  uint32_t cmin;      // the table ends when cn reaches cmin
+  int32_t startN;     // the n of deltas[0]
+  uint16_t len;       // number of deltas
+  uint32_t endRest;   // rampDelta() remainder after the last delta, to carry on past the table
+  uint16_t *deltas;   // abs(deltaCn) for n = startN .. startN+len-1
+};
+
+// one position sample for the follower, see startFollowing()
+struct FollowerSetpoint {
+  int32_t position;  // steps
+  uint32_t time_us;  // micros() the position applies at
+  float velocity;    // steps/sec, secant over the last FOLLOWER_VELOCITY_SAMPLES samples
+};
+
 class SpeedStepper {
+  friend class SpeedStepperGroup; // drives the axes' steps from one scheduler
+  template <uint8_t, uint8_t, bool> friend class SpeedStepperT; // run() with its own pin output
 
 public:
 
@@ -51,6 +71,7 @@ public:
      Use InvertDirectionPin() to change this if needed
   */
   SpeedStepper(int stepPin, int dirPin);
+  ~SpeedStepper();
 
   /**
     Set where to send debug output, if any
@@ -72,6 +93,34 @@ public:
   */
   boolean isGoingHome();
 
+  /**
+    moveTo(int32_t)
+    run to this absolute position, in steps, and stop there
+    accelerates to maxSpeed, or less for short moves, and decelerates to stop at the target
+    the deceleration point is planned once here, not checked against the stopping distance every step
+    Still limited by the plus/minus limits.
+    calling setSpeed(), stop() or goHome() cancels the move
+  */
+  void moveTo(int32_t absolute);
+
+  /**
+    move(int32_t)
+    moveTo() relative to the current position
+  */
+  void move(int32_t relative);
+
+  /**
+    getTargetPosition()
+    returns the target of the last moveTo()/move()
+  */
+  int32_t getTargetPosition();
+
+  /**
+    isMovingToTarget()
+    returns true if running a moveTo()/move()
+  */
+  boolean isMovingToTarget();
+
   /**
      setPlusLimit(int32_t)
      sets the max positive limit position (in steps)
@@ -173,6 +222,7 @@ public:
   /**
      oneStep()
      Takes a single step in the current direction
+     Does not change the current position or check the position limits
   */
   void oneStep();
 
@@ -232,14 +282,14 @@ public:
   /**
      setMaxSpeed(float)
      Sets the maximum abs(speed) that setSpeed can set
-     Is limited to < 1000
+     Is limited to <= 50000
   */
   void setMaxSpeed(float maxSp);
 
   /**
      setMinSpeed(float)
      Sets the minimum abs(speed) that setSpeed can set
-     minSpeed is limited to > 0.0003
+     minSpeed is limited to >= 0.1
   */
   void setMinSpeed(float minSp);
 
@@ -250,9 +300,123 @@ public:
   */
   void setAcceleration(float newAcceleration);
 
+  /**
+     setJerk(float)
+     0.0 (the default) uses the constant acceleration ramp
+     > 0.0 uses a jerk limited (S-curve) ramp, the acceleration changes at no more than jerk steps/sec^3
+       up to the setAcceleration() rate, so speed changes, starts and stops have no step in acceleration.
+     The S-curve ramp does not use the ramp tables.
+  */
+  void setJerk(float newJerk);
+
+  /**
+     getJerk()
+     returns the jerk set, 0.0 if using the constant acceleration ramp
+  */
+  float getJerk();
+
+  /**
+     getSCurveAcceleration()
+     returns the S-curve ramp's current rate of change of abs(getSpeed()), steps/sec^2
+     0.0 if using the constant acceleration ramp
+  */
+  float getSCurveAcceleration();
+
+  /**
+     setRampTables(bool)
+     true to use precomputed ramp tables for speeding up and slowing down
+     false (the default) to calculate each step
+     While on, accelerations are rounded to 1/RAMP_TABLE_ACCEL_STEPS of a doubling (within 1.1%)
+     so nearly equal accelerations share a table.
+     setAcceleration(), setMaxSpeed() and setProfile() build the tables they need, run() never does,
+     and the last RAMP_TABLE_CACHE_SIZE tables are kept.
+     A profile segment whose table is not in the cache calculates each step.
+     Each table uses 2*RAMP_TABLE_MAX_LEN bytes
+  */
+  void setRampTables(boolean enable);
+
+  /**
+     getRampTableBuildCount()
+     returns the number of ramp tables built, e.g. to check a profile reuses its tables
+  */
+  uint32_t getRampTableBuildCount();
+
+  /**
+     setAbsoluteSchedule(bool)
+     false (the default), each step is timed from when the previous step was actually taken
+       so any lateness in calling run() delays all the following steps and the actual speed is less than getSpeed()
+     true, each step is timed from the previous step's deadline, including the fractions of a us,
+       so late steps are caught up by taking the following steps sooner.
+       If run() falls more than MAX_CATCH_UP_STEPS behind, those steps are dropped (see getMissedStepCount())
+       and the schedule restarts from now.
+  */
+  void setAbsoluteSchedule(boolean enable);
+
+  /**
+     getLateStepCount()
+     returns number of steps taken a whole step interval or more after their deadline
+  */
+  uint32_t getLateStepCount();
+
+  /**
+     getMissedStepCount()
+     returns number of steps dropped when the absolute schedule fell more than MAX_CATCH_UP_STEPS behind
+  */
+  uint32_t getMissedStepCount();
+
+  /**
+     getMaxStepLateness()
+     returns the max us a step was taken after its deadline
+  */
+  uint32_t getMaxStepLateness();
+
+  /**
+     clearScheduleCounts()
+     zeros the late/missed step counts and the max step lateness
+  */
+  void clearScheduleCounts();
+
+  const static uint32_t MAX_CATCH_UP_STEPS = 4;
+
+  // S-curve stopping distance allowance for the step the stop starts on and the fitted polynomial
+  constexpr static float STOP_DISTANCE_MARGIN = 1.01;
+
+  /**
+     setNonBlockingStepPulse(bool)
+     false (the default), each step busy waits minPulseWidth between STEP_PIN HIGH and LOW
+     true, STEP_PIN is set HIGH by one run() and set LOW by a later run() once minPulseWidth has passed
+       and the next step waits for minPulseWidth LOW, so run() never busy waits for a step pulse.
+       Changing direction still waits for any step pulse to finish
+  */
+  void setNonBlockingStepPulse(boolean enable);
+
+  /**
+     setStepQueue(StepQueue *queuePtr, uint32_t lookAhead_us)
+     NULL (the default), run() outputs the steps itself when they are due
+     otherwise run() plans the steps up to lookAhead_us ahead into the queue
+       and the queue's timer interrupt outputs them, so loop() delays less than lookAhead_us do not delay the steps.
+       getSpeed() and getCurrentPosition() are then the planned values, up to lookAhead_us ahead of the motor
+       and stop()/hardStop() take effect after the steps already queued.
+     Call while stopped.
+  */
+#ifdef SPEED_STEPPER_STEP_QUEUE
+  void setStepQueue(StepQueue *queuePtr, uint32_t lookAhead_us = 5000);
+#endif
+
+  const static size_t RAMP_TABLE_CACHE_SIZE = 4;
+  const static uint16_t RAMP_TABLE_MAX_LEN = 1024;
+  const static int RAMP_TABLE_ACCEL_STEPS = 32; // acceleration rounding steps per doubling
+
   // a little less than max int32_t
   // allow for times 2 for distanceToGo to still fit in int32_t
   const static int32_t MAX_INT32_T  = 0x3ffffff0;
+
+  // step intervals cn, c0, final_cn, cmin, cmax are fixed point Q24.8 us, i.e. 256 == 1us
+  // this keeps 1/256us resolution at high step rates with no float maths per step
+  // max step interval is ~16.7sec
+  const static uint32_t CN_FRAC_BITS = 8;
+  const static uint32_t CN_ONE_US = (1UL << CN_FRAC_BITS);
+  const static uint32_t CN_MAX = 0xffffff00;
     
     /**
       setProfile
@@ -278,8 +442,184 @@ public:
     */      
     bool isProfileRunning();
 
+  /**
+     startFollowing(uint32_t delay_us, float kp, uint32_t maxExtrapolation_us)
+     Follows a stream of positions added by pushSetpoint(), e.g. from motion sim software at 100..500Hz
+     The stream is played back delay_us behind the sample times, interpolating between samples
+     and using the interpolated sample velocity as the speed feed forward, plus kp * position error (steps/sec per step)
+     If the samples stop arriving, the last velocity is extrapolated for up to maxExtrapolation_us and then it holds position.
+     The speed is updated every FOLLOWER_UPDATE_US via setSpeed(), so the acceleration and speed limits still apply.
+     Calling setSpeed(), moveTo() or goHome() stops following.
+  */
+  void startFollowing(uint32_t delay_us = 10000, float kp = 20.0, uint32_t maxExtrapolation_us = 20000);
+
+  /**
+     stopFollowing()
+     stop following and decelerate to a stop
+  */
+  void stopFollowing();
+
+  /**
+     isFollowing()
+     returns true if following pushSetpoint() positions
+  */
+  boolean isFollowing();
+
+  /**
+     pushSetpoint(int32_t position)
+     pushSetpoint(int32_t position, uint32_t time_us)
+     add a position sample for the follower, time_us is the micros() the sample applies at (default now)
+     O(1), the oldest sample is dropped if FOLLOWER_QUEUE_SIZE samples are waiting
+     returns false if not following or the sample is not later than the last one
+  */
+  boolean pushSetpoint(int32_t position);
+  boolean pushSetpoint(int32_t position, uint32_t time_us);
+
+  /**
+     getFollowerError()
+     returns the last follower position error, steps, setpoint - currentPosition
+  */
+  int32_t getFollowerError();
+
+  /**
+     getFollowerMaxError()
+     returns the max abs(follower position error) since clearFollowerStats()
+  */
+  int32_t getFollowerMaxError();
+
+  /**
+     getFollowerMaxLatency()
+     returns the max us from a sample being pushed to it being played back
+  */
+  uint32_t getFollowerMaxLatency();
+
+  /**
+     getFollowerDroppedCount()
+     returns number of samples dropped because the queue was full
+  */
+  uint32_t getFollowerDroppedCount();
+
+  /**
+     getFollowerStarvedCount()
+     returns number of updates that ran past maxExtrapolation_us with no new sample
+  */
+  uint32_t getFollowerStarvedCount();
+
+  void clearFollowerStats();
+
+  const static size_t FOLLOWER_QUEUE_SIZE = 8;
+  const static size_t FOLLOWER_VELOCITY_SAMPLES = 3; // secant over this many sample intervals
+  const static uint32_t FOLLOWER_UPDATE_US = 1000;
+
 private:
 
+  /**
+     DigitalPins
+     the pin output for SpeedStepper, digitalWrite() to the pins passed to the constructor
+     SpeedStepperT uses its own, with the pins fixed at compile time
+  */
+  struct DigitalPins {
+    static inline void writeStep(SpeedStepper &s, boolean level) {
+      digitalWrite(s.STEP_PIN, level ? HIGH : LOW);
+    }
+    static inline void writeDir(SpeedStepper &s, boolean level) {
+      digitalWrite(s.DIR_PIN, level ? HIGH : LOW);
+    }
+  };
+
+  /**
+     outputStepPulse<PINS>()
+     Outputs one step pulse on the STEP_PIN, first writing DIR_PIN if it does not match dir
+     templated on the pin output so SpeedStepperT's pin writes inline
+  */
+  template <class PINS>
+  inline void outputStepPulse() {
+    if (nonBlockingPulse) {
+      while (stepPulsePending) {
+        finishStepPulse<PINS>(); // only waits if two steps are output without a run() between them
+      }
+      if (!finishStepPulse<PINS>()) {
+        // e.g. the first step of a reversal straight after the last step, run() outputs it when ready
+        stepPulsePending = true;
+        return;
+      }
+      PINS::writeStep(*this, HIGH);
+      stepPulseHigh = true;
+      stepPulseEdgeTime = micros();
+      // run() sets STEP_PIN LOW after minPulseWidth
+      return;
+    }
+    outputDir<PINS>();
+    PINS::writeStep(*this, HIGH);
+    // Delay the minimum allowed pulse width
+    delayMicroseconds(minPulseWidth);
+    PINS::writeStep(*this, LOW);
+  }
+
+  /**
+     finishStepPulse<PINS>()
+     endStepPulse() templated on the pin output
+     also writes any DIR_PIN change setDir() left for it and then any step pulse outputStepPulse() left for it,
+     so neither a direction change nor a step straight after the last one busy waits
+  */
+  template <class PINS>
+  inline boolean finishStepPulse() {
+    uint32_t sinceEdge = micros() - stepPulseEdgeTime;
+    if (sinceEdge < minPulseWidth) {
+      return false; // still in the HIGH or the LOW part of the pulse
+    }
+    if (stepPulseHigh) {
+      PINS::writeStep(*this, LOW);
+      stepPulseHigh = false;
+      stepPulseEdgeTime += sinceEdge;
+      return false; // need minPulseWidth LOW as well
+    }
+    boolean level = (dir != dirPinInverted);
+    if (level != dirPinLevel) {
+      // setDir() left DIR_PIN to here, STEP_PIN is LOW so it is safe to change
+      PINS::writeDir(*this, level);
+      dirPinLevel = level;
+      stepPulseEdgeTime += sinceEdge;
+      return false; // need minPulseWidth for the driver's dir setup time
+    }
+    if (stepPulsePending) {
+      PINS::writeStep(*this, HIGH);
+      stepPulsePending = false;
+      stepPulseHigh = true;
+      stepPulseEdgeTime += sinceEdge;
+      return false;
+    }
+    return true;
+  }
+
+  /**
+     outputDir<PINS>()
+     writes DIR_PIN if its level does not match dir and dirPinInverted
+     then waits minPulseWidth for the driver's dir setup time
+  */
+  template <class PINS>
+  inline void outputDir() {
+    boolean level = (dir != dirPinInverted);
+    if (level != dirPinLevel) {
+      PINS::writeDir(*this, level);
+      dirPinLevel = level;
+      delayMicroseconds(minPulseWidth);
+    }
+  }
+
+  /**
+     runUpdate()
+     the start of run(), follower updates and moving on to the next profile segment
+  */
+  void runUpdate();
+
+  /**
+     stepDue(uint32_t now)
+     returns true if it is time for the next step and updates the position and the step schedule for it
+     the caller outputs the step pulse
+  */
+  boolean stepDue(uint32_t now);
+
   /**
      runSpeed()
      return false if nothing to do
@@ -287,6 +627,75 @@ private:
   */
   boolean runSpeed();
 
+  /**
+     runSpeed(uint32_t now)
+     as runSpeed() but uses now instead of reading micros()
+  */
+  boolean runSpeed(uint32_t now);
+
+  /**
+     startMove(int32_t target, float speed)
+     run at abs(speed) towards target and stop there
+     uses temporary position limits at the target, as goHome() does
+  */
+  void startMove(int32_t target, float speed);
+
+  /**
+     planMove()
+     sets moveDecelSteps, the closed form distance from the target to start decelerating
+     for the trapezoidal, or if too short, triangular speed profile of the current move
+  */
+  void planMove();
+
+  /**
+     restoreLimits()
+     puts back the position limits saved by goHome() or startMove()
+     clears goingHome and movingToTarget
+  */
+  void restoreLimits();
+
+  /**
+     groupStep(bool forward)
+     one step in the given direction, within the position limits
+     used by SpeedStepperGroup for the slave axes
+  */
+  void groupStep(boolean forward);
+
+  /**
+     startStep()
+     oneStep() for the first step of a run from stopped, counted in the current position
+  */
+  void startStep();
+
+  /**
+     stepPulse()
+     Outputs one step pulse on the STEP_PIN
+  */
+  void stepPulse();
+
+  /**
+     endStepPulse()
+     For non-blocking step pulses, sets STEP_PIN LOW once minPulseWidth has passed
+     and then writes DIR_PIN if setDir() changed it and outputs any step pulse left pending
+     returns true if STEP_PIN is LOW and has been for minPulseWidth, i.e. ready for the next step
+  */
+  boolean endStepPulse();
+
+  /**
+     waitStepPulseEnd()
+     Busy waits for any non-blocking step pulse to finish
+  */
+  void waitStepPulseEnd();
+
+  /**
+     planSteps()
+     fills the step queue up to queueLookAhead us ahead
+     returns true if stepper still running
+  */
+#ifdef SPEED_STEPPER_STEP_QUEUE
+  boolean planSteps();
+#endif
+
   /**
      New speed, limited to maxSpeed and minSpeed
      if it is < minSpeed it is set to 0.0
@@ -317,6 +726,70 @@ private:
   */
   void printComputeNewStepDebug();
 
+  /**
+     speedToCn(float)
+     convert abs(speed) steps/sec to a fixed point step interval
+     clamped to CN_MAX
+  */
+  uint32_t speedToCn(float a_sp);
+
+  /**
+     cnToInterval(uint32_t)
+     round a fixed point step interval to the nearest us for stepInterval
+  */
+  uint32_t cnToInterval(uint32_t c);
+
+  /**
+     rampDelta(uint32_t c, uint32_t denom, uint32_t &rest)
+     returns abs(deltaCn) = (2*c)/denom for Equation 13, in integer maths
+     carrying the remainder forward in rest
+  */
+  uint32_t rampDelta(uint32_t c, uint32_t denom, uint32_t &rest);
+
+  /**
+     internalSetAcceleration(float newAcceleration, bool buildTable)
+     setAcceleration(), buildTable false if a missing ramp table should not be built
+  */
+  void internalSetAcceleration(float newAcceleration, boolean buildTable);
+
+  /**
+     limitAcceleration(float)
+     returns abs(newAcceleration) limited to >= 0.0001 and rounded for the ramp tables
+  */
+  float limitAcceleration(float newAcceleration);
+
+  /**
+     accelerationToC0(float)
+     returns the Equation 15 first step interval for this acceleration, fixed point
+  */
+  uint32_t accelerationToC0(float a);
+
+  /**
+     selectRampTable(bool build)
+     picks the cached ramp table for the current acceleration and cmin
+     building it if it is not in the cache and build is true
+  */
+  void selectRampTable(boolean build);
+
+  /**
+     findRampTable(float accel, bool build)
+     returns the cached ramp table for accel and cmin, building it if build is true
+     NULL if not found
+  */
+  SpeedRampTable *findRampTable(float accel, boolean build);
+
+  /**
+     buildProfileRampTables()
+     builds the ramp tables for the set profile's segments
+  */
+  void buildProfileRampTables();
+
+  /**
+     buildRampTable(SpeedRampTable*, float accel)
+     runs Equation 13 from the c0 for accel up to cmin and saves the deltaCn's
+  */
+  void buildRampTable(SpeedRampTable *tablePtr, float accel);
+
   /**
      updateComputeTimes()
      Keeps track of maximum time computeNewSpeed() takes to execute
@@ -332,6 +805,44 @@ private:
        returns true  if oneStep taken
     */
     bool computeNewSpeed();
+
+  /**
+     updateFollower(uint32_t now)
+     sets the speed from the setpoint queue, called from run() every FOLLOWER_UPDATE_US while following
+  */
+  void updateFollower(uint32_t now);
+
+  /**
+     followerSetpoint(size_t i)
+     returns the i'th oldest queued setpoint
+  */
+  FollowerSetpoint &followerSetpoint(size_t i);
+
+  /**
+     computeSCurveSpeed(int32_t distanceTo)
+     computeNewSpeed() for setJerk() > 0
+     returns true if oneStep taken
+  */
+  bool computeSCurveSpeed(int32_t distanceTo);
+
+  /**
+     sCurveStopDistance(float speed, float accel, boolean &reachesAccel)
+     returns the steps needed to stop from this S-curve speed and acceleration
+     reachesAccel is set false if the stop is too short to reach the full deceleration
+  */
+  float sCurveStopDistance(float speed, float accel, boolean &reachesAccel);
+
+  /**
+     fitSCurveStopDistance(float j, float T)
+     fits sCurveStopDistance() over the next T sec at jerk j to a polynomial evaluated per step
+  */
+  void fitSCurveStopDistance(float j, float T);
+
+  /**
+     setSCurveInterval()
+     sets cn and stepInterval for scSpeed without a divide
+  */
+  void setSCurveInterval();
     
     /**
       printCurrentProfileStep()
@@ -347,18 +858,46 @@ private:
     unsigned long profileStepLenMs;
     unsigned long profileStepStartMs;
     float profileTargetSpeed;
+
+  boolean following;
+  uint32_t followerDelay; // us
+  float followerKp;
+  uint32_t followerMaxExtrapolation; // us
+  uint32_t followerLastUpdate; // micros()
+  FollowerSetpoint followerQueue[FOLLOWER_QUEUE_SIZE];
+  uint32_t followerPushTime[FOLLOWER_QUEUE_SIZE]; // micros() when pushed, for latency
+  size_t followerHead; // oldest
+  size_t followerCount;
+  uint32_t followerPushed; // total samples pushed, the ring slots before followerHead keep the older samples for the velocity secant
+  int32_t followerError;
+  int32_t followerMaxError;
+  uint32_t followerMaxLatency;
+  uint32_t followerDroppedCount;
+  uint32_t followerStarvedCount;
+
+  boolean useRampTables;
+  SpeedRampTable rampTables[RAMP_TABLE_CACHE_SIZE];
+  SpeedRampTable *rampTablePtr; // NULL if not using tables
+  size_t rampTableNext; // next cache entry to replace
+  uint32_t rampTableBuildCount;
     
   const int32_t LARGE_N = 1000000000;
   uint32_t start_us;
 
   boolean dirPinInverted;
+  boolean dirPinLevel; // the level last written to DIR_PIN
+  boolean deferDirOutput; // true for SpeedStepperT, setDir() leaves DIR_PIN to the next step pulse
   Print* debugPtr;
   int32_t n;
-  float cn;
-  float c0;
-  float cs; // speed c
-  float final_cn; // cn at targetSpeed
+  uint32_t cn;  // Q24.8 us
+  uint32_t cnRest; // remainder carried from the last cn calculation
+  uint32_t c0;
+  uint32_t final_cn; // cn at targetSpeed
+  int32_t cruiseStepsToStop; // stepsToStop saved when ramp reaches final_cn
   boolean goingHome; // set to true when returning to home, 0 position
+  boolean movingToTarget; // set to true by startMove() until stopped
+  int32_t targetPosition; // for startMove()
+  int32_t moveDecelSteps; // start decelerating this many steps from the move's limit, -1 if not planned
 
   boolean dir; // dir true forward, false reverse
   // change setDir() method  to get stepper to go in required direction for forward
@@ -370,22 +909,48 @@ private:
 
   float maxSpeed;
   float minSpeed;
-  float cmin; // min step interval limited to 1000us
-  float cmax; // max step interval set min speed
+  uint32_t cmin; // min step interval limited to 20us
+  uint32_t cmax; // max step interval set min speed
   uint32_t stepInterval;
   int32_t currentPosition;
-  uint32_t lastStepTime;
+  uint32_t lastStepTime; // or the last step deadline if absoluteSchedule
+  boolean absoluteSchedule;
+  uint32_t scheduleFrac; // fraction of a us carried to the next deadline, Q24.8
+  uint32_t lateStepCount;
+  uint32_t missedStepCount;
+  uint32_t maxStepLateness;
+  boolean nonBlockingPulse;
+  boolean stepPulseHigh; // non-blocking step pulse waiting to be set LOW
+  boolean stepPulsePending; // non-blocking step pulse waiting for the last pulse or a DIR change to finish
+  uint32_t stepPulseEdgeTime; // micros() of last STEP_PIN change
+  StepQueue *stepQueuePtr; // NULL if run() outputs the steps
+  uint32_t queueLookAhead; // us
   float acceleration; // steps/sec per sec
+  float jerk; // steps/sec^3, 0.0 for constant acceleration ramps
+  float scSpeed; // S-curve abs(speed)
+  float scAccel; // S-curve rate of change of abs(speed)
+  float scMinSpeed; // S-curve speed of the first step, c0
+  float scInvJerk; // 1/jerk
+  float scInvAccel; // 1/acceleration
+  float scDt; // S-curve step interval in sec, 1/scSpeed
+  float scLandJerk; // jerk landing on the target speed, 0.0 if not landing
+  int32_t scLimitDistance; // distanceToGo() while stopping for a limit, -1 if not
+  float scStopPoly[5]; // sCurveStopDistance() as a polynomial in scStopX, see fitSCurveStopDistance()
+  float scStopX; // 4*(time since the fit)/(time fitted over)
+  float scStopInvH; // scStopX per sec
+  float scStopJerk; // jerk of the fit
+  float scStopAccel; // scAccel at the fit
+  boolean scStopFitted; // false to refit on the next step
   int32_t maxPositionLimit;
   int32_t minPositionLimit;
-  int32_t tempMaxPosLimit; // override for going home
+  int32_t tempMaxPosLimit; // override for going home or startMove()
   int32_t tempMinPosLimit; 
 
 
   const float maxMaxSpeed;
   // steps/sec min 1 i.e. 5e-3 rev/sec at 200 step per rev
   // i.e. 200sec/rev, 3.3min/rev
-  // min speed must be > 0.0003
+  // min speed must be >= 0.1, i.e. step interval fits in cn
   const float minMaxSpeed;
   // minSpeed sets how slow you can set the target speed
   // if setSpeed called with a target speed of less than this(e.g. 0) AND current speed is < 2*minSpeed
@@ -393,8 +958,6 @@ private:
 
   int STEP_PIN;
   int DIR_PIN;
-  float speed;
-  float a_speed;
   float targetSpeed;
   float a_targetSpeed;
   boolean targetDir;
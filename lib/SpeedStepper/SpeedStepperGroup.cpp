@@ -0,0 +1,205 @@
+// SpeedStepperGroup.cpp
+#include "SpeedStepperGroup.h"
+
+/*
+   (c)2019 Forward Computing and Control Pty. Ltd.
+   NSW Australia, www.forward.com.au
+   This code is not warranted to be fit for any purpose. You may only use it at your own risk.
+   This code may be freely used for both private and commercial use
+   provided this copyright is maintained.
+*/
+
+SpeedStepperGroup::SpeedStepperGroup() {
+  numAxes = 0;
+  master = 0;
+  maxSpeed = 1000.0;
+  acceleration = 1000.0;
+  masterSteps = 0;
+  masterSaved = false;
+  masterMaxSpeed = 0.0;
+  masterAcceleration = 0.0;
+  for (size_t i = 0; i < MAX_AXES; i++) {
+    axes[i] = NULL;
+    deltas[i] = 0;
+    errors[i] = 0;
+    forward[i] = true;
+  }
+}
+
+/**
+   addStepper(SpeedStepper &stepper)
+   add an axis to the group, the axes are indexed in the order added
+   returns false if the group already has MAX_AXES axes
+*/
+boolean SpeedStepperGroup::addStepper(SpeedStepper &stepper) {
+  if (numAxes >= MAX_AXES) {
+    return false;
+  }
+  axes[numAxes++] = &stepper;
+  return true;
+}
+
+/**
+   getNumAxes()
+   returns number of axes added
+*/
+size_t SpeedStepperGroup::getNumAxes() {
+  return numAxes;
+}
+
+/**
+   setMaxSpeed(float)
+   the master axis' max speed, steps/sec, for moveTo()
+*/
+void SpeedStepperGroup::setMaxSpeed(float speed) {
+  maxSpeed = (speed >= 0.0) ? speed : -speed;
+}
+
+/**
+   setAcceleration(float)
+   the master axis' acceleration, steps/sec/sec, for moveTo()
+*/
+void SpeedStepperGroup::setAcceleration(float _acceleration) {
+  acceleration = (_acceleration >= 0.0) ? _acceleration : -_acceleration;
+}
+
+/**
+   moveTo(const int32_t targets[])
+   start a coordinated move of all the axes to these positions, one per axis
+   The axis with the largest distance is the master
+   its max speed and acceleration are saved and restored when the move ends
+   returns false if the group is still running, call stop() first
+*/
+boolean SpeedStepperGroup::moveTo(const int32_t targets[]) {
+  if ((numAxes == 0) || isRunning()) {
+    return false;
+  }
+  restoreMaster(); // in case run() was not called after the last move ended
+  master = 0;
+  masterSteps = 0;
+  for (size_t i = 0; i < numAxes; i++) {
+    int32_t delta = targets[i] - axes[i]->getCurrentPosition();
+    forward[i] = (delta >= 0);
+    deltas[i] = forward[i] ? delta : -delta;
+    if (deltas[i] > masterSteps) {
+      masterSteps = deltas[i];
+      master = i;
+    }
+  }
+  if (masterSteps == 0) {
+    return true; // already there
+  }
+  for (size_t i = 0; i < numAxes; i++) {
+    // start at half so the slave steps are centred between master steps
+    // and each slave takes exactly deltas[i] steps in masterSteps master steps
+    errors[i] = masterSteps / 2;
+    if (i != master) {
+      axes[i]->hardStop();
+    }
+  }
+  SpeedStepper *m = axes[master];
+  masterMaxSpeed = m->maxSpeed;
+  masterAcceleration = m->acceleration;
+  masterSaved = true;
+  m->setMaxSpeed(maxSpeed);
+  m->setAcceleration(acceleration);
+  int32_t before = m->getCurrentPosition();
+  m->moveTo(targets[master]); // takes the first master step now
+  if (m->getCurrentPosition() != before) {
+    stepSlaves();
+  }
+  if (!m->isRunning()) {
+    restoreMaster(); // a one step move
+  }
+  return true;
+}
+
+/**
+   run()
+   call at least once per loop()
+   reads micros() once, steps the master when due and the slaves in proportion
+   returns true if the group is still moving
+*/
+boolean SpeedStepperGroup::run() {
+  if (numAxes == 0) {
+    return false;
+  }
+  SpeedStepper *m = axes[master];
+  for (size_t i = 0; i < numAxes; i++) {
+    if (axes[i]->nonBlockingPulse && (axes[i]->stepPulseHigh || axes[i]->stepPulsePending)) {
+      axes[i]->endStepPulse(); // set STEP_PIN LOW, or output a pending step
+    }
+  }
+  if (m->nonBlockingPulse && (!m->endStepPulse())) {
+    return m->isRunning();
+  }
+  int32_t before = m->getCurrentPosition();
+  if (m->runSpeed(micros())) {
+    m->computeNewSpeed();
+  }
+  if (m->getCurrentPosition() != before) {
+    stepSlaves();
+  }
+  if (!m->isRunning()) {
+    restoreMaster();
+    return false;
+  }
+  return true;
+}
+
+/**
+   stepSlaves()
+   called after each master step
+   Bresenham, each slave steps when its accumulated deltas pass masterSteps
+*/
+void SpeedStepperGroup::stepSlaves() {
+  for (size_t i = 0; i < numAxes; i++) {
+    if (i == master) {
+      continue;
+    }
+    errors[i] += deltas[i];
+    if (errors[i] >= masterSteps) {
+      errors[i] -= masterSteps;
+      axes[i]->groupStep(forward[i]);
+    }
+  }
+}
+
+/**
+   restoreMaster()
+   puts back the master axis' own max speed and acceleration, saved by moveTo()
+   an acceleration of 0 was never set, setAcceleration() would limit it, so it is left at the group's
+*/
+void SpeedStepperGroup::restoreMaster() {
+  if (!masterSaved) {
+    return;
+  }
+  masterSaved = false;
+  SpeedStepper *m = axes[master];
+  m->setMaxSpeed(masterMaxSpeed);
+  if (masterAcceleration > 0.0) {
+    m->setAcceleration(masterAcceleration);
+  }
+}
+
+/**
+   isRunning()
+   returns true if the group is still moving
+*/
+boolean SpeedStepperGroup::isRunning() {
+  if (numAxes == 0) {
+    return false;
+  }
+  return axes[master]->isRunning();
+}
+
+/**
+   stop()
+   decelerate the master to a stop, the slaves keep in proportion
+*/
+void SpeedStepperGroup::stop() {
+  if (numAxes == 0) {
+    return;
+  }
+  axes[master]->stop();
+}
@@ -0,0 +1,123 @@
+// SpeedStepperGroup.h
+#ifndef SPEED_STEPPER_GROUP_H
+#define SPEED_STEPPER_GROUP_H
+
+/*
+ * (c)2019 Forward Computing and Control Pty. Ltd.
+ * NSW Australia, www.forward.com.au
+ * This code is not warranted to be fit for any purpose. You may only use it at your own risk.
+ * This code may be freely used for both private and commercial use
+ * provided this copyright is maintained.
+ */
+
+#include "SpeedStepper.h"
+
+/**
+   SpeedStepperGroup
+   Moves up to MAX_AXES SpeedSteppers together so they all start and finish at the same time.
+   For each move the axis with the largest distance is the master and is ramped by its SpeedStepper code
+   using the group's max speed and acceleration.
+   The other (slave) axes step in proportion using Bresenham (DDA) interpolation, each time the master steps.
+   group.run() replaces calling run() on each axis and reads micros() once for all the axes.
+
+   e.g.
+   SpeedStepper stepperX(17, 18);
+   SpeedStepper stepperY(16, 19);
+   SpeedStepperGroup group;
+   group.addStepper(stepperX);
+   group.addStepper(stepperY);
+   int32_t targets[] = {2000, 500};
+   group.moveTo(targets);
+   ...
+   loop() { group.run(); }
+
+   The axes should not use setStepQueue() and should not have their own run() called while in the group.
+*/
+class SpeedStepperGroup {
+public:
+  const static size_t MAX_AXES = 4;
+
+  SpeedStepperGroup();
+
+  /**
+     addStepper(SpeedStepper &stepper)
+     add an axis to the group, the axes are indexed in the order added
+     returns false if the group already has MAX_AXES axes
+  */
+  boolean addStepper(SpeedStepper &stepper);
+
+  /**
+     getNumAxes()
+     returns number of axes added
+  */
+  size_t getNumAxes();
+
+  /**
+     setMaxSpeed(float)
+     the master axis' max speed, steps/sec, for moveTo()
+  */
+  void setMaxSpeed(float speed);
+
+  /**
+     setAcceleration(float)
+     the master axis' acceleration, steps/sec/sec, for moveTo()
+  */
+  void setAcceleration(float acceleration);
+
+  /**
+     moveTo(const int32_t targets[])
+     start a coordinated move of all the axes to these positions, one per axis
+     the master axis moves at the group's max speed and acceleration,
+     its own are restored when the move ends, i.e. by the run() that returns false
+     returns false if the group is still running, call stop() first
+  */
+  boolean moveTo(const int32_t targets[]);
+
+  /**
+     run()
+     call at least once per loop()
+     steps the master when due and the slaves in proportion
+     returns true if the group is still moving
+  */
+  boolean run();
+
+  /**
+     isRunning()
+     returns true if the group is still moving
+  */
+  boolean isRunning();
+
+  /**
+     stop()
+     decelerate the master to a stop, the slaves keep in proportion
+  */
+  void stop();
+
+private:
+  /**
+     stepSlaves()
+     called after each master step, steps the slaves in proportion
+  */
+  void stepSlaves();
+
+  /**
+     restoreMaster()
+     puts back the master axis' own max speed and acceleration, saved by moveTo()
+  */
+  void restoreMaster();
+
+  SpeedStepper *axes[MAX_AXES];
+  size_t numAxes;
+  size_t master;
+  float maxSpeed;
+  float acceleration;
+  int32_t masterSteps;       // abs distance of the master for this move
+  int32_t deltas[MAX_AXES];  // abs distance for each axis
+  int32_t errors[MAX_AXES];  // Bresenham error for each axis
+  boolean forward[MAX_AXES]; // direction of each axis for this move
+  boolean masterSaved;       // moveTo() has saved the master's settings and not restored them yet
+  float masterMaxSpeed;      // the master axis' own max speed
+  float masterAcceleration;  // the master axis' own acceleration
+};
+
+#endif // SPEED_STEPPER_GROUP_H
@@ -0,0 +1,108 @@
+// SpeedStepperT.h
+#ifndef SPEED_STEPPER_T_H
+#define SPEED_STEPPER_T_H
+
+/*
+ * Modification (c)2019 Forward Computing and Control Pty. Ltd.
+ * NSW Australia, www.forward.com.au
+ * This code is not warranted to be fit for any purpose. You may only use it at your own risk.
+ * The modifications may be freely used for both private and commercial use
+ * provided this copyright is maintained.
+ *
+ * See SpeedStepper.h for the AccelStepper copyright and licensing
+ */
+
+#include "SpeedStepper.h"
+
+/**
+   SpeedStepperT<STEP_PIN, DIR_PIN, INVERT>
+   A SpeedStepper with the pins fixed at compile time.
+   run() outputs the step and dir edges as single GPIO register set/clear stores, inlined, instead of digitalWrite() calls.
+   All the ramping, limits, profiles etc are the SpeedStepper code, there are no virtual methods.
+   INVERT true inverts the DIR_PIN output, i.e. LOW for forward, the same as calling invertDirectionLogic()
+
+   DIR_PIN is written just before the next step pulse, not when the direction is set.
+   Steps from stepForward()/stepReverse(), SpeedStepperGroup and a step queue use the SpeedStepper digitalWrite() output,
+   as does calling run() through a SpeedStepper reference or pointer.
+
+   e.g.
+   SpeedStepperT<17, 18> stepper;  // replaces SpeedStepper stepper(17, 18);
+
+   ESP32 uses the GPIO.out_w1ts/out_w1tc registers (pins 0..31) and GPIO.out1_w1ts/out1_w1tc (pins 32..39)
+   Defining SPEED_STEPPER_HOST_GPIO (for building on a PC) calls speedStepperHostGpioWrite(pin, level) instead,
+   supplied by the host build, so the edge sequence and the writes per step can be checked.
+   Other boards fall back to digitalWrite() with constant pins.
+*/
+
+#if defined(SPEED_STEPPER_HOST_GPIO)
+// the 'GPIO register store' for host builds
+void speedStepperHostGpioWrite(uint8_t pin, boolean level);
+#elif defined(ARDUINO_ARCH_ESP32)
+#include "soc/gpio_struct.h"
+#endif
+
+template <uint8_t STEP_PIN_T, uint8_t DIR_PIN_T, bool INVERT = false>
+class SpeedStepperT : public SpeedStepper {
+
+public:
+  SpeedStepperT() : SpeedStepper(STEP_PIN_T, DIR_PIN_T) {
+    dirPinInverted = INVERT;
+    deferDirOutput = true; // run() writes DIR_PIN before the next step
+  }
+
+  /**
+     run()
+     SpeedStepper::run() with the step and dir edges written by GpioPins
+  */
+  boolean run() {
+    runUpdate();
+#ifdef SPEED_STEPPER_STEP_QUEUE
+    if (stepQueuePtr != NULL) {
+      return planSteps();
+    }
+#endif
+    if (nonBlockingPulse && (!finishStepPulse<GpioPins>())) {
+      return (stepInterval != 0); // the last step pulse is not finished yet
+    }
+    if ((stepInterval != 0) && stepDue(micros())) {
+      outputStepPulse<GpioPins>();
+      computeNewSpeed(); // does ramping if runningProfile
+    }
+    return (stepInterval != 0);
+  }
+
+private:
+  struct GpioPins {
+    static inline void writeStep(SpeedStepper &, boolean level) {
+      gpioWrite<STEP_PIN_T>(level);
+    }
+    static inline void writeDir(SpeedStepper &, boolean level) {
+      gpioWrite<DIR_PIN_T>(level);
+    }
+  };
+
+  template <uint8_t PIN>
+  static inline void gpioWrite(boolean level) {
+#if defined(SPEED_STEPPER_HOST_GPIO)
+    speedStepperHostGpioWrite(PIN, level);
+#elif defined(ARDUINO_ARCH_ESP32)
+    if (PIN < 32) {
+      if (level) {
+        GPIO.out_w1ts = (1UL << (PIN & 31));
+      } else {
+        GPIO.out_w1tc = (1UL << (PIN & 31));
+      }
+    } else {
+      if (level) {
+        GPIO.out1_w1ts.val = (1UL << (PIN & 31));
+      } else {
+        GPIO.out1_w1tc.val = (1UL << (PIN & 31));
+      }
+    }
+#else
+    digitalWrite(PIN, level ? HIGH : LOW);
+#endif
+  }
+};
+
+#endif // SPEED_STEPPER_T_H
@@ -0,0 +1,347 @@
+// StepQueue.cpp
+#include "StepQueue.h"
+
+/*
+   (c)2019 Forward Computing and Control Pty. Ltd.
+   NSW Australia, www.forward.com.au
+   This code is not warranted to be fit for any purpose. You may only use it at your own risk.
+   This code may be freely used for both private and commercial use
+   provided this copyright is maintained.
+*/
+
+#ifdef SPEED_STEPPER_STEP_QUEUE
+
+StepQueue::StepQueue(StepTimer &timer, uint32_t pulseWidth_us) : pulseWidth(pulseWidth_us) {
+  timerPtr = &timer;
+  head = 0;
+  tail = 0;
+  pushedUs = 0;
+  poppedUs = 0;
+  timerRunning = false;
+  producerRunning = false;
+  pulseHigh = false;
+  dirForward = true;
+  ranEmpty = false;
+  lastStepUs = 0;
+  nextStepUs = 0;
+  clearStats();
+}
+
+/**
+   begin()
+   connects the timer, call once from setup()
+*/
+void StepQueue::begin() {
+  timerPtr->begin(this);
+  timerPtr->writeStep(LOW);
+  timerPtr->writeDir(dirForward ? HIGH : LOW);
+}
+
+/**
+   push(uint32_t interval, bool forward)
+   add a step interval us after the previous step
+   returns false if the queue is full
+*/
+boolean StepQueue::push(uint32_t interval, boolean forward) {
+  uint16_t t = tail.load(std::memory_order_relaxed);
+  if ((uint16_t)(t - head.load(std::memory_order_acquire)) >= QUEUE_SIZE) {
+    return false; // full
+  }
+  entries[t & (QUEUE_SIZE - 1)].interval = interval;
+  entries[t & (QUEUE_SIZE - 1)].forward = forward;
+  pushedUs += interval;
+  tail.store(t + 1, std::memory_order_release);
+  uint16_t d = depth();
+  if (d > maxDepth) {
+    maxDepth = d;
+  }
+  return true;
+}
+
+/**
+   availableForWrite()
+   returns number of entries that can be pushed
+*/
+uint16_t StepQueue::availableForWrite() {
+  return QUEUE_SIZE - depth();
+}
+
+/**
+   depth()
+   returns number of entries waiting to be output
+*/
+uint16_t StepQueue::depth() {
+  return (uint16_t)(tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire));
+}
+
+/**
+   queuedTime()
+   returns the us of steps waiting to be output
+*/
+uint32_t StepQueue::queuedTime() {
+  return pushedUs - poppedUs;
+}
+
+/**
+   setProducerRunning(bool)
+   true while the planner expects to keep the queue filled
+*/
+void StepQueue::setProducerRunning(boolean running) {
+  producerRunning = running;
+}
+
+/**
+   kick()
+   starts the timer if it is idle and there are steps queued
+   If the interrupt is just going idle as this is called, the next kick() restarts it
+*/
+void StepQueue::kick() {
+  if (timerRunning.load(std::memory_order_acquire) || (depth() == 0)) {
+    return;
+  }
+  timerRunning.store(true, std::memory_order_release);
+  pulseHigh = false;
+  uint32_t now = timerPtr->nowUs();
+  uint32_t interval = entries[head.load(std::memory_order_relaxed) & (QUEUE_SIZE - 1)].interval;
+  uint32_t sinceLast = now - lastStepUs;
+  uint32_t wait = 1;
+  if (interval > sinceLast) {
+    wait = interval - sinceLast; // still on time, e.g. a step longer than the planner's look ahead
+  } else if (ranEmpty) {
+    underrunCount++; // this step is late because the queue ran empty
+  }
+  // else first step of a new move, don't try to catch up
+  ranEmpty = false;
+  nextStepUs = now + wait;
+  timerPtr->start(wait);
+}
+
+uint32_t StepQueue::getUnderrunCount() {
+  return underrunCount;
+}
+
+uint16_t StepQueue::getMaxDepth() {
+  return maxDepth;
+}
+
+uint32_t StepQueue::getMaxJitter() {
+  return maxJitter;
+}
+
+uint32_t StepQueue::getStepCount() {
+  return stepCount;
+}
+
+void StepQueue::clearStats() {
+  underrunCount = 0;
+  maxDepth = 0;
+  maxJitter = 0;
+  stepCount = 0;
+}
+
+/**
+   onTimer()
+   called from the StepTimer interrupt
+   Each step takes two calls, one sets STEP HIGH and the next, pulseWidth later,
+   sets it LOW and sets DIR for the following step so DIR has the whole step interval to settle.
+   returns us until the next call, 0 to stop the timer
+*/
+uint32_t STEP_QUEUE_ISR_ATTR StepQueue::onTimer() {
+  uint16_t h = head.load(std::memory_order_relaxed);
+  if (!pulseHigh) {
+    // rising edge for the entry at head
+    if (h == tail.load(std::memory_order_acquire)) {
+      timerRunning.store(false, std::memory_order_release);
+      return 0;
+    }
+    StepQueueEntry &e = entries[h & (QUEUE_SIZE - 1)];
+    if (e.forward != dirForward) { // not set on last falling edge, e.g. first step
+      dirForward = e.forward;
+      timerPtr->writeDir(dirForward ? HIGH : LOW);
+    }
+    timerPtr->writeStep(HIGH);
+    uint32_t now = timerPtr->nowUs();
+    uint32_t jitter = (now >= nextStepUs) ? (now - nextStepUs) : (nextStepUs - now);
+    if (jitter > maxJitter) {
+      maxJitter = jitter;
+    }
+    lastStepUs = nextStepUs;
+    poppedUs += e.interval;
+    head.store(h + 1, std::memory_order_release);
+    stepCount++;
+    pulseHigh = true;
+    return pulseWidth;
+  }
+  // else falling edge
+  timerPtr->writeStep(LOW);
+  pulseHigh = false;
+  if (h == tail.load(std::memory_order_acquire)) {
+    ranEmpty = producerRunning; // kick() counts an underrun if the next step is then late
+    timerRunning.store(false, std::memory_order_release);
+    return 0;
+  }
+  StepQueueEntry &next = entries[h & (QUEUE_SIZE - 1)];
+  if (next.forward != dirForward) {
+    dirForward = next.forward;
+    timerPtr->writeDir(dirForward ? HIGH : LOW);
+  }
+  nextStepUs = lastStepUs + next.interval;
+  uint32_t sinceLast = timerPtr->nowUs() - lastStepUs;
+  uint32_t wait = (next.interval > sinceLast) ? (next.interval - sinceLast) : 0;
+  return (wait < pulseWidth) ? pulseWidth : wait; // at least pulseWidth LOW, also DIR setup time
+}
+
+#if defined(ARDUINO_ARCH_ESP32)
+#include "soc/gpio_struct.h"
+
+static StepTimerESP32 *stepTimerESP32Ptrs[4];
+static void STEP_QUEUE_ISR_ATTR stepTimerISR0() {
+  stepTimerESP32Ptrs[0]->onInterrupt();
+}
+static void STEP_QUEUE_ISR_ATTR stepTimerISR1() {
+  stepTimerESP32Ptrs[1]->onInterrupt();
+}
+static void STEP_QUEUE_ISR_ATTR stepTimerISR2() {
+  stepTimerESP32Ptrs[2]->onInterrupt();
+}
+static void STEP_QUEUE_ISR_ATTR stepTimerISR3() {
+  stepTimerESP32Ptrs[3]->onInterrupt();
+}
+static void (*const stepTimerISRs[4])() = {stepTimerISR0, stepTimerISR1, stepTimerISR2, stepTimerISR3};
+
+StepTimerESP32::StepTimerESP32(uint8_t _stepPin, uint8_t _dirPin, uint8_t _timerNo) {
+  stepPin = _stepPin;
+  dirPin = _dirPin;
+  timerNo = _timerNo & 3;
+  timer = NULL;
+  queuePtr = NULL;
+}
+
+void StepTimerESP32::begin(StepQueue *_queuePtr) {
+  queuePtr = _queuePtr;
+  pinMode(stepPin, OUTPUT);
+  pinMode(dirPin, OUTPUT);
+  stepTimerESP32Ptrs[timerNo] = this;
+  timer = timerBegin(timerNo, 80, true); // 80Mhz / 80 => 1us ticks
+  timerAttachInterrupt(timer, stepTimerISRs[timerNo], true);
+}
+
+void STEP_QUEUE_ISR_ATTR StepTimerESP32::start(uint32_t us) {
+  timerWrite(timer, 0);
+  timerAlarmWrite(timer, us, false); // one shot
+  timerAlarmEnable(timer);
+}
+
+static inline void STEP_QUEUE_ISR_ATTR gpioWrite(uint8_t pin, boolean level) {
+  if (pin < 32) {
+    if (level) {
+      GPIO.out_w1ts = (1UL << pin);
+    } else {
+      GPIO.out_w1tc = (1UL << pin);
+    }
+  } else {
+    if (level) {
+      GPIO.out1_w1ts.val = (1UL << (pin - 32));
+    } else {
+      GPIO.out1_w1tc.val = (1UL << (pin - 32));
+    }
+  }
+}
+
+void STEP_QUEUE_ISR_ATTR StepTimerESP32::writeStep(boolean level) {
+  gpioWrite(stepPin, level);
+}
+
+void STEP_QUEUE_ISR_ATTR StepTimerESP32::writeDir(boolean level) {
+  gpioWrite(dirPin, level);
+}
+
+uint32_t STEP_QUEUE_ISR_ATTR StepTimerESP32::nowUs() {
+  return micros();
+}
+
+void STEP_QUEUE_ISR_ATTR StepTimerESP32::onInterrupt() {
+  uint32_t next = queuePtr->onTimer();
+  if (next) {
+    start(next);
+  }
+}
+#endif
+
+VirtualStepTimer::VirtualStepTimer() {
+  queuePtr = NULL;
+  now = 0;
+  due = 0;
+  armed = false;
+  latency = 0;
+  stepLevel = false;
+  dirLevel = false;
+  stepEdges = 0;
+  dirChanges = 0;
+}
+
+void VirtualStepTimer::begin(StepQueue *_queuePtr) {
+  queuePtr = _queuePtr;
+}
+
+void VirtualStepTimer::start(uint32_t us) {
+  due = now + us + latency;
+  armed = true;
+}
+
+void VirtualStepTimer::writeStep(boolean level) {
+  if (level && !stepLevel) {
+    stepEdges++;
+  }
+  stepLevel = level;
+}
+
+void VirtualStepTimer::writeDir(boolean level) {
+  if (level != dirLevel) {
+    dirChanges++;
+  }
+  dirLevel = level;
+}
+
+uint32_t VirtualStepTimer::nowUs() {
+  return now;
+}
+
+/**
+   advance(uint32_t us)
+   moves the clock on by us, running any timer events that fall due
+*/
+void VirtualStepTimer::advance(uint32_t us) {
+  uint32_t end = now + us;
+  while (armed && ((int32_t)(end - due) >= 0)) {
+    now = due;
+    armed = false;
+    uint32_t next = queuePtr->onTimer();
+    if (next) {
+      start(next);
+    }
+  }
+  now = end;
+}
+
+void VirtualStepTimer::setLatency(uint32_t us) {
+  latency = us;
+}
+
+uint32_t VirtualStepTimer::getStepEdges() {
+  return stepEdges;
+}
+
+uint32_t VirtualStepTimer::getDirChanges() {
+  return dirChanges;
+}
+
+boolean VirtualStepTimer::getStepLevel() {
+  return stepLevel;
+}
+
+boolean VirtualStepTimer::getDirLevel() {
+  return dirLevel;
+}
+
+#endif // SPEED_STEPPER_STEP_QUEUE
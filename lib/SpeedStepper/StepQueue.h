@@ -0,0 +1,265 @@
+// StepQueue.h
+#ifndef STEP_QUEUE_H
+#define STEP_QUEUE_H
+
+/*
+ * (c)2019 Forward Computing and Control Pty. Ltd.
+ * NSW Australia, www.forward.com.au
+ * This code is not warranted to be fit for any purpose. You may only use it at your own risk.
+ * This code may be freely used for both private and commercial use
+ * provided this copyright is maintained.
+ */
+
+#include <Arduino.h>
+
+// StepQueue needs <atomic>, which some toolchains, e.g. AVR's, do not have
+// without it SpeedStepper has no setStepQueue() and run() always outputs the steps itself
+#if defined(__has_include)
+#if __has_include(<atomic>)
+#define SPEED_STEPPER_STEP_QUEUE
+#endif
+#endif
+
+#ifdef SPEED_STEPPER_STEP_QUEUE
+#include <atomic>
+
+/**
+   StepQueue decouples step timing from loop()
+   SpeedStepper::setStepQueue() makes run() plan the steps a few ms ahead into this queue (the producer)
+   and a hardware timer interrupt takes them out and outputs the step pulses (the consumer)
+   so delays in loop() no longer show up as step jitter, as long as loop() keeps the queue filled.
+
+   The queue is lock free for one producer (loop()) and one consumer (the timer ISR)
+   The timer and the step/dir outputs are a StepTimer backend:
+     StepTimerESP32 uses an ESP32 hardware timer
+     VirtualStepTimer runs on a simulated clock, for host (PC) builds
+*/
+
+#if defined(ARDUINO_ARCH_ESP32)
+#define STEP_QUEUE_ISR_ATTR IRAM_ATTR
+#else
+#define STEP_QUEUE_ISR_ATTR
+#endif
+
+struct StepQueueEntry {
+  uint32_t interval; // us from the previous step to this one, 0 => as soon as possible
+  boolean forward;   // direction for this step
+};
+
+class StepQueue;
+
+/**
+   StepTimer
+   the timer and pin outputs used by StepQueue
+*/
+class StepTimer {
+public:
+  virtual ~StepTimer() {}
+  /**
+     begin(StepQueue*)
+     called once by StepQueue::begin() to connect the timer interrupt to the queue
+  */
+  virtual void begin(StepQueue *queuePtr) = 0;
+  /**
+     start(uint32_t us)
+     call StepQueue::onTimer() once after us
+  */
+  virtual void start(uint32_t us) = 0;
+  virtual void writeStep(boolean level) = 0;
+  virtual void writeDir(boolean level) = 0;
+  virtual uint32_t nowUs() = 0;
+};
+
+class StepQueue {
+public:
+  // must be a power of 2
+  const static uint16_t QUEUE_SIZE = 128;
+
+  /**
+     StepQueue(StepTimer &timer, uint32_t pulseWidth_us)
+     pulseWidth_us is the STEP_PIN HIGH time
+  */
+  StepQueue(StepTimer &timer, uint32_t pulseWidth_us = 2);
+
+  /**
+     begin()
+     connects the timer, call once from setup()
+  */
+  void begin();
+
+  // ======= producer side, loop() ==========
+
+  /**
+     push(uint32_t interval, bool forward)
+     add a step interval us after the previous step
+     returns false if the queue is full
+  */
+  boolean push(uint32_t interval, boolean forward);
+
+  /**
+     availableForWrite()
+     returns number of entries that can be pushed
+  */
+  uint16_t availableForWrite();
+
+  /**
+     depth()
+     returns number of entries waiting to be output
+  */
+  uint16_t depth();
+
+  /**
+     queuedTime()
+     returns the us of steps waiting to be output
+  */
+  uint32_t queuedTime();
+
+  /**
+     setProducerRunning(bool)
+     true while the planner expects to keep the queue filled
+     a step that is late because the queue ran empty while this was true is counted as an underrun
+  */
+  void setProducerRunning(boolean running);
+
+  /**
+     kick()
+     starts the timer if it is idle and there are steps queued
+  */
+  void kick();
+
+  // ======= statistics, can be read from any core ==========
+
+  /**
+     getUnderrunCount()
+     number of steps output late because the queue ran empty while the producer was running
+  */
+  uint32_t getUnderrunCount();
+
+  /**
+     getMaxDepth()
+     max entries in the queue since the last clearStats()
+  */
+  uint16_t getMaxDepth();
+
+  /**
+     getMaxJitter()
+     max us any step pulse was output from its scheduled time
+  */
+  uint32_t getMaxJitter();
+
+  /**
+     getStepCount()
+     number of step pulses output
+  */
+  uint32_t getStepCount();
+
+  void clearStats();
+
+  // ======= consumer side ==========
+
+  /**
+     onTimer()
+     called from the StepTimer interrupt
+     returns us until the next call, 0 to stop the timer
+  */
+  uint32_t STEP_QUEUE_ISR_ATTR onTimer();
+
+private:
+  StepTimer *timerPtr;
+  const uint32_t pulseWidth;
+  StepQueueEntry entries[QUEUE_SIZE];
+  std::atomic<uint16_t> head;  // next entry to output, written by consumer
+  std::atomic<uint16_t> tail;  // next entry to fill, written by producer
+  volatile uint32_t pushedUs;  // total interval pushed, written by producer
+  volatile uint32_t poppedUs;  // total interval output, written by consumer
+  std::atomic<boolean> timerRunning;
+  volatile boolean producerRunning;
+  // consumer state
+  boolean pulseHigh;
+  boolean dirForward;
+  volatile boolean ranEmpty; // the timer stopped on an empty queue while the producer was running
+  uint32_t lastStepUs;
+  uint32_t nextStepUs;  // scheduled time of the next rising edge
+  // stats
+  volatile uint32_t underrunCount;
+  volatile uint16_t maxDepth;
+  volatile uint32_t maxJitter;
+  volatile uint32_t stepCount;
+};
+
+#if defined(ARDUINO_ARCH_ESP32)
+/**
+   StepTimerESP32
+   Uses one of the 4 ESP32 hardware timers, 1us resolution
+   and writes the step/dir pins directly to the GPIO registers
+   The timer interrupt is allocated on the core that calls StepQueue::begin()
+*/
+class StepTimerESP32 : public StepTimer {
+public:
+  StepTimerESP32(uint8_t stepPin, uint8_t dirPin, uint8_t timerNo = 0);
+  void begin(StepQueue *queuePtr) override;
+  void STEP_QUEUE_ISR_ATTR start(uint32_t us) override;
+  void STEP_QUEUE_ISR_ATTR writeStep(boolean level) override;
+  void STEP_QUEUE_ISR_ATTR writeDir(boolean level) override;
+  uint32_t STEP_QUEUE_ISR_ATTR nowUs() override;
+  void STEP_QUEUE_ISR_ATTR onInterrupt();
+
+private:
+  uint8_t stepPin;
+  uint8_t dirPin;
+  uint8_t timerNo;
+  hw_timer_t *timer;
+  StepQueue *queuePtr;
+};
+#endif
+
+/**
+   VirtualStepTimer
+   A StepTimer that runs on a simulated us clock, for host (PC) builds
+   advance(us) moves the clock on and calls StepQueue::onTimer() at the times the timer would fire
+   so queue depth, underruns and jitter can be checked without hardware.
+   setLatency() adds a fixed interrupt latency to each timer event.
+*/
+class VirtualStepTimer : public StepTimer {
+public:
+  VirtualStepTimer();
+  void begin(StepQueue *queuePtr) override;
+  void start(uint32_t us) override;
+  void writeStep(boolean level) override;
+  void writeDir(boolean level) override;
+  uint32_t nowUs() override;
+
+  /**
+     advance(uint32_t us)
+     moves the clock on by us, running any timer events that fall due
+  */
+  void advance(uint32_t us);
+
+  /**
+     setLatency(uint32_t us)
+     delay each timer event by us
+  */
+  void setLatency(uint32_t us);
+
+  uint32_t getStepEdges();  // rising edges on step
+  uint32_t getDirChanges();
+  boolean getStepLevel();
+  boolean getDirLevel();
+
+private:
+  StepQueue *queuePtr;
+  uint32_t now;
+  uint32_t due;
+  boolean armed;
+  uint32_t latency;
+  boolean stepLevel;
+  boolean dirLevel;
+  uint32_t stepEdges;
+  uint32_t dirChanges;
+};
+
+#else
+class StepQueue; // SpeedStepper's stepQueuePtr is always NULL
+#endif // SPEED_STEPPER_STEP_QUEUE
+
+#endif // STEP_QUEUE_H
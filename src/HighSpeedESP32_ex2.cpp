@@ -10,6 +10,7 @@
 // runing Events on Core 1 or 0 does not seem affect stepper latency (no listeners/handlers set??)
 // float and long vars are 4byte (32bit) size and so are loaded/stored in one instruction on the ESP32
 // so no lock are needed for inter-thread, inter-core transfer of single data values, just declare vars as volatile
+// values that must be read together, e.g. speed and position, are published in a SeqLock, see VolatileVars.h
 
 #include <HS_AsyncTCP.h>
 #include <WiFi.h>
@@ -18,12 +19,14 @@
 #include "secrets.h"
 
 #include "VolatileVars.h" // control and data vars
+#include "WiFiDataHandling.h" // udpSetpointReceived()
 
 // set your network settings here
 // #define WLAN_SSID       "xxxxxxx"        // cannot be longer than 32 characters!
 // #define WLAN_PASS       "xxxxxxx"
 static const char staticIP[] = "192.168.1.251";  // set this the static IP you want, e.g. "10.1.1.200" or leave it as "" for DHCP. DHCP is not recommended.
 static const int portNo = 4989; // What TCP port to listen on for connections.
+static const int udpPortNo = 4989; // What UDP port to listen on for setpoint frames, see udpSetpointReceived()
 static const unsigned long CONNECTION_TIMEOUT_MS = 10000; // 0 => never time out, else close connection if no data received for this time (ms)
 // see asyncConnectionTimeout(CONNECTION_TIMEOUT_MS); at the bottom of setup()
 
@@ -34,6 +37,21 @@ const int DIR_PIN = 18;
 const int ENA_PIN = 13;
 SpeedStepper stepper(STEP_PIN, DIR_PIN);
 
+// profiles that can be started with the p<n> cmd
+SpeedProfileStruct profile0[] = { {4000, 2000}, {4000, 3000}, {-2000, 3000}, {0, 2000} };
+SpeedProfileStruct profile1[] = { {5000, 1000}, {1000, 1000}, {5000, 1000}, {0, 1000} };
+struct ProfileEntry {
+  SpeedProfileStruct *profile;
+  size_t len;
+};
+const ProfileEntry profiles[] = {
+  { profile0, sizeof(profile0) / sizeof(profile0[0]) },
+  { profile1, sizeof(profile1) / sizeof(profile1[0]) },
+};
+const size_t NUM_PROFILES = sizeof(profiles) / sizeof(profiles[0]);
+
+float runSpeed = 5000; // speed for the r cmd, set by the v cmd
+
 millisDelay printDelay;
 // this print interval is slow enought that the print( ) statement nevers blocks
 unsigned long PRINT_DELAY_MS = 0;// 0=> no prints else 1000 for print once per sec
@@ -81,11 +99,15 @@ void setup() {
   Serial.println();
   Serial.println("WiFi connected");
 
+  asyncSetOverflowPolicy(ASYNC_DROP_OLDEST); // a client that falls behind gets the latest results
   if (initAsyncServer(portNo)) {
     Serial.println("HS_AsyncTCP started");
   } else {
     Serial.println("HS_AsyncTCP failed to started");
   }
+  if (!initAsyncUdp(udpPortNo, udpSetpointReceived)) {
+    Serial.println("UDP setpoint listener failed to start");
+  }
   // asyncConnectionTimeout(CONNECTION_TIMEOUT_MS); // optional to disconnect is nothing sent/received for 10s
 
   // initialize stepper
@@ -102,43 +124,91 @@ void setup() {
 }
 
 unsigned long last_us  = 0; // last us for maxLoopTime
+MotionSnapshot snapshot; // published to motionSnapshot_v each loop()
+uint32_t maxLoopTimeClearAck = 0; // last netVars_v.maxLoopTimeClearReq acted on
 unsigned long lastPrint_us  = 0;
 unsigned long lastPrintCount_us  = 0;
 
 void loop() {
-  loopCount_v++;
+  snapshot.loopCount++;
   unsigned long us = micros();
   unsigned long deltaT = us - last_us;
   last_us = us;
-  if (deltaT > maxLoopTime_v) {
-    maxLoopTime_v = deltaT;
+  uint32_t clearReq = netVars_v.maxLoopTimeClearReq.load(std::memory_order_relaxed);
+  if (clearReq != maxLoopTimeClearAck) {
+    maxLoopTimeClearAck = clearReq;
+    snapshot.maxLoopTime = 0;
+    snapshot.maxSetpointLatency = 0;
   }
-  // handle cmds
-  switch(stepperCtrl_v) {
-    case STOP:
-     stepper.stop();
-     break;
-    case RUN:
-     stepper.setSpeed(5000);
-     break;
-    case HOME:
-     stepper.goHome();
-     break;
+  if (deltaT > snapshot.maxLoopTime) {
+    snapshot.maxLoopTime = deltaT;
+  }
+  // handle cmds, each one is run once
+  StepperCmd cmd;
+  bool gotCmd = false;
+  while (stepperCmds_v.pop(cmd)) {
+    gotCmd = true;
+    switch (cmd.cmd) {
+      case STOP:
+        stepper.stop();
+        break;
+      case RUN:
+        stepper.setSpeed(runSpeed);
+        break;
+      case HOME:
+        stepper.goHome();
+        break;
+      case SET_SPEED:
+        runSpeed = cmd.value;
+        stepper.setSpeed(runSpeed);
+        break;
+      case MOVE_TO:
+        stepper.moveTo(cmd.position);
+        break;
+      case SET_ACCEL:
+        if (cmd.value > 0.0) {
+          stepper.setAcceleration(cmd.value);
+        }
+        break;
+      case PROFILE:
+        if ((cmd.value >= 0.0) && (cmd.value < NUM_PROFILES)) {
+          const ProfileEntry &p = profiles[(size_t)cmd.value];
+          stepper.setProfile(p.profile, p.len);
+          stepper.startProfile();
+        }
+        break;
+    }
+  }
+  // follow the newest streamed setpoint, if any
+  SetpointFrame frame;
+  if (setpointFrames_v.read(frame)) {
+    if (!stepper.isFollowing()) {
+      stepper.startFollowing();
+    }
+    stepper.pushSetpoint(frame.position[0], frame.time_us);
+    uint32_t latency = micros() - frame.time_us;
+    if (latency > snapshot.maxSetpointLatency) {
+      snapshot.maxSetpointLatency = latency;
+    }
   }
   stepper.run(); // process stepper
-  speed_v = stepper.getSpeed();
-  position_v = stepper.getCurrentPosition();
+  snapshot.speed = stepper.getSpeed();
+  snapshot.position = stepper.getCurrentPosition();
+  motionSnapshot_v.write(snapshot); // never blocks
+  if (gotCmd) {
+    asyncNotify(); // let asyncLoop() see the result of the cmds now instead of at the next timer wake
+  }
 
   if (printDelay.justFinished()) {
     printDelay.repeat();
     Serial.print(" millis:"); Serial.print(millis());
     deltaT = us - lastPrint_us;
     lastPrint_us = us;
-    float usPerLoop = (float)deltaT / (loopCount_v - lastPrintCount_us);
-    lastPrintCount_us = loopCount_v;
+    float usPerLoop = (float)deltaT / (snapshot.loopCount - lastPrintCount_us);
+    lastPrintCount_us = snapshot.loopCount;
     Serial.print(" avg us/loop:"); Serial.print(usPerLoop);
-    Serial.print(" Speed:");Serial.print(speed_v);
-    Serial.print(" Position:");Serial.print(position_v);
+    Serial.print(" Speed:");Serial.print(snapshot.speed);
+    Serial.print(" Position:");Serial.print(snapshot.position);
     Serial.println();
   }
   
@@ -0,0 +1,85 @@
+#ifndef SEQ_LOCK_H_
+#define SEQ_LOCK_H_
+/*
+   (c)2023 Forward Computing and Control Pty. Ltd.
+   NSW Australia, www.forward.com.au
+   This code is not warranted to be fit for any purpose. You may only use it at your own risk.
+   This generated code may be freely used for both private and commercial use
+   provided this copyright is maintained.
+*/
+
+#include <atomic>
+
+/**
+   SeqLock<T>
+   Passes a multi-field struct from one writer to any number of readers on other cores/tasks
+   without ever blocking the writer.
+   The writer makes the sequence number odd, copies in the data and then makes it even again.
+   A reader copies the data out and retries if the sequence number was odd or changed while it was copying,
+   so the reader always gets all the fields from the same write().
+
+   Only ONE task may call write(). T must be plain data (no pointers to data that changes)
+
+   e.g.
+   SeqLock<MotionSnapshot> motionSnapshot_v;
+   // loop() on core 1
+   motionSnapshot_v.write(snapshot);
+   // HS_AsyncTCP task on core 0
+   MotionSnapshot s;
+   motionSnapshot_v.read(s);
+*/
+template <class T>
+class SeqLock {
+public:
+  SeqLock() : seq(0) {
+    data = T();
+  }
+
+  /**
+     write(const T &value)
+     publish a new value, never blocks
+     Only one task may call this.
+  */
+  void write(const T &value) {
+    uint32_t s = seq.load(std::memory_order_relaxed);
+    seq.store(s + 1, std::memory_order_relaxed); // odd => write in progress
+    std::atomic_thread_fence(std::memory_order_release);
+    data = value;
+    seq.store(s + 2, std::memory_order_release);
+  }
+
+  /**
+     read(T &value)
+     copies the latest complete value into value
+     retries while a write() is in progress
+     returns the number of retries, usually 0
+  */
+  uint32_t read(T &value) const {
+    uint32_t retries = 0;
+    while (true) {
+      uint32_t s1 = seq.load(std::memory_order_acquire);
+      if ((s1 & 1) == 0) {
+        value = data;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (seq.load(std::memory_order_relaxed) == s1) {
+          return retries;
+        }
+      }
+      retries++;
+    }
+  }
+
+  /**
+     getSequence()
+     incremented by 2 on each write(), readers can use it to tell if there is a new value
+  */
+  uint32_t getSequence() const {
+    return seq.load(std::memory_order_acquire) & ~((uint32_t)1);
+  }
+
+private:
+  std::atomic<uint32_t> seq;
+  T data;
+};
+
+#endif
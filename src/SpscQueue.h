@@ -0,0 +1,116 @@
+#ifndef SPSC_QUEUE_H_
+#define SPSC_QUEUE_H_
+/*
+   (c)2023 Forward Computing and Control Pty. Ltd.
+   NSW Australia, www.forward.com.au
+   This code is not warranted to be fit for any purpose. You may only use it at your own risk.
+   This generated code may be freely used for both private and commercial use
+   provided this copyright is maintained.
+*/
+
+#include <atomic>
+#include <stdint.h>
+
+/**
+   SpscQueue<T, SIZE>
+   A bounded queue from ONE producer task to ONE consumer task, e.g. HS_AsyncTCP on core 0 to loop() on core 1
+   push() and pop() are wait-free, they never block or retry.
+   A push() to a full queue is dropped and counted, so the producer never waits for the consumer.
+   SIZE must be a power of 2, one less than SIZE entries can be queued.
+
+   e.g.
+   SpscQueue<StepperCmd, 16> stepperCmds_v;
+   // HS_AsyncTCP task
+   stepperCmds_v.push(cmd);
+   // loop()
+   StepperCmd cmd;
+   while (stepperCmds_v.pop(cmd)) { ... }
+*/
+template <class T, uint16_t SIZE>
+class SpscQueue {
+  static_assert((SIZE >= 2) && ((SIZE & (SIZE - 1)) == 0), "SpscQueue SIZE must be a power of 2");
+public:
+  SpscQueue() : head(0), tail(0), overflowCount(0), maxDepth(0) {
+  }
+
+  // ======= producer side ==========
+
+  /**
+     push(const T &item)
+     returns false, and counts an overflow, if the queue is full
+  */
+  bool push(const T &item) {
+    uint16_t t = tail.load(std::memory_order_relaxed);
+    uint16_t next = (t + 1) & (SIZE - 1);
+    if (next == head.load(std::memory_order_acquire)) {
+      overflowCount.store(overflowCount.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+      return false; // full
+    }
+    items[t] = item;
+    tail.store(next, std::memory_order_release);
+    uint16_t d = (next - head.load(std::memory_order_relaxed)) & (SIZE - 1);
+    if (d > maxDepth.load(std::memory_order_relaxed)) {
+      maxDepth.store(d, std::memory_order_relaxed);
+    }
+    return true;
+  }
+
+  /**
+     availableForWrite()
+     returns number of items that can be pushed
+  */
+  uint16_t availableForWrite() const {
+    return (SIZE - 1) - depth();
+  }
+
+  // ======= consumer side ==========
+
+  /**
+     pop(T &item)
+     returns false if the queue is empty, else copies the oldest item into item
+  */
+  bool pop(T &item) {
+    uint16_t h = head.load(std::memory_order_relaxed);
+    if (h == tail.load(std::memory_order_acquire)) {
+      return false; // empty
+    }
+    item = items[h];
+    head.store((h + 1) & (SIZE - 1), std::memory_order_release);
+    return true;
+  }
+
+  // ======= either side ==========
+
+  /**
+     depth()
+     returns number of items waiting
+  */
+  uint16_t depth() const {
+    return (tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire)) & (SIZE - 1);
+  }
+
+  /**
+     getOverflowCount()
+     number of push()es dropped because the queue was full
+  */
+  uint32_t getOverflowCount() const {
+    return overflowCount.load(std::memory_order_relaxed);
+  }
+
+  /**
+     getMaxDepth()
+     max items waiting at any one time, use this to size the queue
+  */
+  uint16_t getMaxDepth() const {
+    return maxDepth.load(std::memory_order_relaxed);
+  }
+
+private:
+  T items[SIZE];
+  std::atomic<uint16_t> head;  // next item to pop, written by consumer
+  std::atomic<uint16_t> tail;  // next item to push, written by producer
+  std::atomic<uint32_t> overflowCount; // written by producer
+  std::atomic<uint16_t> maxDepth;      // written by producer
+};
+
+#endif
@@ -0,0 +1,91 @@
+#ifndef TELEMETRY_FRAME_H_
+#define TELEMETRY_FRAME_H_
+/*
+   (c)2023 Forward Computing and Control Pty. Ltd.
+   NSW Australia, www.forward.com.au
+   This code is not warranted to be fit for any purpose. You may only use it at your own risk.
+   This generated code may be freely used for both private and commercial use
+   provided this copyright is maintained.
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+/**
+   TelemetryFrame
+   Builds one binary telemetry frame, all values little endian
+     uint8_t  0xA5     sync, never in the text output which is all ASCII
+     uint8_t  schema   TELEMETRY_SCHEMA_ID, the field list is sent as text by asyncConnected()
+     uint16_t length   of the fields
+     fields            each value memcpy'd in, no padding
+     uint16_t crc      CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF) of schema, length and fields
+   Change TELEMETRY_SCHEMA_ID whenever the fields change.
+
+   e.g.
+   TelemetryFrame frame(TELEMETRY_SCHEMA_ID);
+   frame.add((uint32_t)millis());
+   frame.add(speed);
+   stream.write(frame.finish(), frame.length());
+*/
+class TelemetryFrame {
+public:
+  const static uint8_t SYNC = 0xA5;
+  const static size_t HEADER_LEN = 4;
+  const static size_t MAX_FIELDS_LEN = 128;
+
+  TelemetryFrame(uint8_t schema) : len(HEADER_LEN) {
+    buf[0] = SYNC;
+    buf[1] = schema;
+  }
+
+  /**
+     add(const T &value)
+     appends value's bytes, ignored if the frame is full
+     The ESP32 is little endian so the bytes are copied as is.
+  */
+  template <class T>
+  void add(const T &value) {
+    if ((len + sizeof(T)) <= (HEADER_LEN + MAX_FIELDS_LEN)) {
+      memcpy(buf + len, &value, sizeof(T));
+      len += sizeof(T);
+    }
+  }
+
+  /**
+     finish()
+     fills in the length and crc, returns the frame to write, length() bytes long
+  */
+  const uint8_t *finish() {
+    uint16_t fieldsLen = len - HEADER_LEN;
+    memcpy(buf + 2, &fieldsLen, 2);
+    uint16_t crc = crc16(buf + 1, len - 1);
+    memcpy(buf + len, &crc, 2);
+    return buf;
+  }
+
+  size_t length() const {
+    return len + 2;
+  }
+
+  /**
+     crc16(const uint8_t *data, size_t n)
+     CRC-16/CCITT-FALSE, e.g. python binascii.crc_hqx(data, 0xFFFF)
+  */
+  static uint16_t crc16(const uint8_t *data, size_t n) {
+    uint16_t crc = 0xFFFF;
+    while (n--) {
+      crc ^= (uint16_t)(*data++) << 8;
+      for (uint8_t i = 0; i < 8; i++) {
+        crc = (crc & 0x8000) ? ((crc << 1) ^ 0x1021) : (crc << 1);
+      }
+    }
+    return crc;
+  }
+
+private:
+  uint8_t buf[HEADER_LEN + MAX_FIELDS_LEN + 2];
+  size_t len; // header + fields so far
+};
+
+#endif
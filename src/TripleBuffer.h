@@ -0,0 +1,112 @@
+#ifndef TRIPLE_BUFFER_H_
+#define TRIPLE_BUFFER_H_
+/*
+   (c)2023 Forward Computing and Control Pty. Ltd.
+   NSW Australia, www.forward.com.au
+   This code is not warranted to be fit for any purpose. You may only use it at your own risk.
+   This generated code may be freely used for both private and commercial use
+   provided this copyright is maintained.
+*/
+
+#include <atomic>
+#include <stdint.h>
+
+/**
+   TripleBuffer<T>
+   Passes the latest multi-field value from ONE writer task to ONE reader task when only the newest value matters,
+   e.g. streamed setpoints from HS_AsyncTCP on core 0 to loop() on core 1
+   Neither side ever waits or retries.
+   The writer fills its back buffer and swaps it with the middle buffer.
+   The reader swaps its front buffer with the middle buffer only when the middle has a new value.
+   So the reader always gets the freshest complete value and values it did not get to are counted as overwritten.
+
+   e.g.
+   TripleBuffer<SetpointFrame> setpointFrames_v;
+   // HS_AsyncTCP task
+   setpointFrames_v.write(frame);
+   // loop()
+   SetpointFrame frame;
+   if (setpointFrames_v.read(frame)) { ... new frame }
+*/
+template <class T>
+class TripleBuffer {
+public:
+  TripleBuffer() : middle(1), writeCount(0), readCount(0), overwriteCount(0) {
+    back = 0;
+    front = 2;
+    for (int i = 0; i < 3; i++) {
+      buffers[i] = T();
+    }
+  }
+
+  /**
+     write(const T &value)
+     publish a new value, never waits
+     Only one task may call this.
+  */
+  void write(const T &value) {
+    buffers[back] = value;
+    uint8_t prev = middle.exchange(back | FRESH, std::memory_order_acq_rel);
+    if (prev & FRESH) {
+      overwriteCount.store(overwriteCount.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+    back = prev & INDEX_MASK;
+    writeCount.store(writeCount.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  }
+
+  /**
+     read(T &value)
+     returns false if there is nothing new since the last read(),
+     else copies the latest value into value and returns true
+     Only one task may call this.
+  */
+  bool read(T &value) {
+    if ((middle.load(std::memory_order_relaxed) & FRESH) == 0) {
+      return false;
+    }
+    uint8_t prev = middle.exchange(front, std::memory_order_acq_rel);
+    front = prev & INDEX_MASK;
+    value = buffers[front];
+    readCount.store(readCount.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    return true;
+  }
+
+  /**
+     getWriteCount()
+     number of values written
+  */
+  uint32_t getWriteCount() const {
+    return writeCount.load(std::memory_order_relaxed);
+  }
+
+  /**
+     getReadCount()
+     number of new values read
+  */
+  uint32_t getReadCount() const {
+    return readCount.load(std::memory_order_relaxed);
+  }
+
+  /**
+     getOverwriteCount()
+     number of values replaced by a newer one before the reader got them
+     If this climbs steadily, the writer is sending faster than the reader uses them
+  */
+  uint32_t getOverwriteCount() const {
+    return overwriteCount.load(std::memory_order_relaxed);
+  }
+
+private:
+  const static uint8_t INDEX_MASK = 0x03;
+  const static uint8_t FRESH = 0x04; // middle has a value the reader has not taken
+
+  T buffers[3];
+  std::atomic<uint8_t> middle; // index of the middle buffer | FRESH
+  uint8_t back;   // only used by the writer
+  uint8_t front;  // only used by the reader
+  std::atomic<uint32_t> writeCount;     // written by writer
+  std::atomic<uint32_t> readCount;      // written by reader
+  std::atomic<uint32_t> overwriteCount; // written by writer
+};
+
+#endif
@@ -10,12 +10,12 @@
 #include "VolatileVars.h"
 // These volatiles communicate between your Arduino loop() and the WiFiDataHandling
 // for code clarity _v is appended to volatile variables
-volatile unsigned long loopCount_v  = 0; // current loop count
-volatile unsigned long maxLoopTime_v  = 0; // max loop time since last cleared
+// see SHARED_VARS, each group on its own cache line(s), written by only one core
+alignas(SHARED_VARS_ALIGN) SeqLock<MotionSnapshot> motionSnapshot_v;
+alignas(SHARED_VARS_ALIGN) NetVars netVars_v;
 
-// variables to pickup stepper position speed
-volatile float speed_v;
-volatile uint32_t position_v;
+// commands to control stepper
+SpscQueue<StepperCmd, STEPPER_CMD_QUEUE_SIZE> stepperCmds_v;
 
-// variable to control stepper
-volatile StepperControlEnum stepperCtrl_v = STOP;
+// streamed position setpoints
+TripleBuffer<SetpointFrame> setpointFrames_v;
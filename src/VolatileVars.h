@@ -8,16 +8,102 @@
    provided this copyright is maintained.
 */
 
+#include <stdint.h>
+#include <atomic>
+#include "SeqLock.h"
+#include "SpscQueue.h"
+#include "TripleBuffer.h"
+#include "TelemetryFrame.h"
+
 // this header lists all the volatile vars used to transfer cmds/data between your loop() and WiFiDataHandling
 // for code clarity _v is appended to volatile variables
-extern volatile unsigned long loopCount_v;
-extern volatile unsigned long maxLoopTime_v; // max loop time since last cleared
 
-// variables to pickup stepper position speed
-extern volatile float speed_v;
-extern volatile uint32_t position_v;
+/**
+   SHARED_VARS
+   Each single value shared between loop() and WiFiDataHandling is declared once here
+     X(direction, type, name, telemetry label)
+   MOTION_TO_NET values are written by loop() into MotionSnapshot, published together once per loop() via motionSnapshot_v
+     so a reader never pairs a position with the speed from a different loop().
+     Each one is a column in the 2sec telemetry, MOTION_SNAPSHOT_CSV_HEADER, MOTION_SNAPSHOT_SCHEMA,
+     printMotionSnapshot() and addMotionSnapshot() are generated from this list
+   NET_TO_MOTION values are written by WiFiDataHandling into netVars_v as std::atomic, label not used
+   The two groups are in separate cache lines, so the cores writing them do not share a line.
+   Adding a value is just one line here.
+*/
+#define SHARED_VARS(X) \
+  X(MOTION_TO_NET, uint32_t, loopCount, "loop count") \
+  X(MOTION_TO_NET, uint32_t, maxLoopTime, "max us/loop") /* since last cleared by maxLoopTimeClearReq */ \
+  X(MOTION_TO_NET, float, speed, "speed") \
+  X(MOTION_TO_NET, int32_t, position, "position") \
+  X(MOTION_TO_NET, uint32_t, maxSetpointLatency, "max setpoint us") /* setpoint received to applied, cleared with maxLoopTime */ \
+  X(NET_TO_MOTION, uint32_t, maxLoopTimeClearReq, "") /* incremented to ask loop() to restart maxLoopTime */
+
+const static size_t SHARED_VARS_ALIGN = 64; // cache line size, on the largest targets
+
+// expand only the entries for one direction
+#define SHARED_VAR_MOTION_TO_NET(motion, net) motion
+#define SHARED_VAR_NET_TO_MOTION(motion, net) net
+
+#define SHARED_VAR_SNAPSHOT_FIELD(dir, type, name, label) SHARED_VAR_##dir(type name;, )
+#define SHARED_VAR_NET_FIELD(dir, type, name, label) SHARED_VAR_##dir(, std::atomic<type> name;)
+#define SHARED_VAR_CSV_LABEL(dir, type, name, label) SHARED_VAR_##dir("," label, )
+#define SHARED_VAR_PRINT(dir, type, name, label) SHARED_VAR_##dir(out.print(','); out.print(snapshot.name);, )
+#define SHARED_VAR_SCHEMA(dir, type, name, label) SHARED_VAR_##dir("," #type " " label, )
+#define SHARED_VAR_ADD(dir, type, name, label) SHARED_VAR_##dir(frame.add(snapshot.name);, )
+
+// loop() stats and stepper position speed, the MOTION_TO_NET values
+struct MotionSnapshot {
+  SHARED_VARS(SHARED_VAR_SNAPSHOT_FIELD)
+};
+// written only by loop(), read with motionSnapshot_v.read(snapshot) from any core
+extern SeqLock<MotionSnapshot> motionSnapshot_v;
+
+// the NET_TO_MOTION values, only WiFiDataHandling writes these
+struct NetVars {
+  SHARED_VARS(SHARED_VAR_NET_FIELD)
+};
+extern NetVars netVars_v;
+
+// ",loop count,max us/loop,..." a string literal, so it can be joined to other literals
+#define MOTION_SNAPSHOT_CSV_HEADER SHARED_VARS(SHARED_VAR_CSV_LABEL)
+
+/**
+   printMotionSnapshot(Print &out, const MotionSnapshot &snapshot)
+   prints ",value,value.." in MOTION_SNAPSHOT_CSV_HEADER order
+*/
+inline void printMotionSnapshot(Print &out, const MotionSnapshot &snapshot) {
+  SHARED_VARS(SHARED_VAR_PRINT)
+}
+
+// ",uint32_t loop count,uint32_t max us/loop,..." the binary field types and labels, a string literal
+#define MOTION_SNAPSHOT_SCHEMA SHARED_VARS(SHARED_VAR_SCHEMA)
+
+/**
+   addMotionSnapshot(TelemetryFrame &frame, const MotionSnapshot &snapshot)
+   adds the values to a binary telemetry frame in MOTION_SNAPSHOT_SCHEMA order
+*/
+inline void addMotionSnapshot(TelemetryFrame &frame, const MotionSnapshot &snapshot) {
+  SHARED_VARS(SHARED_VAR_ADD)
+}
+
+// commands to control stepper, pushed by WiFiDataHandling, popped and run once by loop()
+enum StepperCmdEnum { STOP, RUN, HOME, SET_SPEED, MOVE_TO, SET_ACCEL, PROFILE };
+struct StepperCmd {
+  StepperCmdEnum cmd;
+  float value;      // SET_SPEED steps/sec, SET_ACCEL steps/sec/sec, PROFILE index
+  int32_t position; // MOVE_TO target
+};
+const static uint16_t STEPPER_CMD_QUEUE_SIZE = 16; // power of 2
+// only WiFiDataHandling pushes, only loop() pops
+extern SpscQueue<StepperCmd, STEPPER_CMD_QUEUE_SIZE> stepperCmds_v;
 
-// variable to control stepper
-enum StepperControlEnum { STOP, RUN, HOME };
-extern volatile StepperControlEnum stepperCtrl_v;
+// streamed position setpoints, only the newest frame matters
+const static uint8_t SETPOINT_AXES = 1; // number of axes in each frame
+struct SetpointFrame {
+  uint32_t seq;     // incremented for each frame sent
+  uint32_t time_us; // micros() when the frame was received
+  int32_t position[SETPOINT_AXES];
+};
+// only WiFiDataHandling writes, only loop() reads
+extern TripleBuffer<SetpointFrame> setpointFrames_v;
 #endif
@@ -15,14 +15,65 @@
 #include "VolatileVars.h"
 #include "millisDelay.h"
 #include "SafeString.h"
+#include "HS_AsyncTrace.h"
+#include "HS_AsyncTCP.h"
+#include "BufferStream.h"
 
 static unsigned long lastLoopCount;
+
+// UDP setpoint frame stats
+static bool udpStarted = false; // got a frame, so udpLastSeq is valid
+static uint32_t udpLastSeq = 0;
+static uint32_t udpFrameCount = 0; // frames sent on to loop()
+static uint32_t udpLostCount = 0; // gaps in seq
+static uint32_t udpLateCount = 0; // out of order or repeated, dropped
+static uint32_t udpBadCount = 0; // wrong length
+static const int32_t UDP_SEQ_RESTART = 1000;
 static unsigned long last_us;
 
-static millisDelay dataTimer;
-static unsigned long DATA_TIMER_MS = 2000; // log data every 2sec
 static unsigned long microsStart = 0;
 
+/**
+   TelemetryOutput
+   each connection's telemetry settings, so one client's x/c/i cmds do not change what the others get
+*/
+struct TelemetryOutput {
+  bool binary; // x cmd for TelemetryFrames, c cmd for CSV text
+  millisDelay timer; // i<ms> cmd sets the interval, default every 2sec, stopped while not connected
+  bool due; // set by asyncLoop(), sent by asyncConnectionLoop()
+};
+static TelemetryOutput telemetry[ASYNC_MAX_CLIENTS];
+static const unsigned long TELEMETRY_DEFAULT_MS = 2000;
+
+// the latest sample, formatted by asyncLoop() once for all the connections due that want it
+static BufferStream telemetryCsv;
+static size_t telemetryFrameLen = 0; // 0 if no connection wanted a frame this time
+static uint8_t telemetryFrame[TelemetryFrame::HEADER_LEN + TelemetryFrame::MAX_FIELDS_LEN + 2];
+
+// change this when the telemetry fields change
+const static uint8_t TELEMETRY_SCHEMA_ID = 1;
+
+/**
+   TELEMETRY_COUNTERS
+   the counters sent after the motion snapshot in each telemetry line/frame
+     X(type, value, label)
+*/
+#define TELEMETRY_COUNTERS(X) \
+  X(uint32_t, stepperCmds_v.getOverflowCount(), "cmd overflows") \
+  X(uint32_t, setpointFrames_v.getOverwriteCount(), "setpoints overwritten") \
+  X(uint32_t, asyncSentCount(), "outputs sent") \
+  X(uint32_t, asyncDroppedCount(), "outputs dropped") \
+  X(uint32_t, asyncCoalescedCount(), "outputs coalesced") \
+  X(uint32_t, udpFrameCount, "udp frames") \
+  X(uint32_t, udpLostCount, "udp lost") /* includes asyncUdpDroppedCount(), they leave gaps in seq */ \
+  X(uint32_t, udpLateCount, "udp late") \
+  X(uint32_t, udpBadCount, "udp bad")
+
+#define TELEMETRY_COUNTER_CSV_LABEL(type, value, label) "," label
+#define TELEMETRY_COUNTER_SCHEMA(type, value, label) "," #type " " label
+#define TELEMETRY_COUNTER_PRINT(type, value, label) stream.print(','); stream.print((type)(value));
+#define TELEMETRY_COUNTER_ADD(type, value, label) frame.add((type)(value));
+
 /**
    asyncSetup
    runs on WiFi core 0, in HS_Async thread (task). Use volatiles to interact with your Arduino loop() code
@@ -30,62 +81,250 @@ static unsigned long microsStart = 0;
    Use this to do any initialization of WiFi task local variables, e.g. start timers etc
 */
 void asyncSetup() {
-  dataTimer.start(DATA_TIMER_MS);
   microsStart = micros();
   lastLoopCount = 0;
+  asyncSetConnectionLoopHandler(asyncConnectionLoop);
 }
 
 // this is called from core 1 asyncTCP task
-// approximately every 1.5ms, but can be delayed upto ~20ms if the core 1 is busy with the WiFi
+// every asyncLoopInterval() (1ms), and also after lwIP events and asyncNotify()
+// Telemetry goes to each connection at its own interval and in its own format, see asyncConnectionLoop()
+// Here the snapshot is read, and each format built, once for all the connections due now.
+// avg us/loop and max us/loop are since the last telemetry sent to any connection.
 void asyncLoop(Stream &stream) {
-  // clean up Home cmd when we get home.
-  if ((speed_v == 0.0) && (position_v == 0) && (stepperCtrl_v == HOME)) {
-    stepperCtrl_v = STOP; // got home
+  bool anyDue = false;
+  bool csvDue = false;
+  bool binaryDue = false;
+  for (int i = 0; i < ASYNC_MAX_CLIENTS; i++) {
+    TelemetryOutput &t = telemetry[i];
+    t.due = t.timer.justFinished();
+    if (t.due) {
+      t.timer.restart();
+      anyDue = true;
+      csvDue |= !t.binary;
+      binaryDue |= t.binary;
+    }
+  }
+  telemetryCsv.clear();
+  telemetryFrameLen = 0;
+  if (!anyDue) {
+    return;
+  }
+  MotionSnapshot snapshot;
+  motionSnapshot_v.read(snapshot); // speed and position from the same loop()
+  unsigned long loopCount = snapshot.loopCount;
+  unsigned long us = micros();
+  unsigned long deltaT_us = us - microsStart;
+  unsigned long deltaCount = loopCount - lastLoopCount;
+  lastLoopCount = loopCount;
+  microsStart = us;
+  float avgLoop_us = (deltaCount != 0) ? (((float)deltaT_us) / (deltaCount)) : INFINITY;
+  netVars_v.maxLoopTimeClearReq.fetch_add(1, std::memory_order_relaxed); // loop() resets maxLoopTime for next time
+  uint32_t ms = millis();
+  if (binaryDue) {
+    TelemetryFrame frame(TELEMETRY_SCHEMA_ID);
+    frame.add(ms);
+    frame.add(avgLoop_us);
+    addMotionSnapshot(frame, snapshot);
+    TELEMETRY_COUNTERS(TELEMETRY_COUNTER_ADD)
+    telemetryFrameLen = frame.length();
+    memcpy(telemetryFrame, frame.finish(), telemetryFrameLen);
   }
-  if (dataTimer.justFinished()) {
-    dataTimer.restart();
-    unsigned long loopCount = loopCount_v;
-    unsigned long us = micros();
-    unsigned long deltaT_us = us - microsStart;
-    unsigned long deltaCount = loopCount - lastLoopCount;
-    lastLoopCount = loopCount;
-    microsStart = us;
-    stream.print(millis());
+  if (csvDue) {
+    Print &stream = telemetryCsv; // for TELEMETRY_COUNTER_PRINT
+    stream.print(ms);
     stream.print(",");
     if (deltaCount != 0) {
-      stream.print(((float)deltaT_us) / (deltaCount), 2);
+      stream.print(avgLoop_us, 2);
     } else {
       stream.print("inf");
     }
-    stream.print(","); stream.print(maxLoopTime_v);
-    maxLoopTime_v = 0; // reset for next time
-    stream.print(","); stream.print(speed_v);
-    stream.print(","); stream.print(position_v);
+    printMotionSnapshot(stream, snapshot);
+    TELEMETRY_COUNTERS(TELEMETRY_COUNTER_PRINT)
     stream.println();
   }
 }
+
+// the asyncSetConnectionLoopHandler(), called after asyncLoop() for each connection
+void asyncConnectionLoop(Stream &stream, uint8_t connection) {
+  TelemetryOutput &t = telemetry[connection];
+  if (!t.due) {
+    return;
+  }
+  t.due = false;
+  if (t.binary) {
+    stream.write(telemetryFrame, telemetryFrameLen);
+  } else {
+    stream.write((const uint8_t *)telemetryCsv.getBuffer(), telemetryCsv.available());
+  }
+}
+/**
+   CmdParser
+   the text cmd parse state, one for each connection so cmds from different clients do not mix
+   a cmd's number, or an f frame, can be split across asyncDataReceived() calls
+*/
+struct CmdParser {
+  char numberCmd; // the cmd waiting for its number, '\0' if none
+  char number[16]; // the digits so far, wrapped in a SafeString by cSFA when used
+  SetpointFrame frame; // the f cmd frame being parsed
+  uint8_t frameAxis; // next axis in frame
+};
+static CmdParser parsers[ASYNC_MAX_CLIENTS];
+static uint32_t tcpFrameSeq = 0; // f cmd frames sent to loop(), from all the connections
+
 // msg to send back when connection opened
-void asyncConnected(Stream &stream) {
+void asyncConnected(Stream &stream, uint8_t connection) {
+  parsers[connection] = CmdParser(); // nothing left over from the last client on this connection
+  TelemetryOutput &t = telemetry[connection];
+  t.binary = false;
+  t.due = false;
+  t.timer.start(TELEMETRY_DEFAULT_MS);
   stream.println("Stepper cmds: s->stops r->runs h->sends home");
+  stream.println(" v<speed> sets run speed, m<position> moves to, a<accel> sets acceleration, p<n> runs profile n");
+  stream.println(" f<position> streams a setpoint to follow, f<p0>,<p1>.. for multiple axes");
+  stream.println(" end numbers with newline or space, e.g. m2000");
+  stream.println(" t dumps the next HS_AsyncTCP trace records (build with -DASYNC_LOG_LEVEL=ASYNC_LOG_LEVEL_TRACE)");
+  stream.println(" w shows why the HS_AsyncTCP task woke and the us spent on each");
+  stream.println(" x sends results to this connection as binary frames, c as CSV text, i<ms> sets how often, e.g. i1");
   stream.println("Results output every 2sec.");
-  stream.println("millis,avg us/loop, max us/loop, speed,position");
+  // the binary frame fields, so a client can decode frames without knowing this code
+  stream.print("schema,"); stream.print(TELEMETRY_SCHEMA_ID);
+  stream.println(",uint32_t millis,float avg us/loop" MOTION_SNAPSHOT_SCHEMA TELEMETRY_COUNTERS(TELEMETRY_COUNTER_SCHEMA));
+  stream.println("millis,avg us/loop" MOTION_SNAPSHOT_CSV_HEADER TELEMETRY_COUNTERS(TELEMETRY_COUNTER_CSV_LABEL));
 }
 
-void asyncDisconnected() {
-  // nothing here at the moment
+void asyncDisconnected(uint8_t connection) {
+  telemetry[connection].timer.stop();
+  telemetry[connection].due = false;
+}
+
+static void pushCmd(StepperCmdEnum cmd, float value = 0.0, int32_t position = 0) {
+  StepperCmd stepperCmd;
+  stepperCmd.cmd = cmd;
+  stepperCmd.value = value;
+  stepperCmd.position = position;
+  stepperCmds_v.push(stepperCmd); // if full, dropped and counted
+}
+
+// returns false if the number is invalid
+static bool addFramePosition(CmdParser &p) {
+  cSFA(numberStr, p.number);
+  long l = 0;
+  if ((p.frameAxis >= SETPOINT_AXES) || (!numberStr.toLong(l))) {
+    return false;
+  }
+  p.frame.position[p.frameAxis++] = l;
+  numberStr.clear();
+  return true;
+}
+
+static void pushNumberCmd(CmdParser &p, uint8_t connection) {
+  char c = p.numberCmd;
+  p.numberCmd = '\0';
+  if (c == 'f') {
+    if (addFramePosition(p) && (p.frameAxis == SETPOINT_AXES)) {
+      p.frame.seq = ++tcpFrameSeq;
+      p.frame.time_us = micros();
+      setpointFrames_v.write(p.frame); // never waits, replaces any frame loop() has not picked up
+    }
+    return;
+  }
+  cSFA(numberStr, p.number);
+  float f = 0.0;
+  if (!numberStr.toFloat(f)) {
+    return; // ignore invalid number
+  }
+  if (c == 'v') {
+    pushCmd(SET_SPEED, f);
+  } else if (c == 'm') {
+    long l = 0;
+    if (numberStr.toLong(l)) {
+      pushCmd(MOVE_TO, 0.0, l);
+    }
+  } else if (c == 'a') {
+    pushCmd(SET_ACCEL, f);
+  } else if (c == 'p') {
+    pushCmd(PROFILE, f);
+  } else if (c == 'i') {
+    telemetry[connection].timer.start((f < 1.0) ? 1 : (unsigned long)f);
+  }
+}
+
+void udpSetpointReceived(const uint8_t *data, size_t len, uint32_t rx_us) {
+  if (len != (8 + 4 * SETPOINT_AXES)) {
+    udpBadCount++;
+    return;
+  }
+  SetpointFrame udpFrame;
+  memcpy(&udpFrame.seq, data, 4); // ESP32 is little endian, memcpy as data may not be aligned
+  for (uint8_t i = 0; i < SETPOINT_AXES; i++) {
+    memcpy(&udpFrame.position[i], data + 8 + 4 * i, 4);
+  }
+  int32_t ahead = (int32_t)(udpFrame.seq - udpLastSeq);
+  if (udpStarted && (ahead <= 0) && (ahead >= -UDP_SEQ_RESTART)) {
+    udpLateCount++; // a newer frame has already been used
+    return;
+  }
+  if (udpStarted && (ahead > 1)) {
+    udpLostCount += ahead - 1;
+  }
+  udpStarted = true;
+  udpLastSeq = udpFrame.seq;
+  udpFrame.time_us = rx_us;
+  setpointFrames_v.write(udpFrame); // never waits, replaces any frame loop() has not picked up
+  udpFrameCount++;
 }
 
 // this is called from core 1 by the WiFi support
-void asyncDataReceived(Stream &stream) {
+void asyncDataReceived(Stream &stream, uint8_t connection) {
+  CmdParser &p = parsers[connection];
+  cSFA(numberStr, p.number);
   while (stream.available()) {
     char c = stream.read();
+    if (p.numberCmd != '\0') {
+      if (isDigit(c) || (c == '.') || (c == '-')) {
+        numberStr += c;
+        continue;
+      }
+      if ((p.numberCmd == 'f') && (c == ',')) {
+        if (!addFramePosition(p)) {
+          p.numberCmd = '\0'; // ignore this frame
+        }
+        continue;
+      }
+      pushNumberCmd(p, connection); // any other char ends the number
+    }
     // s for stop, r for run, h for home
     if (c == 's') {
-      stepperCtrl_v = STOP;
+      pushCmd(STOP);
     } else if (c == 'r') {
-      stepperCtrl_v = RUN;
+      pushCmd(RUN);
     } else if (c == 'h') {
-      stepperCtrl_v = HOME;
+      pushCmd(HOME);
+    } else if (c == 't') {
+      // time_us,event,pcb,len  about 30 chars each so 32 fit in the output buffer
+      if (asyncTraceDump(stream, 32) == 0) {
+        stream.println("no trace records");
+      }
+    } else if (c == 'w') {
+      // wakes and busy us for each reason, to see where the HS_AsyncTCP task time goes
+      stream.print("wakes lwIP,notify,timer:");
+      for (int i = 0; i < ASYNC_WAKE_REASONS; i++) {
+        stream.print(i ? "," : ""); stream.print(asyncWakeCount((AsyncWakeReason)i));
+      }
+      stream.print(" busy us:");
+      for (int i = 0; i < ASYNC_WAKE_REASONS; i++) {
+        stream.print(i ? "," : ""); stream.print(asyncWakeBusyMicros((AsyncWakeReason)i));
+      }
+      stream.println();
+    } else if (c == 'x') {
+      telemetry[connection].binary = true;
+    } else if (c == 'c') {
+      telemetry[connection].binary = false;
+    } else if ((c == 'v') || (c == 'm') || (c == 'a') || (c == 'p') || (c == 'f') || (c == 'i')) {
+      p.numberCmd = c;
+      numberStr.clear();
+      p.frameAxis = 0;
     } // ignore other chars
   }
 }
@@ -14,9 +14,9 @@
    Your code MUST implement these 5 methods, can be just empty methods
   void asyncSetup();
   void asyncLoop(Stream &stream);
-  void asyncConnected(Stream &stream);
-  void asyncDisconnected();
-  void asyncDataReceived(Stream &stream);
+  void asyncConnected(Stream &stream, uint8_t connection);
+  void asyncDisconnected(uint8_t connection);
+  void asyncDataReceived(Stream &stream, uint8_t connection);
 */
 
 /**
@@ -30,38 +30,61 @@ void asyncSetup();
 /**
    asyncLoop
    runs on WiFi core 0, in HS_Async thread (task). Use volatiles to interact with your Arduino loop() code
-   Called on average every 1.5ms but can be upto 20ms between calls if the WiFi is busy
-   Text written to stream sent on return from this method.
+   Called every time the HS_Async task wakes, i.e. after lwIP events, on asyncNotify() and every asyncLoopInterval() us (default 1ms)
+   Text written to stream sent to every connection on return from this method.
 */
 void asyncLoop(Stream &stream);
 
 /**
    asyncConnected
    runs on WiFi core 0, in HS_Async thread (task). Use volatiles to interact with your Arduino loop() code
-   Called on new connection
-   Text written to stream sent on return from this method.
+   Called on each new connection, connection is its number, 0 .. ASYNC_MAX_CLIENTS-1
+   Text written to stream sent to just the new connection on return from this method.
 */
-void asyncConnected(Stream &stream);
+void asyncConnected(Stream &stream, uint8_t connection);
 
 /**
    asyncDisconnected
    runs on WiFi core 0, in HS_Async thread (task). Use volatiles to interact with your Arduino loop() code
    Called when connection closed, either by other side or by your code calling asyncCloseConnection();
-   Text written to stream sent on return from this method.
+   connection is the number that was passed to asyncConnected()
 */
-void asyncDisconnected();
+void asyncDisconnected(uint8_t connection);
 
 /**
    asyncDataReceived
    runs on WiFi core 0, in HS_Async thread (task). Use volatiles to interact with your Arduino loop() code
    Called on when data received from WiFi connection.
    All incoming data should be processed in this method. Any unprocessed data will be discared on return from this method
-   Text written to stream sent on return from this method.
+   Text written to stream sent to just the connection the data came from on return from this method.
+   connection is the number of the connection the data came from, each one has its own cmd parser state.
 */
-void asyncDataReceived(Stream &stream);
+void asyncDataReceived(Stream &stream, uint8_t connection);
 
 // ============= end of methods that need to be implemented =====================
 
+/**
+   asyncConnectionLoop
+   runs on WiFi core 0, in HS_Async thread (task), after each asyncLoop(), once for each open connection
+   set as the asyncSetConnectionLoopHandler() by asyncSetup()
+   Writes the telemetry asyncLoop() prepared if this connection's i<ms> interval is up, as CSV text or, after an x cmd, a TelemetryFrame
+   Text written to stream sent to just this connection on return from this method.
+*/
+void asyncConnectionLoop(Stream &stream, uint8_t connection);
+
+/**
+   udpSetpointReceived(const uint8_t *data, size_t len, uint32_t rx_us)
+   the initAsyncUdp() handler for streamed setpoint frames, runs in the HS_Async task
+   Each datagram is one frame, little endian, 8 + 4 * SETPOINT_AXES bytes
+     uint32_t seq      incremented by the sender for each frame
+     uint32_t time_us  sender's timestamp, not used, the follower is timed by rx_us
+     int32_t position[SETPOINT_AXES]
+   Frames with a seq not after the last one used are dropped as late or repeated,
+   a jump back of more than 1000 is taken as the sender restarting.
+   The frame goes straight to loop() through setpointFrames_v
+*/
+void udpSetpointReceived(const uint8_t *data, size_t len, uint32_t rx_us);
+
 /**
    asyncCloseConnection()
    flags connection to be closed
@@ -1,4 +1,6 @@
-import telnetlib
+import socket
+import struct
+import binascii
 import threading
 import tkinter as tk
 from tkinter import ttk
@@ -20,40 +22,114 @@ speed_data = []
 position_data = []
 max_loop_time_data = []
 
-# Establish Telnet connection
-tn = telnetlib.Telnet(HOST, PORT)
+# Binary telemetry frames (sent after the 'x' cmd), see TelemetryFrame.h
+#   0xA5, schema id, uint16 length, fields, uint16 CRC-16/CCITT-FALSE of schema id..fields, all little endian
+# the field types and labels come from the "schema,<id>,<type> <label>,..." line sent on connection
+FRAME_SYNC = 0xA5
+SCHEMA_TYPES = {'uint8_t': 'B', 'int8_t': 'b', 'uint16_t': 'H', 'int16_t': 'h',
+                'uint32_t': 'I', 'int32_t': 'i', 'float': 'f'}
+schema_id = None
+schema_format = None
+schema_labels = []
+csv_labels = []
+
+# Establish connection, a plain socket as telnetlib would mangle 0xFF bytes in the binary frames
+sock = socket.create_connection((HOST, PORT))
+rx_buffer = bytearray()
+
+def read_bytes(n):
+    global rx_buffer
+    while len(rx_buffer) < n:
+        data = sock.recv(4096)
+        if not data:
+            raise ConnectionError("connection closed")
+        rx_buffer += data
+    result = bytes(rx_buffer[:n])
+    del rx_buffer[:n]
+    return result
+
+def read_line():
+    global rx_buffer
+    while b'\n' not in rx_buffer:
+        data = sock.recv(4096)
+        if not data:
+            raise ConnectionError("connection closed")
+        rx_buffer += data
+    idx = rx_buffer.index(b'\n')
+    result = bytes(rx_buffer[:idx])
+    del rx_buffer[:idx + 1]
+    return result.decode('ascii', 'replace').strip()
+
+def parse_schema(line):
+    global schema_id, schema_format, schema_labels
+    fields = line.split(',')
+    schema_id = int(fields[1])
+    schema_format = '<'
+    schema_labels = []
+    for field in fields[2:]:
+        type_name, label = field.split(' ', 1)
+        schema_format += SCHEMA_TYPES[type_name]
+        schema_labels.append(label)
+
+def read_frame():
+    # the sync byte has been read, returns a dict of label: value or None if the frame is bad
+    header = read_bytes(3)
+    frame_schema = header[0]
+    length = struct.unpack('<H', header[1:3])[0]
+    body = read_bytes(length + 2)
+    crc = struct.unpack('<H', body[length:])[0]
+    if crc != binascii.crc_hqx(header + body[:length], 0xFFFF):
+        print("bad frame CRC")
+        return None
+    if (frame_schema != schema_id) or (length != struct.calcsize(schema_format)):
+        print(f"unknown frame schema {frame_schema}")
+        return None
+    return dict(zip(schema_labels, struct.unpack(schema_format, body[:length])))
+
+def read_values():
+    # returns a dict of label: value for the next results, from a binary frame or a CSV line
+    global csv_labels
+    while True:
+        first = read_bytes(1)
+        if first[0] == FRAME_SYNC:
+            values = read_frame()
+            if values is not None:
+                return values
+            continue
+        rx_buffer.insert(0, first[0])
+        response = read_line()
+        print(f"Raw data received: {response}")  # Debugging output
+        if response.startswith('schema,'):
+            parse_schema(response)
+        elif response.startswith('millis,'):
+            csv_labels = response.split(',')
+        elif csv_labels:
+            fields = response.split(',')
+            if len(fields) == len(csv_labels):
+                try:
+                    return {label: float(value) for label, value in zip(csv_labels, fields)}
+                except ValueError as e:
+                    print(f"ValueError: {e} - received data: {response}")
 
 def update_data():
     global time_ms, avg_loop_time_us, max_loop_time_us, speed, position, speed_data, position_data, max_loop_time_data
 
     while True:
-        # Read data from Telnet
-        response = tn.read_until(b'\n').decode('ascii').strip()
-        print(f"Raw data received: {response}")  # Debugging output
-        try:
-            # Split the comma-separated string into individual values
-            values = response.split(',')
-            if len(values) == 5:
-                # Strip whitespace and convert to appropriate types
-                time_ms = int(values[0].strip())
-                avg_loop_time_us = float(values[1].strip())
-                max_loop_time_us = int(values[2].strip())
-                speed = float(values[3].strip())
-                position = int(values[4].strip())
-                
-                speed_data.append(speed)
-                position_data.append(position)
-                max_loop_time_data.append(max_loop_time_us)
-                
-                if len(speed_data) > 100:
-                    speed_data.pop(0)
-                    position_data.pop(0)
-                    max_loop_time_data.pop(0)
-            else:
-                print(f"Unexpected data format: {response}")
-        except ValueError as e:
-            print(f"ValueError: {e} - received data: {response}")
-            continue
+        values = read_values()
+        time_ms = int(values['millis'])
+        avg_loop_time_us = values['avg us/loop']
+        max_loop_time_us = int(values['max us/loop'])
+        speed = values['speed']
+        position = int(values['position'])
+
+        speed_data.append(speed)
+        position_data.append(position)
+        max_loop_time_data.append(max_loop_time_us)
+
+        if len(speed_data) > 100:
+            speed_data.pop(0)
+            position_data.pop(0)
+            max_loop_time_data.pop(0)
 
         # Update GUI
         time_label.config(text=f"Time: {time_ms} ms")
@@ -62,10 +138,10 @@ def update_data():
         canvas.draw()
 
 def send_command(command):
-    tn.write(command.encode('ascii') + b'\n')
+    sock.sendall(command.encode('ascii') + b'\n')
 
 def on_closing():
-    tn.close()
+    sock.close()
     root.destroy()
 
 # Create main window
@@ -140,6 +216,9 @@ home_button.grid(row=0, column=2, padx=5)
 reverse_button = ttk.Button(button_frame, text="REVERSE", command=lambda: send_command('b'))
 reverse_button.grid(row=0, column=3, padx=5)
 
+# binary telemetry frames, send 'c' instead for CSV text
+send_command('x')
+
 # Start the data update thread
 data_thread = threading.Thread(target=update_data, daemon=True)
 data_thread.start()
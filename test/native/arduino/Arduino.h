@@ -0,0 +1,119 @@
+// Arduino.h
+#ifndef ARDUINO_H
+#define ARDUINO_H
+
+/*
+   (c)2023 Forward Computing and Control Pty. Ltd.
+   NSW Australia, www.forward.com.au
+   This code is not warranted to be fit for any purpose. You may only use it at your own risk.
+   This code may be freely used for both private and commercial use
+   provided this copyright is maintained.
+*/
+
+/**
+   The few Arduino calls SpeedStepper uses, for the PlatformIO native test env (pio test -e native)
+   Header only, so the tests need no Arduino core.
+   micros() / millis() read a simulated clock that only moves when a test calls hostAdvanceMicros()
+   or a busy wait calls delayMicroseconds(), so the step timing the tests see is exact and repeatable.
+   digitalWrite() keeps each pin's level and counts its rising edges.
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+#include <stdio.h>
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+#define HIGH 0x1
+#define LOW  0x0
+#define INPUT 0x01
+#define OUTPUT 0x03
+
+#define F(s) (s)
+
+const static uint8_t HOST_NUM_PINS = 64;
+
+inline uint64_t hostMicrosNow = 0; // the simulated clock, us
+inline uint8_t hostPinLevel[HOST_NUM_PINS];
+inline uint32_t hostPinRises[HOST_NUM_PINS];
+
+inline unsigned long micros() {
+  return (uint32_t)hostMicrosNow;
+}
+
+inline unsigned long millis() {
+  return (uint32_t)(hostMicrosNow / 1000);
+}
+
+inline void hostAdvanceMicros(uint32_t us) {
+  hostMicrosNow += us;
+}
+
+inline void delayMicroseconds(uint32_t us) {
+  hostMicrosNow += us;
+}
+
+inline void delay(uint32_t ms) {
+  hostMicrosNow += ((uint64_t)ms) * 1000;
+}
+
+inline void pinMode(uint8_t, uint8_t) {
+}
+
+inline void digitalWrite(uint8_t pin, uint8_t level) {
+  if (pin >= HOST_NUM_PINS) {
+    return;
+  }
+  if (level && !hostPinLevel[pin]) {
+    hostPinRises[pin]++;
+  }
+  hostPinLevel[pin] = level ? HIGH : LOW;
+}
+
+inline int digitalRead(uint8_t pin) {
+  return (pin < HOST_NUM_PINS) ? hostPinLevel[pin] : LOW;
+}
+
+/**
+   hostResetPins()
+   sets all the pins LOW and zeros the rising edge counts
+*/
+inline void hostResetPins() {
+  memset(hostPinLevel, 0, sizeof(hostPinLevel));
+  memset(hostPinRises, 0, sizeof(hostPinRises));
+}
+
+class Print {
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t b) = 0;
+  size_t print(const char *s) {
+    size_t n = 0;
+    while (*s) {
+      n += write((uint8_t)*s++);
+    }
+    return n;
+  }
+  size_t print(long l) {
+    char buf[24];
+    snprintf(buf, sizeof(buf), "%ld", l);
+    return print(buf);
+  }
+  size_t print(double d) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.2f", d);
+    return print(buf);
+  }
+  size_t println() {
+    return print("\r\n");
+  }
+  template <class T> size_t println(T t) {
+    size_t n = print(t);
+    return n + println();
+  }
+};
+
+#endif // ARDUINO_H
@@ -0,0 +1,99 @@
+// test_main.cpp
+/*
+   (c)2023 Forward Computing and Control Pty. Ltd.
+   NSW Australia, www.forward.com.au
+   This code is not warranted to be fit for any purpose. You may only use it at your own risk.
+   This code may be freely used for both private and commercial use
+   provided this copyright is maintained.
+*/
+
+// SpeedStepper::setAbsoluteSchedule(), step rate with a coarse run() rate, late step catch up and dropped backlogs
+// pio test -e native -f native/test_absolute_schedule
+
+#include <Arduino.h>
+#include <unity.h>
+#include "SpeedStepper.h"
+
+static const int STEP_PIN = 4;
+static const int DIR_PIN = 5;
+
+/**
+   runFor(stepper, us, pollUs)
+   calls run() every pollUs simulated us for us
+   returns the steps taken
+*/
+static uint32_t runFor(SpeedStepper &stepper, uint32_t us, uint32_t pollUs) {
+  uint32_t rises = hostPinRises[STEP_PIN];
+  uint32_t start = micros();
+  while ((uint32_t)(micros() - start) < us) {
+    stepper.run();
+    hostAdvanceMicros(pollUs);
+  }
+  return hostPinRises[STEP_PIN] - rises;
+}
+
+void setUp(void) {
+  hostMicrosNow = 1000;
+  hostResetPins();
+}
+
+void tearDown(void) {
+}
+
+// 3000 steps/sec is 333.33us per step, run() every 7us
+// relative scheduling loses up to 7us a step, the absolute schedule keeps the exact rate
+static void test_rate_with_coarse_run() {
+  SpeedStepper relative(STEP_PIN, DIR_PIN);
+  relative.hardStart(3000);
+  uint32_t relSteps = runFor(relative, 1000000, 7) + 1; // + the hardStart() step
+  TEST_ASSERT_LESS_THAN(2980, relSteps); // measured 2959
+
+  hostResetPins();
+  SpeedStepper absolute(STEP_PIN, DIR_PIN);
+  absolute.setAbsoluteSchedule(true);
+  absolute.hardStart(3000);
+  uint32_t absSteps = runFor(absolute, 1000000, 7) + 1;
+  TEST_ASSERT_LESS_OR_EQUAL(1, labs((long)absSteps - 3001)); // a step at 0 and every 333.33us to 1sec
+  TEST_ASSERT_EQUAL(0, absolute.getLateStepCount());
+  TEST_ASSERT_EQUAL(0, absolute.getMissedStepCount());
+  TEST_ASSERT_LESS_OR_EQUAL(7, absolute.getMaxStepLateness());
+}
+
+// a 2.5ms stall at 1000 steps/sec is caught up by the following steps
+static void test_stall_caught_up() {
+  SpeedStepper stepper(STEP_PIN, DIR_PIN);
+  stepper.setAbsoluteSchedule(true);
+  stepper.hardStart(1000);
+  uint32_t steps = 1 + runFor(stepper, 400000, 5);
+  hostAdvanceMicros(2500); // loop() stalled
+  steps += runFor(stepper, 600000, 5);
+  TEST_ASSERT_LESS_OR_EQUAL(1, labs((long)steps - 1003)); // every 1ms for 1.0025sec
+  TEST_ASSERT_EQUAL(1, stepper.getLateStepCount()); // the first step after the stall, the catch up steps are less late
+  TEST_ASSERT_EQUAL(0, stepper.getMissedStepCount());
+  TEST_ASSERT_GREATER_OR_EQUAL(1000, stepper.getMaxStepLateness());
+}
+
+// more than MAX_CATCH_UP_STEPS behind, the backlog is dropped and counted and the schedule restarts
+static void test_stall_dropped() {
+  SpeedStepper stepper(STEP_PIN, DIR_PIN);
+  stepper.setAbsoluteSchedule(true);
+  stepper.hardStart(1000);
+  uint32_t steps = 1 + runFor(stepper, 400000, 5);
+  hostAdvanceMicros(10000);
+  steps += runFor(stepper, 600000, 5);
+  uint32_t missed = stepper.getMissedStepCount();
+  TEST_ASSERT_LESS_OR_EQUAL(1, labs((long)missed - 10));
+  TEST_ASSERT_LESS_OR_EQUAL(1, labs((long)(steps + missed) - 1011)); // every 1ms for 1.01sec
+  stepper.clearScheduleCounts();
+  TEST_ASSERT_EQUAL(0, stepper.getMissedStepCount());
+  TEST_ASSERT_EQUAL(0, stepper.getLateStepCount());
+  TEST_ASSERT_EQUAL(0, stepper.getMaxStepLateness());
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_rate_with_coarse_run);
+  RUN_TEST(test_stall_caught_up);
+  RUN_TEST(test_stall_dropped);
+  return UNITY_END();
+}
@@ -0,0 +1,206 @@
+// test_main.cpp
+/*
+   (c)2023 Forward Computing and Control Pty. Ltd.
+   NSW Australia, www.forward.com.au
+   This code is not warranted to be fit for any purpose. You may only use it at your own risk.
+   This code may be freely used for both private and commercial use
+   provided this copyright is maintained.
+*/
+
+// SpeedStepper's Q24.8 fixed point ramp against the float Equation 13 ramp it replaced
+// pio test -e native -f native/test_fixed_point_ramp
+
+#include <Arduino.h>
+#include <unity.h>
+#include "SpeedStepper.h"
+
+static const int STEP_PIN = 4;
+static const int DIR_PIN = 5;
+
+/**
+   FloatRamp
+   the float recurrence SpeedStepper used before the fixed point engine
+   c0 per Equation 15, then Equation 13, cn += -(2*cn)/(4*n+1), n++ each step
+*/
+struct FloatRamp {
+  float cn; // us
+  long n;
+  void start(float acceleration) {
+    cn = 0.676 * sqrt(2.0 / acceleration) * 1000000.0;
+    n = 1;
+  }
+  void next() {
+    cn += -((2.0 * cn) / ((4.0 * n) + 1));
+    n++;
+  }
+  float speed() {
+    return 1000000.0 / cn;
+  }
+};
+
+/**
+   runSteps(stepper, steps, speeds)
+   calls run() every simulated us until steps more steps have been taken
+   saving getSpeed() after each step
+   returns the steps taken, less than steps if the stepper stopped
+*/
+static size_t runSteps(SpeedStepper &stepper, size_t steps, float *speeds) {
+  size_t taken = 0;
+  uint32_t rises = hostPinRises[STEP_PIN];
+  uint32_t timeout = 0;
+  while ((taken < steps) && (timeout < 2000000)) {
+    stepper.run();
+    if (hostPinRises[STEP_PIN] != rises) {
+      rises = hostPinRises[STEP_PIN];
+      if (speeds) {
+        speeds[taken] = stepper.getSpeed();
+      }
+      taken++;
+      timeout = 0;
+    }
+    if (!stepper.isRunning()) {
+      break;
+    }
+    hostAdvanceMicros(1);
+    timeout++;
+  }
+  return taken;
+}
+
+void setUp(void) {
+  hostMicrosNow = 1000;
+  hostResetPins();
+}
+
+void tearDown(void) {
+}
+
+static float relError(float a, float b) {
+  return fabsf(a - b) / b;
+}
+
+// each step of the speed up ramp stays within 0.1% of the float ramp
+static void test_accel_matches_float() {
+  const float ACCEL = 20000;
+  const float SPEED = 20000;
+  const size_t STEPS = 9000; // ~ SPEED^2/(2*ACCEL) = 10000 steps to cruise
+  static float speeds[STEPS];
+  SpeedStepper stepper(STEP_PIN, DIR_PIN);
+  stepper.setMaxSpeed(SPEED);
+  stepper.setAcceleration(ACCEL);
+  stepper.setSpeed(SPEED);
+  TEST_ASSERT_EQUAL(STEPS, runSteps(stepper, STEPS, speeds));
+  FloatRamp ref;
+  ref.start(ACCEL);
+  float maxErr = 0;
+  for (size_t i = 0; i < STEPS; i++) {
+    ref.next(); // the speed set by computeNewSpeed() after step i
+    float err = relError(speeds[i], ref.speed());
+    if (err > maxErr) {
+      maxErr = err;
+    }
+  }
+  TEST_ASSERT_FLOAT_WITHIN(0.001, 0.0, maxErr);
+}
+
+// the ramp reaches the target speed exactly, at the same step as the float ramp
+static void test_reaches_target_speed() {
+  const float ACCEL = 5000;
+  const float SPEED = 5000;
+  static float speeds[3000];
+  SpeedStepper stepper(STEP_PIN, DIR_PIN);
+  stepper.setMaxSpeed(SPEED);
+  stepper.setAcceleration(ACCEL);
+  stepper.setSpeed(SPEED);
+  runSteps(stepper, 3000, speeds);
+  size_t cruise = 0;
+  while ((cruise < 3000) && (speeds[cruise] < SPEED)) {
+    cruise++;
+  }
+  FloatRamp ref;
+  ref.start(ACCEL);
+  size_t refCruise = 0;
+  do {
+    ref.next();
+    refCruise++;
+  } while ((1000000.0 / SPEED) - ref.cn < ((2.0 * ref.cn) / ((4.0 * ref.n) + 1))); // float ramp snaps to final_cn
+  TEST_ASSERT_FLOAT_WITHIN(0.5, SPEED, speeds[2999]);
+  TEST_ASSERT_LESS_OR_EQUAL(2, labs((long)cruise - (long)refCruise));
+}
+
+// stopping from speed takes the Equation 16 steps and slows at the float ramp's rate
+static void test_decel_matches_float() {
+  const float ACCEL = 20000;
+  const float SPEED = 10000;
+  static float speeds[5000];
+  SpeedStepper stepper(STEP_PIN, DIR_PIN);
+  stepper.setMaxSpeed(SPEED);
+  stepper.setAcceleration(ACCEL);
+  stepper.setSpeed(SPEED);
+  runSteps(stepper, 4000, NULL); // 2500 steps to cruise
+  TEST_ASSERT_FLOAT_WITHIN(0.5, SPEED, stepper.getSpeed());
+  stepper.setSpeed(0.0);
+  float startSpeed = stepper.getSpeed(); // setSpeed() applies the first slow down step
+  size_t steps = runSteps(stepper, 5000, speeds);
+  TEST_ASSERT_FALSE(stepper.isRunning());
+  long stepsToStop = (long)((SPEED * SPEED) / (2.0 * ACCEL)); // Equation 16
+  TEST_ASSERT_LESS_OR_EQUAL(2, labs((long)steps - stepsToStop));
+
+  FloatRamp ref;
+  ref.cn = 1000000.0 / SPEED;
+  ref.n = -stepsToStop;
+  ref.next();
+  TEST_ASSERT_FLOAT_WITHIN(0.001, 0.0, relError(startSpeed, ref.speed()));
+  float maxErr = 0;
+  for (size_t i = 0; (i + 1 < steps) && (ref.n < -1); i++) {
+    ref.next();
+    float err = relError(speeds[i], ref.speed());
+    if (err > maxErr) {
+      maxErr = err;
+    }
+  }
+  TEST_ASSERT_FLOAT_WITHIN(0.001, 0.0, maxErr);
+}
+
+// 50000 steps/sec, well past the old 1000 steps/sec limit
+static void test_max_speed() {
+  SpeedStepper stepper(STEP_PIN, DIR_PIN);
+  stepper.setMaxSpeed(50000);
+  stepper.setAcceleration(500000);
+  stepper.setSpeed(50000);
+  runSteps(stepper, 5000, NULL);
+  TEST_ASSERT_FLOAT_WITHIN(1.0, 50000, stepper.getSpeed());
+  // 20us per step once at speed
+  uint32_t rises = hostPinRises[STEP_PIN];
+  uint32_t start = micros();
+  while ((micros() - start) < 20000) {
+    stepper.run();
+    hostAdvanceMicros(1);
+  }
+  TEST_ASSERT_EQUAL(1000, hostPinRises[STEP_PIN] - rises);
+}
+
+// slowest speeds and accelerations still fit in the fixed point cn
+static void test_slow_speed() {
+  SpeedStepper stepper(STEP_PIN, DIR_PIN);
+  stepper.setMinSpeed(0.1);
+  stepper.setAcceleration(0.01);
+  stepper.setSpeed(0.5);
+  TEST_ASSERT_TRUE(stepper.isRunning());
+  float sp = stepper.getSpeed();
+  TEST_ASSERT_TRUE(sp > 0.0);
+  TEST_ASSERT_TRUE(sp <= 0.5);
+  FloatRamp ref;
+  ref.start(0.01);
+  TEST_ASSERT_FLOAT_WITHIN(0.001, 0.0, relError(sp, ref.speed()));
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_accel_matches_float);
+  RUN_TEST(test_reaches_target_speed);
+  RUN_TEST(test_decel_matches_float);
+  RUN_TEST(test_max_speed);
+  RUN_TEST(test_slow_speed);
+  return UNITY_END();
+}
@@ -0,0 +1,80 @@
+// test_main.cpp
+/*
+   (c)2023 Forward Computing and Control Pty. Ltd.
+   NSW Australia, www.forward.com.au
+   This code is not warranted to be fit for any purpose. You may only use it at your own risk.
+   This code may be freely used for both private and commercial use
+   provided this copyright is maintained.
+*/
+
+// SpeedStepper::pushSetpoint() sample ordering and following a setpoint stream
+// pio test -e native -f native/test_follower
+
+#include <Arduino.h>
+#include <unity.h>
+#include "SpeedStepper.h"
+
+static const int STEP_PIN = 4;
+static const int DIR_PIN = 5;
+
+/**
+   runFor(stepper, us)
+   calls run() every 5 simulated us for us
+*/
+static void runFor(SpeedStepper &stepper, uint32_t us) {
+  uint32_t start = micros();
+  while ((uint32_t)(micros() - start) < us) {
+    stepper.run();
+    hostAdvanceMicros(5);
+  }
+}
+
+void setUp(void) {
+  hostMicrosNow = 1000;
+  hostResetPins();
+}
+
+void tearDown(void) {
+}
+
+// a sample between the newest one and the one FOLLOWER_VELOCITY_SAMPLES back is rejected, as is a repeat
+static void test_out_of_order_rejected() {
+  SpeedStepper stepper(STEP_PIN, DIR_PIN);
+  TEST_ASSERT_FALSE(stepper.pushSetpoint(0, 1000)); // not following
+  stepper.startFollowing();
+  uint32_t t = micros();
+  for (int i = 0; i < 4; i++) {
+    TEST_ASSERT_TRUE(stepper.pushSetpoint(i * 10, t + i * 10000));
+  }
+  TEST_ASSERT_FALSE(stepper.pushSetpoint(25, t + 25000));
+  TEST_ASSERT_FALSE(stepper.pushSetpoint(30, t + 30000));
+  TEST_ASSERT_FALSE(stepper.pushSetpoint(0, t));
+  TEST_ASSERT_TRUE(stepper.pushSetpoint(40, t + 40000));
+}
+
+// a 1000 steps/sec stream pushed every 5ms is followed to the last setpoint
+static void test_follows_stream() {
+  SpeedStepper stepper(STEP_PIN, DIR_PIN);
+  stepper.setMaxSpeed(2000);
+  stepper.setAcceleration(20000);
+  stepper.startFollowing(10000, 20.0, 20000);
+  for (int i = 0; i <= 100; i++) {
+    TEST_ASSERT_TRUE(stepper.pushSetpoint(i * 5));
+    runFor(stepper, 5000);
+  }
+  TEST_ASSERT_FLOAT_WITHIN(100, 1000, stepper.getSpeed());
+  TEST_ASSERT_INT_WITHIN(30, 500 - 10, stepper.getCurrentPosition()); // 10ms behind
+  for (int i = 0; i < 100; i++) {
+    stepper.pushSetpoint(500); // holds
+    runFor(stepper, 5000);
+  }
+  TEST_ASSERT_EQUAL(500, stepper.getCurrentPosition());
+  TEST_ASSERT_EQUAL(0, stepper.getFollowerDroppedCount());
+}
+
+int main(int, char **) {
+  UNITY_BEGIN();
+  RUN_TEST(test_out_of_order_rejected);
+  RUN_TEST(test_follows_stream);
+  return UNITY_END();
+}
@@ -0,0 +1,209 @@
+// test_main.cpp
+/*
+   (c)2023 Forward Computing and Control Pty. Ltd.
+   NSW Australia, www.forward.com.au
+   This code is not warranted to be fit for any purpose. You may only use it at your own risk.
+   This code may be freely used for both private and commercial use
+   provided this copyright is maintained.
+*/
+
+// SpeedStepperT, the step/dir edge sequence from its inlined GPIO writes and the writes per step
+// pio test -e native -f native/test_gpio_template
+
+#include <Arduino.h>
+#include <unity.h>
+#include <type_traits>
+#include "SpeedStepperT.h"
+
+static const uint8_t STEP_PIN = 4;
+static const uint8_t DIR_PIN = 5;
+static const uint32_t MIN_PULSE_WIDTH = 2; // SpeedStepper's minPulseWidth
+
+// no vptr, the template adds no state
+static_assert(!std::is_polymorphic<SpeedStepper>::value, "SpeedStepper should have no virtual methods");
+static_assert(sizeof(SpeedStepperT<STEP_PIN, DIR_PIN>) == sizeof(SpeedStepper), "SpeedStepperT should add no members");
+
+struct GpioWrite {
+  uint8_t pin;
+  boolean level;
+  uint32_t time; // micros()
+};
+
+static const size_t GPIO_LOG_SIZE = 4096;
+static GpioWrite gpioLog[GPIO_LOG_SIZE];
+static size_t gpioLogLen = 0;
+
+// the SPEED_STEPPER_HOST_GPIO 'register store', logs each write
+void speedStepperHostGpioWrite(uint8_t pin, boolean level) {
+  TEST_ASSERT_LESS_THAN(GPIO_LOG_SIZE, gpioLogLen);
+  gpioLog[gpioLogLen].pin = pin;
+  gpioLog[gpioLogLen].level = level;
+  gpioLog[gpioLogLen].time = micros();
+  gpioLogLen++;
+}
+
+/**
+   runFor(stepper, us, pollUs)
+   calls run() every pollUs simulated us for us
+*/
+template <class STEPPER>
+static void runFor(STEPPER &stepper, uint32_t us, uint32_t pollUs) {
+  uint32_t start = micros();
+  while ((uint32_t)(micros() - start) < us) {
+    stepper.run();
+    hostAdvanceMicros(pollUs);
+  }
+}
+
+/**
+   checkEdgeSequence(dirWrites)
+   every STEP HIGH is followed by a STEP LOW at least MIN_PULSE_WIDTH later,
+   DIR only changes while STEP is LOW and at least MIN_PULSE_WIDTH before the next STEP HIGH
+   returns the number of step pulses, dirWrites is set to the DIR writes
+*/
+static uint32_t checkEdgeSequence(uint32_t &dirWrites) {
+  uint32_t steps = 0;
+  dirWrites = 0;
+  boolean stepHigh = false;
+  uint32_t stepEdgeTime = 0;
+  boolean dirPending = false;
+  uint32_t dirTime = 0;
+  for (size_t i = 0; i < gpioLogLen; i++) {
+    const GpioWrite &w = gpioLog[i];
+    if (w.pin == DIR_PIN) {
+      TEST_ASSERT_FALSE(stepHigh);
+      dirWrites++;
+      dirPending = true;
+      dirTime = w.time;
+      continue;
+    }
+    TEST_ASSERT_EQUAL(STEP_PIN, w.pin);
+    TEST_ASSERT_TRUE(w.level != stepHigh); // each write is an edge
+    if (w.level) {
+      if (dirPending) {
+        TEST_ASSERT_GREATER_OR_EQUAL(MIN_PULSE_WIDTH, w.time - dirTime);
+        dirPending = false;
+      }
+      steps++;
+    } else {
+      TEST_ASSERT_GREATER_OR_EQUAL(MIN_PULSE_WIDTH, w.time - stepEdgeTime);
+    }
+    stepHigh = w.level;
+    stepEdgeTime = w.time;
+  }
+  TEST_ASSERT_FALSE(stepHigh);
+  return steps;
+}
+
+void setUp(void) {
+  hostMicrosNow = 1000;
+  hostResetPins();
+  gpioLogLen = 0;
+}
+
+void tearDown(void) {
+}
+
+// the same steps as SpeedStepper's digitalWrite() output, two register writes a step
+static void test_same_steps_as_digitalWrite() {
+  SpeedStepper plain(STEP_PIN, DIR_PIN);
+  plain.setAcceleration(5000);
+  plain.setSpeed(1000);
+  runFor(plain, 300000, 5);
+  uint32_t plainSteps = hostPinRises[STEP_PIN];
+
+  hostMicrosNow = 1000;
+  hostResetPins();
+  SpeedStepperT<STEP_PIN, DIR_PIN> fast;
+  fast.setAcceleration(5000);
+  fast.setSpeed(1000); // the first step is from setSpeed(), digitalWrite()
+  TEST_ASSERT_EQUAL(1, hostPinRises[STEP_PIN]);
+  runFor(fast, 300000, 5);
+  uint32_t dirWrites;
+  uint32_t steps = checkEdgeSequence(dirWrites);
+  TEST_ASSERT_EQUAL(plainSteps, steps + 1);
+  TEST_ASSERT_EQUAL(plain.getCurrentPosition(), fast.getCurrentPosition());
+  TEST_ASSERT_EQUAL(0, dirWrites);
+  TEST_ASSERT_EQUAL(2 * steps, gpioLogLen); // HIGH and LOW, nothing else
+  TEST_ASSERT_EQUAL(1, hostPinRises[STEP_PIN]); // run() did not use digitalWrite()
+}
+
+// reversing writes DIR once, from run(), before the first reverse step
+static void test_reverse_edge_sequence() {
+  SpeedStepperT<STEP_PIN, DIR_PIN> stepper;
+  stepper.setAcceleration(5000);
+  stepper.setSpeed(1000);
+  runFor(stepper, 300000, 5);
+  int32_t forwardPos = stepper.getCurrentPosition();
+  gpioLogLen = 0;
+  stepper.setSpeed(-1000);
+  TEST_ASSERT_EQUAL(HIGH, hostPinLevel[DIR_PIN]); // setDir() leaves DIR_PIN to the next step
+  runFor(stepper, 600000, 5);
+  uint32_t dirWrites;
+  uint32_t steps = checkEdgeSequence(dirWrites);
+  TEST_ASSERT_EQUAL(1, dirWrites);
+  TEST_ASSERT_EQUAL(2 * steps + 1, gpioLogLen);
+  TEST_ASSERT_FALSE(stepper.isDirForward());
+  TEST_ASSERT_LESS_THAN(forwardPos, stepper.getCurrentPosition());
+  // the DIR write is LOW, between the last forward step and the first reverse one
+  size_t i = 0;
+  while (gpioLog[i].pin != DIR_PIN) {
+    i++;
+  }
+  TEST_ASSERT_EQUAL(LOW, gpioLog[i].level);
+  int32_t forwardSteps = i / 2; // still decelerating forward before the DIR write
+  TEST_ASSERT_EQUAL(forwardPos + forwardSteps - ((int32_t)steps - forwardSteps), stepper.getCurrentPosition());
+}
+
+// INVERT outputs DIR LOW for forward and HIGH for reverse
+static void test_invert() {
+  SpeedStepperT<STEP_PIN, DIR_PIN, true> stepper;
+  stepper.setAcceleration(5000);
+  stepper.setSpeed(1000);
+  TEST_ASSERT_EQUAL(LOW, hostPinLevel[DIR_PIN]);
+  runFor(stepper, 300000, 5);
+  gpioLogLen = 0;
+  stepper.setSpeed(-1000);
+  runFor(stepper, 600000, 5);
+  uint32_t dirWrites;
+  checkEdgeSequence(dirWrites);
+  TEST_ASSERT_EQUAL(1, dirWrites);
+  size_t i = 0;
+  while (gpioLog[i].pin != DIR_PIN) {
+    i++;
+  }
+  TEST_ASSERT_EQUAL(HIGH, gpioLog[i].level);
+}
+
+// non-blocking pulses, STEP LOW from a later run(), still two writes a step
+static void test_non_blocking_edges() {
+  SpeedStepperT<STEP_PIN, DIR_PIN> stepper;
+  stepper.setNonBlockingStepPulse(true);
+  stepper.setAcceleration(5000);
+  stepper.setSpeed(1000); // DIR HIGH from digitalWrite(), the first step waits for the dir setup time
+  TEST_ASSERT_EQUAL(HIGH, hostPinLevel[DIR_PIN]);
+  TEST_ASSERT_EQUAL(0, hostPinRises[STEP_PIN]);
+  hostAdvanceMicros(MIN_PULSE_WIDTH);
+  stepper.run(); // STEP HIGH
+  hostAdvanceMicros(MIN_PULSE_WIDTH);
+  stepper.run(); // STEP LOW
+  TEST_ASSERT_EQUAL(2, gpioLogLen);
+  TEST_ASSERT_EQUAL(HIGH, gpioLog[0].level);
+  TEST_ASSERT_EQUAL(LOW, gpioLog[1].level);
+  gpioLogLen = 0;
+  runFor(stepper, 300000, 1);
+  uint32_t dirWrites;
+  uint32_t steps = checkEdgeSequence(dirWrites);
+  TEST_ASSERT_GREATER_THAN(100, steps);
+  TEST_ASSERT_EQUAL(2 * steps, gpioLogLen);
+  TEST_ASSERT_EQUAL(steps + 1, stepper.getCurrentPosition());
+}
+
+int main(int, char **) {
+  UNITY_BEGIN();
+  RUN_TEST(test_same_steps_as_digitalWrite);
+  RUN_TEST(test_reverse_edge_sequence);
+  RUN_TEST(test_invert);
+  RUN_TEST(test_non_blocking_edges);
+  return UNITY_END();
+}
@@ -0,0 +1,150 @@
+// test_main.cpp
+/*
+   (c)2023 Forward Computing and Control Pty. Ltd.
+   NSW Australia, www.forward.com.au
+   This code is not warranted to be fit for any purpose. You may only use it at your own risk.
+   This code may be freely used for both private and commercial use
+   provided this copyright is maintained.
+*/
+
+// SpeedStepper::moveTo()/move(), trapezoid and triangle profiles, stopping exactly at the target
+// pio test -e native -f native/test_move_to
+
+#include <Arduino.h>
+#include <unity.h>
+#include "SpeedStepper.h"
+
+static const int STEP_PIN = 4;
+static const int DIR_PIN = 5;
+
+static float peakSpeed; // max abs(getSpeed()) seen by runToStop()
+static int32_t maxPosition; // max getCurrentPosition() seen by runToStop()
+
+/**
+   runToStop(stepper, maxUs)
+   calls run() every 5 simulated us until the stepper stops, or for maxUs
+   returns the us taken
+*/
+static uint32_t runToStop(SpeedStepper &stepper, uint32_t maxUs) {
+  peakSpeed = 0;
+  maxPosition = stepper.getCurrentPosition();
+  uint32_t start = micros();
+  boolean running = true;
+  while (running && ((uint32_t)(micros() - start) < maxUs)) {
+    running = stepper.run(); // the last step is taken by the run() that returns false
+    float sp = fabs(stepper.getSpeed());
+    if (sp > peakSpeed) {
+      peakSpeed = sp;
+    }
+    if (stepper.getCurrentPosition() > maxPosition) {
+      maxPosition = stepper.getCurrentPosition();
+    }
+    hostAdvanceMicros(5);
+  }
+  return micros() - start;
+}
+
+void setUp(void) {
+  hostMicrosNow = 1000;
+  hostResetPins();
+}
+
+void tearDown(void) {
+}
+
+// long move, cruises at maxSpeed and stops on the target, one pulse per step
+static void test_trapezoid() {
+  SpeedStepper stepper(STEP_PIN, DIR_PIN);
+  stepper.setMaxSpeed(2000);
+  stepper.setAcceleration(4000);
+  stepper.moveTo(5000);
+  TEST_ASSERT_TRUE(stepper.isMovingToTarget());
+  TEST_ASSERT_EQUAL(5000, stepper.getTargetPosition());
+  uint32_t us = runToStop(stepper, 10000000);
+  TEST_ASSERT_FALSE(stepper.isRunning());
+  TEST_ASSERT_FALSE(stepper.isMovingToTarget());
+  TEST_ASSERT_EQUAL(5000, stepper.getCurrentPosition());
+  TEST_ASSERT_EQUAL(5000, hostPinRises[STEP_PIN]);
+  TEST_ASSERT_EQUAL(5000, maxPosition); // no overshoot
+  TEST_ASSERT_FLOAT_WITHIN(20, 2000, peakSpeed);
+  // 0.5sec up, 2000 steps/sec for (5000 - 1000 ramp steps), 0.5sec down
+  TEST_ASSERT_FLOAT_WITHIN(0.05, 3.0, us / 1000000.0);
+}
+
+// short move, never reaches maxSpeed, peaks at sqrt(a * d)
+static void test_triangle() {
+  SpeedStepper stepper(STEP_PIN, DIR_PIN);
+  stepper.setMaxSpeed(2000);
+  stepper.setAcceleration(4000);
+  stepper.moveTo(400);
+  runToStop(stepper, 10000000);
+  TEST_ASSERT_FALSE(stepper.isRunning());
+  TEST_ASSERT_EQUAL(400, stepper.getCurrentPosition());
+  TEST_ASSERT_EQUAL(400, hostPinRises[STEP_PIN]);
+  TEST_ASSERT_EQUAL(400, maxPosition);
+  float expectedPeak = sqrt(4000.0 * 400);
+  TEST_ASSERT_FLOAT_WITHIN(expectedPeak * 0.03, expectedPeak, peakSpeed);
+}
+
+// moveTo() behind a running stepper, stops, reverses and stops on the target
+static void test_reverse_to_target() {
+  SpeedStepper stepper(STEP_PIN, DIR_PIN);
+  stepper.setMaxSpeed(2000);
+  stepper.setAcceleration(4000);
+  stepper.setSpeed(1000);
+  uint32_t start = micros();
+  while ((uint32_t)(micros() - start) < 500000) {
+    stepper.run();
+    hostAdvanceMicros(5);
+  }
+  TEST_ASSERT_GREATER_THAN(0, stepper.getCurrentPosition());
+  stepper.moveTo(-300);
+  runToStop(stepper, 10000000);
+  TEST_ASSERT_FALSE(stepper.isRunning());
+  TEST_ASSERT_EQUAL(-300, stepper.getCurrentPosition());
+}
+
+// move() is relative and still stops at the plus limit
+static void test_move_within_limits() {
+  SpeedStepper stepper(STEP_PIN, DIR_PIN);
+  stepper.setMaxSpeed(2000);
+  stepper.setAcceleration(4000);
+  stepper.move(200);
+  runToStop(stepper, 10000000);
+  TEST_ASSERT_EQUAL(200, stepper.getCurrentPosition());
+  stepper.setPlusLimit(300);
+  stepper.move(500);
+  TEST_ASSERT_EQUAL(700, stepper.getTargetPosition());
+  runToStop(stepper, 10000000);
+  TEST_ASSERT_FALSE(stepper.isRunning());
+  TEST_ASSERT_EQUAL(300, stepper.getCurrentPosition());
+  TEST_ASSERT_EQUAL(300, stepper.getPlusLimit()); // the temporary move limit is removed
+}
+
+// setSpeed() cancels the move
+static void test_set_speed_cancels() {
+  SpeedStepper stepper(STEP_PIN, DIR_PIN);
+  stepper.setMaxSpeed(2000);
+  stepper.setAcceleration(4000);
+  stepper.moveTo(5000);
+  uint32_t start = micros();
+  while ((uint32_t)(micros() - start) < 200000) {
+    stepper.run();
+    hostAdvanceMicros(5);
+  }
+  stepper.setSpeed(0);
+  TEST_ASSERT_FALSE(stepper.isMovingToTarget());
+  runToStop(stepper, 10000000);
+  TEST_ASSERT_FALSE(stepper.isRunning());
+  TEST_ASSERT_LESS_THAN(5000, stepper.getCurrentPosition());
+}
+
+int main(int, char **) {
+  UNITY_BEGIN();
+  RUN_TEST(test_trapezoid);
+  RUN_TEST(test_triangle);
+  RUN_TEST(test_reverse_to_target);
+  RUN_TEST(test_move_within_limits);
+  RUN_TEST(test_set_speed_cancels);
+  return UNITY_END();
+}
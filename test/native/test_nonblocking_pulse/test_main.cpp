@@ -0,0 +1,141 @@
+// test_main.cpp
+/*
+   (c)2023 Forward Computing and Control Pty. Ltd.
+   NSW Australia, www.forward.com.au
+   This code is not warranted to be fit for any purpose. You may only use it at your own risk.
+   This code may be freely used for both private and commercial use
+   provided this copyright is maintained.
+*/
+
+// SpeedStepper::setNonBlockingStepPulse(true), run() never waits, STEP/DIR edge timing from polling the pins
+// pio test -e native -f native/test_nonblocking_pulse
+
+#include <Arduino.h>
+#include <unity.h>
+#include "SpeedStepper.h"
+
+static const int STEP_PIN = 4;
+static const int DIR_PIN = 5;
+static const uint32_t MIN_PULSE_WIDTH = 2; // SpeedStepper's minPulseWidth
+
+static uint32_t stepRises;
+static uint32_t dirChanges;
+static uint32_t shortestHigh;
+static uint32_t shortestLow;
+static uint32_t shortestDirSetup; // DIR change to the next STEP HIGH
+static int32_t maxPosition; // max getCurrentPosition() seen by runPolled()
+
+/**
+   runPolled(stepper, maxUs)
+   calls run() every simulated us until the stepper stops, or for maxUs
+   run() must not move the simulated clock, i.e. never delayMicroseconds()
+   a busy wait on micros() would never return, as the clock only moves between the calls
+   the pins only change inside run(), so the levels seen after each call give the exact edge times
+*/
+static void runPolled(SpeedStepper &stepper, uint32_t maxUs) {
+  stepRises = 0;
+  dirChanges = 0;
+  shortestHigh = 0xffffffff;
+  shortestLow = 0xffffffff;
+  shortestDirSetup = 0xffffffff;
+  maxPosition = stepper.getCurrentPosition();
+  uint8_t step = digitalRead(STEP_PIN);
+  uint8_t dirLevel = digitalRead(DIR_PIN);
+  uint32_t stepEdge = micros() - 1000; // long LOW before the first step
+  uint32_t dirEdge = stepEdge;
+  boolean dirSetupPending = false;
+  uint32_t start = micros();
+  boolean running = true;
+  while ((running || step) && ((uint32_t)(micros() - start) < maxUs)) {
+    uint32_t before = micros();
+    running = stepper.run();
+    uint32_t now = micros();
+    TEST_ASSERT_EQUAL_UINT32(before, now); // no busy wait
+    if (stepper.getCurrentPosition() > maxPosition) {
+      maxPosition = stepper.getCurrentPosition();
+    }
+    if (digitalRead(DIR_PIN) != dirLevel) {
+      TEST_ASSERT_EQUAL(LOW, step); // DIR never changes while STEP is HIGH
+      TEST_ASSERT_EQUAL(LOW, digitalRead(STEP_PIN));
+      dirLevel = digitalRead(DIR_PIN);
+      dirChanges++;
+      dirEdge = now;
+      dirSetupPending = true;
+    }
+    if (digitalRead(STEP_PIN) != step) {
+      step = digitalRead(STEP_PIN);
+      uint32_t width = now - stepEdge;
+      if (step) {
+        stepRises++;
+        if (width < shortestLow) {
+          shortestLow = width;
+        }
+        if (dirSetupPending) {
+          dirSetupPending = false;
+          if ((now - dirEdge) < shortestDirSetup) {
+            shortestDirSetup = now - dirEdge;
+          }
+        }
+      } else if (width < shortestHigh) {
+        shortestHigh = width;
+      }
+      stepEdge = now;
+    }
+    hostAdvanceMicros(1);
+  }
+}
+
+void setUp(void) {
+  hostMicrosNow = 1000;
+  hostResetPins();
+}
+
+void tearDown(void) {
+}
+
+// fast move, the step interval is close to 2 * minPulseWidth so every LOW is checked near its limit
+static void test_pulse_widths() {
+  SpeedStepper stepper(STEP_PIN, DIR_PIN);
+  stepper.setNonBlockingStepPulse(true);
+  stepper.setMaxSpeed(40000);
+  stepper.setAcceleration(400000);
+  stepper.moveTo(3000);
+  runPolled(stepper, 10000000);
+  TEST_ASSERT_FALSE(stepper.isRunning());
+  TEST_ASSERT_EQUAL(3000, stepper.getCurrentPosition());
+  TEST_ASSERT_EQUAL(3000, stepRises);
+  TEST_ASSERT_EQUAL(3000, hostPinRises[STEP_PIN]);
+  TEST_ASSERT_EQUAL(LOW, digitalRead(STEP_PIN));
+  TEST_ASSERT_GREATER_OR_EQUAL(MIN_PULSE_WIDTH, shortestHigh);
+  TEST_ASSERT_GREATER_OR_EQUAL(MIN_PULSE_WIDTH, shortestLow);
+  TEST_ASSERT_LESS_OR_EQUAL(1, dirChanges); // the first step may set DIR HIGH for forward
+}
+
+// moveTo() behind a running stepper, DIR changes only between pulses and before the driver's setup time
+static void test_reverse() {
+  SpeedStepper stepper(STEP_PIN, DIR_PIN);
+  stepper.setNonBlockingStepPulse(true);
+  stepper.setMaxSpeed(20000);
+  stepper.setAcceleration(200000);
+  stepper.moveTo(2000);
+  runPolled(stepper, 5000); // part way there
+  TEST_ASSERT_TRUE(stepper.isRunning());
+  TEST_ASSERT_GREATER_THAN(0, stepper.getCurrentPosition());
+  stepper.moveTo(-500);
+  runPolled(stepper, 10000000);
+  TEST_ASSERT_FALSE(stepper.isRunning());
+  TEST_ASSERT_EQUAL(-500, stepper.getCurrentPosition());
+  TEST_ASSERT_EQUAL(1, dirChanges);
+  TEST_ASSERT_GREATER_OR_EQUAL(MIN_PULSE_WIDTH, shortestDirSetup);
+  TEST_ASSERT_GREATER_OR_EQUAL(MIN_PULSE_WIDTH, shortestHigh);
+  TEST_ASSERT_GREATER_OR_EQUAL(MIN_PULSE_WIDTH, shortestLow);
+  // one pulse per step, out to the furthest position and back to the target
+  TEST_ASSERT_EQUAL(maxPosition + (maxPosition + 500), hostPinRises[STEP_PIN]);
+}
+
+int main(int, char **) {
+  UNITY_BEGIN();
+  RUN_TEST(test_pulse_widths);
+  RUN_TEST(test_reverse);
+  return UNITY_END();
+}
@@ -0,0 +1,147 @@
+// test_main.cpp
+/*
+   (c)2023 Forward Computing and Control Pty. Ltd.
+   NSW Australia, www.forward.com.au
+   This code is not warranted to be fit for any purpose. You may only use it at your own risk.
+   This code may be freely used for both private and commercial use
+   provided this copyright is maintained.
+*/
+
+// SpeedStepper::setRampTables(), same ramp as calculating each step and no table building in run()
+// pio test -e native -f native/test_ramp_tables
+
+#include <Arduino.h>
+#include <unity.h>
+#include "SpeedStepper.h"
+
+static const int STEP_PIN = 4;
+static const int DIR_PIN = 5;
+
+/**
+   runSteps(stepper, steps, speeds)
+   calls run() every simulated us until steps more steps have been taken
+   saving getSpeed() after each step
+   returns the steps taken, less than steps if the stepper stopped
+*/
+static size_t runSteps(SpeedStepper &stepper, size_t steps, float *speeds) {
+  size_t taken = 0;
+  uint32_t rises = hostPinRises[STEP_PIN];
+  while (taken < steps) {
+    stepper.run();
+    if (hostPinRises[STEP_PIN] != rises) {
+      rises = hostPinRises[STEP_PIN];
+      speeds[taken++] = stepper.getSpeed();
+    }
+    if (!stepper.isRunning()) {
+      break;
+    }
+    hostAdvanceMicros(1);
+  }
+  return taken;
+}
+
+void setUp(void) {
+  hostMicrosNow = 1000;
+  hostResetPins();
+}
+
+void tearDown(void) {
+}
+
+// speeding up, the table ramp steps through exactly the same speeds as calculating each step
+// slowing down walks the speed up table backwards, which is within 0.02% of the calculated ramp
+static void test_table_matches_calculated() {
+  const size_t STEPS = 6000;
+  static float calculated[STEPS];
+  static float table[STEPS];
+  float *results[2] = {calculated, table};
+  size_t taken[2];
+  size_t accelSteps = 0;
+  for (int useTables = 0; useTables < 2; useTables++) {
+    hostMicrosNow = 1000;
+    SpeedStepper stepper(STEP_PIN, DIR_PIN);
+    stepper.setMaxSpeed(20000);
+    stepper.setAcceleration(65536); // 2^16, not changed by the table rounding
+    stepper.setRampTables(useTables);
+    TEST_ASSERT_EQUAL(useTables, stepper.getRampTableBuildCount());
+    stepper.setSpeed(20000);
+    size_t n = runSteps(stepper, STEPS / 2, results[useTables]);
+    accelSteps = n;
+    stepper.setSpeed(0);
+    taken[useTables] = n + runSteps(stepper, STEPS / 2, results[useTables] + n);
+    TEST_ASSERT_EQUAL(useTables, stepper.getRampTableBuildCount());
+  }
+  TEST_ASSERT_EQUAL(taken[0], taken[1]);
+  for (size_t i = 0; i < accelSteps; i++) {
+    TEST_ASSERT_EQUAL_MESSAGE(0, memcmp(&calculated[i], &table[i], sizeof(float)), "speeds differ");
+  }
+  for (size_t i = accelSteps; i < taken[0]; i++) {
+    TEST_ASSERT_FLOAT_WITHIN(calculated[i] * 2e-4, calculated[i], table[i]);
+  }
+}
+
+// with tables, nearly equal accelerations round to the same 1/32 of a doubling and share one table
+static void test_acceleration_rounding() {
+  SpeedStepper stepper(STEP_PIN, DIR_PIN);
+  stepper.setMaxSpeed(5000);
+  stepper.setAcceleration(10000);
+  stepper.setRampTables(true);
+  uint32_t builds = stepper.getRampTableBuildCount();
+  stepper.setAcceleration(10020);
+  stepper.setAcceleration(9990);
+  TEST_ASSERT_EQUAL(builds, stepper.getRampTableBuildCount());
+  stepper.setAcceleration(10500); // next step up, 2^(1/32) is 2.2%
+  TEST_ASSERT_EQUAL(builds + 1, stepper.getRampTableBuildCount());
+  // the rounded acceleration is within 1.1%, checked by the steps to stop from cruise, Equation 16
+  stepper.setAcceleration(10020);
+  stepper.setSpeed(5000);
+  static float speeds[4000];
+  runSteps(stepper, 3000, speeds);
+  stepper.setSpeed(0);
+  size_t stopSteps = runSteps(stepper, 4000, speeds);
+  float equation16 = (5000.0 * 5000.0) / (2.0 * 10020);
+  TEST_ASSERT_FLOAT_WITHIN(equation16 * 0.011 + 2, equation16, stopSteps);
+}
+
+// profile segments switching accelerations reuse the tables setProfile() built, run() allocates nothing
+static void test_profile_no_build_in_run() {
+  static SpeedProfileStruct profile[] = {
+    {2000, 200}, // 10000 steps/sec^2 from stopped
+    {4000, 200}, // 10000
+    {2010, 200}, // 9950, rounds to the 10000 table
+    {6000, 100}, // 39900
+    {4000, 200}, // 10000
+    {6000, 50},  // 40000, rounds to the 39900 table
+    {0, 300},    // 20000
+  };
+  SpeedStepper stepper(STEP_PIN, DIR_PIN);
+  stepper.setMaxSpeed(6000);
+  stepper.setRampTables(true);
+  uint32_t setupBuilds = stepper.getRampTableBuildCount();
+  stepper.setProfile(profile, sizeof(profile) / sizeof(profile[0]));
+  TEST_ASSERT_EQUAL(setupBuilds + 3, stepper.getRampTableBuildCount()); // 10000, 39900, 20000
+  uint32_t builds = stepper.getRampTableBuildCount();
+  stepper.startProfile(); // 10000 from stopped, already built
+  TEST_ASSERT_EQUAL(builds, stepper.getRampTableBuildCount());
+  uint32_t start = micros();
+  float maxSpeed = 0;
+  while (stepper.isProfileRunning() && ((micros() - start) < 2000000)) {
+    stepper.run();
+    float sp = stepper.getSpeed();
+    if (sp > maxSpeed) {
+      maxSpeed = sp;
+    }
+    hostAdvanceMicros(1);
+  }
+  TEST_ASSERT_FALSE(stepper.isProfileRunning());
+  TEST_ASSERT_EQUAL(builds, stepper.getRampTableBuildCount());
+  TEST_ASSERT_FLOAT_WITHIN(1.0, 6000, maxSpeed);
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_table_matches_calculated);
+  RUN_TEST(test_acceleration_rounding);
+  RUN_TEST(test_profile_no_build_in_run);
+  return UNITY_END();
+}
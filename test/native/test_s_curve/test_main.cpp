@@ -0,0 +1,193 @@
+// test_main.cpp
+/*
+   (c)2023 Forward Computing and Control Pty. Ltd.
+   NSW Australia, www.forward.com.au
+   This code is not warranted to be fit for any purpose. You may only use it at your own risk.
+   This code may be freely used for both private and commercial use
+   provided this copyright is maintained.
+*/
+
+// SpeedStepper::setJerk() S-curve ramps, peak jerk and acceleration against the limits set, stopping at limits and targets
+// pio test -e native -f native/test_s_curve
+
+#include <Arduino.h>
+#include <unity.h>
+#include "SpeedStepper.h"
+
+static const int STEP_PIN = 4;
+static const int DIR_PIN = 5;
+static const float ACCEL = 10000;
+static const float JERK = 100000;
+
+static float maxJerk; // max abs change in getSCurveAcceleration() per sec of step interval
+static float maxAccel; // max abs(getSCurveAcceleration())
+static float maxSpeedChange; // max abs change in abs(getSpeed()) per sec of step interval, less the cn rounding, not counting starts and stops
+static float peakSpeed;
+static float stopSpeed; // abs(getSpeed()) before the step that stopped it
+
+static void clearStats() {
+  maxJerk = 0;
+  maxAccel = 0;
+  maxSpeedChange = 0;
+  peakSpeed = 0;
+  stopSpeed = 0;
+}
+
+/**
+   runFor(stepper, us, untilStopped)
+   calls run() every 5 simulated us for us, or until the stepper stops,
+   and after each step updates the stats from the change in speed and acceleration over the step interval
+*/
+static void runFor(SpeedStepper &stepper, uint32_t us, boolean untilStopped) {
+  float lastSpeed = fabs(stepper.getSpeed());
+  float lastAccel = stepper.getSCurveAcceleration();
+  uint32_t lastRises = hostPinRises[STEP_PIN];
+  uint32_t start = micros();
+  while ((uint32_t)(micros() - start) < us) {
+    boolean running = stepper.run();
+    if (hostPinRises[STEP_PIN] != lastRises) {
+      lastRises = hostPinRises[STEP_PIN];
+      float speed = fabs(stepper.getSpeed());
+      float accel = stepper.getSCurveAcceleration();
+      if ((lastSpeed > 0) && (speed > 0)) {
+        // the ramp updated over the last step interval, 1/lastSpeed
+        float jerk = fabs(accel - lastAccel) * lastSpeed;
+        // getSpeed() is from cn, truncated to 1/256 us, so up to speed^2/(1e6 * 256) over
+        float speedChange = (fabs(speed - lastSpeed) - lastSpeed * lastSpeed / (1000000.0 * 256)) * lastSpeed;
+        maxJerk = (jerk > maxJerk) ? jerk : maxJerk;
+        maxSpeedChange = (speedChange > maxSpeedChange) ? speedChange : maxSpeedChange;
+      }
+      if (speed == 0) {
+        stopSpeed = lastSpeed; // this step stopped it
+      }
+      maxAccel = (fabs(accel) > maxAccel) ? fabs(accel) : maxAccel;
+      peakSpeed = (speed > peakSpeed) ? speed : peakSpeed;
+      lastSpeed = speed;
+      lastAccel = accel;
+    }
+    if (untilStopped && !running) {
+      return;
+    }
+    hostAdvanceMicros(5);
+  }
+}
+
+static void checkLimits() {
+  // 1/lastSpeed is the ramp's dt to float rounding
+  TEST_ASSERT_TRUE_MESSAGE(maxJerk <= JERK * 1.001, "jerk over the limit");
+  TEST_ASSERT_TRUE_MESSAGE(maxAccel <= ACCEL, "acceleration over the limit");
+  TEST_ASSERT_TRUE_MESSAGE(maxSpeedChange <= ACCEL * 1.001, "speed change over the acceleration limit");
+}
+
+static void setupStepper(SpeedStepper &stepper) {
+  stepper.setMaxSpeed(5000);
+  stepper.setAcceleration(ACCEL);
+  stepper.setJerk(JERK);
+}
+
+void setUp(void) {
+  hostMicrosNow = 1000;
+  hostResetPins();
+  clearStats();
+}
+
+void tearDown(void) {
+}
+
+// speed up, slow down, reverse and stop, all within the jerk and acceleration set
+static void test_speed_changes() {
+  SpeedStepper stepper(STEP_PIN, DIR_PIN);
+  setupStepper(stepper);
+  stepper.setSpeed(3000);
+  runFor(stepper, 1000000, false);
+  TEST_ASSERT_FLOAT_WITHIN(1, 3000, stepper.getSpeed());
+  TEST_ASSERT_EQUAL_FLOAT(0, stepper.getSCurveAcceleration());
+  TEST_ASSERT_FLOAT_WITHIN(0.5, ACCEL, maxAccel); // reached the full acceleration
+  TEST_ASSERT_FLOAT_WITHIN(3, 3000, peakSpeed); // no overshoot
+  stepper.setSpeed(1000);
+  runFor(stepper, 1000000, false);
+  TEST_ASSERT_FLOAT_WITHIN(1, 1000, stepper.getSpeed());
+  stepper.setSpeed(-2000);
+  runFor(stepper, 1000000, false);
+  TEST_ASSERT_FLOAT_WITHIN(1, -2000, stepper.getSpeed());
+  stepper.setSpeed(0);
+  runFor(stepper, 1000000, true);
+  TEST_ASSERT_FALSE(stepper.isRunning());
+  checkLimits();
+}
+
+// too short a speed change to reach the full acceleration
+static void test_small_speed_change() {
+  SpeedStepper stepper(STEP_PIN, DIR_PIN);
+  setupStepper(stepper);
+  stepper.setSpeed(1000);
+  runFor(stepper, 500000, false);
+  clearStats();
+  stepper.setSpeed(1400);
+  runFor(stepper, 500000, false);
+  TEST_ASSERT_FLOAT_WITHIN(1, 1400, stepper.getSpeed());
+  TEST_ASSERT_LESS_THAN_FLOAT(ACCEL, maxAccel);
+  TEST_ASSERT_FLOAT_WITHIN(3, 1400, peakSpeed);
+  checkLimits();
+}
+
+// moveTo() stops on the target without overshooting
+static void test_move_to() {
+  SpeedStepper stepper(STEP_PIN, DIR_PIN);
+  setupStepper(stepper);
+  stepper.moveTo(8000);
+  float c0Speed = fabs(stepper.getSpeed()); // the first step
+  runFor(stepper, 10000000, true);
+  TEST_ASSERT_FALSE(stepper.isRunning());
+  TEST_ASSERT_EQUAL(8000, stepper.getCurrentPosition());
+  TEST_ASSERT_EQUAL(8000, hostPinRises[STEP_PIN]); // no overshoot and back
+  TEST_ASSERT_FLOAT_WITHIN(3, 5000, peakSpeed);
+  TEST_ASSERT_FLOAT_WITHIN(0.1, c0Speed, stopSpeed); // ramped all the way down
+  checkLimits();
+}
+
+// stopping at the plus limit from full speed, and from part way up the ramp
+static void test_stop_at_limit() {
+  SpeedStepper stepper(STEP_PIN, DIR_PIN);
+  setupStepper(stepper);
+  stepper.setPlusLimit(6000);
+  stepper.setSpeed(5000);
+  float c0Speed = fabs(stepper.getSpeed());
+  uint32_t start = micros();
+  runFor(stepper, 10000000, true);
+  uint32_t us = micros() - start;
+  TEST_ASSERT_FALSE(stepper.isRunning());
+  TEST_ASSERT_EQUAL(6000, stepper.getCurrentPosition());
+  TEST_ASSERT_EQUAL(6000, hostPinRises[STEP_PIN]);
+  TEST_ASSERT_FLOAT_WITHIN(0.1, c0Speed, stopSpeed);
+  checkLimits();
+  // 0.6sec ramps each end and 0.6sec at 5000, only a few creep steps at the c0 speed
+  TEST_ASSERT_LESS_THAN(2000000, us);
+
+  stepper.setCurrentPosition(0);
+  hostResetPins();
+  clearStats();
+  stepper.setSpeed(5000);
+  runFor(stepper, 10000000, true);
+  TEST_ASSERT_EQUAL(6000, stepper.getCurrentPosition());
+  stepper.setCurrentPosition(0);
+  stepper.setPlusLimit(300);
+  hostResetPins();
+  clearStats();
+  stepper.setSpeed(5000);
+  runFor(stepper, 10000000, true);
+  TEST_ASSERT_FALSE(stepper.isRunning());
+  TEST_ASSERT_EQUAL(300, stepper.getCurrentPosition());
+  TEST_ASSERT_LESS_THAN_FLOAT(5000, peakSpeed);
+  TEST_ASSERT_FLOAT_WITHIN(0.1, c0Speed, stopSpeed);
+  checkLimits();
+}
+
+int main(int, char **) {
+  UNITY_BEGIN();
+  RUN_TEST(test_speed_changes);
+  RUN_TEST(test_small_speed_change);
+  RUN_TEST(test_move_to);
+  RUN_TEST(test_stop_at_limit);
+  return UNITY_END();
+}
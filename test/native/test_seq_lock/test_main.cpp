@@ -0,0 +1,99 @@
+// test_main.cpp
+/*
+   (c)2023 Forward Computing and Control Pty. Ltd.
+   NSW Australia, www.forward.com.au
+   This code is not warranted to be fit for any purpose. You may only use it at your own risk.
+   This code may be freely used for both private and commercial use
+   provided this copyright is maintained.
+*/
+
+// SeqLock, a writer thread and a reader thread, every read is from a single write() and they are in order
+// pio test -e native -f native/test_seq_lock
+
+#include <unity.h>
+#include <stdint.h>
+#include <thread>
+#include <atomic>
+#include "SeqLock.h"
+
+static const uint32_t WRITES = 2000000;
+static const int FIELDS = 32;
+
+// each field is derived from n, a torn read has fields from different writes
+struct Snapshot {
+  uint32_t n;
+  uint32_t field[FIELDS];
+};
+
+static void fill(Snapshot &s, uint32_t n) {
+  s.n = n;
+  for (int i = 0; i < FIELDS; i++) {
+    s.field[i] = n * (i + 3) + i;
+  }
+}
+
+static bool isWhole(const Snapshot &s) {
+  for (int i = 0; i < FIELDS; i++) {
+    if (s.field[i] != s.n * (i + 3) + i) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+// the writer never waits, the reader retries while a write() is in progress
+static void test_no_torn_reads() {
+  SeqLock<Snapshot> lock;
+  Snapshot first;
+  fill(first, 0);
+  lock.write(first);
+  std::atomic<bool> done(false);
+  std::thread writer([&]() {
+    Snapshot s;
+    for (uint32_t n = 1; n <= WRITES; n++) {
+      fill(s, n);
+      lock.write(s);
+    }
+    done.store(true);
+  });
+
+  uint32_t reads = 0;
+  uint32_t torn = 0;
+  uint32_t backwards = 0;
+  uint32_t retries = 0;
+  uint32_t lastN = 0;
+  Snapshot s;
+  while (!done.load()) {
+    retries += lock.read(s);
+    reads++;
+    if (!isWhole(s)) {
+      torn++;
+    }
+    if (s.n < lastN) {
+      backwards++;
+    }
+    lastN = s.n;
+  }
+  writer.join();
+  lock.read(s);
+  TEST_ASSERT_EQUAL_UINT32(0, torn);
+  TEST_ASSERT_EQUAL_UINT32(0, backwards);
+  TEST_ASSERT_EQUAL_UINT32(WRITES, s.n);
+  TEST_ASSERT_EQUAL_UINT32(WRITES * 2 + 2, lock.getSequence()); // +2 a write()
+  TEST_ASSERT_GREATER_THAN_UINT32(0, reads);
+  char msg[64];
+  snprintf(msg, sizeof(msg), "%u reads, %u retries", (unsigned)reads, (unsigned)retries);
+  TEST_MESSAGE(msg);
+}
+
+int main(int, char **) {
+  UNITY_BEGIN();
+  RUN_TEST(test_no_torn_reads);
+  return UNITY_END();
+}
@@ -0,0 +1,106 @@
+// test_main.cpp
+/*
+   (c)2023 Forward Computing and Control Pty. Ltd.
+   NSW Australia, www.forward.com.au
+   This code is not warranted to be fit for any purpose. You may only use it at your own risk.
+   This code may be freely used for both private and commercial use
+   provided this copyright is maintained.
+*/
+
+// SpscQueue, a producer thread and a consumer thread, every command arrives once and in order, and the ops/sec
+// pio test -e native -f native/test_spsc_queue
+
+#include <unity.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include "SpscQueue.h"
+
+static const uint32_t COMMANDS = 2000000;
+
+// the size of a StepperCmd, a command and its parameter
+struct Cmd {
+  uint32_t n;
+  float param;
+};
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+// single thread, full and empty, SIZE-1 usable entries
+static void test_full_and_empty() {
+  SpscQueue<Cmd, 16> queue;
+  Cmd c;
+  TEST_ASSERT_FALSE(queue.pop(c));
+  for (uint32_t n = 0; n < 15; n++) {
+    c.n = n;
+    TEST_ASSERT_TRUE(queue.push(c));
+  }
+  TEST_ASSERT_EQUAL(15, queue.depth());
+  TEST_ASSERT_EQUAL(0, queue.availableForWrite());
+  TEST_ASSERT_FALSE(queue.push(c));
+  TEST_ASSERT_EQUAL_UINT32(1, queue.getOverflowCount());
+  TEST_ASSERT_EQUAL(15, queue.getMaxDepth());
+  for (uint32_t n = 0; n < 15; n++) {
+    TEST_ASSERT_TRUE(queue.pop(c));
+    TEST_ASSERT_EQUAL_UINT32(n, c.n);
+  }
+  TEST_ASSERT_FALSE(queue.pop(c));
+  TEST_ASSERT_EQUAL(0, queue.depth());
+}
+
+// the producer retries a full push(), so every command must arrive, once and in order
+static void test_two_thread_throughput() {
+  SpscQueue<Cmd, 16> queue;
+  auto start = std::chrono::steady_clock::now();
+  std::thread producer([&]() {
+    Cmd c;
+    for (uint32_t n = 1; n <= COMMANDS; n++) {
+      c.n = n;
+      c.param = n * 0.5f;
+      while (!queue.push(c)) {
+        std::this_thread::yield();
+      }
+    }
+  });
+
+  uint32_t received = 0;
+  uint32_t outOfOrder = 0;
+  uint32_t badParam = 0;
+  Cmd c;
+  while (received < COMMANDS) {
+    if (!queue.pop(c)) {
+      std::this_thread::yield(); // the native env may have only one core
+      continue;
+    }
+    received++;
+    if (c.n != received) {
+      outOfOrder++;
+    }
+    if (c.param != c.n * 0.5f) {
+      badParam++;
+    }
+  }
+  producer.join();
+  double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  TEST_ASSERT_EQUAL_UINT32(0, outOfOrder);
+  TEST_ASSERT_EQUAL_UINT32(0, badParam);
+  TEST_ASSERT_FALSE(queue.pop(c));
+  TEST_ASSERT_LESS_OR_EQUAL(15, queue.getMaxDepth());
+  char msg[96];
+  snprintf(msg, sizeof(msg), "%u commands, %.1fM ops/sec, %u full push()es retried",
+           (unsigned)COMMANDS, COMMANDS / secs / 1e6, (unsigned)queue.getOverflowCount());
+  TEST_MESSAGE(msg);
+}
+
+int main(int, char **) {
+  UNITY_BEGIN();
+  RUN_TEST(test_full_and_empty);
+  RUN_TEST(test_two_thread_throughput);
+  return UNITY_END();
+}
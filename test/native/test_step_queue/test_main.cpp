@@ -0,0 +1,176 @@
+// test_main.cpp
+/*
+   (c)2023 Forward Computing and Control Pty. Ltd.
+   NSW Australia, www.forward.com.au
+   This code is not warranted to be fit for any purpose. You may only use it at your own risk.
+   This code may be freely used for both private and commercial use
+   provided this copyright is maintained.
+*/
+
+// SpeedStepper::setStepQueue() driven by a VirtualStepTimer, loop() stalls, underruns, queue depth and timer latency jitter
+// pio test -e native -f native/test_step_queue
+
+#include <Arduino.h>
+#include <unity.h>
+#include "SpeedStepper.h"
+
+static const int STEP_PIN = 4;
+static const int DIR_PIN = 5;
+static const uint32_t LOOK_AHEAD_US = 5000;
+
+static int32_t motorPosition; // +/- each step edge the timer outputs, by its DIR level
+
+/**
+   advanceBoth(timer, us)
+   moves micros() and the timer's clock on together, 1us at a time to follow the motor position
+*/
+static void advanceBoth(VirtualStepTimer &timer, uint32_t us) {
+  for (uint32_t i = 0; i < us; i++) {
+    uint32_t edges = timer.getStepEdges();
+    hostAdvanceMicros(1);
+    timer.advance(1);
+    if (timer.getStepEdges() != edges) {
+      motorPosition += timer.getDirLevel() ? 1 : -1;
+    }
+  }
+}
+
+/**
+   loopFor(stepper, timer, us, loopUs)
+   calls run() every loopUs for us
+*/
+static void loopFor(SpeedStepper &stepper, VirtualStepTimer &timer, uint32_t us, uint32_t loopUs) {
+  uint32_t start = micros();
+  while ((uint32_t)(micros() - start) < us) {
+    stepper.run();
+    advanceBoth(timer, loopUs);
+  }
+}
+
+/**
+   stopAndDrain(stepper, timer, queue)
+   stops the stepper and runs until the queued steps are all output
+*/
+static void stopAndDrain(SpeedStepper &stepper, VirtualStepTimer &timer, StepQueue &queue) {
+  stepper.hardStop();
+  while (stepper.run() || (queue.depth() > 0) || timer.getStepLevel()) {
+    advanceBoth(timer, 100);
+  }
+}
+
+void setUp(void) {
+  hostMicrosNow = 1000;
+  hostResetPins();
+  motorPosition = 0;
+}
+
+void tearDown(void) {
+}
+
+// 2000 steps/sec with loop() stalls shorter than the look ahead, every step is on time
+static void test_stalls_within_look_ahead() {
+  VirtualStepTimer timer;
+  StepQueue queue(timer);
+  queue.begin();
+  SpeedStepper stepper(STEP_PIN, DIR_PIN);
+  stepper.setStepQueue(&queue, LOOK_AHEAD_US);
+  stepper.setAcceleration(20000);
+  stepper.setSpeed(2000);
+  for (int i = 0; i < 20; i++) {
+    loopFor(stepper, timer, 50000, 100);
+    advanceBoth(timer, 4000); // loop() busy elsewhere for 4ms
+  }
+  TEST_ASSERT_EQUAL(0, queue.getUnderrunCount());
+  TEST_ASSERT_EQUAL(0, queue.getMaxJitter());
+  // 5ms of 500us steps, plus the steps of the slower ramp start
+  TEST_ASSERT_GREATER_OR_EQUAL(LOOK_AHEAD_US / 500, queue.getMaxDepth());
+  TEST_ASSERT_LESS_THAN(StepQueue::QUEUE_SIZE, queue.getMaxDepth());
+  stopAndDrain(stepper, timer, queue);
+  TEST_ASSERT_EQUAL(queue.getStepCount(), timer.getStepEdges());
+  TEST_ASSERT_EQUAL(motorPosition, stepper.getCurrentPosition());
+  TEST_ASSERT_EQUAL(0, hostPinRises[STEP_PIN]); // all the steps came from the queue
+}
+
+// a stall longer than the look ahead empties the queue, the late step after it is counted as an underrun
+static void test_stall_longer_than_look_ahead() {
+  VirtualStepTimer timer;
+  StepQueue queue(timer);
+  queue.begin();
+  SpeedStepper stepper(STEP_PIN, DIR_PIN);
+  stepper.setStepQueue(&queue, LOOK_AHEAD_US);
+  stepper.setAcceleration(20000);
+  stepper.setSpeed(2000);
+  loopFor(stepper, timer, 200000, 100);
+  TEST_ASSERT_EQUAL(0, queue.getUnderrunCount());
+  advanceBoth(timer, 3 * LOOK_AHEAD_US);
+  TEST_ASSERT_EQUAL(0, queue.depth());
+  uint32_t edges = timer.getStepEdges();
+  loopFor(stepper, timer, 100000, 100); // restarts without trying to catch up
+  TEST_ASSERT_EQUAL(1, queue.getUnderrunCount());
+  TEST_ASSERT_INT_WITHIN(1, 200, timer.getStepEdges() - edges);
+  stopAndDrain(stepper, timer, queue);
+  TEST_ASSERT_EQUAL(motorPosition, stepper.getCurrentPosition());
+}
+
+// a fixed interrupt latency shows up as jitter, it does not accumulate over the steps
+static void test_timer_latency_jitter() {
+  VirtualStepTimer noLatencyTimer;
+  StepQueue noLatencyQueue(noLatencyTimer);
+  noLatencyQueue.begin();
+  SpeedStepper noLatency(STEP_PIN, DIR_PIN);
+  noLatency.setStepQueue(&noLatencyQueue, LOOK_AHEAD_US);
+  noLatency.setAcceleration(20000);
+  noLatency.setSpeed(2000);
+  loopFor(noLatency, noLatencyTimer, 1000000, 100);
+
+  hostMicrosNow = 1000;
+  motorPosition = 0;
+  VirtualStepTimer timer;
+  timer.setLatency(3);
+  StepQueue queue(timer);
+  queue.begin();
+  SpeedStepper stepper(STEP_PIN, DIR_PIN);
+  stepper.setStepQueue(&queue, LOOK_AHEAD_US);
+  stepper.setAcceleration(20000);
+  stepper.setSpeed(2000);
+  loopFor(stepper, timer, 1000000, 100);
+  TEST_ASSERT_EQUAL(3, queue.getMaxJitter());
+  TEST_ASSERT_EQUAL(0, queue.getUnderrunCount());
+  // the same steps as without the latency, give or take the one just at the end
+  TEST_ASSERT_INT_WITHIN(1, noLatencyTimer.getStepEdges(), timer.getStepEdges());
+  stopAndDrain(stepper, timer, queue);
+  TEST_ASSERT_EQUAL(motorPosition, stepper.getCurrentPosition());
+}
+
+// reversing through the queue, the queue writes DIR, the position matches the output edges
+static void test_reverse() {
+  VirtualStepTimer timer;
+  StepQueue queue(timer);
+  queue.begin();
+  SpeedStepper stepper(STEP_PIN, DIR_PIN);
+  stepper.setStepQueue(&queue, LOOK_AHEAD_US);
+  stepper.setAcceleration(20000);
+  stepper.setSpeed(2000);
+  loopFor(stepper, timer, 200000, 100);
+  uint32_t forwardEdges = timer.getStepEdges();
+  TEST_ASSERT_TRUE(timer.getDirLevel());
+  uint32_t dirChanges = timer.getDirChanges(); // begin() set DIR HIGH
+  stepper.setSpeed(-2000);
+  loopFor(stepper, timer, 400000, 100);
+  TEST_ASSERT_FALSE(timer.getDirLevel());
+  TEST_ASSERT_EQUAL(dirChanges + 1, timer.getDirChanges());
+  stopAndDrain(stepper, timer, queue);
+  TEST_ASSERT_EQUAL(0, queue.getUnderrunCount());
+  TEST_ASSERT_EQUAL(motorPosition, stepper.getCurrentPosition());
+  TEST_ASSERT_LESS_THAN(0, stepper.getCurrentPosition());
+  TEST_ASSERT_GREATER_THAN(forwardEdges, timer.getStepEdges() + stepper.getCurrentPosition());
+}
+
+int main(int, char **) {
+  UNITY_BEGIN();
+  RUN_TEST(test_stalls_within_look_ahead);
+  RUN_TEST(test_stall_longer_than_look_ahead);
+  RUN_TEST(test_timer_latency_jitter);
+  RUN_TEST(test_reverse);
+  return UNITY_END();
+}
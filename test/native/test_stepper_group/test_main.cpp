@@ -0,0 +1,175 @@
+// test_main.cpp
+/*
+   (c)2023 Forward Computing and Control Pty. Ltd.
+   NSW Australia, www.forward.com.au
+   This code is not warranted to be fit for any purpose. You may only use it at your own risk.
+   This code may be freely used for both private and commercial use
+   provided this copyright is maintained.
+*/
+
+// SpeedStepperGroup, exact slave step counts, the axes finishing together and the master's own settings restored
+// pio test -e native -f native/test_stepper_group
+
+#include <Arduino.h>
+#include <unity.h>
+#include "SpeedStepperGroup.h"
+
+static const int X_STEP_PIN = 4;
+static const int X_DIR_PIN = 5;
+static const int Y_STEP_PIN = 6;
+static const int Y_DIR_PIN = 7;
+
+static int32_t firstSlaveStepAt; // master position at the slave's first step pulse of the move
+static int32_t lastSlaveStepAt;  // master position at the slave's last step pulse of the move
+static float peakSpeed; // max abs(getSpeed()) seen by runToStop()
+
+/**
+   moveGroup(group, targets, masterStepper, slaveStepPin, maxUs)
+   group.moveTo(targets), which takes the first steps, then calls group.run() every 5 simulated us
+   until the group stops, or for maxUs
+   records the master position at the first and last slave step pulses
+   returns moveTo()'s result
+*/
+static boolean moveGroup(SpeedStepperGroup &group, const int32_t targets[], SpeedStepper &masterStepper, int slaveStepPin, uint32_t maxUs) {
+  uint32_t slaveRises = hostPinRises[slaveStepPin];
+  firstSlaveStepAt = 0;
+  lastSlaveStepAt = 0;
+  boolean first = true;
+  if (!group.moveTo(targets)) {
+    return false;
+  }
+  uint32_t start = micros();
+  boolean running = true;
+  while (true) {
+    if (hostPinRises[slaveStepPin] != slaveRises) {
+      slaveRises = hostPinRises[slaveStepPin];
+      lastSlaveStepAt = masterStepper.getCurrentPosition();
+      if (first) {
+        firstSlaveStepAt = lastSlaveStepAt;
+        first = false;
+      }
+    }
+    if ((!running) || ((uint32_t)(micros() - start) >= maxUs)) {
+      return true;
+    }
+    hostAdvanceMicros(5);
+    running = group.run();
+  }
+}
+
+/**
+   runToStop(stepper, maxUs)
+   calls run() every 5 simulated us until the stepper stops, or for maxUs
+   returns the us taken
+*/
+static uint32_t runToStop(SpeedStepper &stepper, uint32_t maxUs) {
+  peakSpeed = 0;
+  uint32_t start = micros();
+  boolean running = true;
+  while (running && ((uint32_t)(micros() - start) < maxUs)) {
+    running = stepper.run();
+    float sp = fabs(stepper.getSpeed());
+    if (sp > peakSpeed) {
+      peakSpeed = sp;
+    }
+    hostAdvanceMicros(5);
+  }
+  return micros() - start;
+}
+
+void setUp(void) {
+  hostMicrosNow = 1000;
+  hostResetPins();
+}
+
+void tearDown(void) {
+}
+
+// {2000, 500} then {-1900, -1999}, one pulse per slave step and the slave steps spread over the whole move
+static void test_slave_steps() {
+  SpeedStepper stepperX(X_STEP_PIN, X_DIR_PIN);
+  SpeedStepper stepperY(Y_STEP_PIN, Y_DIR_PIN);
+  SpeedStepperGroup group;
+  TEST_ASSERT_TRUE(group.addStepper(stepperX));
+  TEST_ASSERT_TRUE(group.addStepper(stepperY));
+  group.setMaxSpeed(2000);
+  group.setAcceleration(4000);
+
+  int32_t targets[] = {2000, 500};
+  TEST_ASSERT_TRUE(moveGroup(group, targets, stepperX, Y_STEP_PIN, 10000000));
+  TEST_ASSERT_FALSE(group.isRunning());
+  TEST_ASSERT_EQUAL(2000, stepperX.getCurrentPosition());
+  TEST_ASSERT_EQUAL(500, stepperY.getCurrentPosition());
+  TEST_ASSERT_EQUAL(2000, hostPinRises[X_STEP_PIN]);
+  TEST_ASSERT_EQUAL(500, hostPinRises[Y_STEP_PIN]);
+  // Bresenham from half, a slave step every 4 master steps centred between them
+  TEST_ASSERT_LESS_OR_EQUAL(2 + 1, firstSlaveStepAt);
+  TEST_ASSERT_GREATER_OR_EQUAL(2000 - 2, lastSlaveStepAt);
+
+  // both axes reverse, X moves 3900 and is still the master, Y moves 2499
+  int32_t back[] = {-1900, -1999};
+  TEST_ASSERT_TRUE(moveGroup(group, back, stepperX, Y_STEP_PIN, 10000000));
+  TEST_ASSERT_FALSE(group.isRunning());
+  TEST_ASSERT_EQUAL(-1900, stepperX.getCurrentPosition());
+  TEST_ASSERT_EQUAL(-1999, stepperY.getCurrentPosition());
+  TEST_ASSERT_EQUAL(2000 + 3900, hostPinRises[X_STEP_PIN]);
+  TEST_ASSERT_EQUAL(500 + 2499, hostPinRises[Y_STEP_PIN]);
+  TEST_ASSERT_FALSE(stepperY.isDirForward());
+  // 2499 in 3900, the slave's first and last steps are within one master step of the ends
+  TEST_ASSERT_EQUAL(2000 - 1, firstSlaveStepAt);
+  TEST_ASSERT_LESS_OR_EQUAL(-1900 + 1, lastSlaveStepAt);
+}
+
+// the axis with the larger distance is the master, here Y
+static void test_master_is_longest() {
+  SpeedStepper stepperX(X_STEP_PIN, X_DIR_PIN);
+  SpeedStepper stepperY(Y_STEP_PIN, Y_DIR_PIN);
+  SpeedStepperGroup group;
+  group.addStepper(stepperX);
+  group.addStepper(stepperY);
+  group.setMaxSpeed(2000);
+  group.setAcceleration(4000);
+  int32_t targets[] = {-300, 1200};
+  TEST_ASSERT_TRUE(group.moveTo(targets));
+  TEST_ASSERT_TRUE(group.isRunning());
+  TEST_ASSERT_FALSE(group.moveTo(targets)); // still running
+  while (group.run()) {
+    hostAdvanceMicros(5);
+  }
+  TEST_ASSERT_EQUAL(-300, stepperX.getCurrentPosition());
+  TEST_ASSERT_EQUAL(1200, stepperY.getCurrentPosition());
+  TEST_ASSERT_EQUAL(300, hostPinRises[X_STEP_PIN]);
+  TEST_ASSERT_EQUAL(1200, hostPinRises[Y_STEP_PIN]);
+  TEST_ASSERT_FALSE(stepperX.isDirForward());
+}
+
+// the group's speed and acceleration only apply to the group move, the master's own are back afterwards
+static void test_master_settings_restored() {
+  SpeedStepper stepperX(X_STEP_PIN, X_DIR_PIN);
+  SpeedStepper stepperY(Y_STEP_PIN, Y_DIR_PIN);
+  stepperX.setMaxSpeed(500);
+  stepperX.setAcceleration(1000);
+  SpeedStepperGroup group;
+  group.addStepper(stepperX);
+  group.addStepper(stepperY);
+  group.setMaxSpeed(2000);
+  group.setAcceleration(4000);
+  int32_t targets[] = {3000, 1000};
+  TEST_ASSERT_TRUE(moveGroup(group, targets, stepperX, Y_STEP_PIN, 10000000));
+  TEST_ASSERT_EQUAL(3000, stepperX.getCurrentPosition());
+
+  // on its own again, 0.5sec up to 500 steps/sec, 0.5sec down, 2500 steps at 500 steps/sec
+  stepperX.moveTo(6000);
+  uint32_t us = runToStop(stepperX, 20000000);
+  TEST_ASSERT_EQUAL(6000, stepperX.getCurrentPosition());
+  TEST_ASSERT_FLOAT_WITHIN(10, 500, peakSpeed);
+  TEST_ASSERT_FLOAT_WITHIN(0.05, 6.5, us / 1000000.0);
+}
+
+int main(int, char **) {
+  UNITY_BEGIN();
+  RUN_TEST(test_slave_steps);
+  RUN_TEST(test_master_is_longest);
+  RUN_TEST(test_master_settings_restored);
+  return UNITY_END();
+}
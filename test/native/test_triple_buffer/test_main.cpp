@@ -0,0 +1,120 @@
+// test_main.cpp
+/*
+   (c)2023 Forward Computing and Control Pty. Ltd.
+   NSW Australia, www.forward.com.au
+   This code is not warranted to be fit for any purpose. You may only use it at your own risk.
+   This code may be freely used for both private and commercial use
+   provided this copyright is maintained.
+*/
+
+// TripleBuffer, a writer thread and a reader thread, no torn or out of order frames, every frame is read or counted as overwritten
+// pio test -e native -f native/test_triple_buffer
+
+#include <unity.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <thread>
+#include <atomic>
+#include "TripleBuffer.h"
+
+static const uint32_t FRAMES = 5000000;
+static const int FIELDS = 8;
+
+// each field is derived from n, a torn frame has fields from different writes
+struct Frame {
+  uint32_t n;
+  uint32_t field[FIELDS];
+};
+
+static void fill(Frame &f, uint32_t n) {
+  f.n = n;
+  for (int i = 0; i < FIELDS; i++) {
+    f.field[i] = n * (i + 3) + i;
+  }
+}
+
+static bool isWhole(const Frame &f) {
+  for (int i = 0; i < FIELDS; i++) {
+    if (f.field[i] != f.n * (i + 3) + i) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+// single thread, read() only returns true for a new frame, and returns the newest one
+static void test_latest_only() {
+  TripleBuffer<Frame> buffer;
+  Frame f;
+  TEST_ASSERT_FALSE(buffer.read(f));
+  fill(f, 1);
+  buffer.write(f);
+  fill(f, 2);
+  buffer.write(f);
+  TEST_ASSERT_TRUE(buffer.read(f));
+  TEST_ASSERT_EQUAL_UINT32(2, f.n);
+  TEST_ASSERT_FALSE(buffer.read(f));
+  TEST_ASSERT_EQUAL_UINT32(2, buffer.getWriteCount());
+  TEST_ASSERT_EQUAL_UINT32(1, buffer.getReadCount());
+  TEST_ASSERT_EQUAL_UINT32(1, buffer.getOverwriteCount());
+}
+
+// neither side waits, the reader may skip frames but never sees a torn or older one
+static void test_two_threads() {
+  TripleBuffer<Frame> buffer;
+  std::atomic<bool> done(false);
+  std::thread writer([&]() {
+    Frame f;
+    for (uint32_t n = 1; n <= FRAMES; n++) {
+      fill(f, n);
+      buffer.write(f);
+      if ((n & 0x0f) == 0) {
+        std::this_thread::yield(); // let the reader in, even on a one core host
+      }
+    }
+    done.store(true);
+  });
+
+  uint32_t torn = 0;
+  uint32_t backwards = 0;
+  uint32_t lastN = 0;
+  Frame f;
+  while (!done.load()) {
+    if (!buffer.read(f)) {
+      std::this_thread::yield(); // the native env may have only one core
+      continue;
+    }
+    if (!isWhole(f)) {
+      torn++;
+    }
+    if (f.n <= lastN) {
+      backwards++;
+    }
+    lastN = f.n;
+  }
+  writer.join();
+  if (buffer.read(f)) { // the last frame, if the loop above did not get it
+    lastN = f.n;
+  }
+  TEST_ASSERT_EQUAL_UINT32(0, torn);
+  TEST_ASSERT_EQUAL_UINT32(0, backwards);
+  TEST_ASSERT_EQUAL_UINT32(FRAMES, lastN);
+  TEST_ASSERT_EQUAL_UINT32(FRAMES, buffer.getWriteCount());
+  TEST_ASSERT_EQUAL_UINT32(buffer.getWriteCount(), buffer.getReadCount() + buffer.getOverwriteCount());
+  char msg[64];
+  snprintf(msg, sizeof(msg), "%u reads, %u overwritten", (unsigned)buffer.getReadCount(), (unsigned)buffer.getOverwriteCount());
+  TEST_MESSAGE(msg);
+}
+
+int main(int, char **) {
+  UNITY_BEGIN();
+  RUN_TEST(test_latest_only);
+  RUN_TEST(test_two_threads);
+  return UNITY_END();
+}